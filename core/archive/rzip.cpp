@@ -18,23 +18,169 @@
 */
 #include "rzip.h"
 #include <zlib.h>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
 
 const u8 RZipHeader[8] = { '#', 'R', 'Z', 'I', 'P', 'v', 1, '#' };
+// Chunk size of the files we write, and the largest one we accept when reading
+const u32 MaxChunkSize = 1024 * 1024;
+// Bounds the memory used by a batch whatever the number of threads
+const size_t MaxBatchSize = 8 * MaxChunkSize;
 
-bool RZipFile::Open(const std::string& path, bool write)
+// Runs the compression or decompression of the chunks of a batch on a pool of threads.
+// The calling thread takes part in the work.
+class ChunkWorkers
+{
+public:
+	~ChunkWorkers() { Stop(); }
+
+	static ChunkWorkers& Instance()
+	{
+		static ChunkWorkers instance;
+		return instance;
+	}
+
+	int ThreadCount()
+	{
+		std::lock_guard<std::mutex> _(runMutex);
+		return threadCount();
+	}
+
+	void SetThreadCount(int count)
+	{
+		std::lock_guard<std::mutex> _(runMutex);
+		Stop();
+		requested = count;
+	}
+
+	// Calls task(i) for i in [0, count) and returns when all of them are done
+	void Run(int count, const std::function<void(int)>& task)
+	{
+		std::lock_guard<std::mutex> _(runMutex);
+		if (count <= 1 || threadCount() <= 1)
+		{
+			for (int i = 0; i < count; i++)
+				task(i);
+			return;
+		}
+		if (threads.empty())
+			for (int i = 1; i < threadCount(); i++)
+				threads.emplace_back(&ChunkWorkers::loop, this);
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			// A worker that woke up late for the previous batch may still be looking for work
+			doneCond.wait(lock, [this]() { return active == 0; });
+			this->task = &task;
+			taskCount = count;
+			next = 0;
+			done = 0;
+			generation++;
+		}
+		cond.notify_all();
+		work();
+		// Workers must be out of work() before the task goes out of scope
+		std::unique_lock<std::mutex> lock(mutex);
+		doneCond.wait(lock, [this]() { return done == taskCount && active == 0; });
+		this->task = nullptr;
+	}
+
+private:
+	int threadCount() const
+	{
+		if (requested > 0)
+			return requested;
+		return std::max(1u, std::min(std::thread::hardware_concurrency(), 8u));
+	}
+
+	void Stop()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		cond.notify_all();
+		for (auto& thread : threads)
+			thread.join();
+		threads.clear();
+		stopping = false;
+	}
+
+	void work()
+	{
+		int completed = 0;
+		for (int i = next++; i < taskCount; i = next++)
+		{
+			(*task)(i);
+			completed++;
+		}
+		std::lock_guard<std::mutex> lock(mutex);
+		done += completed;
+		if (done == taskCount)
+			doneCond.notify_one();
+	}
+
+	void loop()
+	{
+		u32 seen = 0;
+		while (true)
+		{
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				cond.wait(lock, [this, seen]() { return stopping || generation != seen; });
+				if (stopping)
+					return;
+				seen = generation;
+				active++;
+			}
+			work();
+			std::lock_guard<std::mutex> lock(mutex);
+			if (--active == 0)
+				doneCond.notify_one();
+		}
+	}
+
+	std::mutex runMutex;
+	std::vector<std::thread> threads;
+	int requested = 0;
+
+	std::mutex mutex;
+	std::condition_variable cond;
+	std::condition_variable doneCond;
+	bool stopping = false;
+	u32 generation = 0;
+	const std::function<void(int)> *task = nullptr;
+	int taskCount = 0;
+	std::atomic<int> next{0};
+	int done = 0;
+	int active = 0;
+};
+
+void RZipFile::SetThreadCount(int count)
+{
+	ChunkWorkers::Instance().SetThreadCount(count);
+}
+
+bool RZipFile::Open(const std::string& path, bool write, Compression compression)
 {
 	verify(file == nullptr);
 
 	file = nowide::fopen(path.c_str(), write ? "wb" : "rb");
 	if (file == nullptr)
 		return false;
+	writing = write;
+	error = false;
+	level = compression == Fast ? Z_BEST_SPEED : Z_DEFAULT_COMPRESSION;
 	if (!write)
 	{
 		u8 header[sizeof(RZipHeader)];
 		if (std::fread(header, sizeof(header), 1, file) != 1
 			|| memcmp(header, RZipHeader, sizeof(header))
 			|| std::fread(&maxChunkSize, sizeof(maxChunkSize), 1, file) != 1
-			|| std::fread(&size, sizeof(size), 1, file) != 1)
+			|| std::fread(&size, sizeof(size), 1, file) != 1
+			|| maxChunkSize == 0 || maxChunkSize > MaxChunkSize)
 		{
 			Close();
 			return false;
@@ -45,61 +191,119 @@ bool RZipFile::Open(const std::string& path, bool write)
 			size &= 0xffffffff;
 			std::fseek(file, -4, SEEK_CUR);
 		}
-		chunk = new u8[maxChunkSize];
-		chunkIndex = 0;
-		chunkSize = 0;
 	}
+	else
+	{
+		maxChunkSize = MaxChunkSize;
+		// The size isn't known yet and is updated when closing
+		size = 0;
+		if (std::fwrite(RZipHeader, sizeof(RZipHeader), 1, file) != 1
+			|| std::fwrite(&maxChunkSize, sizeof(maxChunkSize), 1, file) != 1
+			|| std::fwrite(&size, sizeof(size), 1, file) != 1)
+		{
+			Close();
+			return false;
+		}
+	}
+	// compression output buffer must be 0.1% larger + 12 bytes
+	maxZippedSize = maxChunkSize + maxChunkSize / 1000 + 12;
+	// One chunk per thread
+	u32 chunks = std::max<u32>(1, std::min<u32>(ChunkWorkers::Instance().ThreadCount(), MaxBatchSize / maxChunkSize));
+	batchSize = (size_t)maxChunkSize * chunks;
+	chunk = new u8[batchSize];
+	chunkIndex = 0;
+	chunkSize = 0;
+	zipped.resize(chunks);
+	zippedSize.resize(chunks);
 
 	return true;
 }
 
-void RZipFile::Close()
+bool RZipFile::Close()
 {
-	if (file != nullptr)
+	if (file == nullptr)
+		return false;
+	if (writing)
 	{
-		std::fclose(file);
-		file = nullptr;
-		if (chunk != nullptr)
+		if (chunkSize != 0)
+			WriteChunks();
+		if (!error && (std::fseek(file, sizeof(RZipHeader) + sizeof(maxChunkSize), SEEK_SET) != 0
+				|| std::fwrite(&size, sizeof(size), 1, file) != 1))
+			error = true;
+	}
+	if (std::fclose(file) != 0)
+		error = true;
+	file = nullptr;
+	delete [] chunk;
+	chunk = nullptr;
+	zipped.clear();
+	zippedSize.clear();
+
+	return !error;
+}
+
+bool RZipFile::ReadChunks()
+{
+	if (error)
+		return false;
+	chunkSize = 0;
+	chunkIndex = 0;
+	u32 count = 0;
+	while (count < zipped.size())
+	{
+		u32 sz;
+		if (std::fread(&sz, sizeof(sz), 1, file) != 1)
+			break;
+		if (sz == 0)
+			continue;
+		if (sz > maxZippedSize)
 		{
-			delete [] chunk;
-			chunk = nullptr;
+			// Can't be the output of compress()
+			error = true;
+			break;
 		}
+		if (zipped[count].size() < sz)
+			zipped[count].resize(sz);
+		if (std::fread(zipped[count].data(), sz, 1, file) != 1)
+			break;
+		zippedSize[count++] = sz;
 	}
+	if (count == 0)
+		return false;
+
+	std::vector<uLongf> lengths(count);
+	std::vector<int> results(count);
+	ChunkWorkers::Instance().Run(count, [&](int i) {
+		lengths[i] = maxChunkSize;
+		results[i] = uncompress(chunk + (size_t)i * maxChunkSize, &lengths[i], zipped[i].data(), zippedSize[i]);
+	});
+	// Chunks are normally full except the last one, but don't assume it
+	for (u32 i = 0; i < count; i++)
+	{
+		if (results[i] != Z_OK)
+		{
+			// Don't return what follows a corrupted chunk
+			error = true;
+			break;
+		}
+		if (chunkSize != (size_t)i * maxChunkSize)
+			memmove(chunk + chunkSize, chunk + (size_t)i * maxChunkSize, lengths[i]);
+		chunkSize += lengths[i];
+	}
+	return chunkSize != 0;
 }
 
 size_t RZipFile::Read(void *data, size_t length)
 {
-	verify(file != nullptr);
+	verify(file != nullptr && !writing);
 
 	u8 *p = (u8 *)data;
 	size_t rv = 0;
 	while (rv < length)
 	{
-		if (chunkIndex == chunkSize)
-		{
-			chunkSize = 0;
-			chunkIndex = 0;
-			u32 zippedSize;
-			if (std::fread(&zippedSize, sizeof(zippedSize), 1, file) != 1)
-				break;
-			if (zippedSize == 0)
-				continue;
-			u8 *zipped = new u8[zippedSize];
-			if (std::fread(zipped, zippedSize, 1, file) != 1)
-			{
-				delete [] zipped;
-				break;
-			}
-			uLongf tl = maxChunkSize;
-			if (uncompress(chunk, &tl, zipped, zippedSize) != Z_OK)
-			{
-				delete [] zipped;
-				break;
-			}
-			delete [] zipped;
-			chunkSize = (u32)tl;
-		}
-		u32 l = std::min(chunkSize - chunkIndex, (u32)length);
+		if (chunkIndex == chunkSize && !ReadChunks())
+			break;
+		size_t l = std::min(chunkSize - chunkIndex, length - rv);
 		memcpy(p, chunk + chunkIndex, l);
 		p += l;
 		chunkIndex += l;
@@ -109,43 +313,55 @@ size_t RZipFile::Read(void *data, size_t length)
 	return rv;
 }
 
-size_t RZipFile::Write(const void *data, size_t length)
+bool RZipFile::WriteChunks()
 {
-	verify(file != nullptr);
-	verify(std::ftell(file) == 0);
-
-	maxChunkSize = 1024 * 1024;
-	size = length;
-	if (std::fwrite(RZipHeader, sizeof(RZipHeader), 1, file) != 1
-		|| std::fwrite(&maxChunkSize, sizeof(maxChunkSize), 1, file) != 1
-		|| std::fwrite(&size, sizeof(size), 1, file) != 1)
-		return 0;
-	const u8 *p = (const u8 *)data;
-	// compression output buffer must be 0.1% larger + 12 bytes
-	uLongf maxZippedSize = maxChunkSize + maxChunkSize / 1000 + 12;
-	u8 *zipped = new u8[maxZippedSize];
-	size_t rv = 0;
-	while (rv < length)
+	const u32 count = (u32)((chunkSize + maxChunkSize - 1) / maxChunkSize);
+	std::vector<int> results(count);
+	ChunkWorkers::Instance().Run(count, [&](int i) {
+		zipped[i].resize(maxZippedSize);
+		uLongf zsize = maxZippedSize;
+		size_t offset = (size_t)i * maxChunkSize;
+		results[i] = compress2(zipped[i].data(), &zsize, chunk + offset,
+				std::min<size_t>(maxChunkSize, chunkSize - offset), level);
+		zippedSize[i] = (u32)zsize;
+	});
+	chunkSize = 0;
+	for (u32 i = 0; i < count; i++)
 	{
-		uLongf zippedSize = maxZippedSize;
-		uLongf uncompressedSize = std::min(maxChunkSize, (u32)(length - rv));
-		u32 rc = compress(zipped, &zippedSize, p, uncompressedSize);
-		if (rc != Z_OK)
+		if (results[i] != Z_OK)
 		{
-			WARN_LOG(SAVESTATE, "Compression error: %d", rc);
-			break;
+			WARN_LOG(SAVESTATE, "Compression error: %d", results[i]);
+			error = true;
+			return false;
 		}
-		u32 sz = (u32)zippedSize;
-		if (std::fwrite(&sz, sizeof(sz), 1, file) != 1
-			|| std::fwrite(zipped, zippedSize, 1, file) != 1)
+		if (std::fwrite(&zippedSize[i], sizeof(zippedSize[i]), 1, file) != 1
+			|| std::fwrite(zipped[i].data(), zippedSize[i], 1, file) != 1)
 		{
-			rv = 0;
-			break;
+			error = true;
+			return false;
 		}
-		p += uncompressedSize;
-		rv += uncompressedSize;
 	}
-	delete [] zipped;
-	
-	return rv;
+	return true;
+}
+
+bool RZipFile::Write(const void *data, size_t length)
+{
+	verify(file != nullptr && writing);
+	if (error)
+		return false;
+
+	const u8 *p = (const u8 *)data;
+	while (length > 0)
+	{
+		size_t l = std::min(batchSize - chunkSize, length);
+		memcpy(chunk + chunkSize, p, l);
+		chunkSize += l;
+		p += l;
+		length -= l;
+		size += l;
+		if (chunkSize == batchSize && !WriteChunks())
+			return false;
+	}
+
+	return true;
 }
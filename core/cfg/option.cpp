@@ -25,6 +25,11 @@ namespace config {
 Option<bool> DynarecEnabled("Dynarec.Enabled", true);
 Option<bool> DynarecIdleSkip("Dynarec.idleskip", true);
 Option<bool> DynarecSafeMode("Dynarec.safe-mode");
+Option<bool> DynarecProfiler("Dynarec.Profiler");
+Option<bool> DynarecBlockCache("Dynarec.BlockCache");
+Option<bool> DynarecAsyncCompile("Dynarec.AsyncCompile");
+Option<bool> DynarecSuperblocks("Dynarec.Superblocks");
+Option<bool> DynarecFineSmc("Dynarec.FineSmc");
 
 // General
 
@@ -37,6 +42,11 @@ Option<bool> ForceWindowsCE("Dreamcast.ForceWindowsCE");
 Option<bool> AutoLoadState("Dreamcast.AutoLoadState");
 Option<bool> AutoSaveState("Dreamcast.AutoSaveState");
 Option<int> SavestateSlot("Dreamcast.SavestateSlot");
+Option<bool> GDRomReadAhead("Dreamcast.GDRomReadAhead");
+Option<bool> GDRomMapFiles("Dreamcast.GDRomMapFiles");
+Option<int> GDRomPreload("Dreamcast.GDRomPreload");	// 0: off, 1: compressed, 2: uncompressed
+Option<int> CHDCacheHunks("Dreamcast.CHDCacheHunks", 16);
+Option<int> CHDPrefetchHunks("Dreamcast.CHDPrefetchHunks", 0);
 
 // Sound
 
@@ -56,6 +66,7 @@ Option<bool> AutoLatency("aica.AutoLatency",
 		);
 
 OptionString AudioBackend("backend", "auto", "audio");
+Option<bool> AudioThread("aica.AudioThread");
 
 // Rendering
 
@@ -88,6 +99,9 @@ std::array<Option<int>, 4> CrosshairColor {
 Option<int> SkipFrame("ta.skip");
 Option<int> MaxThreads("pvr.MaxThreads", 3);
 Option<int> AutoSkipFrame("pvr.AutoSkipFrame", 0);
+Option<int> RenderQueueDepth("pvr.RenderQueueDepth", 1);
+Option<int> RenderQueuePacing("pvr.RenderQueuePacing", 0);
+Option<bool> ParallelTaParsing("pvr.ParallelTaParsing");
 Option<int> RenderResolution("rend.Resolution", 480);
 Option<bool> VSync("rend.vsync", true);
 
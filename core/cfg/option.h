@@ -288,6 +288,11 @@ public:
 extern Option<bool> DynarecEnabled;
 extern Option<bool> DynarecIdleSkip;
 extern Option<bool> DynarecSafeMode;
+extern Option<bool> DynarecProfiler;
+extern Option<bool> DynarecBlockCache;
+extern Option<bool> DynarecAsyncCompile;
+extern Option<bool> DynarecSuperblocks;
+extern Option<bool> DynarecFineSmc;
 
 // General
 
@@ -300,6 +305,11 @@ extern Option<bool> ForceWindowsCE;
 extern Option<bool> AutoLoadState;
 extern Option<bool> AutoSaveState;
 extern Option<int> SavestateSlot;
+extern Option<bool> GDRomReadAhead;
+extern Option<bool> GDRomMapFiles;
+extern Option<int> GDRomPreload;
+extern Option<int> CHDCacheHunks;
+extern Option<int> CHDPrefetchHunks;
 
 // Sound
 
@@ -310,6 +320,8 @@ extern Option<int> AudioBufferSize;	//In samples ,*4 for bytes
 extern Option<bool> AutoLatency;
 
 extern OptionString AudioBackend;
+// Audio pushed to the device by a separate thread, which doesn't limit the emulation speed
+extern Option<bool> AudioThread;
 
 // Rendering
 
@@ -374,6 +386,9 @@ extern std::array<Option<int>, 4> CrosshairColor;
 extern Option<int> SkipFrame;
 extern Option<int> MaxThreads;
 extern Option<int> AutoSkipFrame;		// 0: none, 1: some, 2: more
+extern Option<int> RenderQueueDepth;
+extern Option<int> RenderQueuePacing;	// 0: throughput (wait for a free slot), 1: latency (replace the oldest pending frame)
+extern Option<bool> ParallelTaParsing;
 extern Option<int> RenderResolution;
 extern Option<bool> VSync;
 
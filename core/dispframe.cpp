@@ -6,7 +6,6 @@
 
 extern cResetEvent rs;
 extern cResetEvent frame_finished;
-extern TA_context* rqueue;
 
 void SetREP(TA_context* cntx);
 TA_context* read_frame(const char* file, u8* vram_ref = NULL);
@@ -44,7 +43,7 @@ void *dc_run(void*)
 		rend_context saved_rend = ctx->rend;
 		FillBGP(ctx);
 
-		if (rqueue)
+		if (rend_framePending())
 			frame_finished.Wait();
 		if (QueueRender(ctx))  {
 			palette_update();
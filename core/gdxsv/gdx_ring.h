@@ -0,0 +1,142 @@
+#pragma once
+
+#include <atomic>
+#include <algorithm>
+#include <cstring>
+
+#include "types.h"
+#include "gdx_queue.h"
+#include "hw/sh4/sh4_mem.h"
+
+// Single-producer/single-consumer byte ring.
+// Write() must only be called by the producer thread, Read()/Peek()/Clear() only by the consumer thread.
+// Size must be a power of two.
+template<u32 N>
+class GdxRing {
+    static_assert((N & (N - 1)) == 0, "GdxRing size must be a power of two");
+
+public:
+    // Readable bytes. Exact on the consumer side, a lower bound on the producer side.
+    u32 Size() const {
+        return tail_.load(std::memory_order_acquire) - head_.load(std::memory_order_acquire);
+    }
+
+    // Writable bytes. Exact on the producer side, a lower bound on the consumer side.
+    u32 Avail() const {
+        return N - Size();
+    }
+
+    bool Empty() const {
+        return Size() == 0;
+    }
+
+    // Append up to len bytes. Returns the number of bytes written.
+    u32 Write(const u8 *data, u32 len) {
+        return Write(len, [&data](u8 *dst, u32 n) {
+            memcpy(dst, data, n);
+            data += n;
+        });
+    }
+
+    // Append up to len bytes produced by fill(u8 *dst, u32 n), which is called once per contiguous span.
+    template<typename F>
+    u32 Write(u32 len, F fill) {
+        const u32 tail = tail_.load(std::memory_order_relaxed);
+        const u32 head = head_.load(std::memory_order_acquire);
+        len = std::min(len, N - (tail - head));
+        if (len == 0) {
+            return 0;
+        }
+        const u32 pos = tail & (N - 1);
+        const u32 first = std::min(len, N - pos);
+        fill(&buf_[pos], first);
+        if (first < len) {
+            fill(&buf_[0], len - first);
+        }
+        tail_.store(tail + len, std::memory_order_release);
+        return len;
+    }
+
+    // Remove up to len bytes. Returns the number of bytes read.
+    u32 Read(u8 *data, u32 len) {
+        return Read(len, [&data](const u8 *src, u32 n) {
+            memcpy(data, src, n);
+            data += n;
+        });
+    }
+
+    // Remove up to len bytes passed to drain(const u8 *src, u32 n) once per contiguous span.
+    template<typename F>
+    u32 Read(u32 len, F drain) {
+        len = Peek(len, drain);
+        head_.store(head_.load(std::memory_order_relaxed) + len, std::memory_order_release);
+        return len;
+    }
+
+    // Same as Read() without consuming the data.
+    template<typename F>
+    u32 Peek(u32 len, F drain) const {
+        const u32 head = head_.load(std::memory_order_relaxed);
+        const u32 tail = tail_.load(std::memory_order_acquire);
+        len = std::min(len, tail - head);
+        if (len == 0) {
+            return 0;
+        }
+        const u32 pos = head & (N - 1);
+        const u32 first = std::min(len, N - pos);
+        drain(&buf_[pos], first);
+        if (first < len) {
+            drain(&buf_[0], len - first);
+        }
+        return len;
+    }
+
+    // Discard everything currently readable.
+    void Clear() {
+        head_.store(tail_.load(std::memory_order_acquire), std::memory_order_release);
+    }
+
+private:
+    alignas(64) std::atomic<u32> head_{0};
+    alignas(64) std::atomic<u32> tail_{0};
+    alignas(64) u8 buf_[N];
+};
+
+// Bulk copy between a gdx_queue buffer in guest memory and the host.
+// offset is the queue index of the first byte and wraps at GDX_QUEUE_SIZE.
+// A direct pointer into main RAM is used when possible, falling back to byte accesses otherwise.
+static inline void gdx_queue_copy_from_guest(u8 *dst, u32 buf_addr, u32 offset, u32 len) {
+    while (len > 0) {
+        u32 n = std::min<u32>(len, GDX_QUEUE_SIZE - offset);
+        u32 addr = buf_addr + offset;
+        u8 *p = GetMemPtr(addr, n);
+        if (p != nullptr && (addr & RAM_MASK) + n <= RAM_SIZE) {
+            memcpy(dst, p, n);
+        } else {
+            for (u32 i = 0; i < n; ++i) {
+                dst[i] = ReadMem8_nommu(addr + i);
+            }
+        }
+        dst += n;
+        len -= n;
+        offset = (offset + n) % GDX_QUEUE_SIZE;
+    }
+}
+
+static inline void gdx_queue_copy_to_guest(u32 buf_addr, u32 offset, const u8 *src, u32 len) {
+    while (len > 0) {
+        u32 n = std::min<u32>(len, GDX_QUEUE_SIZE - offset);
+        u32 addr = buf_addr + offset;
+        u8 *p = GetMemPtr(addr, n);
+        if (p != nullptr && (addr & RAM_MASK) + n <= RAM_SIZE) {
+            memcpy(p, src, n);
+        } else {
+            for (u32 i = 0; i < n; ++i) {
+                WriteMem8_nommu(addr + i, src[i]);
+            }
+        }
+        src += n;
+        len -= n;
+        offset = (offset + n) % GDX_QUEUE_SIZE;
+    }
+}
@@ -20,6 +20,7 @@ bool Gdxsv::Enabled() const {
 void Gdxsv::Reset() {
     lbs_net.Reset();
     udp_net.Reset();
+    gdxsv_rollback.Reset();
     RestoreOnlinePatch();
 
     // Automatically add ContentPath if it is empty.
@@ -13,6 +13,7 @@
 #include "gdxsv.pb.h"
 #include "gdxsv_backend_tcp.h"
 #include "gdxsv_backend_udp.h"
+#include "gdxsv_rollback.h"
 
 class Gdxsv {
 public:
@@ -6,6 +6,7 @@
 #include <mutex>
 #include <utility>
 #include "gdx_queue.h"
+#include "gdx_ring.h"
 #include "gdxsv_network.h"
 #include "lbs_message.h"
 
@@ -57,11 +58,9 @@ public:
 
         int n = gdx_queue_size(&q);
         if (0 < n) {
-            u8 buf[GDX_QUEUE_SIZE] = {};
-            for (int i = 0; i < n; ++i) {
-                buf[i] = ReadMem8_nommu(buf_addr + q.head);
-                gdx_queue_pop(&q); // dummy pop
-            }
+            u8 buf[GDX_QUEUE_SIZE];
+            gdx_queue_copy_from_guest(buf, buf_addr, q.head, n);
+            q.head = (q.head + n) % GDX_QUEUE_SIZE;
             WriteMem16_nommu(gdx_txq_addr, q.head);
 
             int m = tcp_client_.Send((char *) buf, n);
@@ -88,10 +87,8 @@ public:
         n = tcp_client_.Recv((char *) buf, n);
 
         if (0 < n) {
-            for (int i = 0; i < n; ++i) {
-                WriteMem8_nommu(buf_addr + q.tail, buf[i]);
-                gdx_queue_push(&q, 0); // dummy push
-            }
+            gdx_queue_copy_to_guest(buf_addr, q.tail, buf, n);
+            q.tail = (q.tail + n) % GDX_QUEUE_SIZE;
             WriteMem16_nommu(gdx_rxq_addr + 2, q.tail);
 
             if (callback_lbs_packet_) {
@@ -3,11 +3,13 @@
 #pragma once
 
 #include <algorithm>
+#include <cmath>
 #include <thread>
 #include <string>
 #include "rend/gui.h"
 #include "gdxsv_network.h"
 #include "gdx_queue.h"
+#include "gdx_ring.h"
 
 class GdxsvBackendUdp {
 public:
@@ -17,13 +19,13 @@ public:
 
     ~GdxsvBackendUdp() {
         CloseMcsRemoteWithReason("cl_hard_quit");
-        net_terminate_ = true;
+        JoinNetThread();
     }
 
     void Reset() {
         CloseMcsRemoteWithReason("cl_hard_reset");
+        JoinNetThread();
         session_id_.clear();
-        net_terminate_ = true;
     }
 
     bool Connect(const std::string &host, u16 port) {
@@ -34,16 +36,29 @@ public:
                 return false;
             }
         }
+        if (!wakeup_.Initialized() && !wakeup_.Open()) {
+            WARN_LOG(COMMON, "Failed to open wakeup socket");
+            return false;
+        }
 
+        // The previous net thread uses the remote and may close it on its way out: stop it before reopening.
         CloseMcsRemoteWithReason("connect");
+        JoinNetThread();
         bool ok = mcs_remote_.Open(host.c_str(), port);
         if (!ok) {
             WARN_LOG(COMMON, "Failed to open Udp %s:%d", host.c_str(), port);
             return false;
         }
 
+        // The rings are single producer/single consumer: only reset them while the net thread is stopped.
+        send_ring_.Clear();
+        recv_ring_.Clear();
+        recv_discard_ = false;
+        send_enqueued_at_ = 0;
+        recv_arrived_at_ = 0;
+
         net_terminate_ = false;
-        std::thread([this]() { NetThreadLoop(); }).detach();
+        net_thread_ = std::thread([this]() { NetThreadLoop(); });
         return true;
     }
 
@@ -69,6 +84,7 @@ public:
             mcs_remote_.Close();
         }
         net_terminate_ = true;
+        wakeup_.Notify();
     }
 
     void OnGameWrite() {
@@ -82,21 +98,29 @@ public:
         q.tail = ReadMem16_nommu(gdx_txq_addr + 2);
         u32 buf_addr = gdx_txq_addr + 4;
 
-        int n = gdx_queue_size(&q);
+        u32 n = gdx_queue_size(&q);
         if (0 < n) {
-            std::lock_guard<std::mutex> lock(send_buf_mtx_);
-            for (int i = 0; i < n; ++i) {
-                send_buf_.push_back(ReadMem8_nommu(buf_addr + q.head));
-                gdx_queue_pop(&q); // dummy pop
+            n = send_ring_.Write(n, [&q, buf_addr](u8 *dst, u32 len) {
+                gdx_queue_copy_from_guest(dst, buf_addr, q.head, len);
+                q.head = (q.head + len) % GDX_QUEUE_SIZE;
+            });
+            if (n == 0) {
+                return;
             }
             WriteMem16_nommu(gdx_txq_addr, q.head);
+            u64 expected = 0;
+            send_enqueued_at_.compare_exchange_strong(expected, LatencyHistogram::NowMicros());
+            wakeup_.Notify();
         }
     }
 
     void OnGameRead() {
-        std::lock_guard<std::mutex> lock(recv_buf_mtx_);
-        int n = recv_buf_.size();
-        if (n <= 0) {
+        if (recv_discard_) {
+            recv_ring_.Clear();
+            return;
+        }
+        u32 n = recv_ring_.Size();
+        if (n == 0) {
             return;
         }
 
@@ -110,25 +134,44 @@ public:
         q.tail = ReadMem16_nommu(gdx_rxq_addr + 2);
         u32 buf_addr = gdx_rxq_addr + 4;
 
-        n = std::min<int>(n, gdx_queue_avail(&q));
-        for (int i = 0; i < n; ++i) {
-            WriteMem8_nommu(buf_addr + q.tail, recv_buf_.front());
-            recv_buf_.pop_front();
-            gdx_queue_push(&q, 0); // dummy push
-        }
+        n = std::min(n, gdx_queue_avail(&q));
+        recv_ring_.Read(n, [&q, buf_addr](const u8 *src, u32 len) {
+            gdx_queue_copy_to_guest(buf_addr, q.tail, src, len);
+            q.tail = (q.tail + len) % GDX_QUEUE_SIZE;
+        });
         WriteMem16_nommu(gdx_rxq_addr + 2, q.tail);
+
+        if (recv_ring_.Empty()) {
+            u64 arrived_at = recv_arrived_at_.exchange(0);
+            if (arrived_at != 0) {
+                recv_latency_.Record(LatencyHistogram::NowMicros() - arrived_at);
+            }
+        }
     }
 
+    // Time from OnGameWrite until the bytes are handed to the socket
+    const LatencyHistogram &SendLatency() const { return send_latency_; }
+
+    // Time from datagram arrival until the bytes are fully copied to the game rx queue
+    const LatencyHistogram &RecvLatency() const { return recv_latency_; }
+
+    const LatencyHistogram &PingRtt() const { return ping_rtt_; }
+
 private:
     void NetThreadLoop() {
-        ClearBuffers();
+        send_latency_.Clear();
+        recv_latency_.Clear();
+        ping_rtt_.Clear();
 
+        using Clock = std::chrono::steady_clock;
         const int kFirstMessageSize = 20;
-        int net_loop_count = 0;
+        const auto kResendInterval = std::chrono::milliseconds(100);
+        const auto kRetransmitInterval = std::chrono::milliseconds(16);
         int ping_send_count = 0;
         int ping_recv_count = 0;
         int rtt_sum = 0;
-        int udp_retransmit_countdown = 0;
+        auto next_resend = Clock::now();
+        auto next_retransmit = Clock::now();
         std::string sender;
         std::string user_id;
         std::string session_id;
@@ -147,14 +190,12 @@ private:
         State state = State::Start;
 
         while (!net_terminate_) {
-            net_loop_count++;
+            auto now = Clock::now();
 
             if (state == State::Start) {
-                ClearBuffers();
-                recv_buf_mtx_.lock();
-                recv_buf_.assign({0x0e, 0x61, 0x00, 0x22, 0x10, 0x31, 0x66,
-                                  0x77, 0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd});
-                recv_buf_mtx_.unlock();
+                static const u8 kFirstReply[] = {0x0e, 0x61, 0x00, 0x22, 0x10, 0x31, 0x66,
+                                                 0x77, 0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd};
+                recv_ring_.Write(kFirstReply, sizeof(kFirstReply));
                 session_id_.clear();
                 msg_buf.Clear();
                 state = State::McsSessionExchange;
@@ -162,19 +203,17 @@ private:
 
             if (state == State::McsSessionExchange) {
                 if (session_id.empty()) {
-                    send_buf_mtx_.lock();
-                    if (kFirstMessageSize <= send_buf_.size()) {
-                        for (int j = 12; j < kFirstMessageSize; ++j) {
-                            session_id.push_back((char) send_buf_[j]);
-                        }
+                    if (kFirstMessageSize <= send_ring_.Size()) {
+                        send_ring_.Read(buf, kFirstMessageSize);
+                        session_id.assign((const char *) buf + 12, kFirstMessageSize - 12);
                         NOTICE_LOG(COMMON, "session_id:%s", session_id.c_str());
                         session_id_ = session_id;
                         msg_buf.SessionId(session_id);
-                        send_buf_.clear();
+                        send_ring_.Clear();
                     }
-                    send_buf_mtx_.unlock();
                 } else if (user_id.empty()) {
-                    if (net_loop_count % 100 == 0) {
+                    if (next_resend <= now) {
+                        next_resend = now + kResendInterval;
                         pkt.Clear();
                         pkt.set_type(proto::MessageType::HelloServer);
                         pkt.set_session_id(session_id);
@@ -193,7 +232,8 @@ private:
 
             if (state == State::McsPingTest) {
                 if (ping_recv_count < 10) {
-                    if (net_loop_count % 100 == 0 || ping_send_count == ping_recv_count) {
+                    if (next_resend <= now || ping_send_count == ping_recv_count) {
+                        next_resend = now + kResendInterval;
                         pkt.Clear();
                         pkt.set_type(proto::MessageType::Ping);
                         pkt.set_session_id(session_id_.c_str(), session_id_.size());
@@ -223,26 +263,41 @@ private:
             }
 
             if (state == State::McsInBattle) {
-                std::lock_guard<std::mutex> lock(send_buf_mtx_);
-                int n = send_buf_.size();
-                if (0 < n || udp_retransmit_countdown-- == 0) {
+                u32 n = send_ring_.Size();
+                if (0 < n || next_retransmit <= now) {
+                    bool pushed = false;
                     if (0 < n && msg_buf.CanPush()) {
-                        n = std::min<int>(n, sizeof(buf));
-                        for (int i = 0; i < n; ++i) {
-                            buf[i] = send_buf_.front();
-                            send_buf_.pop_front();
-                        }
+                        n = send_ring_.Read(buf, sizeof(buf));
                         msg_buf.PushBattleMessage(user_id, buf, n);
+                        pushed = send_ring_.Empty();
                     }
 
                     if (msg_buf.Packet().SerializeToArray((void *) buf, (int) sizeof(buf))) {
                         if (udp_client_.SendTo((const char *) buf, msg_buf.Packet().GetCachedSize(), mcs_remote_)) {
-                            udp_retransmit_countdown = 16;
+                            next_retransmit = now + kRetransmitInterval;
+                            u64 enqueued_at = pushed ? send_enqueued_at_.exchange(0) : 0;
+                            if (enqueued_at != 0) {
+                                send_latency_.Record(LatencyHistogram::NowMicros() - enqueued_at);
+                            }
                         }
                     }
                 }
             }
 
+            // Sleep until a datagram arrives, the game writes (wakeup), or the next timer fires.
+            auto deadline = now + kResendInterval;
+            if (state == State::McsInBattle) {
+                deadline = std::min(deadline, next_retransmit);
+            }
+            if (state == State::McsSessionExchange || state == State::McsPingTest) {
+                deadline = std::min(deadline, next_resend);
+            }
+            auto timeout = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - Clock::now()).count();
+            udp_client_.Wait((int) std::max<long long>(0, timeout + 1), wakeup_);
+            if (net_terminate_) {
+                break;
+            }
+
             while (true) {
                 int n = udp_client_.ReadableSize();
                 if (n <= 0) {
@@ -285,21 +340,25 @@ private:
                         auto rtt = static_cast<float>(t2 - pkt.pong_data().timestamp());
                         ping_recv_count++;
                         rtt_sum += rtt;
+                        ping_rtt_.Record(static_cast<u64>(rtt) * 1000);
                     }
                         break;
 
                     case proto::MessageType::Battle:
                         if (state != State::McsInBattle) break;
                         msg_buf.ApplySeqAck(pkt.seq(), pkt.ack());
-                        recv_buf_mtx_.lock();
                         for (auto &msg : pkt.battle_data()) {
                             if (msg_filter.IsNextMessage(msg)) {
-                                for (auto c : msg.body()) {
-                                    recv_buf_.push_back(c);
+                                const auto &body = msg.body();
+                                if (recv_ring_.Write((const u8 *) body.data(), body.size()) != body.size()) {
+                                    ERROR_LOG(COMMON, "recv buffer overflow");
                                 }
                             }
                         }
-                        recv_buf_mtx_.unlock();
+                        if (!recv_ring_.Empty()) {
+                            u64 expected = 0;
+                            recv_arrived_at_.compare_exchange_strong(expected, LatencyHistogram::NowMicros());
+                        }
                         break;
 
                     case proto::Fin:
@@ -308,32 +367,42 @@ private:
                         break;
                 }
             }
-            std::this_thread::sleep_for(std::chrono::milliseconds(1));
         }
-        ClearBuffers();
+        // Leftover data must not reach the game. The rings are emptied by their consumers.
+        send_ring_.Clear();
+        recv_discard_ = true;
 
+        NOTICE_LOG(COMMON, "send latency: %s", send_latency_.Summary().c_str());
+        NOTICE_LOG(COMMON, "recv latency: %s", recv_latency_.Summary().c_str());
+        NOTICE_LOG(COMMON, "ping rtt: %s", ping_rtt_.Summary().c_str());
         NOTICE_LOG(COMMON, "NetThread finished");
     }
 
-    void ClearBuffers() {
-        recv_buf_mtx_.lock();
-        recv_buf_.clear();
-        recv_buf_mtx_.unlock();
-
-        send_buf_mtx_.lock();
-        send_buf_.clear();
-        send_buf_mtx_.unlock();
+    void JoinNetThread() {
+        net_terminate_ = true;
+        wakeup_.Notify();
+        if (net_thread_.joinable()) {
+            net_thread_.join();
+        }
     }
 
     const std::map<std::string, u32> &symbols_;
     UdpRemote mcs_remote_;
     UdpClient udp_client_;
+    UdpWakeup wakeup_;
 
     std::string session_id_;
     std::atomic<int> &maxlag_;
     std::atomic<bool> net_terminate_;
-    std::mutex send_buf_mtx_;
-    std::mutex recv_buf_mtx_;
-    std::deque<u8> send_buf_;
-    std::deque<u8> recv_buf_;
+    std::thread net_thread_;
+    // send: emu thread -> net thread, recv: net thread -> emu thread
+    GdxRing<64 * 1024> send_ring_;
+    GdxRing<64 * 1024> recv_ring_;
+    std::atomic<bool> recv_discard_{false};
+
+    std::atomic<u64> send_enqueued_at_{0};
+    std::atomic<u64> recv_arrived_at_{0};
+    LatencyHistogram send_latency_;
+    LatencyHistogram recv_latency_;
+    LatencyHistogram ping_rtt_;
 };
@@ -1,5 +1,7 @@
 #include "gdxsv_network.h"
 
+#include <cmath>
+
 #ifndef _WIN32
 #include <sys/ioctl.h>
 #endif
@@ -287,6 +289,87 @@ void UdpClient::Close() {
     }
 }
 
+bool UdpClient::Wait(int timeout_ms, UdpWakeup &wakeup) const {
+    fd_set set_r;
+    FD_ZERO(&set_r);
+    FD_SET(sock_, &set_r);
+    sock_t max_sock = sock_;
+    if (wakeup.Initialized()) {
+        FD_SET(wakeup.sock(), &set_r);
+        max_sock = std::max(max_sock, wakeup.sock());
+    }
+
+    timeval timeout;
+    timeout.tv_sec = timeout_ms / 1000;
+    timeout.tv_usec = (timeout_ms % 1000) * 1000;
+    int res = select(max_sock + 1, &set_r, nullptr, nullptr, &timeout);
+    if (res < 0) {
+        if (get_last_error() != EINTR) {
+            WARN_LOG(COMMON, "UDP select failed. errno=%d", get_last_error());
+        }
+        return false;
+    }
+    if (res == 0) {
+        return false;
+    }
+    if (wakeup.Initialized() && FD_ISSET(wakeup.sock(), &set_r)) {
+        wakeup.Drain();
+    }
+    return FD_ISSET(sock_, &set_r);
+}
+
+bool UdpWakeup::Open() {
+    sock_t new_sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (new_sock == INVALID_SOCKET) {
+        WARN_LOG(COMMON, "UdpWakeup socket fail %d", get_last_error());
+        return false;
+    }
+
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+
+    socklen_t addr_len = sizeof(addr);
+    if (::bind(new_sock, (struct sockaddr *) &addr, sizeof(addr)) < 0
+        || ::getsockname(new_sock, (struct sockaddr *) &addr, &addr_len) < 0
+        || ::connect(new_sock, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+        ERROR_LOG(COMMON, "UdpWakeup setup failed. errno=%d", get_last_error());
+        closesocket(new_sock);
+        return false;
+    }
+
+    set_non_blocking(new_sock);
+    Close();
+    sock_ = new_sock;
+    return true;
+}
+
+bool UdpWakeup::Initialized() const {
+    return sock_ != INVALID_SOCKET;
+}
+
+void UdpWakeup::Notify() {
+    if (sock_ != INVALID_SOCKET) {
+        char c = 0;
+        ::send(sock_, &c, 1, 0);
+    }
+}
+
+void UdpWakeup::Drain() {
+    char buf[64];
+    while (::recv(sock_, buf, sizeof(buf), 0) > 0) {
+    }
+}
+
+void UdpWakeup::Close() {
+    if (sock_ != INVALID_SOCKET) {
+        closesocket(sock_);
+        sock_ = INVALID_SOCKET;
+    }
+}
+
 MessageBuffer::MessageBuffer() {
     Clear();
 }
@@ -347,3 +430,57 @@ bool MessageFilter::IsNextMessage(const proto::BattleMessage &msg) {
 void MessageFilter::Clear() {
     recv_seq.clear();
 }
+
+void LatencyHistogram::Record(u64 micros) {
+    int i = 0;
+    while (i < kBuckets - 1 && (1ull << i) < micros) {
+        i++;
+    }
+    buckets_[i]++;
+    sum_ += micros;
+    u64 prev = max_;
+    while (prev < micros && !max_.compare_exchange_weak(prev, micros)) {
+    }
+}
+
+u64 LatencyHistogram::Count() const {
+    u64 n = 0;
+    for (const auto &b : buckets_) {
+        n += b;
+    }
+    return n;
+}
+
+u64 LatencyHistogram::Percentile(double p) const {
+    u64 total = Count();
+    if (total == 0) {
+        return 0;
+    }
+    u64 target = std::max<u64>(1, (u64) std::ceil(total * p / 100.0));
+    u64 n = 0;
+    for (int i = 0; i < kBuckets; ++i) {
+        n += buckets_[i];
+        if (target <= n) {
+            return 1ull << i;
+        }
+    }
+    return max_;
+}
+
+std::string LatencyHistogram::Summary() const {
+    u64 n = Count();
+    char buf[128];
+    snprintf(buf, sizeof(buf), "n=%llu avg=%lluus p50<=%lluus p99<=%lluus max=%lluus",
+             (unsigned long long) n, (unsigned long long) (n == 0 ? 0 : sum_ / n),
+             (unsigned long long) Percentile(50), (unsigned long long) Percentile(99),
+             (unsigned long long) max_);
+    return std::string(buf);
+}
+
+void LatencyHistogram::Clear() {
+    for (auto &b : buckets_) {
+        b = 0;
+    }
+    sum_ = 0;
+    max_ = 0;
+}
@@ -3,6 +3,8 @@
 #include <string>
 #include <mutex>
 #include <deque>
+#include <atomic>
+#include <chrono>
 
 #include "types.h"
 #include "network/net_platform.h"
@@ -91,9 +93,33 @@ public:
     const sockaddr_in &net_addr() const;
 
 private:
-    bool is_open_;
+    bool is_open_ = false;
     std::string str_addr_;
-    sockaddr_in net_addr_;
+    sockaddr_in net_addr_{};
+};
+
+// Loopback datagram socket used to interrupt a thread waiting in UdpClient::Wait.
+// A socket (instead of a pipe or eventfd) keeps it usable with select() on every platform.
+class UdpWakeup {
+public:
+    ~UdpWakeup() {
+        Close();
+    }
+
+    bool Open();
+
+    bool Initialized() const;
+
+    void Notify();
+
+    void Drain();
+
+    void Close();
+
+    sock_t sock() const { return sock_; }
+
+private:
+    sock_t sock_ = INVALID_SOCKET;
 };
 
 class UdpClient {
@@ -102,6 +128,10 @@ public:
 
     bool Initialized() const;
 
+    // Block until a datagram is readable, the wakeup is notified or timeout_ms elapsed.
+    // Returns true if the socket has data to read.
+    bool Wait(int timeout_ms, UdpWakeup &wakeup) const;
+
     int RecvFrom(char *buf, int len, std::string &sender);
 
     int SendTo(const char *buf, int len, const UdpRemote &remote);
@@ -117,3 +147,33 @@ private:
     int bind_port_;
     std::string bind_ip_;
 };
+
+// Lock-free latency histogram with power-of-two microsecond buckets.
+// Record() may be called from any thread.
+class LatencyHistogram {
+public:
+    static const int kBuckets = 24;
+
+    static u64 NowMicros() {
+        return std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    void Record(u64 micros);
+
+    u64 Count() const;
+
+    // Upper bound in microseconds of the bucket containing the given percentile (0-100).
+    u64 Percentile(double p) const;
+
+    u64 Max() const { return max_; }
+
+    std::string Summary() const;
+
+    void Clear();
+
+private:
+    std::atomic<u64> buckets_[kBuckets] = {};
+    std::atomic<u64> sum_{0};
+    std::atomic<u64> max_{0};
+};
@@ -0,0 +1,392 @@
+#include "gdxsv_rollback.h"
+
+#include <algorithm>
+#include <cstddef>
+
+#include "cfg/cfg.h"
+#include "hw/sh4/sh4_if.h"
+#include "hw/sh4/sh4_mem.h"
+#include "hw/sh4/sh4_sched.h"
+#include "hw/sh4/modules/mmu.h"
+#include "hw/sh4/dyna/blockmanager.h"
+#include "hw/arm7/arm7_rec.h"
+#include "hw/aica/dsp.h"
+#include "hw/pvr/ta_ctx.h"
+#include "input/gamepad_device.h"
+#include "rend/gui.h"
+#include "stdclass.h"
+
+extern cResetEvent frame_finished;
+
+GdxsvRollback gdxsv_rollback;
+
+void RollbackStateRing::Init(int slots) {
+    chain_.Reset();
+    slots_ = slots;
+}
+
+bool RollbackStateRing::Save(u32 frame) {
+    if (slots_ == 0) {
+        return false;
+    }
+    if (!chain_.Take(frame)) {
+        return false;
+    }
+    if (frame >= slots_) {
+        chain_.DropBefore(frame - slots_ + 1);
+    }
+    return true;
+}
+
+bool RollbackStateRing::Load(u32 frame) {
+    if (!Has(frame)) {
+        return false;
+    }
+
+    // The render thread may still be using the TA context list
+    while (rend_framePending()) {
+        frame_finished.Wait(100);
+    }
+#if FEAT_AREC == DYNAREC_JIT
+    aicaarm::recompiler::flush();
+#endif
+    mmu_flush_table();
+#if FEAT_SHREC != DYNAREC_NONE
+    bool keep_blocks = !mmu_enabled();
+    if (keep_blocks) {
+        bm_SaveCodePages();
+    }
+    bm_Reset();
+#endif
+
+    if (!chain_.Restore(frame)) {
+        return false;
+    }
+    mmu_set_state();
+#if FEAT_SHREC != DYNAREC_NONE
+    if (keep_blocks && !mmu_enabled()) {
+        bm_DiscardChangedBlocks();
+    } else
+#endif
+    {
+        sh4_cpu.ResetCache();
+    }
+    dsp.dyndirty = true;
+    sh4_sched_ffts();
+    return true;
+}
+
+bool RollbackStateRing::Has(u32 frame) const {
+    return chain_.Has(frame);
+}
+
+u64 RollbackStateRing::Hash(u32 frame) const {
+    return chain_.Hash(frame);
+}
+
+void RollbackStateRing::Clear() {
+    chain_.Reset();
+    slots_ = 0;
+}
+
+void RollbackInputHistory::Clear() {
+    for (u32 i = 0; i < kSize; i++) {
+        local_[i] = Entry();
+        remote_[i] = Entry();
+        used_[i] = Entry();
+    }
+    last_confirmed_ = 0;
+    prediction_ = RollbackInput();
+}
+
+void RollbackInputHistory::SetLocal(u32 frame, const RollbackInput &input) {
+    Entry &e = local_[frame % kSize];
+    e.frame = frame;
+    e.input = input;
+}
+
+const RollbackInput &RollbackInputHistory::Local(u32 frame) const {
+    static const RollbackInput neutral;
+    const Entry &e = local_[frame % kSize];
+    return e.frame == frame ? e.input : neutral;
+}
+
+bool RollbackInputHistory::ConfirmRemote(u32 frame, const RollbackInput &input) {
+    if (remote_[frame % kSize].frame == frame) {
+        // duplicate
+        return false;
+    }
+    if (frame + kSize / 2 <= last_confirmed_ || last_confirmed_ + kSize / 2 <= frame) {
+        // out of window
+        return false;
+    }
+    Entry &e = remote_[frame % kSize];
+    e.frame = frame;
+    e.input = input;
+    while (remote_[(last_confirmed_ + 1) % kSize].frame == last_confirmed_ + 1) {
+        last_confirmed_++;
+        prediction_ = remote_[last_confirmed_ % kSize].input;
+    }
+
+    const Entry &used = used_[frame % kSize];
+    return used.frame == frame && used.input != input;
+}
+
+const RollbackInput &RollbackInputHistory::Remote(u32 frame) {
+    Entry &used = used_[frame % kSize];
+    const Entry &e = remote_[frame % kSize];
+    used.frame = frame;
+    used.input = e.frame == frame ? e.input : prediction_;
+    return used.input;
+}
+
+void GdxsvRollback::Reset() {
+    if (active_) {
+        Stop();
+    }
+    if (!cfgLoadBool("gdxsv", "rollback", false) || settings.platform.system != DC_PLATFORM_DREAMCAST) {
+        return;
+    }
+
+    local_port_ = cfgLoadInt("gdxsv", "rollback_player", 0) == 0 ? 0 : 1;
+    delay_ = std::max(1, std::min(8, cfgLoadInt("gdxsv", "rollback_delay", 1)));
+    max_frames_ = std::max(2, std::min(16, cfgLoadInt("gdxsv", "rollback_frames", 6)));
+    check_hash_ = cfgLoadBool("gdxsv", "rollback_check", false);
+    int port = cfgLoadInt("gdxsv", "rollback_port", 0);
+    std::string peer = cfgLoadStr("gdxsv", "rollback_peer", "");
+
+    if (!udp_.Initialized() && !udp_.Bind(port)) {
+        WARN_LOG(COMMON, "rollback: bind failed");
+        return;
+    }
+    if (!peer_.Open(peer)) {
+        WARN_LOG(COMMON, "rollback: invalid peer address '%s'", peer.c_str());
+        return;
+    }
+    if (!wakeup_.Initialized()) {
+        wakeup_.Open();
+    }
+
+    states_.Init(max_frames_);
+    inputs_.Clear();
+    // Inputs are delayed by delay_ frames: the first ones are neutral on both sides
+    for (u32 f = 0; f <= delay_; f++) {
+        inputs_.SetLocal(f, neutral_);
+        inputs_.ConfirmRemote(f, neutral_);
+    }
+    for (auto &h : local_hashes_) {
+        h = HashEntry();
+    }
+    for (auto &h : peer_hashes_) {
+        h = HashEntry();
+    }
+    frame_ = 0;
+    sim_frame_ = 0;
+    rollback_frame_ = ~0u;
+    peer_ack_ = 0;
+    last_hash_sent_ = 0;
+    last_recv_time_ = LatencyHistogram::NowMicros();
+    frame_ended_ = false;
+    interrupted_ = false;
+    rollback_count_ = 0;
+    resim_frames_ = 0;
+    max_rollback_ = 0;
+    stall_count_ = 0;
+    desync_count_ = 0;
+    hash_checks_ = 0;
+    active_ = true;
+    NOTICE_LOG(COMMON, "rollback: started player:%d delay:%d frames:%d peer:%s", local_port_ + 1, delay_, max_frames_,
+               peer_.str_addr().c_str());
+}
+
+void GdxsvRollback::Stop() {
+    if (!active_) {
+        return;
+    }
+    active_ = false;
+    frame_ended_ = false;
+    states_.Clear();
+    settings.aica.muteAudio = false;
+    settings.disableRenderer = false;
+    NOTICE_LOG(COMMON, "rollback: stopped at frame %d. rollbacks:%d resimulated:%d max:%d stalls:%d hashes:%d desyncs:%d",
+               frame_, rollback_count_, resim_frames_, max_rollback_, stall_count_, hash_checks_, desync_count_);
+}
+
+void GdxsvRollback::OnVBlank() {
+    frame_ended_ = true;
+    sh4_cpu.Stop();
+}
+
+void GdxsvRollback::NextFrame() {
+    frame_ended_ = false;
+    Receive();
+
+    frame_++;
+    inputs_.SetLocal(frame_ + delay_, CaptureLocalInput());
+    Send();
+
+    // Don't run further ahead than the number of frames we can roll back
+    if (inputs_.LastConfirmedRemote() + max_frames_ < frame_) {
+        stall_count_++;
+        u64 last_send = LatencyHistogram::NowMicros();
+        while (active_ && !interrupted_ && inputs_.LastConfirmedRemote() + max_frames_ < frame_) {
+            if (udp_.Wait(1, wakeup_)) {
+                Receive();
+            }
+            u64 now = LatencyHistogram::NowMicros();
+            if (now - last_send >= 16000) {
+                Send();
+                last_send = now;
+            }
+            if (now - last_recv_time_ >= 10000000) {
+                WARN_LOG(COMMON, "rollback: peer timeout");
+                gui_display_notification("Rollback: connection lost", 3000);
+                Stop();
+                return;
+            }
+        }
+        if (interrupted_) {
+            return;
+        }
+    }
+
+    if (rollback_frame_ < frame_) {
+        u32 target = rollback_frame_;
+        rollback_frame_ = ~0u;
+        if (!states_.Load(target)) {
+            ERROR_LOG(COMMON, "rollback: no state for frame %d (current %d)", target, frame_);
+            desync_count_++;
+        } else {
+            settings.aica.muteAudio = true;
+            settings.disableRenderer = true;
+            for (u32 f = target; f < frame_; f++) {
+                if (f != target) {
+                    states_.Save(f);
+                }
+                sim_frame_ = f;
+                if (!RunFrame()) {
+                    WARN_LOG(COMMON, "rollback: re-simulation interrupted");
+                    break;
+                }
+            }
+            settings.aica.muteAudio = false;
+            settings.disableRenderer = false;
+            rollback_count_++;
+            resim_frames_ += frame_ - target;
+            max_rollback_ = std::max(max_rollback_, frame_ - target);
+        }
+    }
+
+    states_.Save(frame_);
+    sim_frame_ = frame_;
+
+    if (check_hash_) {
+        // The state at the start of frame f is final once all the inputs before f are confirmed
+        u32 f = std::min(inputs_.LastConfirmedRemote() + 1, frame_);
+        if (last_hash_sent_ < f && states_.Has(f)) {
+            HashEntry &h = local_hashes_[f % RollbackInputHistory::kSize];
+            h.frame = f;
+            h.hash = states_.Hash(f);
+            last_hash_sent_ = f;
+            CheckHash(f, h.hash);
+        }
+    }
+}
+
+bool GdxsvRollback::RunFrame() {
+    frame_ended_ = false;
+    sh4_cpu.Run();
+    bool ended = frame_ended_ && !interrupted_;
+    frame_ended_ = false;
+    return ended;
+}
+
+const RollbackInput &GdxsvRollback::Input(u32 port) {
+    if (port == (u32) local_port_) {
+        return inputs_.Local(sim_frame_);
+    }
+    if (port == (u32) (local_port_ ^ 1)) {
+        return inputs_.Remote(sim_frame_);
+    }
+    return neutral_;
+}
+
+RollbackInput GdxsvRollback::CaptureLocalInput() const {
+    RollbackInput input;
+    input.kcode = kcode[0];
+    input.lt = lt[0];
+    input.rt = rt[0];
+    input.joyx = joyx[0];
+    input.joyy = joyy[0];
+    return input;
+}
+
+void GdxsvRollback::Send() {
+    Packet pkt = {};
+    pkt.magic = kMagic;
+    pkt.ack_frame = inputs_.LastConfirmedRemote();
+    if (check_hash_ && last_hash_sent_ != 0) {
+        pkt.hash_frame = last_hash_sent_;
+        pkt.hash = local_hashes_[last_hash_sent_ % RollbackInputHistory::kSize].hash;
+    }
+    // Resend everything the peer hasn't acknowledged yet
+    u32 last = frame_ + delay_;
+    u32 first = std::max(peer_ack_ + 1, last + 1 > kMaxInputsPerPacket ? last + 1 - kMaxInputsPerPacket : 0);
+    pkt.start_frame = first;
+    pkt.count = first <= last ? last - first + 1 : 0;
+    for (u32 i = 0; i < pkt.count; i++) {
+        pkt.inputs[i] = inputs_.Local(first + i);
+    }
+    int size = (int) (offsetof(Packet, inputs) + pkt.count * sizeof(RollbackInput));
+    udp_.SendTo((const char *) &pkt, size, peer_);
+}
+
+void GdxsvRollback::Receive() {
+    Packet pkt;
+    std::string sender;
+    while (true) {
+        int n = udp_.RecvFrom((char *) &pkt, sizeof(pkt), sender);
+        if (n <= 0) {
+            break;
+        }
+        if (sender != peer_.str_addr()) {
+            continue;
+        }
+        if (n < (int) offsetof(Packet, inputs) || pkt.magic != kMagic
+            || n < (int) (offsetof(Packet, inputs) + pkt.count * sizeof(RollbackInput))) {
+            continue;
+        }
+        last_recv_time_ = LatencyHistogram::NowMicros();
+        peer_ack_ = std::max(peer_ack_, pkt.ack_frame);
+        for (u32 i = 0; i < pkt.count && i < kMaxInputsPerPacket; i++) {
+            u32 f = pkt.start_frame + i;
+            if (inputs_.ConfirmRemote(f, pkt.inputs[i]) && f < rollback_frame_) {
+                rollback_frame_ = f;
+            }
+        }
+        if (pkt.hash_frame != 0) {
+            HashEntry &h = peer_hashes_[pkt.hash_frame % RollbackInputHistory::kSize];
+            if (h.frame != pkt.hash_frame) {
+                h.frame = pkt.hash_frame;
+                h.hash = pkt.hash;
+                CheckHash(pkt.hash_frame, pkt.hash);
+            }
+        }
+    }
+}
+
+void GdxsvRollback::CheckHash(u32 frame, u64 hash) {
+    const HashEntry &local = local_hashes_[frame % RollbackInputHistory::kSize];
+    const HashEntry &peer = peer_hashes_[frame % RollbackInputHistory::kSize];
+    if (local.frame != frame || peer.frame != frame) {
+        return;
+    }
+    hash_checks_++;
+    if (local.hash != peer.hash) {
+        desync_count_++;
+        ERROR_LOG(COMMON, "rollback: desync at frame %d local:%016llx peer:%016llx", frame,
+                  (unsigned long long) local.hash, (unsigned long long) peer.hash);
+    } else {
+        DEBUG_LOG(COMMON, "rollback: frame %d hash %016llx ok", frame, (unsigned long long) hash);
+    }
+}
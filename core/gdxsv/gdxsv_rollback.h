@@ -0,0 +1,186 @@
+// Rollback netcode for gdxsv battles
+
+#pragma once
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include "types.h"
+#include "gdxsv_network.h"
+#include "snapshot.h"
+
+struct RollbackInput {
+    u32 kcode = ~0u;
+    u8 lt = 0;
+    u8 rt = 0;
+    s8 joyx = 0;
+    s8 joyy = 0;
+
+    bool operator==(const RollbackInput &o) const {
+        return kcode == o.kcode && lt == o.lt && rt == o.rt && joyx == o.joyx && joyy == o.joyy;
+    }
+
+    bool operator!=(const RollbackInput &o) const {
+        return !(*this == o);
+    }
+};
+
+// In-memory savestates of the last frames, indexed by frame number.
+// Only the guest memory pages written since the previous frame are copied (see SnapshotChain).
+class RollbackStateRing {
+public:
+    void Init(int slots);
+
+    // Snapshot the machine as the state at the start of the given frame.
+    bool Save(u32 frame);
+
+    bool Load(u32 frame);
+
+    bool Has(u32 frame) const;
+
+    u64 Hash(u32 frame) const;
+
+    void Clear();
+
+private:
+    SnapshotChain chain_;
+    u32 slots_ = 0;
+};
+
+// Per-frame inputs of the local and the remote player.
+// Remote inputs that haven't been received yet are predicted by repeating the last confirmed one.
+class RollbackInputHistory {
+public:
+    static const u32 kSize = 128;
+
+    void Clear();
+
+    void SetLocal(u32 frame, const RollbackInput &input);
+
+    const RollbackInput &Local(u32 frame) const;
+
+    // Record the actual remote input of a frame.
+    // Returns true if the frame was already simulated with a different prediction.
+    bool ConfirmRemote(u32 frame, const RollbackInput &input);
+
+    // Confirmed or predicted remote input for the frame being simulated.
+    const RollbackInput &Remote(u32 frame);
+
+    // All remote inputs up to and including this frame are confirmed.
+    u32 LastConfirmedRemote() const { return last_confirmed_; }
+
+private:
+    struct Entry {
+        u32 frame = ~0u;
+        RollbackInput input;
+    };
+
+    Entry local_[kSize];
+    Entry remote_[kSize];
+    Entry used_[kSize];
+    u32 last_confirmed_ = 0;
+    RollbackInput prediction_;
+};
+
+// Opt-in rollback mode: the machine is snapshotted every frame, remote inputs are predicted,
+// and frames are re-simulated when a prediction turns out wrong.
+// Both peers run a local two-player game; inputs are exchanged directly over UDP.
+class GdxsvRollback {
+public:
+    // Read the configuration and (re)start a session if enabled. Emulation must be stopped.
+    void Reset();
+
+    bool Active() const { return active_; }
+
+    // Called at vblank: stops the cpu so that NextFrame() runs between frames.
+    void OnVBlank();
+
+    bool FrameEnded() const { return active_ && frame_ended_ && !interrupted_; }
+
+    // Emulation thread, between two frames. Handles network, rollback and snapshot.
+    void NextFrame();
+
+    // An external stop of the emulation was requested
+    void Interrupt() {
+        interrupted_ = true;
+        wakeup_.Notify();
+    }
+
+    void Resume() { interrupted_ = false; }
+
+    // Input of the given maple port for the frame being simulated
+    const RollbackInput &Input(u32 port);
+
+    void Stop();
+
+    // Session statistics
+    u32 Frame() const { return frame_; }
+    u32 RollbackCount() const { return rollback_count_; }
+    // Frames whose state hash was compared with the peer's (rollback_check)
+    u32 HashChecks() const { return hash_checks_; }
+    u32 DesyncCount() const { return desync_count_; }
+
+private:
+    static const u32 kMaxInputsPerPacket = 32;
+    static const u32 kMagic = 0x42524447; // GDRB
+
+#pragma pack(push, 1)
+    struct Packet {
+        u32 magic;
+        u32 ack_frame;
+        u32 hash_frame;
+        u64 hash;
+        u32 start_frame;
+        u8 count;
+        RollbackInput inputs[kMaxInputsPerPacket];
+    };
+#pragma pack(pop)
+
+    bool RunFrame();
+
+    void Send();
+
+    void Receive();
+
+    void CheckHash(u32 frame, u64 hash);
+
+    RollbackInput CaptureLocalInput() const;
+
+    bool active_ = false;
+    std::atomic<bool> interrupted_{false};
+    bool frame_ended_ = false;
+    bool check_hash_ = false;
+    int local_port_ = 0;
+    u32 delay_ = 1;
+    u32 max_frames_ = 6;
+    u32 frame_ = 0;
+    u32 sim_frame_ = 0;
+    u32 rollback_frame_ = ~0u;
+    u32 peer_ack_ = 0;
+    u32 last_hash_sent_ = 0;
+    u64 last_recv_time_ = 0;
+
+    UdpClient udp_;
+    UdpRemote peer_;
+    UdpWakeup wakeup_;
+    RollbackStateRing states_;
+    RollbackInputHistory inputs_;
+    RollbackInput neutral_;
+
+    struct HashEntry {
+        u32 frame = 0;
+        u64 hash = 0;
+    };
+    HashEntry local_hashes_[RollbackInputHistory::kSize];
+    HashEntry peer_hashes_[RollbackInputHistory::kSize];
+
+    u32 rollback_count_ = 0;
+    u32 resim_frames_ = 0;
+    u32 max_rollback_ = 0;
+    u32 stall_count_ = 0;
+    u32 desync_count_ = 0;
+    u32 hash_checks_ = 0;
+};
+
+extern GdxsvRollback gdxsv_rollback;
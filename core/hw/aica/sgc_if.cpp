@@ -30,6 +30,14 @@
 #include <algorithm>
 #include <cmath>
 
+#if HOST_CPU == CPU_X64 || (HOST_CPU == CPU_X86 && defined(__SSE2__))
+#include <emmintrin.h>
+#define AICA_MIX_SIMD
+#elif HOST_CPU == CPU_ARM64 || (HOST_CPU == CPU_ARM && defined(__ARM_NEON__))
+#include <arm_neon.h>
+#define AICA_MIX_SIMD
+#endif
+
 #undef FAR
 
 //#define CLIP_WARN
@@ -544,6 +552,76 @@ struct ChannelEx
 			Chans[i].Step(mixl, mixr);
 	}
 
+	// Same as 32 calls to Step(mixl, mixr), each output being accumulated in its own array
+	__forceinline void Step32(SampleType *mixl, SampleType *mixr, SampleType (*mixs)[32])
+	{
+		if (!enabled)
+			return;
+		alignas(16) SampleType oLeft[32];
+		alignas(16) SampleType oRight[32];
+		alignas(16) SampleType oDsp[32];
+		int count = 0;
+		//stop working on this channel if its turned off ...
+		while (count < 32 && Step(oLeft[count], oRight[count], oDsp[count]))
+			count++;
+		Mix(count, oLeft, oRight, oDsp, mixl, mixr, mixs[VolMix.DSPOut - dsp.MIXS]);
+	}
+
+	// Adds the channel outputs of count samples to the mix, as Step(mixl, mixr) does.
+	// 4 samples at a time with SSE2 or NEON when available (AICA_MIX_SIMD)
+	static void Mix(int count, const SampleType *oLeft, const SampleType *oRight, const SampleType *oDsp,
+			SampleType *mixl, SampleType *mixr, SampleType *dspOut)
+	{
+		const bool dspEnabled = config::DSPEnabled;
+		int i = 0;
+#if defined(AICA_MIX_SIMD) && (HOST_CPU == CPU_X64 || HOST_CPU == CPU_X86)
+		for (; i + 4 <= count; i += 4)
+		{
+			__m128i l = _mm_load_si128((const __m128i *)&oLeft[i]);
+			__m128i r = _mm_load_si128((const __m128i *)&oRight[i]);
+			__m128i d = _mm_load_si128((const __m128i *)&oDsp[i]);
+			_mm_store_si128((__m128i *)&dspOut[i], _mm_add_epi32(_mm_load_si128((const __m128i *)&dspOut[i]), d));
+			if (!dspEnabled)
+			{
+				__m128i muted = _mm_cmpeq_epi32(_mm_add_epi32(l, r), _mm_setzero_si128());
+				__m128i send = _mm_and_si128(muted, _mm_srai_epi32(d, 4));
+				l = _mm_or_si128(_mm_andnot_si128(muted, l), send);
+				r = _mm_or_si128(_mm_andnot_si128(muted, r), send);
+			}
+			_mm_store_si128((__m128i *)&mixl[i], _mm_add_epi32(_mm_load_si128((const __m128i *)&mixl[i]), l));
+			_mm_store_si128((__m128i *)&mixr[i], _mm_add_epi32(_mm_load_si128((const __m128i *)&mixr[i]), r));
+		}
+#elif defined(AICA_MIX_SIMD)
+		for (; i + 4 <= count; i += 4)
+		{
+			int32x4_t l = vld1q_s32(&oLeft[i]);
+			int32x4_t r = vld1q_s32(&oRight[i]);
+			int32x4_t d = vld1q_s32(&oDsp[i]);
+			vst1q_s32(&dspOut[i], vaddq_s32(vld1q_s32(&dspOut[i]), d));
+			if (!dspEnabled)
+			{
+				uint32x4_t muted = vceqq_s32(vaddq_s32(l, r), vdupq_n_s32(0));
+				int32x4_t send = vshrq_n_s32(d, 4);
+				l = vbslq_s32(muted, send, l);
+				r = vbslq_s32(muted, send, r);
+			}
+			vst1q_s32(&mixl[i], vaddq_s32(vld1q_s32(&mixl[i]), l));
+			vst1q_s32(&mixr[i], vaddq_s32(vld1q_s32(&mixr[i]), r));
+		}
+#endif
+		for (; i < count; i++)
+		{
+			SampleType left = oLeft[i];
+			SampleType right = oRight[i];
+			dspOut[i] += oDsp[i];
+			if (left + right == 0 && !dspEnabled)
+				left = right = oDsp[i] >> 4;
+
+			mixl[i] += left;
+			mixr[i] += right;
+		}
+	}
+
 	void SetAegState(_EG_state newstate)
 	{
 		StepAEG=AEG_STEP_LUT[newstate];
@@ -1355,124 +1433,10 @@ void WriteCommonReg8(u32 reg,u32 data)
 s16 cdda_sector[CDDA_SIZE]={0};
 u32 cdda_index=CDDA_SIZE<<1;
 
-//no DSP for now in this version
-void AICA_Sample32()
+// CDDA input, DSP effects and master volume, then output of the sample
+static void MixOutput(SampleType mixl, SampleType mixr)
 {
-	SampleType mxlr[64];
-	memset(mxlr,0,sizeof(mxlr));
-
-	//Generate 32 samples for each channel, before moving to next channel
-	//much more cache efficient !
-	u32 sg=0;
-	for (int ch = 0; ch < 64; ch++)
-	{
-		for (int i=0;i<32;i++)
-		{
-			SampleType oLeft,oRight,oDsp;
-			//stop working on this channel if its turned off ...
-			if (!Chans[ch].Step(oLeft, oRight, oDsp))
-				break;
-
-			sg++;
-
-			if (oLeft + oRight == 0)
-				oLeft = oRight = oDsp;
-
-			mxlr[i*2+0] += oLeft;
-			mxlr[i*2+1] += oRight;
-		}
-	}
-	//OK , generated all Channels  , now DSP/ect + final mix ;p
 	//CDDA EXTS input
-	
-	for (int i=0;i<32;i++)
-	{
-		SampleType mixl,mixr;
-
-		mixl=mxlr[i*2+0];
-		mixr=mxlr[i*2+1];
-
-		if (cdda_index>=CDDA_SIZE)
-		{
-			cdda_index=0;
-			libCore_CDDA_Sector(cdda_sector);
-		}
-		s32 EXTS0L=cdda_sector[cdda_index];
-		s32 EXTS0R=cdda_sector[cdda_index+1];
-		cdda_index+=2;
-
-		//Final MIX ..
-		//Add CDDA / DSP effect(s)
-
-		//CDDA
-		VOLPAN(EXTS0L, dsp_out_vol[16].EFSDL, dsp_out_vol[16].EFPAN, mixl, mixr);
-		VOLPAN(EXTS0R, dsp_out_vol[17].EFSDL, dsp_out_vol[17].EFPAN, mixl, mixr);
-
-		/*
-		no dsp for now -- needs special handling of oDSP for ch paraller version ...
-		if (config::DSPEnabled)
-		{
-			dsp_step();
-
-			for (int i=0;i<16;i++)
-			{
-				VOLPAN( (*(s16*)&DSPData->EFREG[i]) ,dsp_out_vol[i].EFSDL,dsp_out_vol[i].EFPAN,mixl,mixr);
-			}
-		}
-		*/
-
-		//Mono !
-		if (CommonData->Mono)
-		{
-			//Yay for mono =P
-			mixl+=mixr;
-			mixr=mixl;
-		}
-
-		//MVOL !
-		//we want to make sure mix* is *At least* 23 bits wide here, so 64 bit mul !
-		u32 mvol=CommonData->MVOL;
-		s32 val=volume_lut[mvol];
-		mixl=(s32)FPMul((s64)mixl,val,15);
-		mixr=(s32)FPMul((s64)mixr,val,15);
-
-
-		if (CommonData->DAC18B)
-		{
-			//If 18 bit output , make it 16b :p
-			mixl=FPs(mixl,2);
-			mixr=FPs(mixr,2);
-		}
-
-		//Sample is ready ! clip/saturate and store :}
-
-#ifdef CLIP_WARN
-		if (((s16)mixl) != mixl)
-			printf("Clipped mixl %d\n",mixl);
-		if (((s16)mixr) != mixr)
-			printf("Clipped mixr %d\n",mixr);
-#endif
-
-		clip16(mixl);
-		clip16(mixr);
-
-		if (!settings.input.fastForwardMode && !config::DisableSound)
-			WriteSample(mixr,mixl);
-	}
-}
-
-void AICA_Sample()
-{
-	SampleType mixl,mixr;
-	mixl = 0;
-	mixr = 0;
-	memset(dsp.MIXS,0,sizeof(dsp.MIXS));
-
-	ChannelEx::StepAll(mixl,mixr);
-	
-	//OK , generated all Channels  , now DSP/ect + final mix ;p
-	//CDDA EXTS input
-	
 	if (cdda_index>=CDDA_SIZE)
 	{
 		cdda_index=0;
@@ -1500,7 +1464,7 @@ void AICA_Sample()
 			VOLPAN(*(s16*)&DSPData->EFREG[i], dsp_out_vol[i].EFSDL, dsp_out_vol[i].EFPAN, mixl, mixr);
 	}
 
-	if (settings.input.fastForwardMode || config::DisableSound)
+	if (settings.input.fastForwardMode || settings.aica.muteAudio || config::DisableSound)
 		return;
 
 	//Mono !
@@ -1539,6 +1503,46 @@ void AICA_Sample()
 	WriteSample(mixr,mixl);
 }
 
+/*
+	Generates 32 samples for each channel before moving to the next one: much more cache efficient.
+	Channels don't depend on each other, so the output is the same as 32 calls to AICA_Sample
+	as long as no register is written in between.
+*/
+void AICA_Sample32()
+{
+	alignas(32) static SampleType mixl[32];
+	alignas(32) static SampleType mixr[32];
+	// DSP inputs (MIXS) of each sample
+	alignas(32) static SampleType mixs[16][32];
+	memset(mixl, 0, sizeof(mixl));
+	memset(mixr, 0, sizeof(mixr));
+	memset(mixs, 0, sizeof(mixs));
+
+	for (int ch = 0; ch < 64; ch++)
+		Chans[ch].Step32(mixl, mixr, mixs);
+
+	//OK , generated all Channels  , now DSP/ect + final mix ;p
+	for (int i = 0; i < 32; i++)
+	{
+		for (int j = 0; j < 16; j++)
+			dsp.MIXS[j] = mixs[j][i];
+		MixOutput(mixl[i], mixr[i]);
+	}
+}
+
+void AICA_Sample()
+{
+	SampleType mixl,mixr;
+	mixl = 0;
+	mixr = 0;
+	memset(dsp.MIXS,0,sizeof(dsp.MIXS));
+
+	ChannelEx::StepAll(mixl,mixr);
+	
+	//OK , generated all Channels  , now DSP/ect + final mix ;p
+	MixOutput(mixl, mixr);
+}
+
 bool channel_serialize(void **data, unsigned int *total_size)
 {
 	int i = 0 ;
@@ -4,6 +4,7 @@
 #include "hw/naomi/naomi_cart.h"
 #include "input/gamepad_device.h"
 #include "cfg/option.h"
+#include "gdxsv/gdxsv_rollback.h"
 
 static u8 GetBtFromSgn(s8 val)
 {
@@ -64,7 +65,16 @@ void MapleConfigMap::GetInput(PlainJoystickState* pjs)
 {
 	u32 player_num = playerNum();
 
-	if (settings.platform.system == DC_PLATFORM_DREAMCAST)
+	if (settings.platform.system == DC_PLATFORM_DREAMCAST && gdxsv_rollback.Active())
+	{
+		const RollbackInput& input = gdxsv_rollback.Input(player_num);
+		pjs->kcode = input.kcode;
+		pjs->joy[PJAI_X1] = GetBtFromSgn(input.joyx);
+		pjs->joy[PJAI_Y1] = GetBtFromSgn(input.joyy);
+		pjs->trigger[PJTI_R] = input.rt;
+		pjs->trigger[PJTI_L] = input.lt;
+	}
+	else if (settings.platform.system == DC_PLATFORM_DREAMCAST)
 	{
 		pjs->kcode = kcode[player_num];
 		pjs->joy[PJAI_X1] = GetBtFromSgn(joyx[player_num]);
@@ -1,4 +1,5 @@
 #include "_vmem.h"
+#include "mem_watch.h"
 #include "hw/aica/aica_if.h"
 #include "hw/pvr/pvr_mem.h"
 #include "hw/sh4/dyna/blockmanager.h"
@@ -474,6 +475,7 @@ static void _vmem_term_mappings()
 
 void _vmem_init_mappings()
 {
+	memwatch::disable();
 	_vmem_term_mappings();
 	// Fallback to statically allocated buffers, this results in slow-ops being generated.
 	if (vmemstatus == MemTypeError) {
@@ -678,6 +680,7 @@ void _vmem_unprotect_vram(u32 addr, u32 size)
 	{
 		mem_region_unlock(&vram[addr], size);
 	}
+	memwatch::unprotected(memwatch::Vram, addr, size);
 }
 
 u32 _vmem_get_vram_offset(void *addr)
@@ -0,0 +1,259 @@
+#include "mem_watch.h"
+#include "_vmem.h"
+#include "hw/aica/aica_if.h"
+#include "hw/pvr/pvr_mem.h"
+#include "hw/sh4/sh4_mem.h"
+#include "hw/sh4/dyna/blockmanager.h"
+#include "stdclass.h"
+
+#include <algorithm>
+
+bool VramLockedWriteOffset(size_t offset);
+
+namespace memwatch
+{
+
+struct View
+{
+	u8 *base;
+	u32 size;	// size of the host mapping: the region and its mirrors
+};
+
+static const int MaxViews = 8;
+
+static bool tracking;
+static View views[RegionCount][MaxViews];
+static int viewCount[RegionCount];
+static bool dirty[RegionCount][RAM_SIZE_MAX / PAGE_SIZE];
+
+static_assert(VRAM_SIZE_MAX <= RAM_SIZE_MAX && ARAM_SIZE_MAX <= RAM_SIZE_MAX, "dirty page table too small");
+
+u32 regionSize(Region region)
+{
+	switch (region)
+	{
+	case Ram:
+		return RAM_SIZE;
+	case Vram:
+		return VRAM_SIZE;
+	default:
+		return ARAM_SIZE;
+	}
+}
+
+u8 *regionPtr(Region region)
+{
+	switch (region)
+	{
+	case Ram:
+		return mem_b.data;
+	case Vram:
+		return vram.data;
+	default:
+		return aica_ram.data;
+	}
+}
+
+static void initViews(Region region)
+{
+	View *v = views[region];
+	if (!_nvmem_enabled())
+	{
+		v[0] = { regionPtr(region), regionSize(region) };
+		viewCount[region] = 1;
+		return;
+	}
+	static const u32 ramViews[] = { 0x0C000000, 0x8C000000, 0xAC000000, 0xCC000000 };
+	static const u32 vramViews[] = { 0x04000000, 0x06000000, 0x84000000, 0x86000000, 0xA4000000, 0xA6000000, 0xC4000000, 0xC6000000 };
+	static const u32 aramViews[] = { 0x00800000, 0x02800000, 0x80800000, 0x82800000, 0xA0800000, 0xA2800000, 0xC0800000, 0xC2800000 };
+	const u32 *addresses;
+	u32 size;
+	int count;
+	switch (region)
+	{
+	case Ram:
+		addresses = ramViews;
+		size = 0x04000000;
+		count = _nvmem_4gb_space() ? 4 : 1;
+		break;
+	case Vram:
+		addresses = vramViews;
+		size = 0x01000000;
+		count = _nvmem_4gb_space() ? 8 : 2;
+		break;
+	default:
+		addresses = aramViews;
+		size = 0x00800000;
+		count = 8;
+		if (!_nvmem_4gb_space())
+		{
+			// Area 0 is read-only in the 512MB space, aica ram is written through its own view
+			v[0] = { &virt_ram_base[0x20000000], size };
+			viewCount[region] = 1;
+			return;
+		}
+		break;
+	}
+	for (int i = 0; i < count; i++)
+		v[i] = { virt_ram_base + addresses[i], size };
+	viewCount[region] = count;
+}
+
+static void protect(Region region, u32 addr, u32 size)
+{
+	const u32 regSize = regionSize(region);
+	for (int i = 0; i < viewCount[region]; i++)
+		// Windows can't protect more than one mapping at once, so do each mirror separately
+		for (u32 mirror = 0; mirror < views[region][i].size; mirror += regSize)
+			mem_region_lock(views[region][i].base + mirror + addr, size);
+}
+
+static void unprotect(Region region, u32 addr, u32 size)
+{
+	const u32 regSize = regionSize(region);
+	for (int i = 0; i < viewCount[region]; i++)
+		for (u32 mirror = 0; mirror < views[region][i].size; mirror += regSize)
+			mem_region_unlock(views[region][i].base + mirror + addr, size);
+}
+
+// Protects the clean pages of [first, last)
+static void protectClean(Region region, u32 first, u32 last)
+{
+	u32 start = first;
+	for (u32 page = first; page <= last; page++)
+	{
+		if (page == last || dirty[region][page])
+		{
+			if (page > start)
+				protect(region, start * PAGE_SIZE, (page - start) * PAGE_SIZE);
+			start = page + 1;
+		}
+	}
+}
+
+void enable()
+{
+	if (tracking)
+		disable();
+	for (int r = 0; r < RegionCount; r++)
+	{
+		Region region = (Region)r;
+		initViews(region);
+		memset(dirty[region], 0, sizeof(dirty[region]));
+		protect(region, 0, regionSize(region));
+	}
+	tracking = true;
+}
+
+void disable()
+{
+	if (!tracking)
+		return;
+	tracking = false;
+	// Pages protected by other subsystems are handed back as if they were written to,
+	// since they may now be protected in more views than their owner knows about.
+#if FEAT_SHREC != DYNAREC_NONE
+	for (u32 addr = 0; addr < RAM_SIZE; addr += PAGE_SIZE)
+		if (bm_RamPageHasBlocks(addr))
+			bm_RamWriteAccess(addr);
+#endif
+	for (u32 addr = 0; addr < VRAM_SIZE; addr += PAGE_SIZE)
+		VramLockedWriteOffset(addr);
+	for (int r = 0; r < RegionCount; r++)
+		unprotect((Region)r, 0, regionSize((Region)r));
+}
+
+bool enabled()
+{
+	return tracking;
+}
+
+static void markDirty(Region region, u32 addr, bool notifyCode)
+{
+	dirty[region][addr / PAGE_SIZE] = true;
+	unprotect(region, addr, PAGE_SIZE);
+	// Let the other subsystems know about the write if they protected this page as well
+	if (region == Ram)
+	{
+#if FEAT_SHREC != DYNAREC_NONE
+		if (notifyCode && bm_RamPageHasBlocks(addr))
+			bm_RamWriteAccess(addr);
+#endif
+	}
+	else if (region == Vram)
+	{
+		VramLockedWriteOffset(addr);
+	}
+}
+
+bool writeAccess(void *p)
+{
+	if (!tracking)
+		return false;
+	for (int r = 0; r < RegionCount; r++)
+	{
+		Region region = (Region)r;
+		for (int i = 0; i < viewCount[region]; i++)
+		{
+			const View& view = views[region][i];
+			if ((u8 *)p < view.base || (u8 *)p >= view.base + view.size)
+				continue;
+			u32 addr = (u32)((u8 *)p - view.base) % regionSize(region) & ~PAGE_MASK;
+			if (dirty[region][addr / PAGE_SIZE])
+				// protected by someone else
+				return false;
+			markDirty(region, addr, true);
+			return true;
+		}
+	}
+	return false;
+}
+
+bool touch(Region region, u32 addr)
+{
+	addr &= ~PAGE_MASK;
+	if (!tracking || dirty[region][addr / PAGE_SIZE])
+		return false;
+	markDirty(region, addr, false);
+	return true;
+}
+
+void unprotected(Region region, u32 addr, u32 size)
+{
+	if (!tracking)
+		return;
+	u32 first = addr / PAGE_SIZE;
+	u32 last = std::min(addr + size, regionSize(region));
+	last = (last + PAGE_MASK) / PAGE_SIZE;
+	protectClean(region, first, last);
+}
+
+void collect(Region region, std::vector<u32>& pages)
+{
+	if (!tracking)
+		return;
+	const u32 count = regionSize(region) / PAGE_SIZE;
+	u32 start = 0;
+	bool inRun = false;
+	for (u32 page = 0; page <= count; page++)
+	{
+		bool d = page < count && dirty[region][page];
+		if (d)
+		{
+			dirty[region][page] = false;
+			pages.push_back(page * PAGE_SIZE);
+			if (!inRun)
+			{
+				start = page;
+				inRun = true;
+			}
+		}
+		else if (inRun)
+		{
+			protect(region, start * PAGE_SIZE, (page - start) * PAGE_SIZE);
+			inRun = false;
+		}
+	}
+}
+
+}
@@ -0,0 +1,52 @@
+/*
+	Write tracking of guest memory at page granularity.
+
+	Main RAM, VRAM and AICA RAM are write-protected in every host view (mirrors included).
+	The first write to a page since the last collect() faults, marks the page dirty and unprotects it.
+	Code protection (blockmanager) and texture protection (TexCache) still work on top of it:
+	they are notified of the write when the page was also protected by them.
+*/
+#pragma once
+#include "types.h"
+
+#include <vector>
+
+namespace memwatch
+{
+
+enum Region
+{
+	Ram,
+	Vram,
+	Aram,
+	RegionCount
+};
+
+// Size in bytes of a tracked region
+u32 regionSize(Region region);
+
+// Host pointer to the first view of a tracked region
+u8 *regionPtr(Region region);
+
+// Start tracking: all pages are protected and considered clean
+void enable();
+// Stop tracking and unprotect all pages that aren't protected by another subsystem
+void disable();
+bool enabled();
+
+// Called by the fault handlers. Returns true if the address is a tracked page.
+bool writeAccess(void *p);
+
+// The host is about to write to a page: same as a write access, without the fault.
+// The code cache isn't notified: the caller takes care of it (see bm_SaveCodePages)
+// Returns true if the page was clean and has been unprotected in all the views.
+bool touch(Region region, u32 addr);
+
+// Another subsystem unprotected [addr, addr + size) of a region.
+// Pages that are still clean are protected again.
+void unprotected(Region region, u32 addr, u32 size);
+
+// Appends the offsets of the pages written since the previous call to pages, and protects them again.
+void collect(Region region, std::vector<u32>& pages);
+
+}
@@ -31,7 +31,7 @@ bool pend_rend = false;
 
 TA_context* _pvrrc;
 
-static void dump_frame(const char* file, TA_context* ctx, u8* vram, const u8* vram_ref = NULL) {
+void dump_frame(const char* file, TA_context* ctx, u8* vram, const u8* vram_ref = NULL) {
 	FILE* fw = fopen(file, "wb");
 
 	//append to it
@@ -65,8 +65,8 @@ static void dump_frame(const char* file, TA_context* ctx, u8* vram, const u8* vr
 		}
 	}
 
-	compressed = (u8*)malloc(VRAM_SIZE+16);
-	compressed_size = VRAM_SIZE;
+	compressed_size = compressBound(VRAM_SIZE);
+	compressed = (u8*)malloc(compressed_size);
 	verify(compress(compressed, &compressed_size, src_vram, VRAM_SIZE) == Z_OK);
 	fwrite(&compressed_size, 1, sizeof(compressed_size), fw);
 	fwrite(compressed, 1, compressed_size, fw);
@@ -76,8 +76,8 @@ static void dump_frame(const char* file, TA_context* ctx, u8* vram, const u8* vr
 		free(src_vram);
 
 	fwrite(&bytes, 1, sizeof(t), fw);
-	compressed = (u8*)malloc(bytes + 16);
-	compressed_size = VRAM_SIZE;
+	compressed_size = compressBound(bytes);
+	compressed = (u8*)malloc(compressed_size);
 	verify(compress(compressed, &compressed_size, ctx->tad.thd_root, bytes) == Z_OK);
 	fwrite(&compressed_size, 1, sizeof(compressed_size), fw);
 	fwrite(compressed, 1, compressed_size, fw);
@@ -187,7 +187,7 @@ static bool rend_frame(TA_context* ctx)
 	}
 	bool proc = renderer->Process(ctx);
 
-	if (!proc || (!ctx->rend.isRTT && !ctx->rend.isRenderFramebuffer))
+	if ((!proc || (!ctx->rend.isRTT && !ctx->rend.isRenderFramebuffer)) && !ctx->rend.asyncProcess)
 		// If rendering to texture, continue locking until the frame is rendered
 		re.Set();
 
@@ -239,6 +239,9 @@ bool rend_single_frame(const bool& enabled)
 	//clear up & free data ..
 	FinishRender(_pvrrc);
 	_pvrrc = nullptr;
+	if (rend_framePending())
+		// render the next queued frame without waiting
+		rs.Set();
 
 	return frame_rendered;
 }
@@ -313,7 +316,8 @@ void rend_term_renderer()
 
 void rend_reset()
 {
-	FinishRender(DequeueRender());
+	while (TA_context *ctx = DequeueRender())
+		FinishRender(ctx);
 	do_swap = false;
 	render_called = false;
 	pend_rend = false;
@@ -358,11 +362,14 @@ void rend_start_render()
 			ctx->rend.fog_clamp_max = FOG_CLAMP_MAX;
 		}
 
+		// With a deeper render queue, the emulation only waits for render to texture frames
+		bool async = rend_queueDepth() > 1 && !ctx->rend.isRTT && !ctx->rend.isRenderFramebuffer;
+		ctx->rend.asyncProcess = async;
 		if (QueueRender(ctx))
 		{
 			palette_update();
 			rs.Set();
-			pend_rend = true;
+			pend_rend = !async;
 		}
 	}
 }
@@ -394,6 +401,8 @@ void rend_vblank()
 	check_framebuffer_write();
     cheatManager.apply();
 	gdxsv.Update();
+	if (gdxsv_rollback.Active())
+		gdxsv_rollback.OnVBlank();
 }
 
 void check_framebuffer_write()
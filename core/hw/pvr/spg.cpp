@@ -6,6 +6,7 @@
 #include "input/gamepad_device.h"
 #include "oslib/oslib.h"
 #include "rend/TexCache.h"
+#include "hw/sh4/dyna/ngen.h"
 
 //SPG emulation; Scanline/Raster beam registers & interrupts
 
@@ -137,6 +138,10 @@ int spg_line_sched(int tag, int cycl, int jit)
 				SPG_STATUS.fieldnum=0;
 
 			rend_vblank();
+#if FEAT_SHREC != DYNAREC_NONE
+			rdv_InstallCompiledBlocks();
+			rdv_CompileSuperblocks();
+#endif
 
 			double now = os_GetSeconds() * 1000000.0;
 			cpu_time_idx = (cpu_time_idx + 1) % cpu_cycles.size();
@@ -210,6 +215,15 @@ int spg_line_sched(int tag, int cycl, int jit)
 					spd_vbs/full_rps,mode,res,fullvbs,
 					spd_fps,fskip/ts
 					, mv, mv_c);
+				RenderQueueStats rq = rend_GetQueueStats();
+				if (rend_queueDepth() > 1 && rq.queued != 0)
+				{
+					double occupancy = 0;
+					for (int i = 0; i <= MAX_RENDER_QUEUE; i++)
+						occupancy += (double)i * rq.occupancy[i];
+					INFO_LOG(COMMON, "Render queue: %d frames, %.2f pending on average, %d dropped, %d waits (%.1f ms)",
+						rq.queued, occupancy / rq.queued, rq.dropped, rq.waits, rq.wait_us / 1000.0);
+				}
 				
 				fskip=0;
 				last_fps=os_GetSeconds();
@@ -1,6 +1,7 @@
 #include "ta_ctx.h"
 #include "spg.h"
 #include "cfg/option.h"
+#include "oslib/oslib.h"
 
 extern u32 fskip;
 extern u32 FrameCount;
@@ -9,8 +10,6 @@ static int RenderCount;
 TA_context* ta_ctx;
 tad_context ta_tad;
 
-TA_context*  vd_ctx;
-rend_context vd_rc;
 
 // helper for 32 byte aligned memory allocation
 void* OS_aligned_malloc(size_t align, size_t size)
@@ -68,25 +67,81 @@ void SetCurrentTARC(u32 addr)
 }
 
 static std::mutex mtx_rqueue;
-TA_context* rqueue;
+// Frames waiting to be rendered, oldest first. The first one is in use once dequeued by the renderer.
+static TA_context* rqueue[MAX_RENDER_QUEUE];
+static u32 rqueue_count;
+static bool rqueue_busy;
+static RenderQueueStats rqueue_stats;
 cResetEvent frame_finished;
 
+u32 rend_queueDepth()
+{
+	return std::min(std::max((int)config::RenderQueueDepth, 1), MAX_RENDER_QUEUE);
+}
+
+static bool rqueueFull()
+{
+	std::lock_guard<std::mutex> lock(mtx_rqueue);
+	return rqueue_count >= rend_queueDepth();
+}
+
+// Latency pacing: replaces the oldest frame not in use by the renderer
+static bool rqueueReplace(TA_context* ctx)
+{
+	TA_context* old = nullptr;
+	mtx_rqueue.lock();
+	for (u32 i = rqueue_busy ? 1 : 0; i < rqueue_count; i++)
+	{
+		// the emulation waits until these are processed
+		if (!rqueue[i]->rend.asyncProcess)
+			continue;
+		old = rqueue[i];
+		for (; i + 1 < rqueue_count; i++)
+			rqueue[i] = rqueue[i + 1];
+		rqueue[i] = ctx;
+		break;
+	}
+	mtx_rqueue.unlock();
+	if (old == nullptr)
+		return false;
+
+	tactx_Recycle(old);
+	fskip++;
+	rqueue_stats.dropped++;
+	return true;
+}
+
 bool QueueRender(TA_context* ctx)
 {
 	verify(ctx != 0);
 	
 	bool skipFrame = false;
 	RenderCount++;
-	if (RenderCount % (config::SkipFrame + 1) != 0)
+	if (RenderCount % (config::SkipFrame + 1) != 0 || settings.disableRenderer)
+	{
 		skipFrame = true;
-	else if (rqueue && (config::AutoSkipFrame == 0
-				|| (config::AutoSkipFrame == 1 && SH4FastEnough)))
-		// The previous render hasn't completed yet so we wait.
-		// If autoskipframe is enabled (normal level), we only do so if the CPU is running
-		// fast enough over the last frames
-		frame_finished.Wait();
-
-	if (skipFrame || rqueue)
+	}
+	else if (rqueueFull())
+	{
+		if (config::RenderQueuePacing == 1 && rqueueReplace(ctx))
+		{
+			rqueue_stats.queued++;
+			rqueue_stats.occupancy[rend_queueDepth()]++;
+			return true;
+		}
+		if (config::AutoSkipFrame == 0 || (config::AutoSkipFrame == 1 && SH4FastEnough))
+		{
+			// The previous renders haven't completed yet so we wait.
+			// If autoskipframe is enabled (normal level), we only do so if the CPU is running
+			// fast enough over the last frames
+			double start = os_GetSeconds();
+			frame_finished.Wait();
+			rqueue_stats.waits++;
+			rqueue_stats.wait_us += (u64)((os_GetSeconds() - start) * 1000000.0);
+		}
+	}
+
+	if (skipFrame || rqueueFull())
 	{
 		tactx_Recycle(ctx);
 		fskip++;
@@ -95,11 +150,10 @@ bool QueueRender(TA_context* ctx)
 
 	frame_finished.Reset();
 	mtx_rqueue.lock();
-	TA_context* old = rqueue;
-	rqueue=ctx;
+	rqueue_stats.occupancy[rqueue_count]++;
+	rqueue[rqueue_count++] = ctx;
 	mtx_rqueue.unlock();
-
-	verify(!old);
+	rqueue_stats.queued++;
 
 	return true;
 }
@@ -107,7 +161,8 @@ bool QueueRender(TA_context* ctx)
 TA_context* DequeueRender()
 {
 	mtx_rqueue.lock();
-	TA_context* rv = rqueue;
+	TA_context* rv = rqueue_count != 0 ? rqueue[0] : nullptr;
+	rqueue_busy = rv != nullptr;
 	mtx_rqueue.unlock();
 
 	if (rv)
@@ -118,19 +173,22 @@ TA_context* DequeueRender()
 
 bool rend_framePending() {
 	mtx_rqueue.lock();
-	TA_context* rv = rqueue;
+	u32 count = rqueue_count;
 	mtx_rqueue.unlock();
 
-	return rv != 0;
+	return count != 0;
 }
 
 void FinishRender(TA_context* ctx)
 {
 	if (ctx != NULL)
 	{
-		verify(rqueue == ctx);
 		mtx_rqueue.lock();
-		rqueue = NULL;
+		verify(rqueue_count != 0 && rqueue[0] == ctx);
+		rqueue_count--;
+		for (u32 i = 0; i < rqueue_count; i++)
+			rqueue[i] = rqueue[i + 1];
+		rqueue_busy = false;
 		mtx_rqueue.unlock();
 
 		tactx_Recycle(ctx);
@@ -138,6 +196,13 @@ void FinishRender(TA_context* ctx)
 	frame_finished.Set();
 }
 
+RenderQueueStats rend_GetQueueStats()
+{
+	RenderQueueStats stats = rqueue_stats;
+	rqueue_stats = RenderQueueStats();
+	return stats;
+}
+
 static std::mutex mtx_pool;
 
 static std::vector<TA_context*> ctx_pool;
@@ -168,7 +233,8 @@ void tactx_Recycle(TA_context* poped_ctx)
 {
 	mtx_pool.lock();
 	{
-		if (ctx_pool.size()>2)
+		// enough for the queued frames, the one being rendered and the next ones
+		if (ctx_pool.size() > rend_queueDepth() + 1)
 		{
 			poped_ctx->Free();
 			delete poped_ctx;
@@ -122,6 +122,7 @@ struct rend_context
 	bool Overrun;
 	bool isRTT;
 	bool isRenderFramebuffer;
+	bool asyncProcess;	// the emulation doesn't wait until the frame is processed
 	
 	FB_X_CLIP_type    fb_X_CLIP;
 	FB_Y_CLIP_type    fb_Y_CLIP;
@@ -156,6 +157,35 @@ struct rend_context
 		fZ_min= 1000000.0f;
 		fZ_max= 1.0f;
 		isRenderFramebuffer = false;
+		asyncProcess = false;
+	}
+
+	void Alloc()
+	{
+		verts.InitBytes(4 * 1024 * 1024, &Overrun, "verts");	//up to 4 mb of vtx data/frame = ~ 96k vtx/frame
+		idx.Init(120 * 1024, &Overrun, "idx");					//up to 120K indexes ( idx have stripification overhead )
+		global_param_op.Init(16384, &Overrun, "global_param_op");
+		global_param_pt.Init(5120, &Overrun, "global_param_pt");
+		global_param_mvo.Init(4096, &Overrun, "global_param_mvo");
+		global_param_tr.Init(10240, &Overrun, "global_param_tr");
+		global_param_mvo_tr.Init(4096, &Overrun, "global_param_mvo_tr");
+
+		modtrig.Init(16384, &Overrun, "modtrig");
+
+		render_passes.Init(sizeof(RenderPass) * 10, &Overrun, "render_passes");	// 10 render passes
+	}
+
+	void Free()
+	{
+		verts.Free();
+		idx.Free();
+		global_param_op.Free();
+		global_param_pt.Free();
+		global_param_tr.Free();
+		modtrig.Free();
+		global_param_mvo.Free();
+		global_param_mvo_tr.Free();
+		render_passes.Free();
 	}
 };
 
@@ -202,17 +232,7 @@ struct TA_context
 	{
 		tad.Reset((u8*)OS_aligned_malloc(32, TA_DATA_SIZE));
 
-		rend.verts.InitBytes(4 * 1024 * 1024, &rend.Overrun, "verts");	//up to 4 mb of vtx data/frame = ~ 96k vtx/frame
-		rend.idx.Init(120 * 1024, &rend.Overrun, "idx");				//up to 120K indexes ( idx have stripification overhead )
-		rend.global_param_op.Init(16384, &rend.Overrun, "global_param_op");
-		rend.global_param_pt.Init(5120, &rend.Overrun, "global_param_pt");
-		rend.global_param_mvo.Init(4096, &rend.Overrun, "global_param_mvo");
-		rend.global_param_tr.Init(10240, &rend.Overrun, "global_param_tr");
-		rend.global_param_mvo_tr.Init(4096, &rend.Overrun, "global_param_mvo_tr");
-
-		rend.modtrig.Init(16384, &rend.Overrun, "modtrig");
-		
-		rend.render_passes.Init(sizeof(RenderPass) * 10, &rend.Overrun, "render_passes");	// 10 render passes
+		rend.Alloc();
 
 		Reset();
 	}
@@ -231,15 +251,7 @@ struct TA_context
 	{
 		verify(tad.End() - tad.thd_root <= TA_DATA_SIZE);
 		OS_aligned_free(tad.thd_root);
-		rend.verts.Free();
-		rend.idx.Free();
-		rend.global_param_op.Free();
-		rend.global_param_pt.Free();
-		rend.global_param_tr.Free();
-		rend.modtrig.Free();
-		rend.global_param_mvo.Free();
-		rend.global_param_mvo_tr.Free();
-		rend.render_passes.Free();
+		rend.Free();
 	}
 };
 
@@ -247,9 +259,6 @@ struct TA_context
 extern TA_context* ta_ctx;
 extern tad_context ta_tad;
 
-extern TA_context*  vd_ctx;
-extern rend_context vd_rc;
-
 TA_context* tactx_Find(u32 addr, bool allocnew=false);
 TA_context* tactx_Pop(u32 addr);
 
@@ -269,6 +278,21 @@ bool QueueRender(TA_context* ctx);
 TA_context* DequeueRender();
 void FinishRender(TA_context* ctx);
 
+// Frames can be queued while the renderer is busy, up to config::RenderQueueDepth
+#define MAX_RENDER_QUEUE 4
+u32 rend_queueDepth();
+
+struct RenderQueueStats
+{
+	u32 queued;
+	u32 dropped;		// pending frames replaced by a newer one (latency pacing)
+	u32 occupancy[MAX_RENDER_QUEUE + 1];	// queued frames by number of frames already pending
+	u32 waits;			// the emulation waited for a free slot
+	u64 wait_us;
+};
+// Returns the metrics since the last call
+RenderQueueStats rend_GetQueueStats();
+
 //must be moved to proper header
 void FillBGP(TA_context* ctx);
 bool UsingAutoSort(int pass_number);
@@ -12,16 +12,17 @@
 
 #include <algorithm>
 #include <cmath>
+#include <memory>
+#include <vector>
+#ifndef TARGET_NO_OPENMP
+#include <omp.h>
+#endif
 
-#define TACALL DYNACALL
 #ifdef NDEBUG
 #undef verify
 #define verify(x)
 #endif
 
-//cache state vars
-static u32 tileclip_val = 0;
-
 static u8 f32_su8_tbl[65536];
 #define float_to_satu8(val) f32_su8_tbl[((u32&)val)>>16]
 
@@ -48,35 +49,13 @@ static u8 float_to_satu8_math(float val)
 	return u8(saturate01(val)*255);
 }
 
-//vdec state variables
-static ModTriangle* lmr;
-
-static PolyParam* CurrentPP;
-static List<PolyParam>* CurrentPPlist;
-
-//TA state vars	
-alignas(4) static u8 FaceBaseColor[4];
-alignas(4) static u8 FaceOffsColor[4];
-alignas(4) static u8 FaceBaseColor1[4];
-alignas(4) static u8 FaceOffsColor1[4];
-static u32 SFaceBaseColor;
-static u32 SFaceOffsColor;
-
 //misc ones
 const u32 ListType_None = -1;
 const u32 SZ32 = 1;
 const u32 SZ64 = 2;
 
 #include "ta_structs.h"
-
-typedef Ta_Dma* DYNACALL TaListFP(Ta_Dma* data,Ta_Dma* data_end);
-typedef void TACALL TaPolyParamFP(void* ptr);
-
-static TaListFP* TaCmd;
-	
-static u32 CurrentList;
-static TaListFP* VertexDataFP;
-static bool ListIsFinished[5];
+#include "ta_vtx_simd.h"
 
 static f32 f16(u16 v)
 {
@@ -84,15 +63,47 @@ static f32 f16(u16 v)
 	return *(f32*)&z;
 }
 
-#define vdrc vd_rc
-
 //Splitter function (normally ta_dma_main , modified for split dma's)
+//Each instance is an independent decoder with its own state and output
 
 class FifoSplitter
 {
+public:
+	rend_context vdrc;
+
+private:
+	typedef Ta_Dma* (FifoSplitter::*TaListFP)(Ta_Dma* data,Ta_Dma* data_end);
+	typedef void (FifoSplitter::*TaPolyParamFP)(void* ptr);
+
 	static const u32 *ta_type_lut;
 
-	static void ta_list_start(u32 new_list)
+	//cache state vars
+	u32 tileclip_val = 0;
+
+	//vdec state variables
+	ModTriangle* lmr;
+
+	PolyParam* CurrentPP;
+	List<PolyParam>* CurrentPPlist;
+
+	//TA state vars
+	alignas(4) u8 FaceBaseColor[4];
+	alignas(4) u8 FaceOffsColor[4];
+	alignas(4) u8 FaceBaseColor1[4];
+	alignas(4) u8 FaceOffsColor1[4];
+	u32 SFaceBaseColor;
+	u32 SFaceOffsColor;
+
+	TaListFP TaCmd;
+
+	u32 CurrentList;
+	TaListFP VertexDataFP;
+	bool ListIsFinished[8];		// indexed by the 3-bit list type
+
+	// Texture ids are resolved by the caller after decoding
+	bool deferTextures = false;
+
+	void ta_list_start(u32 new_list)
 	{
 		verify(CurrentList==ListType_None);
 		//verify(ListIsFinished[new_list]==false);
@@ -101,7 +112,7 @@ class FifoSplitter
 		StartList(CurrentList);
 	}
 
-	static Ta_Dma* DYNACALL NullVertexData(Ta_Dma* data,Ta_Dma* data_end)
+	Ta_Dma* NullVertexData(Ta_Dma* data,Ta_Dma* data_end)
 	{
 		INFO_LOG(PVR, "TA: Invalid state, ignoring VTX data");
 		return data+SZ32;
@@ -111,14 +122,14 @@ class FifoSplitter
 	//Poly decoder , will be moved to pvr code
 	template <u32 poly_type,u32 part>
 	__forceinline
-	static Ta_Dma* TACALL ta_handle_poly(Ta_Dma* data,Ta_Dma* data_end)
+	Ta_Dma* ta_handle_poly(Ta_Dma* data,Ta_Dma* data_end)
 	{
 		TA_VertexParam* vp=(TA_VertexParam*)data;
 		u32 rv=0;
 
 		if (part==2)
 		{
-			TaCmd=ta_main;
+			TaCmd=&FifoSplitter::ta_main;
 		}
 
 		switch (poly_type)
@@ -181,26 +192,26 @@ case num : {\
 	//Code Splitter/routers
 		
 	//helper function for dummy dma's.Handles 32B and then switches to ta_main for next data
-	static Ta_Dma* TACALL ta_dummy_32(Ta_Dma* data,Ta_Dma* data_end)
+	Ta_Dma* ta_dummy_32(Ta_Dma* data,Ta_Dma* data_end)
 	{
-		TaCmd=ta_main;
+		TaCmd=&FifoSplitter::ta_main;
 		return data+SZ32;
 	}
-	static Ta_Dma* TACALL ta_modvolB_32(Ta_Dma* data,Ta_Dma* data_end)
+	Ta_Dma* ta_modvolB_32(Ta_Dma* data,Ta_Dma* data_end)
 	{
 		AppendModVolVertexB((TA_ModVolB*)data);
-		TaCmd=ta_main;
+		TaCmd=&FifoSplitter::ta_main;
 		return data+SZ32;
 	}
 		
-	static Ta_Dma* TACALL ta_mod_vol_data(Ta_Dma* data,Ta_Dma* data_end)
+	Ta_Dma* ta_mod_vol_data(Ta_Dma* data,Ta_Dma* data_end)
 	{
 		TA_VertexParam* vp=(TA_VertexParam*)data;
 		if (data==data_end)
 		{
 			AppendModVolVertexA(&vp->mvolA);
 			//32B more needed , 32B done :)
-			TaCmd=ta_modvolB_32;
+			TaCmd=&FifoSplitter::ta_modvolB_32;
 			return data+SZ32;
 		}
 		else
@@ -211,22 +222,22 @@ case num : {\
 			return data+SZ64;
 		}
 	}
-	static Ta_Dma* TACALL ta_spriteB_data(Ta_Dma* data,Ta_Dma* data_end)
+	Ta_Dma* ta_spriteB_data(Ta_Dma* data,Ta_Dma* data_end)
 	{
 		//32B more needed , 32B done :)
-		TaCmd=ta_main;
+		TaCmd=&FifoSplitter::ta_main;
 			
 		AppendSpriteVertexB((TA_Sprite1B*)data);
 
 		return data+SZ32;
 	}
-	static Ta_Dma* TACALL ta_sprite_data(Ta_Dma* data,Ta_Dma* data_end)
+	Ta_Dma* ta_sprite_data(Ta_Dma* data,Ta_Dma* data_end)
 	{
 		verify(data->pcw.ParaType==ParamType_Vertex_Parameter);
 		if (data==data_end)
 		{
 			//32B more needed , 32B done :)
-			TaCmd=ta_spriteB_data;
+			TaCmd=&FifoSplitter::ta_spriteB_data;
 
 			TA_VertexParam* vp=(TA_VertexParam*)data;
 
@@ -245,7 +256,7 @@ case num : {\
 	}
 
 	template <u32 poly_type,u32 poly_size>
-	static Ta_Dma* TACALL ta_poly_data(Ta_Dma* data,Ta_Dma* data_end)
+	Ta_Dma* ta_poly_data(Ta_Dma* data,Ta_Dma* data_end)
 	{
 		verify(data<=data_end);
 
@@ -269,7 +280,7 @@ case num : {\
 		fist_half:
 			ta_handle_poly<poly_type,1>(data,0);
 			if (data->pcw.EndOfStrip) EndPolyStrip();
-			TaCmd=ta_handle_poly<poly_type,2>;
+			TaCmd=&FifoSplitter::ta_handle_poly<poly_type,2>;
 					
 			data+=SZ32;
 		}
@@ -277,13 +288,13 @@ case num : {\
 		return data;
 
 strip_end:
-		TaCmd=ta_main;
+		TaCmd=&FifoSplitter::ta_main;
 		if (data->pcw.EndOfStrip)
 			EndPolyStrip();
 		return data+poly_size;
 	}
 
-	static void TACALL AppendPolyParam2Full(void* vpp)
+	void AppendPolyParam2Full(void* vpp)
 	{
 		Ta_Dma* pp=(Ta_Dma*)vpp;
 
@@ -291,7 +302,7 @@ strip_end:
 		AppendPolyParam2B((TA_PolyParam2B*)&pp[1]);
 	}
 
-	static void TACALL AppendPolyParam4Full(void* vpp)
+	void AppendPolyParam4Full(void* vpp)
 	{
 		Ta_Dma* pp=(Ta_Dma*)vpp;
 
@@ -300,20 +311,20 @@ strip_end:
 	}
 	//Second part of poly data
 	template <int t>
-	static Ta_Dma* TACALL ta_poly_B_32(Ta_Dma* data,Ta_Dma* data_end)
+	Ta_Dma* ta_poly_B_32(Ta_Dma* data,Ta_Dma* data_end)
 	{
 		if (t==2)
 			AppendPolyParam2B((TA_PolyParam2B*)data);
 		else
 			AppendPolyParam4B((TA_PolyParam4B*)data);
 	
-		TaCmd=ta_main;
+		TaCmd=&FifoSplitter::ta_main;
 		return data+SZ32;
 	}
 
 	//Group_En bit seems ignored, thanks p1pkin 
 #define group_EN() /*if (data->pcw.Group_En) */{ TileClipMode(data->pcw.User_Clip); }
-	static Ta_Dma* TACALL ta_main(Ta_Dma* data,Ta_Dma* data_end)
+	Ta_Dma* ta_main(Ta_Dma* data,Ta_Dma* data_end)
 	{
 		do
 		{
@@ -338,7 +349,7 @@ strip_end:
 					//printf("End list %X\n",CurrentList);
 					ListIsFinished[CurrentList]=true;
 					CurrentList=ListType_None;
-					VertexDataFP = NullVertexData;
+					VertexDataFP = &FifoSplitter::NullVertexData;
 					data+=SZ32;
 				}
 				break;
@@ -371,7 +382,7 @@ strip_end:
 					{
 						//accept mod data
 						StartModVol((TA_ModVolParam*)data);
-						VertexDataFP = ta_mod_vol_data;
+						VertexDataFP = &FifoSplitter::ta_mod_vol_data;
 						data+=SZ32;
 					}
 					else
@@ -389,7 +400,7 @@ strip_end:
 						{
 
 							//poly , 32B/64B
-							ta_poly_param_lut[ppid](data);
+							(this->*ta_poly_param_lut[ppid])(data);
 							data+=psz;
 						}
 						else
@@ -397,7 +408,7 @@ strip_end:
 
 							//AppendPolyParam64A((TA_PolyParamA*)data);
 							//64b , first part
-							ta_poly_param_a_lut[ppid](data);
+							(this->*ta_poly_param_a_lut[ppid])(data);
 							//Handle next 32B ;)
 							TaCmd=ta_poly_param_b_lut[ppid];
 							data+=SZ32;
@@ -414,7 +425,7 @@ strip_end:
 					if (CurrentList==ListType_None)
 						ta_list_start(data->pcw.ListType);	//start a list ;)
 
-					VertexDataFP = ta_sprite_data;
+					VertexDataFP = &FifoSplitter::ta_sprite_data;
 					AppendSpriteParam((TA_SpriteParam*)data);
 					data+=SZ32;
 				}
@@ -422,7 +433,7 @@ strip_end:
 
 				//Variable size
 			case ParamType_Vertex_Parameter:
-				data = VertexDataFP(data, data_end);
+				data = (this->*VertexDataFP)(data, data_end);
 				break;
 
 				//not handled
@@ -444,7 +455,7 @@ public:
 	//Fill in lookup table
 	FifoSplitter()
 	{
-		VertexDataFP = NullVertexData;
+		VertexDataFP = &FifoSplitter::NullVertexData;
 		ta_type_lut = TaTypeLut::instance().table;
 	}
 	/*
@@ -627,10 +638,10 @@ public:
 	void vdec_init()
 	{
 		VDECInit();
-		TaCmd = ta_main;
+		TaCmd = &FifoSplitter::ta_main;
 		CurrentList = ListType_None;
-		ListIsFinished[0] = ListIsFinished[1] = ListIsFinished[2] = ListIsFinished[3] = ListIsFinished[4] = false;
-		VertexDataFP = NullVertexData;
+		memset(ListIsFinished, 0, sizeof(ListIsFinished));
+		VertexDataFP = &FifoSplitter::NullVertexData;
 		memset(FaceBaseColor, 0xff, sizeof(FaceBaseColor));
 		memset(FaceOffsColor, 0xff, sizeof(FaceOffsColor));
 		memset(FaceBaseColor1, 0xff, sizeof(FaceBaseColor1));
@@ -640,11 +651,12 @@ public:
 		lmr = NULL;
 		CurrentPP = NULL;
 		CurrentPPlist = NULL;
+		deferTextures = false;
 	}
 		
 private:
 	__forceinline
-		static void SetTileClip(u32 xmin,u32 ymin,u32 xmax,u32 ymax)
+		void SetTileClip(u32 xmin,u32 ymin,u32 xmax,u32 ymax)
 	{
 		u32 rv=tileclip_val & 0xF0000000;
 		rv|=xmin; //6 bits
@@ -655,14 +667,14 @@ private:
 	}
 
 	__forceinline
-		static void TileClipMode(u32 mode)
+		void TileClipMode(u32 mode)
 	{
 		tileclip_val=(tileclip_val&(~0xF0000000)) | (mode<<28);
 	}
 
 	//list handling
 	__forceinline
-		static void StartList(u32 ListType)
+		void StartList(u32 ListType)
 	{
 		if (ListType==ListType_Opaque)
 			CurrentPPlist=&vdrc.global_param_op;
@@ -675,7 +687,7 @@ private:
 	}
 
 	__forceinline
-		static void EndList(u32 ListType)
+		void EndList(u32 ListType)
 	{
 		if (CurrentPP != NULL && CurrentPP->count == 0)
 			CurrentPPlist->PopLast();
@@ -689,7 +701,7 @@ private:
 
 	//Polys  -- update code on sprites if that gets updated too --
 	template<class T>
-	static void glob_param_bdc_(T* pp)
+	void glob_param_bdc_(T* pp)
 	{
 		PolyParam* d_pp = CurrentPP;
 		if (d_pp == NULL || d_pp->count != 0)
@@ -708,7 +720,7 @@ private:
 
 		d_pp->texid = -1;
 
-		if (d_pp->pcw.Texture)
+		if (d_pp->pcw.Texture && !deferTextures)
 			d_pp->texid = renderer->GetTexture(d_pp->tsp,d_pp->tcw);
 
 		d_pp->tsp1.full = -1;
@@ -718,6 +730,10 @@ private:
 
 	#define glob_param_bdc(pp) glob_param_bdc_( (TA_PolyParam0*)pp)
 
+#ifdef TA_VTX_SIMD
+	#define poly_float_color(to,src) \
+		ta_float_color(to,&pp->src##A)
+#else
 	#define poly_float_color_(to,a,r,g,b) \
 		to[0] = float_to_satu8(r);	\
 		to[1] = float_to_satu8(g);	\
@@ -727,12 +743,13 @@ private:
 
 	#define poly_float_color(to,src) \
 		poly_float_color_(to,pp->src##A,pp->src##R,pp->src##G,pp->src##B)
+#endif
 
 	// Poly param handling
 
 	// Packed/Floating Color
 	__forceinline
-		static void TACALL AppendPolyParam0(void* vpp)
+		void AppendPolyParam0(void* vpp)
 	{
 		TA_PolyParam0* pp=(TA_PolyParam0*)vpp;
 
@@ -741,7 +758,7 @@ private:
 
 	// Intensity, no Offset Color
 	__forceinline
-		static void TACALL AppendPolyParam1(void* vpp)
+		void AppendPolyParam1(void* vpp)
 	{
 		TA_PolyParam1* pp=(TA_PolyParam1*)vpp;
 
@@ -751,7 +768,7 @@ private:
 
 	// Intensity, use Offset Color
 	__forceinline
-		static void TACALL AppendPolyParam2A(void* vpp)
+		void AppendPolyParam2A(void* vpp)
 	{
 		TA_PolyParam2A* pp=(TA_PolyParam2A*)vpp;
 
@@ -759,7 +776,7 @@ private:
 	}
 
 	__forceinline
-		static void TACALL AppendPolyParam2B(void* vpp)
+		void AppendPolyParam2B(void* vpp)
 	{
 		TA_PolyParam2B* pp=(TA_PolyParam2B*)vpp;
 
@@ -769,7 +786,7 @@ private:
 
 	// Packed Color, with Two Volumes
 	__forceinline
-		static void TACALL AppendPolyParam3(void* vpp)
+		void AppendPolyParam3(void* vpp)
 	{
 		TA_PolyParam3* pp=(TA_PolyParam3*)vpp;
 
@@ -777,13 +794,13 @@ private:
 
 		CurrentPP->tsp1.full = pp->tsp1.full;
 		CurrentPP->tcw1.full = pp->tcw1.full;
-		if (pp->pcw.Texture)
+		if (pp->pcw.Texture && !deferTextures)
 			CurrentPP->texid1 = renderer->GetTexture(pp->tsp1, pp->tcw1);
 	}
 
 	// Intensity, with Two Volumes
 	__forceinline
-		static void TACALL AppendPolyParam4A(void* vpp)
+		void AppendPolyParam4A(void* vpp)
 	{
 		TA_PolyParam4A* pp=(TA_PolyParam4A*)vpp;
 
@@ -791,12 +808,12 @@ private:
 
 		CurrentPP->tsp1.full = pp->tsp1.full;
 		CurrentPP->tcw1.full = pp->tcw1.full;
-		if (pp->pcw.Texture)
+		if (pp->pcw.Texture && !deferTextures)
 			CurrentPP->texid1 = renderer->GetTexture(pp->tsp1, pp->tcw1);
 	}
 
 	__forceinline
-		static void TACALL AppendPolyParam4B(void* vpp)
+		void AppendPolyParam4B(void* vpp)
 	{
 		TA_PolyParam4B* pp=(TA_PolyParam4B*)vpp;
 
@@ -806,7 +823,7 @@ private:
 
 	//Poly Strip handling
 	__forceinline
-		static void EndPolyStrip()
+		void EndPolyStrip()
 	{
 		CurrentPP->count = vdrc.verts.used() - CurrentPP->first;
 
@@ -822,7 +839,7 @@ private:
 
 
 	
-	static inline void update_fz(float z)
+	inline void update_fz(float z)
 	{
 		if ((s32&)vdrc.fZ_max<(s32&)z && (s32&)z<0x49800000)
 			vdrc.fZ_max=z;
@@ -831,7 +848,7 @@ private:
 		//Poly Vertex handlers
 		//Append vertex base
 	template<class T>
-	static Vertex* vert_cvt_base_(T* vtx)
+	Vertex* vert_cvt_base_(T* vtx)
 	{
 		f32 invW=vtx->xyz[2];
 		Vertex* cv=vdrc.verts.Append();
@@ -854,39 +871,38 @@ private:
 		cv->v = (vtx->v_name);
 
 	#define vert_uv_16(u_name,v_name) \
-		cv->u = f16(vtx->u_name);\
-		cv->v = f16(vtx->v_name);
+		ta_uv16(&cv->u,&vtx->v_name);
 
 	#define vert_uv1_32(u_name,v_name) \
 		cv->u1 = (vtx->u_name);\
 		cv->v1 = (vtx->v_name);
 
 	#define vert_uv1_16(u_name,v_name) \
-		cv->u1 = f16(vtx->u_name);\
-		cv->v1 = f16(vtx->v_name);
+		ta_uv16(&cv->u1,&vtx->v_name);
 
 		//Color conversions
 	#define vert_packed_color_(to,src) \
-		{ \
-		u32 t=src; \
-		to[2] = (u8)(t);t>>=8;\
-		to[1] = (u8)(t);t>>=8;\
-		to[0] = (u8)(t);t>>=8;\
-		to[3] = (u8)(t);      \
-		}
+		ta_packed_color(to,src);
 
+#ifndef TA_VTX_SIMD
 	#define vert_float_color_(to,a,r,g,b) \
 		to[0] = float_to_satu8(r); \
 		to[1] = float_to_satu8(g); \
 		to[2] = float_to_satu8(b); \
 		to[3] = float_to_satu8(a);
+#endif
 
 		//Macros to make thins easier ;)
 	#define vert_packed_color(to,src) \
 		vert_packed_color_(cv->to,vtx->src);
 
+#ifdef TA_VTX_SIMD
+	#define vert_float_color(to,src) \
+		ta_float_color(cv->to,&vtx->src##A);
+#else
 	#define vert_float_color(to,src) \
 		vert_float_color_(cv->to,vtx->src##A,vtx->src##R,vtx->src##G,vtx->src##B)
+#endif
 
 		//Intensity handling
 
@@ -894,40 +910,36 @@ private:
 		//Alpha doesn't get intensity
 		//Intensity is clamped before the mul, as well as on face color to work the same as the hardware. [Fixes red dog]
 
+#ifdef TA_VTX_SIMD
+	#define vert_face_color_(to,face,intensity) \
+		ta_intensity_color(cv->to,face,float_to_satu8(vtx->intensity));
+#else
+	#define vert_face_color_(to,face,intensity) \
+		{ u32 satint=float_to_satu8(vtx->intensity); \
+		cv->to[0] = face[0]*satint/256;  \
+		cv->to[1] = face[1]*satint/256;  \
+		cv->to[2] = face[2]*satint/256;  \
+		cv->to[3] = face[3]; }
+#endif
+
 	#define vert_face_base_color(baseint) \
-		{ u32 satint=float_to_satu8(vtx->baseint); \
-		cv->col[0] = FaceBaseColor[0]*satint/256;  \
-		cv->col[1] = FaceBaseColor[1]*satint/256;  \
-		cv->col[2] = FaceBaseColor[2]*satint/256;  \
-		cv->col[3] = FaceBaseColor[3]; }
+		vert_face_color_(col,FaceBaseColor,baseint)
 
 	#define vert_face_offs_color(offsint) \
-		{ u32 satint=float_to_satu8(vtx->offsint); \
-		cv->spc[0] = FaceOffsColor[0]*satint/256;  \
-		cv->spc[1] = FaceOffsColor[1]*satint/256;  \
-		cv->spc[2] = FaceOffsColor[2]*satint/256;  \
-		cv->spc[3] = FaceOffsColor[3]; }
+		vert_face_color_(spc,FaceOffsColor,offsint)
 
 	#define vert_face_base_color1(baseint) \
-		{ u32 satint=float_to_satu8(vtx->baseint); \
-		cv->col1[0] = FaceBaseColor1[0]*satint/256;  \
-		cv->col1[1] = FaceBaseColor1[1]*satint/256;  \
-		cv->col1[2] = FaceBaseColor1[2]*satint/256;  \
-		cv->col1[3] = FaceBaseColor1[3]; }
+		vert_face_color_(col1,FaceBaseColor1,baseint)
 
 	#define vert_face_offs_color1(offsint) \
-		{ u32 satint=float_to_satu8(vtx->offsint); \
-		cv->spc1[0] = FaceOffsColor1[0]*satint/256;  \
-		cv->spc1[1] = FaceOffsColor1[1]*satint/256;  \
-		cv->spc1[2] = FaceOffsColor1[2]*satint/256;  \
-		cv->spc1[3] = FaceOffsColor1[3]; }
+		vert_face_color_(spc1,FaceOffsColor1,offsint)
 
 	//vert_float_color_(cv->spc,FaceOffsColor[3],FaceOffsColor[0]*satint/256,FaceOffsColor[1]*satint/256,FaceOffsColor[2]*satint/256); }
 
 
 	//(Non-Textured, Packed Color)
 	__forceinline
-		static void AppendPolyVertex0(TA_Vertex0* vtx)
+		void AppendPolyVertex0(TA_Vertex0* vtx)
 	{
 		vert_cvt_base;
 
@@ -936,7 +948,7 @@ private:
 
 	//(Non-Textured, Floating Color)
 	__forceinline
-		static void AppendPolyVertex1(TA_Vertex1* vtx)
+		void AppendPolyVertex1(TA_Vertex1* vtx)
 	{
 		vert_cvt_base;
 
@@ -945,7 +957,7 @@ private:
 
 	//(Non-Textured, Intensity)
 	__forceinline
-		static void AppendPolyVertex2(TA_Vertex2* vtx)
+		void AppendPolyVertex2(TA_Vertex2* vtx)
 	{
 		vert_cvt_base;
 
@@ -954,7 +966,7 @@ private:
 
 	//(Textured, Packed Color)
 	__forceinline
-		static void AppendPolyVertex3(TA_Vertex3* vtx)
+		void AppendPolyVertex3(TA_Vertex3* vtx)
 	{
 		vert_cvt_base;
 
@@ -966,7 +978,7 @@ private:
 
 	//(Textured, Packed Color, 16bit UV)
 	__forceinline
-		static void AppendPolyVertex4(TA_Vertex4* vtx)
+		void AppendPolyVertex4(TA_Vertex4* vtx)
 	{
 		vert_cvt_base;
 
@@ -978,7 +990,7 @@ private:
 
 	//(Textured, Floating Color)
 	__forceinline
-		static void AppendPolyVertex5A(TA_Vertex5A* vtx)
+		void AppendPolyVertex5A(TA_Vertex5A* vtx)
 	{
 		vert_cvt_base;
 
@@ -988,7 +1000,7 @@ private:
 	}
 
 	__forceinline
-		static void AppendPolyVertex5B(TA_Vertex5B* vtx)
+		void AppendPolyVertex5B(TA_Vertex5B* vtx)
 	{
 		vert_res_base;
 
@@ -998,7 +1010,7 @@ private:
 
 	//(Textured, Floating Color, 16bit UV)
 	__forceinline
-		static void AppendPolyVertex6A(TA_Vertex6A* vtx)
+		void AppendPolyVertex6A(TA_Vertex6A* vtx)
 	{
 		vert_cvt_base;
 
@@ -1007,7 +1019,7 @@ private:
 		vert_uv_16(u,v);
 	}
 	__forceinline
-		static void AppendPolyVertex6B(TA_Vertex6B* vtx)
+		void AppendPolyVertex6B(TA_Vertex6B* vtx)
 	{
 		vert_res_base;
 
@@ -1017,7 +1029,7 @@ private:
 
 	//(Textured, Intensity)
 	__forceinline
-		static void AppendPolyVertex7(TA_Vertex7* vtx)
+		void AppendPolyVertex7(TA_Vertex7* vtx)
 	{
 		vert_cvt_base;
 
@@ -1029,7 +1041,7 @@ private:
 
 	//(Textured, Intensity, 16bit UV)
 	__forceinline
-		static void AppendPolyVertex8(TA_Vertex8* vtx)
+		void AppendPolyVertex8(TA_Vertex8* vtx)
 	{
 		vert_cvt_base;
 
@@ -1042,7 +1054,7 @@ private:
 
 	//(Non-Textured, Packed Color, with Two Volumes)
 	__forceinline
-		static void AppendPolyVertex9(TA_Vertex9* vtx)
+		void AppendPolyVertex9(TA_Vertex9* vtx)
 	{
 		vert_cvt_base;
 
@@ -1052,7 +1064,7 @@ private:
 
 	//(Non-Textured, Intensity,	with Two Volumes)
 	__forceinline
-		static void AppendPolyVertex10(TA_Vertex10* vtx)
+		void AppendPolyVertex10(TA_Vertex10* vtx)
 	{
 		vert_cvt_base;
 
@@ -1062,7 +1074,7 @@ private:
 
 	//(Textured, Packed Color,	with Two Volumes)	
 	__forceinline
-		static void AppendPolyVertex11A(TA_Vertex11A* vtx)
+		void AppendPolyVertex11A(TA_Vertex11A* vtx)
 	{
 		vert_cvt_base;
 
@@ -1072,7 +1084,7 @@ private:
 		vert_uv_32(u0,v0);
 	}
 	__forceinline
-		static void AppendPolyVertex11B(TA_Vertex11B* vtx)
+		void AppendPolyVertex11B(TA_Vertex11B* vtx)
 	{
 		vert_res_base;
 
@@ -1084,7 +1096,7 @@ private:
 
 	//(Textured, Packed Color, 16bit UV, with Two Volumes)
 	__forceinline
-		static void AppendPolyVertex12A(TA_Vertex12A* vtx)
+		void AppendPolyVertex12A(TA_Vertex12A* vtx)
 	{
 		vert_cvt_base;
 
@@ -1094,7 +1106,7 @@ private:
 		vert_uv_16(u0,v0);
 	}
 	__forceinline
-		static void AppendPolyVertex12B(TA_Vertex12B* vtx)
+		void AppendPolyVertex12B(TA_Vertex12B* vtx)
 	{
 		vert_res_base;
 
@@ -1106,7 +1118,7 @@ private:
 
 	//(Textured, Intensity,	with Two Volumes)
 	__forceinline
-		static void AppendPolyVertex13A(TA_Vertex13A* vtx)
+		void AppendPolyVertex13A(TA_Vertex13A* vtx)
 	{
 		vert_cvt_base;
 
@@ -1116,7 +1128,7 @@ private:
 		vert_uv_32(u0,v0);
 	}
 	__forceinline
-		static void AppendPolyVertex13B(TA_Vertex13B* vtx)
+		void AppendPolyVertex13B(TA_Vertex13B* vtx)
 	{
 		vert_res_base;
 
@@ -1128,7 +1140,7 @@ private:
 
 	//(Textured, Intensity, 16bit UV, with Two Volumes)
 	__forceinline
-		static void AppendPolyVertex14A(TA_Vertex14A* vtx)
+		void AppendPolyVertex14A(TA_Vertex14A* vtx)
 	{
 		vert_cvt_base;
 
@@ -1138,7 +1150,7 @@ private:
 		vert_uv_16(u0,v0);
 	}
 	__forceinline
-		static void AppendPolyVertex14B(TA_Vertex14B* vtx)
+		void AppendPolyVertex14B(TA_Vertex14B* vtx)
 	{
 		vert_res_base;
 
@@ -1150,7 +1162,7 @@ private:
 
 	//Sprites
 	__forceinline
-		static void AppendSpriteParam(TA_SpriteParam* spr)
+		void AppendSpriteParam(TA_SpriteParam* spr)
 	{
 		//printf("Sprite\n");
 		PolyParam* d_pp=CurrentPP;
@@ -1172,7 +1184,7 @@ private:
 
 		d_pp->texid = -1;
 		
-		if (d_pp->pcw.Texture) {
+		if (d_pp->pcw.Texture && !deferTextures) {
 			d_pp->texid = renderer->GetTexture(d_pp->tsp,d_pp->tcw);
 		}
 		d_pp->tcw1.full = -1;
@@ -1195,7 +1207,7 @@ private:
 
 	//Sprite Vertex Handlers
 	__forceinline
-		static void AppendSpriteVertexA(TA_Sprite1A* sv)
+		void AppendSpriteVertexA(TA_Sprite1A* sv)
 	{
         CurrentPP->count = 4;
 
@@ -1268,7 +1280,7 @@ private:
 		P.v = A_v + k1 * AB_v + k2 * AC_v;
 	}
 	__forceinline
-		static void AppendSpriteVertexB(TA_Sprite1B* sv)
+		void AppendSpriteVertexB(TA_Sprite1B* sv)
 	{
 		vert_res_base;
 		cv-=3;
@@ -1299,7 +1311,7 @@ private:
 
 	// Modifier Volumes Vertex handlers
 	
-	static void EndModVol()
+	void EndModVol()
 	{
 		List<ModifierVolumeParam> *list = NULL;
 		if (CurrentList == ListType_Opaque_Modifier_Volume)
@@ -1319,7 +1331,7 @@ private:
 	}
 
 	//Mod Volume Vertex handlers
-	static void StartModVol(TA_ModVolParam* param)
+	void StartModVol(TA_ModVolParam* param)
 	{
 		EndModVol();
 
@@ -1335,7 +1347,7 @@ private:
 		p->first = vdrc.modtrig.used();
 	}
 	__forceinline
-		static void AppendModVolVertexA(TA_ModVolA* mvv)
+		void AppendModVolVertexA(TA_ModVolA* mvv)
 	{
 		if (CurrentList != ListType_Opaque_Modifier_Volume && CurrentList != ListType_Translucent_Modifier_Volume)
 			return;
@@ -1355,7 +1367,7 @@ private:
 	}
 
 	__forceinline
-		static void AppendModVolVertexB(TA_ModVolB* mvv)
+		void AppendModVolVertexB(TA_ModVolB* mvv)
 	{
 		if (CurrentList != ListType_Opaque_Modifier_Volume && CurrentList != ListType_Translucent_Modifier_Volume)
 			return;
@@ -1364,13 +1376,244 @@ private:
 		//update_fz(mvv->z2);
 	}
 
-	static void VDECInit()
+	void VDECInit()
 	{
-		vd_rc.Clear();
+		vdrc.Clear();
 
 		//allocate storage for BG poly
-		vd_rc.global_param_op.Append();
-		vd_rc.verts.Append(4);
+		vdrc.global_param_op.Append();
+		vdrc.verts.Append(4);
+	}
+
+public:
+	Ta_Dma* parse(Ta_Dma* data, Ta_Dma* data_end)
+	{
+		while (data <= data_end)
+			data = (this->*TaCmd)(data, data_end);
+		return data;
+	}
+
+	//Decoder state that carries over from one list to the next
+	struct State
+	{
+		u32 tileclip;
+		u8 faceColors[4][4];
+	};
+
+	void saveState(State& state) const
+	{
+		state.tileclip = tileclip_val;
+		memcpy(state.faceColors[0], FaceBaseColor, 4);
+		memcpy(state.faceColors[1], FaceOffsColor, 4);
+		memcpy(state.faceColors[2], FaceBaseColor1, 4);
+		memcpy(state.faceColors[3], FaceOffsColor1, 4);
+	}
+
+	void loadState(const State& state)
+	{
+		tileclip_val = state.tileclip;
+		memcpy(FaceBaseColor, state.faceColors[0], 4);
+		memcpy(FaceOffsColor, state.faceColors[1], 4);
+		memcpy(FaceBaseColor1, state.faceColors[2], 4);
+		memcpy(FaceOffsColor1, state.faceColors[3], 4);
+	}
+
+	//Starts decoding a segment into the lists of this decoder, see split()
+	void startSegment(const State& state)
+	{
+		loadState(state);
+		TaCmd = &FifoSplitter::ta_main;
+		CurrentList = ListType_None;
+		VertexDataFP = &FifoSplitter::NullVertexData;
+		SFaceBaseColor = 0;
+		SFaceOffsColor = 0;
+		lmr = NULL;
+		CurrentPP = NULL;
+		CurrentPPlist = NULL;
+		deferTextures = true;
+	}
+
+	struct Segment
+	{
+		Ta_Dma* start;
+		Ta_Dma* end;		//last 32B of the segment
+		u32 pass;
+		State state;		//at the start of the segment
+		u32 modvol_list;	//modifier volume list started by the segment, or ListType_None
+	};
+
+	//Splits the TA data of each render pass into segments that can be decoded independently:
+	//the decoder is idle after an End_Of_List control parameter.
+	//Walks the data like ta_main but only tracks the state, starting from the current state of this decoder.
+	//The state at the end of each pass is returned in pass_states.
+	//Fails if a list continues in the next render pass or the data is invalid.
+	bool split(TA_context* ctx, std::vector<Segment>& segments, std::vector<State>& pass_states)
+	{
+		enum { VtxNone, VtxPoly, VtxSprite, VtxModVol } vtx_type = VtxNone;
+		u32 vtx_size = SZ32;
+		u32 list = ListType_None;
+		bool second_half = false;
+		u32 param_b = 0;		//poly param type if second_half is its 2nd part
+
+		segments.clear();
+		pass_states.clear();
+		for (u32 pass = 0; pass <= ctx->tad.render_pass_count; pass++)
+		{
+			if (list != ListType_None || second_half)
+				return false;
+			ctx->MarkRend(pass);
+			Ta_Dma* data = (Ta_Dma *)ctx->rend.proc_start;
+			Ta_Dma* data_end = (Ta_Dma *)ctx->rend.proc_end - 1;
+
+			Segment segment;
+			segment.start = data;
+			segment.pass = pass;
+			segment.modvol_list = ListType_None;
+			saveState(segment.state);
+			while (data <= data_end)
+			{
+				if (second_half)
+				{
+					if (param_b == 2)
+						AppendPolyParam2B((TA_PolyParam2B*)data);
+					else if (param_b == 4)
+						AppendPolyParam4B((TA_PolyParam4B*)data);
+					second_half = false;
+					param_b = 0;
+					data += SZ32;
+					continue;
+				}
+				switch (data->pcw.ParaType)
+				{
+				case ParamType_End_Of_List:
+					list = ListType_None;
+					vtx_type = VtxNone;
+					data += SZ32;
+					segment.end = data - 1;
+					segments.push_back(segment);
+					segment.start = data;
+					segment.modvol_list = ListType_None;
+					saveState(segment.state);
+					break;
+
+				case ParamType_User_Tile_Clip:
+					SetTileClip(data->data_32[3] & 63, data->data_32[4] & 31, data->data_32[5] & 63, data->data_32[6] & 31);
+					data += SZ32;
+					break;
+
+				case ParamType_Object_List_Set:
+					data += SZ32;
+					break;
+
+				case ParamType_Polygon_or_Modifier_Volume:
+					group_EN();
+					if (list == ListType_None)
+						list = data->pcw.ListType;
+					if (list > ListType_Punch_Through)
+						return false;
+					if (IsModVolList(list))
+					{
+						segment.modvol_list = list;
+						vtx_type = VtxModVol;
+						data += SZ32;
+					}
+					else
+					{
+						u32 uid = ta_type_lut[data->pcw.obj_ctrl];
+						u32 psz = uid >> 30;
+						u32 pdid = (u8)uid;
+						u32 ppid = (u8)(uid >> 8);
+						if (pdid > 14 || ppid > 4)
+							return false;
+						vtx_type = VtxPoly;
+						vtx_size = pdid == 5 || pdid == 6 || pdid >= 11 ? SZ64 : SZ32;
+						if (ppid == 1)
+						{
+							TA_PolyParam1* pp = (TA_PolyParam1*)data;
+							poly_float_color(FaceBaseColor, FaceColor);
+						}
+						if (data != data_end || psz == 1)
+						{
+							if (ppid == 2)
+								AppendPolyParam2B((TA_PolyParam2B*)&data[1]);
+							else if (ppid == 4)
+								AppendPolyParam4B((TA_PolyParam4B*)&data[1]);
+							data += psz;
+						}
+						else
+						{
+							second_half = true;
+							param_b = ppid;
+							data += SZ32;
+						}
+					}
+					break;
+
+				case ParamType_Sprite:
+					group_EN();
+					if (list == ListType_None)
+						list = data->pcw.ListType;
+					if (list > ListType_Punch_Through)
+						return false;
+					vtx_type = VtxSprite;
+					data += SZ32;
+					break;
+
+				case ParamType_Vertex_Parameter:
+					if (vtx_type == VtxNone)
+						data += SZ32;
+					else if (vtx_type != VtxPoly || vtx_size == SZ64)
+					{
+						if (data == data_end)
+						{
+							second_half = true;
+							data += SZ32;
+						}
+						else
+						{
+							data += SZ64;
+							if (vtx_type == VtxPoly)
+							{
+								//same as ta_poly_data
+								while (!(data - SZ64)->pcw.EndOfStrip && data < data_end)
+									data += SZ64;
+								if (!(data - SZ64)->pcw.EndOfStrip && data == data_end)
+								{
+									second_half = true;
+									data += SZ32;
+								}
+							}
+						}
+					}
+					else
+					{
+						do {
+							data += SZ32;
+						} while (!(data - SZ32)->pcw.EndOfStrip && data <= data_end);
+					}
+					break;
+
+				default:
+					return false;
+				}
+			}
+			if (segment.start <= data_end)
+			{
+				segment.end = data_end;
+				segments.push_back(segment);
+			}
+			pass_states.emplace_back();
+			saveState(pass_states.back());
+		}
+		return true;
+	}
+
+	//The texture of polygons with two volumes
+	static bool hasTexture1(const PolyParam& pp)
+	{
+		u32 ppid = (u8)(ta_type_lut[pp.pcw.obj_ctrl] >> 8);
+		return pp.pcw.ParaType == ParamType_Polygon_or_Modifier_Volume && pp.pcw.Texture
+				&& (ppid == 3 || ppid == 4);
 	}
 };
 
@@ -1494,11 +1737,11 @@ static void make_index(const List<PolyParam> *polys, int first, int end, bool me
 	}
 }
 
-static void fix_texture_bleeding(const List<PolyParam> *list)
+static void fix_texture_bleeding(const List<PolyParam> *list, rend_context* ctx)
 {
 	const PolyParam *pp_end = list->LastPtr(0);
-	const u32 *idx_base = vd_rc.idx.head();
-	Vertex *vtx_base = vd_rc.verts.head();
+	const u32 *idx_base = ctx->idx.head();
+	Vertex *vtx_base = ctx->verts.head();
 	for (const PolyParam *pp = list->head(); pp != pp_end; pp++)
 	{
 		if (!pp->pcw.Texture || pp->count < 3)
@@ -1540,13 +1783,226 @@ static void fix_texture_bleeding(const List<PolyParam> *list)
 	}
 }
 
+//
+// Parallel decoding (pvr.ParallelTaParsing)
+// The segments of the TA data are decoded by several decoders on worker threads.
+// Their output is then appended to the context in stream order, which gives the same result as the serial decoding.
+//
+#define MAX_TA_DECODERS 4
+//smaller frames are decoded serially
+#define PARALLEL_TA_MIN_SIZE (64 * 1024)
+
+struct ListCounts
+{
+	u32 verts;
+	u32 modtrig;
+	u32 op;
+	u32 pt;
+	u32 tr;
+	u32 mvo;
+	u32 mvo_tr;
+
+	ListCounts() = default;
+	ListCounts(const rend_context& rc)
+		: verts(rc.verts.used()), modtrig(rc.modtrig.used()),
+		  op(rc.global_param_op.used()), pt(rc.global_param_pt.used()), tr(rc.global_param_tr.used()),
+		  mvo(rc.global_param_mvo.used()), mvo_tr(rc.global_param_mvo_tr.used()) {}
+};
+
+struct SegmentOutput
+{
+	int decoder;
+	ListCounts begin;
+	ListCounts end;
+};
+
+static std::vector<std::unique_ptr<FifoSplitter>> ta_decoders;
+static std::vector<FifoSplitter::Segment> ta_segments;
+static std::vector<SegmentOutput> ta_outputs;
+static std::vector<FifoSplitter::State> ta_pass_states;
+static size_t ta_next_segment;
+
+static int ta_decoder_count()
+{
+#ifdef TARGET_NO_OPENMP
+	return 1;
+#else
+	return std::min(omp_get_max_threads(), MAX_TA_DECODERS);
+#endif
+}
+
+//Decodes the segments of a frame on worker threads.
+//Returns false if the frame must be decoded serially.
+static bool ta_decode_parallel(TA_context* ctx)
+{
+	int count = ta_decoder_count();
+	if (count < 2 || ctx->tad.End() - ctx->tad.thd_root < PARALLEL_TA_MIN_SIZE)
+		return false;
+	while ((int)ta_decoders.size() < count)
+	{
+		ta_decoders.emplace_back(new FifoSplitter());
+		ta_decoders.back()->vdrc.Alloc();
+	}
+	FifoSplitter::State state;
+	TAFifo0.saveState(state);
+	FifoSplitter& scanner = *ta_decoders[0];
+	scanner.loadState(state);
+	if (!scanner.split(ctx, ta_segments, ta_pass_states) || ta_segments.size() < 2)
+		return false;
+	count = std::min(count, (int)ta_segments.size());
+
+	//consecutive segments of about the same size for each decoder
+	size_t total = ctx->tad.End() - ctx->tad.thd_root;
+	size_t size = 0;
+	int decoder = 0;
+	ta_outputs.resize(ta_segments.size());
+	for (size_t i = 0; i < ta_segments.size(); i++)
+	{
+		ta_outputs[i].decoder = decoder;
+		size += (u8 *)(ta_segments[i].end + 1) - (u8 *)ta_segments[i].start;
+		if (size * count >= total * (decoder + 1) && decoder < count - 1)
+			decoder++;
+	}
+	count = decoder + 1;
+
+#pragma omp parallel for num_threads(count) schedule(static, 1)
+	for (int d = 0; d < count; d++)
+	{
+		FifoSplitter& decoder = *ta_decoders[d];
+		decoder.vdrc.Clear();
+		for (size_t i = 0; i < ta_segments.size(); i++)
+		{
+			if (ta_outputs[i].decoder != d)
+				continue;
+			const FifoSplitter::Segment& segment = ta_segments[i];
+			ta_outputs[i].begin = ListCounts(decoder.vdrc);
+			decoder.startSegment(segment.state);
+			decoder.parse(segment.start, segment.end);
+			ta_outputs[i].end = ListCounts(decoder.vdrc);
+		}
+	}
+
+	for (int d = 0; d < count; d++)
+	{
+		const rend_context& rc = ta_decoders[d]->vdrc;
+		if (rc.Overrun)
+			return false;
+		if ((s32&)TAFifo0.vdrc.fZ_max < (s32&)rc.fZ_max)
+			TAFifo0.vdrc.fZ_max = rc.fZ_max;
+	}
+	ta_next_segment = 0;
+
+	return true;
+}
+
+template<typename T>
+static T *append_list(List<T>& to, const List<T>& from, u32 begin, u32 end)
+{
+	int count = end - begin;
+	if (count > to.avail)
+	{
+		to.sig_overrun();
+		return nullptr;
+	}
+	T *p = to.Append(count);
+	memcpy(p, from.head() + begin, count * sizeof(T));
+
+	return p;
+}
+
+//Polygons decoded on worker threads have no texture yet
+static void resolve_textures(PolyParam *pp, const PolyParam *end)
+{
+	const PolyParam *prev = nullptr;
+	for (; pp != end; prev = pp++)
+	{
+		if (!pp->pcw.Texture)
+			continue;
+		//strips of the same polygon use the same texture
+		if (prev != nullptr && prev->pcw.Texture && prev->tsp.full == pp->tsp.full && prev->tcw.full == pp->tcw.full)
+			pp->texid = prev->texid;
+		else
+			pp->texid = renderer->GetTexture(pp->tsp, pp->tcw);
+		if (FifoSplitter::hasTexture1(*pp))
+		{
+			if (prev != nullptr && FifoSplitter::hasTexture1(*prev)
+					&& prev->tsp1.full == pp->tsp1.full && prev->tcw1.full == pp->tcw1.full)
+				pp->texid1 = prev->texid1;
+			else
+				pp->texid1 = renderer->GetTexture(pp->tsp1, pp->tcw1);
+		}
+	}
+}
+
+static bool append_polys(List<PolyParam>& to, const List<PolyParam>& from, u32 begin, u32 end, u32 vtx_base)
+{
+	PolyParam *pp = append_list(to, from, begin, end);
+	if (pp == nullptr)
+		return false;
+	PolyParam *pp_end = pp + (end - begin);
+	for (PolyParam *p = pp; p != pp_end; p++)
+		p->first += vtx_base;
+	resolve_textures(pp, pp_end);
+
+	return true;
+}
+
+static bool append_modvols(List<ModifierVolumeParam>& to, const List<ModifierVolumeParam>& from, u32 begin, u32 end, u32 modtrig_base)
+{
+	ModifierVolumeParam *p = append_list(to, from, begin, end);
+	if (p == nullptr)
+		return false;
+	for (u32 i = begin; i < end; i++, p++)
+		p->first += modtrig_base;
+
+	return true;
+}
+
+//Like EndModVol(), which the first modifier volume of a list calls on the last volume of the previous lists
+static void end_last_modvol(List<ModifierVolumeParam>& list, u32 modtrig_count)
+{
+	if (list.used() > 0)
+	{
+		ModifierVolumeParam *p = list.LastPtr();
+		p->count = modtrig_count - p->first;
+		if (p->count == 0)
+			list.PopLast();
+	}
+}
+
+//Appends the decoded segments of a render pass
+static void ta_append_pass(u32 pass, rend_context& rc)
+{
+	for (; ta_next_segment < ta_segments.size() && ta_segments[ta_next_segment].pass == pass; ta_next_segment++)
+	{
+		const FifoSplitter::Segment& segment = ta_segments[ta_next_segment];
+		const SegmentOutput& out = ta_outputs[ta_next_segment];
+		if (segment.modvol_list == ListType_Opaque_Modifier_Volume)
+			end_last_modvol(rc.global_param_mvo, rc.modtrig.used());
+		else if (segment.modvol_list == ListType_Translucent_Modifier_Volume)
+			end_last_modvol(rc.global_param_mvo_tr, rc.modtrig.used());
+		const rend_context& from = ta_decoders[out.decoder]->vdrc;
+		u32 vtx_base = rc.verts.used() - out.begin.verts;
+		u32 modtrig_base = rc.modtrig.used() - out.begin.modtrig;
+
+		if (append_list(rc.verts, from.verts, out.begin.verts, out.end.verts) == nullptr
+				|| append_list(rc.modtrig, from.modtrig, out.begin.modtrig, out.end.modtrig) == nullptr
+				|| !append_polys(rc.global_param_op, from.global_param_op, out.begin.op, out.end.op, vtx_base)
+				|| !append_polys(rc.global_param_pt, from.global_param_pt, out.begin.pt, out.end.pt, vtx_base)
+				|| !append_polys(rc.global_param_tr, from.global_param_tr, out.begin.tr, out.end.tr, vtx_base)
+				|| !append_modvols(rc.global_param_mvo, from.global_param_mvo, out.begin.mvo, out.end.mvo, modtrig_base)
+				|| !append_modvols(rc.global_param_mvo_tr, from.global_param_mvo_tr, out.begin.mvo_tr, out.end.mvo_tr, modtrig_base))
+			break;
+	}
+	TAFifo0.loadState(ta_pass_states[pass]);
+}
+
 bool ta_parse_vdrc(TA_context* ctx)
 {
 	ctx->rend_inuse.lock();
 	bool rv=false;
-	verify(vd_ctx == 0);
-	vd_ctx = ctx;
-	vd_rc = vd_ctx->rend;
+	rend_context& vd_rc = TAFifo0.vdrc;
+	vd_rc = ctx->rend;
 
 	TAFifo0.vdec_init();
 
@@ -1561,6 +2017,7 @@ bool ta_parse_vdrc(TA_context* ctx)
 		bgpp->texid = renderer->GetTexture(bgpp->tsp, bgpp->tcw);
 		empty_context = false;
 	}
+	bool parallel = config::ParallelTaParsing && ta_decode_parallel(ctx);
 
 	for (u32 pass = 0; pass <= ctx->tad.render_pass_count; pass++)
 	{
@@ -1568,11 +2025,10 @@ bool ta_parse_vdrc(TA_context* ctx)
 		vd_rc.proc_start = ctx->rend.proc_start;
 		vd_rc.proc_end = ctx->rend.proc_end;
 
-		Ta_Dma* ta_data = (Ta_Dma *)vd_rc.proc_start;
-		Ta_Dma* ta_data_end = (Ta_Dma *)vd_rc.proc_end - 1;
-
-		while (ta_data <= ta_data_end)
-			ta_data = TaCmd(ta_data, ta_data_end);
+		if (parallel)
+			ta_append_pass(pass, vd_rc);
+		else
+			TAFifo0.parse((Ta_Dma *)vd_rc.proc_start, (Ta_Dma *)vd_rc.proc_end - 1);
 
 		if (ctx->rend.Overrun)
 			break;
@@ -1610,9 +2066,9 @@ bool ta_parse_vdrc(TA_context* ctx)
 		WARN_LOG(PVR, "ERROR: TA context overrun");
 	else if (config::RenderResolution > 480)
 	{
-		fix_texture_bleeding(&vd_rc.global_param_op);
-		fix_texture_bleeding(&vd_rc.global_param_pt);
-		fix_texture_bleeding(&vd_rc.global_param_tr);
+		fix_texture_bleeding(&vd_rc.global_param_op, &vd_rc);
+		fix_texture_bleeding(&vd_rc.global_param_pt, &vd_rc);
+		fix_texture_bleeding(&vd_rc.global_param_tr, &vd_rc);
 	}
 	if (rv && !overrun)
 	{
@@ -1624,8 +2080,7 @@ bool ta_parse_vdrc(TA_context* ctx)
 		vd_rc.fb_Y_CLIP.max = std::min(vd_rc.fb_Y_CLIP.max, ymax + 31);
 	}
 
-	vd_ctx->rend = vd_rc;
-	vd_ctx = 0;
+	ctx->rend = vd_rc;
 	ctx->rend_inuse.unlock();
 
 	ctx->rend.Overrun = overrun;
@@ -0,0 +1,74 @@
+/*
+	Color and texture coordinate conversions of the TA vertex and polygon parameters.
+	They give the same results as the per-component code in ta_vtx.cpp.
+	The floating point colors are converted 4 components at a time with SSE2 or NEON when available (TA_VTX_SIMD).
+*/
+#pragma once
+#include "types.h"
+
+#if HOST_CPU == CPU_X64 || (HOST_CPU == CPU_X86 && defined(__SSE2__))
+#include <emmintrin.h>
+#define TA_VTX_SIMD
+#elif HOST_CPU == CPU_ARM64 || (HOST_CPU == CPU_ARM && defined(__ARM_NEON__))
+#include <arm_neon.h>
+#define TA_VTX_SIMD
+#endif
+
+#ifdef TA_VTX_SIMD
+// Clamps the A, R, G, B floats to [0, 1] and stores them as R, G, B, A bytes.
+// Like the f32_su8_tbl lookup table, only the upper 16 bits of each float are used.
+static inline void ta_float_color(u8 *to, const f32 *argb)
+{
+#if HOST_CPU == CPU_X64 || HOST_CPU == CPU_X86
+	__m128i v = _mm_and_si128(_mm_loadu_si128((const __m128i *)argb), _mm_set1_epi32(0xffff0000));
+	v = _mm_shuffle_epi32(v, _MM_SHUFFLE(0, 3, 2, 1));
+	// compared as integers: above 1.0 (including NaNs) is 1.0 and negative is 0
+	const __m128i one = _mm_set1_epi32(0x3f800000);
+	__m128i above = _mm_cmpgt_epi32(v, one);
+	v = _mm_or_si128(_mm_andnot_si128(above, v), _mm_and_si128(above, one));
+	v = _mm_andnot_si128(_mm_srai_epi32(v, 31), v);
+	__m128i i = _mm_cvttps_epi32(_mm_mul_ps(_mm_castsi128_ps(v), _mm_set1_ps(255.f)));
+	i = _mm_packs_epi32(i, i);
+	*(u32 *)to = _mm_cvtsi128_si32(_mm_packus_epi16(i, i));
+#else
+	uint32x4_t v = vandq_u32(vld1q_u32((const u32 *)argb), vdupq_n_u32(0xffff0000));
+	v = vextq_u32(v, v, 1);
+	// compared as integers: above 1.0 (including NaNs) is 1.0 and negative is 0
+	int32x4_t s = vminq_s32(vreinterpretq_s32_u32(v), vdupq_n_s32(0x3f800000));
+	s = vmaxq_s32(s, vdupq_n_s32(0));
+	uint32x4_t i = vcvtq_u32_f32(vmulq_n_f32(vreinterpretq_f32_s32(s), 255.f));
+	uint16x4_t h = vmovn_u32(i);
+	uint8x8_t b = vmovn_u16(vcombine_u16(h, h));
+	vst1_lane_u32((u32 *)to, vreinterpret_u32_u8(b), 0);
+#endif
+}
+
+// Scales the R, G, B components of the face color by the intensity. Alpha is unchanged.
+static inline void ta_intensity_color(u8 *to, const u8 *face, u32 intensity)
+{
+	u32 color = *(const u32 *)face;
+#if HOST_CPU == CPU_X64 || HOST_CPU == CPU_X86
+	__m128i c = _mm_unpacklo_epi8(_mm_cvtsi32_si128(color), _mm_setzero_si128());
+	c = _mm_srli_epi16(_mm_mullo_epi16(c, _mm_set1_epi16((s16)intensity)), 8);
+	u32 rgb = _mm_cvtsi128_si32(_mm_packus_epi16(c, c));
+#else
+	uint16x8_t c = vmull_u8(vreinterpret_u8_u32(vdup_n_u32(color)), vdup_n_u8((u8)intensity));
+	u32 rgb = vget_lane_u32(vreinterpret_u32_u8(vshrn_n_u16(c, 8)), 0);
+#endif
+	*(u32 *)to = (rgb & 0x00ffffff) | (color & 0xff000000);
+}
+#endif
+
+// Stores a packed ARGB color as R, G, B, A bytes
+static inline void ta_packed_color(u8 *to, u32 argb)
+{
+	*(u32 *)to = (argb & 0xff00ff00) | ((argb >> 16) & 0xff) | ((argb & 0xff) << 16);
+}
+
+// Expands the 16-bit texture coordinates. They are stored in the opposite order: v first, then u.
+static inline void ta_uv16(f32 *uv, const u16 *vu)
+{
+	u32 packed = *(const u32 *)vu;
+	*(u32 *)&uv[0] = packed & 0xffff0000;
+	*(u32 *)&uv[1] = packed << 16;
+}
@@ -0,0 +1,153 @@
+#include "asynccompile.h"
+#include "blockcache.h"
+#include "ngen.h"
+#include "hw/sh4/sh4_mem.h"
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+#if FEAT_SHREC != DYNAREC_NONE
+
+namespace
+{
+
+// The guest memory that must not change while a block is decoded: the first pages of the block
+const u32 StablePages = 3;
+
+struct Request
+{
+	u32 addr;
+	fpscr_t fpu_cfg;
+	bool readOnly;
+};
+
+std::mutex mutex;
+std::condition_variable cond;		// new request or exit
+std::condition_variable idleCond;	// the worker thread is idle
+std::deque<Request> requests;
+std::deque<AsyncResult> results;
+bool busy;
+bool exiting;
+std::thread thread;
+
+void decode(const Request& request, AsyncResult& result)
+{
+	result.addr = request.addr;
+	result.block = nullptr;
+
+	// The guest code keeps running and may modify the code being decoded
+	u32 start = request.addr & ~PAGE_MASK;
+	u32 size = std::min(StablePages * PAGE_SIZE, RAM_SIZE - (start & RAM_MASK));
+	u64 hash = bc_HashMemory(start, size);
+
+	RuntimeBlockInfo *block = ngen_AllocateBlock();
+	// The protection of the code pages belongs to the cpu thread
+	block->read_only = request.readOnly;
+	if (!block->Setup(request.addr, request.fpu_cfg, DM_Background)
+			|| !bc_Dependencies(block->addr, block->sh4_code_size, block->read_only, result.depStart, result.depSize)
+			|| result.depStart < start || result.depStart + result.depSize > start + size)
+	{
+		ac_DeleteBlock(block);
+		return;
+	}
+	result.depHash = bc_HashMemory(result.depStart, result.depSize);
+	if (bc_HashMemory(start, size) != hash)
+	{
+		ac_DeleteBlock(block);
+		return;
+	}
+	result.block = block;
+}
+
+void run()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	for (;;)
+	{
+		cond.wait(lock, []() { return exiting || !requests.empty(); });
+		if (exiting)
+			break;
+		Request request = requests.front();
+		requests.pop_front();
+		busy = true;
+		lock.unlock();
+
+		AsyncResult result;
+		decode(request, result);
+
+		lock.lock();
+		busy = false;
+		results.push_back(result);
+		idleCond.notify_all();
+	}
+}
+
+}
+
+void ac_Request(u32 addr, fpscr_t fpu_cfg, bool readOnly)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	if (!thread.joinable())
+	{
+		exiting = false;
+		thread = std::thread(run);
+	}
+	requests.push_back({ addr, fpu_cfg, readOnly });
+	cond.notify_one();
+}
+
+bool ac_GetResult(AsyncResult& result)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	if (results.empty())
+		return false;
+	result = results.front();
+	results.pop_front();
+	return true;
+}
+
+u32 ac_Pending()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return (u32)requests.size() + busy;
+}
+
+void ac_Flush()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	idleCond.wait(lock, []() { return requests.empty() && !busy; });
+}
+
+void ac_Reset()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	requests.clear();
+	idleCond.wait(lock, []() { return !busy; });
+	for (AsyncResult& result : results)
+		if (result.block != nullptr)
+			ac_DeleteBlock(result.block);
+	results.clear();
+}
+
+void ac_DeleteBlock(RuntimeBlockInfo *block)
+{
+	// Not accounted for by the block manager
+	block->sh4_code_size = 0;
+	delete block;
+}
+
+void ac_Term()
+{
+	ac_Reset();
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		exiting = true;
+		cond.notify_one();
+	}
+	if (thread.joinable())
+		thread.join();
+}
+
+#endif // FEAT_SHREC != DYNAREC_NONE
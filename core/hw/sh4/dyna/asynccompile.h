@@ -0,0 +1,39 @@
+/*
+	Background compilation of dynarec blocks.
+
+	On a miss, the cpu thread only generates a baseline block calling the interpreter for each
+	non-branch instruction, which is much quicker than decoding and optimizing it.
+	A worker thread then decodes and optimizes the block, and the cpu thread replaces the baseline
+	block with it (rdv_InstallCompiledBlocks) if the guest code hasn't changed in the meantime.
+	Host code generation and the block manager are only used by the cpu thread.
+	Disabled when the mmu is enabled.
+*/
+#pragma once
+#include "types.h"
+#include "blockmanager.h"
+
+struct AsyncResult
+{
+	u32 addr;
+	// nullptr if the block couldn't be compiled in the background
+	RuntimeBlockInfo *block;
+	// guest memory read while decoding and optimizing the block
+	u32 depStart;
+	u32 depSize;
+	u64 depHash;
+};
+
+// Queues the decoding of the block at addr, which must be in system RAM.
+// The block is decoded as read_only if readOnly. This is checked again when it's installed.
+void ac_Request(u32 addr, fpscr_t fpu_cfg, bool readOnly);
+// Gets the next decoded block. Returns false if there is none.
+bool ac_GetResult(AsyncResult& result);
+// Number of requests not processed yet
+u32 ac_Pending();
+// Waits until all the queued blocks have been decoded
+void ac_Flush();
+// Drops the queued requests and the results, and waits for the worker thread to be idle
+void ac_Reset();
+// Deletes a block decoded in the background that isn't installed
+void ac_DeleteBlock(RuntimeBlockInfo *block);
+void ac_Term();
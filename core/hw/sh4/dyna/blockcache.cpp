@@ -0,0 +1,241 @@
+#include "blockcache.h"
+#include "hw/sh4/sh4_core.h"
+#include "hw/sh4/sh4_mem.h"
+#include "hw/sh4/modules/mmu.h"
+#include "cfg/option.h"
+#include "archive/rzip.h"
+#include "version.h"
+
+#include <unordered_map>
+#include <xxhash.h>
+
+#if FEAT_SHREC != DYNAREC_NONE
+
+namespace
+{
+
+const char Magic[8] = { 'F', 'C', 'B', 'L', 'K', 'C', 1, 0 };
+// Entries are only valid for the build that created them
+const char BuildId[] = GIT_HASH " " BUILD_DATE;
+const u32 MaxEntries = 128 * 1024;
+// Different code compiled at the same address (overlays)
+const u32 MaxEntriesPerKey = 4;
+
+struct EntryInfo
+{
+	u32 depStart;		// guest memory read while decoding and optimizing the block
+	u32 depSize;
+	u64 depHash;
+
+	u32 sh4_code_size;
+	u32 guest_cycles;
+	u32 guest_opcodes;
+	u32 BranchBlock;
+	u32 NextBlock;
+	u32 BlockType;
+	u8 has_fpu_op;
+	u8 has_jcond;
+	u8 read_only;
+	u8 _pad;
+	u32 opcount;
+};
+
+struct Entry
+{
+	EntryInfo info;
+	std::vector<shil_opcode> oplist;
+};
+
+std::unordered_map<u64, std::vector<Entry>> entries;
+u32 entryCount;
+
+u64 makeKey(const RuntimeBlockInfo *block)
+{
+	u32 flags = block->fpu_cfg.PR
+			| block->fpu_cfg.SZ << 1
+			| (block->fpu_cfg.RM == 1) << 2
+			| (bool)config::DynarecSafeMode << 3
+			| (bool)config::DynarecIdleSkip << 4;
+	return (u64)block->vaddr << 32 | flags;
+}
+
+bool enabled()
+{
+	return config::DynarecBlockCache && !mmu_enabled();
+}
+
+}
+
+// The decoder looks ahead of the block to match division sequences,
+// and the optimizer reads constants and branch targets in the block pages when they are protected.
+bool bc_Dependencies(u32 addr, u32 size, bool readOnly, u32& start, u32& depSize)
+{
+	start = addr;
+	u32 end = addr + size + 128;
+	if (readOnly)
+	{
+		start &= ~PAGE_MASK;
+		end = std::max(end, ((addr + size - 1) | PAGE_MASK) + 1);
+	}
+	depSize = end - start;
+	// System RAM only
+	return (start >> 29) != 7 && ((start >> 26) & 7) == 3
+			&& (start & RAM_MASK) + depSize <= RAM_SIZE;
+}
+
+u64 bc_HashMemory(u32 start, u32 size)
+{
+	return XXH64(&mem_b[start & RAM_MASK], size, 0);
+}
+
+bool bc_Lookup(RuntimeBlockInfo *block, bool assumeReadOnly)
+{
+	if (!enabled())
+		return false;
+	auto it = entries.find(makeKey(block));
+	if (it == entries.end())
+		return false;
+	for (const Entry& entry : it->second)
+	{
+		const EntryInfo& info = entry.info;
+		bool readOnly = assumeReadOnly ? block->read_only : bm_IsCodeProtectable(block->addr, info.sh4_code_size);
+		if (readOnly != (bool)info.read_only)
+			continue;
+		if (bc_HashMemory(info.depStart, info.depSize) != info.depHash)
+			continue;
+		if (info.has_fpu_op && sr.FD == 1)
+			// let the decoder raise the exception
+			return false;
+		block->sh4_code_size = info.sh4_code_size;
+		block->guest_cycles = info.guest_cycles;
+		block->guest_opcodes = info.guest_opcodes;
+		block->BranchBlock = info.BranchBlock;
+		block->NextBlock = info.NextBlock;
+		block->BlockType = (BlockEndType)info.BlockType;
+		block->has_fpu_op = info.has_fpu_op;
+		block->has_jcond = info.has_jcond;
+		block->oplist = entry.oplist;
+		return true;
+	}
+	return false;
+}
+
+void bc_Add(const RuntimeBlockInfo *block)
+{
+	if (!enabled() || entryCount >= MaxEntries)
+		return;
+	Entry entry;
+	EntryInfo& info = entry.info;
+	memset(&info, 0, sizeof(info));
+	if (!bc_Dependencies(block->addr, block->sh4_code_size, block->read_only, info.depStart, info.depSize))
+		return;
+	info.depHash = bc_HashMemory(info.depStart, info.depSize);
+	info.sh4_code_size = block->sh4_code_size;
+	info.guest_cycles = block->guest_cycles;
+	info.guest_opcodes = block->guest_opcodes;
+	info.BranchBlock = block->BranchBlock;
+	info.NextBlock = block->NextBlock;
+	info.BlockType = block->BlockType;
+	info.has_fpu_op = block->has_fpu_op;
+	info.has_jcond = block->has_jcond;
+	info.read_only = block->read_only;
+	info.opcount = (u32)block->oplist.size();
+	entry.oplist = block->oplist;
+
+	std::vector<Entry>& list = entries[makeKey(block)];
+	for (const Entry& e : list)
+		if (e.info.depHash == info.depHash && e.info.read_only == info.read_only)
+			return;
+	if (list.size() >= MaxEntriesPerKey)
+	{
+		list.erase(list.begin());
+		entryCount--;
+	}
+	list.push_back(std::move(entry));
+	entryCount++;
+}
+
+void bc_Clear()
+{
+	entries.clear();
+	entryCount = 0;
+}
+
+bool bc_Load(const std::string& path)
+{
+	bc_Clear();
+	RZipFile file;
+	if (!file.Open(path, false))
+		return false;
+	char magic[sizeof(Magic)];
+	char buildId[sizeof(BuildId)];
+	u32 opcodeSize;
+	u32 count;
+	if (file.Read(magic, sizeof(magic)) != sizeof(magic) || memcmp(magic, Magic, sizeof(magic))
+			|| file.Read(buildId, sizeof(buildId)) != sizeof(buildId) || memcmp(buildId, BuildId, sizeof(buildId))
+			|| file.Read(&opcodeSize, sizeof(opcodeSize)) != sizeof(opcodeSize) || opcodeSize != sizeof(shil_opcode)
+			|| file.Read(&count, sizeof(count)) != sizeof(count))
+	{
+		INFO_LOG(DYNAREC, "Block cache %s is from another version", path.c_str());
+		return false;
+	}
+	for (u32 i = 0; i < count && entryCount < MaxEntries; i++)
+	{
+		u64 key;
+		Entry entry;
+		if (file.Read(&key, sizeof(key)) != sizeof(key)
+				|| file.Read(&entry.info, sizeof(entry.info)) != sizeof(entry.info)
+				|| entry.info.opcount > BLOCK_MAX_SH_OPS_HARD)
+		{
+			bc_Clear();
+			return false;
+		}
+		entry.oplist.resize(entry.info.opcount);
+		size_t size = entry.oplist.size() * sizeof(shil_opcode);
+		if (file.Read(entry.oplist.data(), size) != size)
+		{
+			bc_Clear();
+			return false;
+		}
+		std::vector<Entry>& list = entries[key];
+		if (list.size() < MaxEntriesPerKey)
+		{
+			list.push_back(std::move(entry));
+			entryCount++;
+		}
+	}
+	INFO_LOG(DYNAREC, "Block cache: %d blocks loaded from %s", entryCount, path.c_str());
+
+	return true;
+}
+
+bool bc_Save(const std::string& path)
+{
+	if (entryCount == 0)
+		return true;
+	RZipFile file;
+	if (!file.Open(path, true, RZipFile::Fast))
+		return false;
+	file.Write(Magic, sizeof(Magic));
+	file.Write(BuildId, sizeof(BuildId));
+	u32 opcodeSize = sizeof(shil_opcode);
+	file.Write(&opcodeSize, sizeof(opcodeSize));
+	file.Write(&entryCount, sizeof(entryCount));
+	for (const auto& it : entries)
+		for (const Entry& entry : it.second)
+		{
+			file.Write(&it.first, sizeof(it.first));
+			file.Write(&entry.info, sizeof(entry.info));
+			file.Write(entry.oplist.data(), entry.oplist.size() * sizeof(shil_opcode));
+		}
+	if (!file.Close())
+	{
+		WARN_LOG(DYNAREC, "Error writing block cache %s", path.c_str());
+		return false;
+	}
+	INFO_LOG(DYNAREC, "Block cache: %d blocks saved to %s", entryCount, path.c_str());
+
+	return true;
+}
+
+#endif // FEAT_SHREC != DYNAREC_NONE
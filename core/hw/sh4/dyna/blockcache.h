@@ -0,0 +1,27 @@
+/*
+	Persistent cache of decoded and optimized blocks.
+
+	The shil opcodes of a block are saved after the SSA passes, and reused when the same guest code
+	is compiled again, in this session or the next one. Host code is still generated for each block.
+	An entry is only used if the guest memory read while decoding and optimizing it is unchanged,
+	as well as the fpscr bits, the protection of the block and the dynarec options affecting the decoder.
+	Disabled when the mmu is enabled.
+*/
+#pragma once
+#include "types.h"
+#include "blockmanager.h"
+
+// Sets up the block from the cache. The block vaddr, addr and fpu_cfg must be set.
+// If assumeReadOnly, the entry must have been compiled with the block read_only value instead of
+// the current protection of its code, which only the cpu thread can check.
+bool bc_Lookup(RuntimeBlockInfo *block, bool assumeReadOnly = false);
+// Adds a block that has just been decoded and optimized
+void bc_Add(const RuntimeBlockInfo *block);
+
+bool bc_Load(const std::string& path);
+bool bc_Save(const std::string& path);
+void bc_Clear();
+
+// Range of guest memory read while decoding and optimizing a block. Returns false if it isn't in system RAM.
+bool bc_Dependencies(u32 addr, u32 size, bool readOnly, u32& start, u32& depSize);
+u64 bc_HashMemory(u32 start, u32 size);
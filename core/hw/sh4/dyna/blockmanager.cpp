@@ -4,8 +4,7 @@
 */
 
 #include <algorithm>
-#include <set>
-#include <map>
+#include <mutex>
 #include "blockmanager.h"
 #include "ngen.h"
 
@@ -13,7 +12,12 @@
 #include "hw/sh4/sh4_mem.h"
 #include "hw/sh4/sh4_opcode_list.h"
 #include "hw/sh4/sh4_sched.h"
-
+#include "hw/mem/mem_watch.h"
+#include "profiler/profiler.h"
+#include <xxhash.h>
+#if defined(__unix__)
+#include <unistd.h>
+#endif
 
 #if defined(__unix__) && defined(DYNA_OPROF)
 #include <opagent.h>
@@ -24,16 +28,121 @@ op_agent_t          oprofHandle;
 
 
 typedef std::vector<RuntimeBlockInfoPtr> bm_List;
-typedef std::set<RuntimeBlockInfoPtr> bm_Set;
-typedef std::map<void*, RuntimeBlockInfoPtr> bm_Map;
 
-static bm_Set all_temp_blocks;
 static bm_List del_blocks;
 
 bool unprotected_pages[RAM_SIZE_MAX/PAGE_SIZE];
-static std::set<RuntimeBlockInfo*> blocks_per_page[RAM_SIZE_MAX/PAGE_SIZE];
+// Lists of the write protected blocks of each page, linked through RuntimeBlockInfo::page_links
+static RuntimeBlockInfo *blocks_per_page[RAM_SIZE_MAX/PAGE_SIZE];
+u8 locked_pages[RAM_SIZE_MAX/PAGE_SIZE];
+// Chunks of each page holding protected code, one bit per SMC_CHUNK_SIZE bytes.
+// Bits of discarded blocks are only cleared when the page is written.
+static u64 code_chunks[RAM_SIZE_MAX/PAGE_SIZE];
+
+// Blocks by host code address. The code cache is divided in slices holding the blocks starting there,
+// sorted by address. The last one holds the blocks whose code is outside the code cache (cpp dynarec).
+#define CODE_SLICE_SIZE 4096
+#define CODE_SLICES ((CODE_SIZE + TEMP_CODE_SIZE) / CODE_SLICE_SIZE + 1)
+static bm_List code_slices[CODE_SLICES];
+static u32 block_count;
+
+/*
+	Blocks are allocated and freed on every compilation and invalidation, by the cpu thread and
+	the background compiler. They are carved from chunks, and recycled by size.
+*/
+class BlockPool
+{
+public:
+	void *alloc(size_t size)
+	{
+		size_t sizeClass = (size + Granularity - 1) / Granularity;
+		if (sizeClass >= Classes)
+			return ::operator new(size);
+		std::lock_guard<std::mutex> lock(mutex);
+		FreeItem *&head = freeLists[sizeClass];
+		if (head == nullptr)
+		{
+			u8 *chunk = (u8 *)::operator new(sizeClass * Granularity * ChunkItems);
+			for (u32 i = 0; i < ChunkItems; i++)
+			{
+				FreeItem *item = (FreeItem *)(chunk + i * sizeClass * Granularity);
+				item->next = head;
+				head = item;
+			}
+		}
+		FreeItem *item = head;
+		head = item->next;
+		return item;
+	}
+
+	void free(void *p, size_t size)
+	{
+		size_t sizeClass = (size + Granularity - 1) / Granularity;
+		if (sizeClass >= Classes)
+		{
+			::operator delete(p);
+			return;
+		}
+		std::lock_guard<std::mutex> lock(mutex);
+		FreeItem *item = (FreeItem *)p;
+		item->next = freeLists[sizeClass];
+		freeLists[sizeClass] = item;
+	}
+
+	static BlockPool& instance()
+	{
+		// never destroyed since blocks may be freed by static destructors
+		static BlockPool *pool = new BlockPool();
+		return *pool;
+	}
+
+private:
+	struct FreeItem
+	{
+		FreeItem *next;
+	};
+	static const size_t Granularity = 16;
+	static const size_t Classes = 128;
+	static const u32 ChunkItems = 64;
+
+	FreeItem *freeLists[Classes] {};
+	std::mutex mutex;
+};
+
+// For the reference counts of the blocks
+template<typename T>
+struct PoolAllocator
+{
+	typedef T value_type;
+
+	PoolAllocator() = default;
+	template<typename U>
+	PoolAllocator(const PoolAllocator<U>&) {}
+
+	T *allocate(size_t n)
+	{
+		return (T *)BlockPool::instance().alloc(n * sizeof(T));
+	}
+	void deallocate(T *p, size_t n)
+	{
+		BlockPool::instance().free(p, n * sizeof(T));
+	}
+};
+template<typename T, typename U>
+bool operator==(const PoolAllocator<T>&, const PoolAllocator<U>&) { return true; }
+template<typename T, typename U>
+bool operator!=(const PoolAllocator<T>&, const PoolAllocator<U>&) { return false; }
+
+void *RuntimeBlockInfo::operator new(size_t size)
+{
+	return BlockPool::instance().alloc(size);
+}
+
+void RuntimeBlockInfo::operator delete(void *p, size_t size)
+{
+	BlockPool::instance().free(p, size);
+}
 
-static bm_Map blkmap;
 // Stats
 u32 protected_blocks;
 u32 unprotected_blocks;
@@ -42,6 +151,13 @@ u32 unprotected_blocks;
 
 // addr must be a physical address
 // This returns an executable address
+static FILE *perf_map;
+
+static void bm_WritePerfMapEntry(RuntimeBlockInfo *block)
+{
+	fprintf(perf_map, "%zx %x sh4:%08X\n", (size_t)CC_RW2RX(block->code), block->host_code_size, block->vaddr);
+}
+
 static DynarecCodeEntryPtr DYNACALL bm_GetCode(u32 addr)
 {
 	DynarecCodeEntryPtr rv = FPCA(addr);
@@ -114,29 +230,103 @@ RuntimeBlockInfoPtr DYNACALL bm_GetBlock(u32 addr)
 		return bm_GetBlock((void*)cde);  // Returns RX pointer
 }
 
+static u32 bm_CodeSlice(const void *code)
+{
+	uintptr_t offset = (uintptr_t)code - (uintptr_t)CodeCache;
+	if (offset >= CODE_SIZE + TEMP_CODE_SIZE)
+		return CODE_SLICES - 1;
+	return offset / CODE_SLICE_SIZE;
+}
+
+static bool bm_CodeLess(const RuntimeBlockInfoPtr& block, const void *code)
+{
+	return (const void *)block->code < code;
+}
+
+// Returns the position of the block with this code in its slice, or the end of the slice
+static bm_List::iterator bm_FindCode(bm_List& list, const void *code)
+{
+	auto it = std::lower_bound(list.begin(), list.end(), code, bm_CodeLess);
+	if (it != list.end() && (const void *)(*it)->code != code)
+		return list.end();
+	return it;
+}
+
+// The link of the block in the list of the given page
+static RuntimeBlockInfo::PageLink& bm_PageLink(RuntimeBlockInfo *block, u32 page)
+{
+	u32 first = (block->addr & RAM_MASK) / PAGE_SIZE;
+	return block->page_links[(page - first) & (RAM_MASK / PAGE_SIZE)];
+}
+
+static void bm_UnlinkPages(RuntimeBlockInfo *block)
+{
+	u32 first = (block->addr & RAM_MASK) / PAGE_SIZE;
+	for (u32 i = 0; i < block->linked_pages; i++)
+	{
+		u32 page = (first + i) & (RAM_MASK / PAGE_SIZE);
+		RuntimeBlockInfo::PageLink& link = block->page_links[i];
+		if (link.prev != nullptr)
+			bm_PageLink(link.prev, page).next = link.next;
+		else
+			blocks_per_page[page] = link.next;
+		if (link.next != nullptr)
+			bm_PageLink(link.next, page).prev = link.prev;
+	}
+	block->linked_pages = 0;
+}
+
+// The chunks of the given page holding some code of the block
+static u64 bm_CodeChunks(const RuntimeBlockInfo *block, u32 page)
+{
+	u32 pageAddr = page * PAGE_SIZE;
+	u32 start = (block->addr - pageAddr) & RAM_MASK;
+	u32 end;
+	if (start < PAGE_SIZE)
+	{
+		end = std::min(start + block->sh4_code_size, (u32)PAGE_SIZE);
+	}
+	else
+	{
+		// starts in a previous page
+		end = std::min(block->sh4_code_size - ((pageAddr - block->addr) & RAM_MASK), (u32)PAGE_SIZE);
+		start = 0;
+	}
+	u32 first = start / SMC_CHUNK_SIZE;
+	u32 last = (end - 1) / SMC_CHUNK_SIZE;
+	return (~0ull >> (63 - last)) & (~0ull << first);
+}
+
 // This takes a RX address and returns the info block ptr (RW space)
 RuntimeBlockInfoPtr bm_GetBlock(void* dynarec_code)
 {
-	if (blkmap.empty())
-		return NULL;
-
 	void *dynarecrw = CC_RX2RW(dynarec_code);
-	// Returns a block who's code addr is bigger than dynarec_code (or end)
-	auto iter = blkmap.upper_bound(dynarecrw);
-	if (iter == blkmap.begin())
-		return NULL;
-	iter--;  // Need to go back to find the potential candidate
-
-	// However it might be out of bounds, check for that
-	if ((u8*)iter->second->code + iter->second->host_code_size <= (u8*)dynarec_code)
+	// Only the last block starting before the address can contain it
+	u32 slice = bm_CodeSlice(dynarecrw);
+	const bm_List& list = code_slices[slice];
+	const RuntimeBlockInfoPtr *block = nullptr;
+	auto it = std::lower_bound(list.begin(), list.end(), (u8 *)dynarecrw + 1, bm_CodeLess);
+	if (it != list.begin())
+		block = &*(it - 1);
+	else if (slice != CODE_SLICES - 1)
+	{
+		while (slice-- > 0)
+			if (!code_slices[slice].empty())
+			{
+				block = &code_slices[slice].back();
+				break;
+			}
+	}
+	if (block == nullptr || !(*block)->contains_code((u8*)dynarecrw))
 		return NULL;
 
-	verify(iter->second->contains_code((u8*)dynarecrw));
-	return iter->second;
+	return *block;
 }
 
 static void bm_CleanupDeletedBlocks()
 {
+	// samples in deleted blocks must be attributed first
+	prof_resolve_samples();
 	del_blocks.clear();
 }
 
@@ -160,15 +350,20 @@ RuntimeBlockInfoPtr bm_GetStaleBlock(void* dynarec_code)
 
 void bm_AddBlock(RuntimeBlockInfo* blk)
 {
-	RuntimeBlockInfoPtr block(blk);
-	if (block->temp_block)
-		all_temp_blocks.insert(block);
-	auto iter = blkmap.find((void*)blk->code);
-	if (iter != blkmap.end()) {
-		INFO_LOG(DYNAREC, "DUP: %08X %p %08X %p", iter->second->addr, iter->second->code, block->addr, block->code);
-		verify(false);
+	RuntimeBlockInfoPtr block(blk, std::default_delete<RuntimeBlockInfo>(), PoolAllocator<RuntimeBlockInfo>());
+	bm_List& list = code_slices[bm_CodeSlice((void*)blk->code)];
+	// Blocks are mostly added in address order
+	auto iter = list.end();
+	if (!list.empty() && (void*)list.back()->code >= (void*)blk->code)
+	{
+		iter = std::lower_bound(list.begin(), list.end(), (void*)blk->code, bm_CodeLess);
+		if ((*iter)->code == blk->code) {
+			INFO_LOG(DYNAREC, "DUP: %08X %p %08X %p", (*iter)->addr, (*iter)->code, block->addr, block->code);
+			verify(false);
+		}
 	}
-	blkmap[(void*)block->code] = block;
+	list.insert(iter, block);
+	block_count++;
 
 	verify((void*)bm_GetCode(block->addr) == (void*)ngen_FailedToFindBlock);
 	FPCA(block->addr) = (DynarecCodeEntryPtr)CC_RW2RX(block->code);
@@ -186,17 +381,20 @@ void bm_AddBlock(RuntimeBlockInfo* blk)
 		}
 	}
 #endif
-
+	if (perf_map != nullptr)
+		bm_WritePerfMapEntry(block.get());
 }
 
 void bm_DiscardBlock(RuntimeBlockInfo* block)
 {
 	// Remove from block map
-	auto it = blkmap.find((void*)block->code);
-	verify(it != blkmap.end());
-	RuntimeBlockInfoPtr block_ptr = it->second;
+	bm_List& list = code_slices[bm_CodeSlice((void*)block->code)];
+	auto it = bm_FindCode(list, (void*)block->code);
+	verify(it != list.end());
+	RuntimeBlockInfoPtr block_ptr = std::move(*it);
 
-	blkmap.erase(it);
+	list.erase(it);
+	block_count--;
 
 	block_ptr->pNextBlock = NULL;
 	block_ptr->pBranchBlock = NULL;
@@ -206,11 +404,8 @@ void bm_DiscardBlock(RuntimeBlockInfo* block)
 	verify((void*)bm_GetCode(block_ptr->addr) == (void*)block_ptr->code);
 	FPCA(block_ptr->addr) = ngen_FailedToFindBlock;
 
-	if (block_ptr->temp_block)
-		all_temp_blocks.erase(block_ptr);
-
-	del_blocks.push_back(block_ptr);
 	block_ptr->Discard();
+	del_blocks.push_back(std::move(block_ptr));
 }
 
 void bm_Periodical_1s()
@@ -252,11 +447,14 @@ void bm_Reset()
 		mem_region_unlock(virt_ram_base + 0x8C000000u, 0x90000000u - 0x8C000000u);
 		mem_region_unlock(virt_ram_base + 0xAC000000u, 0xB0000000u - 0xAC000000u);
 	}
+	memset(locked_pages, 0, sizeof(locked_pages));
+	memwatch::unprotected(memwatch::Ram, 0, RAM_SIZE);
 }
 
 static void bm_LockPage(u32 addr)
 {
 	addr = addr & (RAM_MASK - PAGE_MASK);
+	locked_pages[addr / PAGE_SIZE] = 1;
 	mem_region_lock(virt_ram_base + 0x0C000000 + addr, PAGE_SIZE);
 	if (_nvmem_4gb_space())
 	{
@@ -269,6 +467,7 @@ static void bm_LockPage(u32 addr)
 static void bm_UnlockPage(u32 addr)
 {
 	addr = addr & (RAM_MASK - PAGE_MASK);
+	locked_pages[addr / PAGE_SIZE] = 0;
 	mem_region_unlock(virt_ram_base + 0x0C000000 + addr, PAGE_SIZE);
 	if (_nvmem_4gb_space())
 	{
@@ -276,32 +475,36 @@ static void bm_UnlockPage(u32 addr)
 		mem_region_unlock(virt_ram_base + 0xAC000000 + addr, PAGE_SIZE);
 		// TODO wraps
 	}
+	memwatch::unprotected(memwatch::Ram, addr, PAGE_SIZE);
 }
 
 void bm_ResetCache()
 {
+	// the code cache is about to be reused
+	prof_resolve_samples();
 	ngen_ResetBlocks();
 	_vmem_bm_reset();
 
-	for (const auto& it : blkmap)
+	for (auto& list : code_slices)
 	{
-		RuntimeBlockInfoPtr block = it.second;
-		block->relink_data = 0;
-		block->pNextBlock = NULL;
-		block->pBranchBlock = NULL;
-		// needed for the transition to full mmu. Could perhaps limit it to the current block.
-		block->Relink();
-		// Avoid circular references
-		block->Discard();
-		del_blocks.push_back(block);
+		for (auto& block : list)
+		{
+			block->relink_data = 0;
+			block->pNextBlock = NULL;
+			block->pBranchBlock = NULL;
+			// needed for the transition to full mmu. Could perhaps limit it to the current block.
+			block->Relink();
+			// Avoid circular references
+			block->Discard();
+			del_blocks.push_back(std::move(block));
+		}
+		// includes temp blocks as well
+		list.clear();
 	}
+	block_count = 0;
 
-	blkmap.clear();
-	// blkmap includes temp blocks as well
-	all_temp_blocks.clear();
-
-	for (auto& block_list : blocks_per_page)
-		block_list.clear();
+	memset(blocks_per_page, 0, sizeof(blocks_per_page));
+	memset(code_chunks, 0, sizeof(code_chunks));
 
 	memset(unprotected_pages, 0, sizeof(unprotected_pages));
 
@@ -321,16 +524,52 @@ void bm_ResetCache()
 
 void bm_ResetTempCache(bool full)
 {
-	if (!full)
+	// A full reset already dropped them with the other blocks
+	if (full)
+		return;
+	bm_List temp_blocks;
+	// the temp code cache follows the code cache
+	for (u32 slice = CODE_SIZE / CODE_SLICE_SIZE; slice < CODE_SLICES; slice++)
 	{
-		for (const auto& block : all_temp_blocks)
+		bm_List& list = code_slices[slice];
+		auto end = std::stable_partition(list.begin(), list.end(), [](const RuntimeBlockInfoPtr& block) {
+			return !block->temp_block;
+		});
+		for (auto it = end; it != list.end(); ++it)
 		{
+			RuntimeBlockInfoPtr& block = *it;
 			FPCA(block->addr) = ngen_FailedToFindBlock;
-			blkmap.erase((void*)block->code);
+			bm_UnlinkPages(block.get());
+			temp_blocks.push_back(std::move(block));
 		}
+		block_count -= list.end() - end;
+		list.erase(end, list.end());
 	}
-	del_blocks.insert(del_blocks.begin(),all_temp_blocks.begin(),all_temp_blocks.end());
-	all_temp_blocks.clear();
+	del_blocks.insert(del_blocks.begin(), temp_blocks.begin(), temp_blocks.end());
+}
+
+std::vector<RuntimeBlockInfoPtr> bm_ReclaimCode(void *start, void *end)
+{
+	// this part of the code cache is about to be reused
+	prof_resolve_samples();
+
+	std::vector<RuntimeBlockInfoPtr> blocks;
+	for (u32 slice = bm_CodeSlice(start); slice <= bm_CodeSlice((u8 *)end - 1); slice++)
+	{
+		const bm_List& list = code_slices[slice];
+		auto it = std::lower_bound(list.begin(), list.end(), start, bm_CodeLess);
+		for (; it != list.end() && (void *)(*it)->code < end; ++it)
+			blocks.push_back(*it);
+	}
+	for (const auto& block : blocks)
+		bm_DiscardBlock(block.get());
+	// Stale blocks must not be found in the new code
+	del_blocks.erase(std::remove_if(del_blocks.begin(), del_blocks.end(),
+			[start, end](const RuntimeBlockInfoPtr& block) {
+				return (void *)block->code >= start && (void *)block->code < end;
+			}), del_blocks.end());
+
+	return blocks;
 }
 
 void bm_Init()
@@ -354,19 +593,48 @@ void bm_Term()
 	bm_Reset();
 }
 
+void bm_EnablePerfMap(bool enable)
+{
+	if (!enable)
+	{
+		if (perf_map != nullptr)
+			fclose(perf_map);
+		perf_map = nullptr;
+		return;
+	}
+#if defined(__unix__)
+	if (perf_map != nullptr)
+		return;
+	char path[64];
+	sprintf(path, "/tmp/perf-%d.map", (int)getpid());
+	perf_map = fopen(path, "a");
+	if (perf_map == nullptr)
+	{
+		WARN_LOG(DYNAREC, "Cannot open %s", path);
+		return;
+	}
+	// unbuffered so that entries are there even if the process crashes
+	setvbuf(perf_map, nullptr, _IONBF, 0);
+	for (const auto& list : code_slices)
+		for (const auto& block : list)
+			bm_WritePerfMapEntry(block.get());
+	INFO_LOG(DYNAREC, "Writing JIT symbols to %s", path);
+#endif
+}
+
 void bm_WriteBlockMap(const std::string& file)
 {
 	FILE* f=fopen(file.c_str(),"wb");
 	if (f)
 	{
 		INFO_LOG(DYNAREC, "Writing block map !");
-		for (auto& it : blkmap)
-		{
-			RuntimeBlockInfoPtr& block = it.second;
-			fprintf(f, "block: %d:%08X:%p:%d:%d:%d\n", block->BlockType, block->addr, block->code, block->host_code_size, block->guest_cycles, block->guest_opcodes);
-			for(size_t j = 0; j < block->oplist.size(); j++)
-				fprintf(f,"\top: %zd:%d:%s\n", j, block->oplist[j].guest_offs, block->oplist[j].dissasm().c_str());
-		}
+		for (auto& list : code_slices)
+			for (auto& block : list)
+			{
+				fprintf(f, "block: %d:%08X:%p:%d:%d:%d\n", block->BlockType, block->addr, block->code, block->host_code_size, block->guest_cycles, block->guest_opcodes);
+				for(size_t j = 0; j < block->oplist.size(); j++)
+					fprintf(f,"\top: %zd:%d:%s\n", j, block->oplist[j].guest_offs, block->oplist[j].dissasm().c_str());
+			}
 		fclose(f);
 		INFO_LOG(DYNAREC, "Finished writing block map");
 	}
@@ -374,11 +642,9 @@ void bm_WriteBlockMap(const std::string& file)
 
 void sh4_jitsym(FILE* out)
 {
-	for (const auto& it : blkmap)
-	{
-		const RuntimeBlockInfoPtr& block = it.second;
-		fprintf(out, "%p %d %08X\n", block->code, block->host_code_size, block->addr);
-	}
+	for (const auto& list : code_slices)
+		for (const auto& block : list)
+			fprintf(out, "%p %d %08X\n", block->code, block->host_code_size, block->addr);
 }
 
 #if 0
@@ -524,43 +790,46 @@ void RuntimeBlockInfo::Discard()
 	}
 	pre_refs.clear();
 
-	if (read_only)
-	{
-		// Remove this block from the per-page block lists
-		for (u32 addr = this->addr & ~PAGE_MASK; addr < this->addr + this->sh4_code_size; addr += PAGE_SIZE)
-		{
-			auto& block_list = blocks_per_page[(addr & RAM_MASK) / PAGE_SIZE];
-			block_list.erase(this);
-		}
-	}
+	bm_UnlinkPages(this);
 }
 
-void RuntimeBlockInfo::SetProtectedFlags()
+bool bm_IsCodeProtectable(u32 addr, u32 size)
 {
 	// Don't write protect rom and BIOS/IP.BIN (Grandia II)
 	if (!IsOnRam(addr) || (addr & 0x1FFF0000) == 0x0c000000)
+		return false;
+	if (((addr & PAGE_MASK) + size + PAGE_MASK) / PAGE_SIZE > BLOCK_MAX_PAGES)
+		return false;
+	for (u32 page = addr & ~PAGE_MASK; page < addr + size; page += PAGE_SIZE)
+		if (unprotected_pages[(page & RAM_MASK) / PAGE_SIZE])
+			return false;
+	return true;
+}
+
+void RuntimeBlockInfo::SetProtectedFlags()
+{
+	if (!bm_IsCodeProtectable(addr, sh4_code_size))
 	{
 		this->read_only = false;
 		unprotected_blocks++;
 		return;
 	}
-	for (u32 addr = this->addr & ~PAGE_MASK; addr < this->addr + sh4_code_size; addr += PAGE_SIZE)
-	{
-		if (unprotected_pages[(addr & RAM_MASK) / PAGE_SIZE])
-		{
-			this->read_only = false;
-			unprotected_blocks++;
-			return;
-		}
-	}
 	this->read_only = true;
 	protected_blocks++;
+	linked_pages = 0;
 	for (u32 addr = this->addr & ~PAGE_MASK; addr < this->addr + sh4_code_size; addr += PAGE_SIZE)
 	{
-		auto& block_list = blocks_per_page[(addr & RAM_MASK) / PAGE_SIZE];
-		if (block_list.empty())
+		u32 page = (addr & RAM_MASK) / PAGE_SIZE;
+		if (blocks_per_page[page] == nullptr)
 			bm_LockPage(addr);
-		block_list.insert(this);
+		// Insert at the head of the page list
+		PageLink& link = page_links[linked_pages++];
+		link.prev = nullptr;
+		link.next = blocks_per_page[page];
+		if (link.next != nullptr)
+			bm_PageLink(link.next, page).prev = this;
+		blocks_per_page[page] = this;
+		code_chunks[page] |= bm_CodeChunks(this, page);
 	}
 }
 
@@ -574,16 +843,103 @@ void bm_RamWriteAccess(u32 addr)
 	}
 	unprotected_pages[addr / PAGE_SIZE] = true;
 	bm_UnlockPage(addr);
-	std::set<RuntimeBlockInfo*>& block_list = blocks_per_page[addr / PAGE_SIZE];
-	std::vector<RuntimeBlockInfo*> list_copy;
-	list_copy.insert(list_copy.begin(), block_list.begin(), block_list.end());
-	if (!list_copy.empty())
+	RuntimeBlockInfo *&block_list = blocks_per_page[addr / PAGE_SIZE];
+	if (block_list != nullptr)
 		DEBUG_LOG(DYNAREC, "bm_RamWriteAccess write access to %08x pc %08x", addr, next_pc);
-	for (auto& block : list_copy)
+	// Discarding a block removes it from the list
+	while (block_list != nullptr)
+		bm_DiscardBlock(block_list);
+	code_chunks[addr / PAGE_SIZE] = 0;
+	prof.counters.bm.smc_pages++;
+}
+
+template<typename T>
+void DYNACALL bm_WriteLockedRam(u32 addr, T data)
+{
+	addr &= RAM_MASK;
+	u32 page = addr / PAGE_SIZE;
+	u32 offset = addr & PAGE_MASK;
+	u64 chunks = (1ull << (offset / SMC_CHUNK_SIZE)) | (1ull << ((offset + sizeof(T) - 1) / SMC_CHUNK_SIZE));
+	if (code_chunks[page] & chunks)
 	{
-		bm_DiscardBlock(block);
+		// Only discard the blocks overlapping the written bytes
+		u64 remaining = 0;
+		RuntimeBlockInfo *block = blocks_per_page[page];
+		while (block != nullptr)
+		{
+			RuntimeBlockInfo *next = bm_PageLink(block, page).next;
+			if (((addr - block->addr) & RAM_MASK) < block->sh4_code_size
+					|| ((block->addr - addr) & RAM_MASK) < sizeof(T))
+			{
+				DEBUG_LOG(DYNAREC, "bm_WriteLockedRam write access to %08x discards block %08x", addr, block->addr);
+				bm_DiscardBlock(block);
+				prof.counters.bm.smc_discarded++;
+			}
+			else
+			{
+				remaining |= bm_CodeChunks(block, page);
+			}
+			block = next;
+		}
+		code_chunks[page] = remaining;
+		prof.counters.bm.smc_code_writes++;
+	}
+	else
+	{
+		prof.counters.bm.smc_data_writes++;
+	}
+	// Rollback write tracking protects all the mirrors of the page, including the one written below.
+	// Mark the page dirty without faulting, then lock it again for the writes that don't go through the barrier.
+	if (memwatch::touch(memwatch::Ram, addr))
+		bm_LockPage(addr);
+	// The first mirror of the main RAM view isn't locked by the code protection
+	*(T *)&mem_b.data[RAM_SIZE + addr] = data;
+}
+template void DYNACALL bm_WriteLockedRam<u8>(u32 addr, u8 data);
+template void DYNACALL bm_WriteLockedRam<u16>(u32 addr, u16 data);
+template void DYNACALL bm_WriteLockedRam<u32>(u32 addr, u32 data);
+template void DYNACALL bm_WriteLockedRam<u64>(u32 addr, u64 data);
+
+// Content of the protected code pages before loading a state
+static std::vector<std::pair<u32, u64>> code_page_hashes;
+
+void bm_SaveCodePages()
+{
+	code_page_hashes.clear();
+	for (u32 page = 0; page < RAM_SIZE / PAGE_SIZE; page++)
+		if (blocks_per_page[page] != nullptr)
+			code_page_hashes.emplace_back(page, XXH64(&mem_b[page * PAGE_SIZE], PAGE_SIZE, 0));
+}
+
+void bm_DiscardChangedBlocks()
+{
+	u32 total = block_count;
+	// Discard first: a block spanning two pages goes if either one changed
+	for (const auto& it : code_page_hashes)
+	{
+		RuntimeBlockInfo *&block_list = blocks_per_page[it.first];
+		if (block_list == nullptr || XXH64(&mem_b[it.first * PAGE_SIZE], PAGE_SIZE, 0) == it.second)
+			continue;
+		while (block_list != nullptr)
+			bm_DiscardBlock(block_list);
+		code_chunks[it.first] = 0;
 	}
-	verify(block_list.empty());
+	// bm_Reset() unprotected all pages
+	for (const auto& it : code_page_hashes)
+		if (blocks_per_page[it.first] != nullptr)
+			bm_LockPage(it.first * PAGE_SIZE);
+	code_page_hashes.clear();
+
+	u32 kept = block_count;
+	u32 discarded = (u32)(total - kept);
+	prof.counters.bm.load_kept += kept;
+	prof.counters.bm.load_discarded += discarded;
+	INFO_LOG(DYNAREC, "State loaded: %d blocks kept, %d discarded", kept, discarded);
+}
+
+bool bm_RamPageHasBlocks(u32 addr)
+{
+	return blocks_per_page[(addr & RAM_MASK) / PAGE_SIZE] != nullptr;
 }
 
 bool bm_RamWriteAccess(void *p)
@@ -643,9 +999,9 @@ void print_blocks()
 		INFO_LOG(DYNAREC, "Writing blocks to %p", f);
 	}
 
-	for (auto it : blkmap)
+	for (const auto& list : code_slices)
+	for (const RuntimeBlockInfoPtr& blk : list)
 	{
-		RuntimeBlockInfoPtr blk = it.second;
 		if (f)
 		{
 			fprintf(f,"block: %p\n",blk.get());
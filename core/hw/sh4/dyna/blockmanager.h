@@ -9,6 +9,9 @@
 typedef void (*DynarecCodeEntryPtr)();
 typedef std::shared_ptr<RuntimeBlockInfo> RuntimeBlockInfoPtr;
 
+// Write protected blocks can't span more pages than this
+#define BLOCK_MAX_PAGES 3
+
 struct RuntimeBlockInfo_Core
 {
 	u32 addr;
@@ -18,7 +21,7 @@ struct RuntimeBlockInfo_Core
 
 struct RuntimeBlockInfo: RuntimeBlockInfo_Core
 {
-	bool Setup(u32 pc,fpscr_t fpu_cfg);
+	bool Setup(u32 pc,fpscr_t fpu_cfg,DecodeMode mode=DM_Normal);
 	const char* hash();
 
 	u32 vaddr;
@@ -36,6 +39,9 @@ struct RuntimeBlockInfo: RuntimeBlockInfo_Core
 	bool has_fpu_op;
 	u32 blockcheck_failures;
 	bool temp_block;
+	bool baseline;	// to be replaced by the block being compiled in the background
+	bool superblock;	// made of several blocks linked by static branches
+	bool cache_hit;	// set up from the block cache
 
 	u32 BranchBlock; //if not 0xFFFFFFFF then jump target
 	u32 NextBlock;   //if not 0xFFFFFFFF then next block (by position)
@@ -58,6 +64,9 @@ struct RuntimeBlockInfo: RuntimeBlockInfo_Core
 	}
 
 	virtual ~RuntimeBlockInfo();
+	// Blocks are allocated from a pool
+	static void *operator new(size_t size);
+	static void operator delete(void *p, size_t size);
 
 	virtual u32 Relink()=0;
 	virtual void Relocate(void* dst)=0;
@@ -72,9 +81,20 @@ struct RuntimeBlockInfo: RuntimeBlockInfo_Core
 	void SetProtectedFlags();
 
 	bool read_only;
+
+	// Links in the lists of blocks of each write protected page
+	struct PageLink
+	{
+		RuntimeBlockInfo *prev;
+		RuntimeBlockInfo *next;
+	};
+	PageLink page_links[BLOCK_MAX_PAGES];
+	u32 linked_pages;
 };
 
 void bm_WriteBlockMap(const std::string& file);
+// Writes the address and guest pc of each block to /tmp/perf-<pid>.map so that perf can symbolize them
+void bm_EnablePerfMap(bool enable);
 
 DynarecCodeEntryPtr DYNACALL bm_GetCodeByVAddr(u32 addr);
 RuntimeBlockInfoPtr bm_GetBlock(void* dynarec_code);
@@ -86,17 +106,39 @@ void bm_DiscardBlock(RuntimeBlockInfo* block);
 void bm_Reset();
 void bm_ResetCache();
 void bm_ResetTempCache(bool full);
+// Discards the blocks whose host code is in [start, end) and returns them
+std::vector<RuntimeBlockInfoPtr> bm_ReclaimCode(void *start, void *end);
 void bm_Periodical_1s();
 
+// Loading a state without flushing the code cache:
+// call bm_SaveCodePages() before bm_Reset() and unserializing, then bm_DiscardChangedBlocks()
+// to discard the blocks whose code pages changed. Not suitable when the mmu is enabled.
+void bm_SaveCodePages();
+void bm_DiscardChangedBlocks();
+
 void bm_Init();
 void bm_Term();
 
 void bm_vmem_pagefill(void** ptr,u32 size_bytes);
 bool bm_RamWriteAccess(void *p);
 void bm_RamWriteAccess(u32 addr);
+// The code at [addr, addr + size) would be write protected if compiled now
+bool bm_IsCodeProtectable(u32 addr, u32 size);
+// The page holds blocks relying on its write protection
+bool bm_RamPageHasBlocks(u32 addr);
 static inline bool bm_IsRamPageProtected(u32 addr)
 {
 	extern bool unprotected_pages[RAM_SIZE_MAX/PAGE_SIZE];
 	addr &= RAM_MASK;
 	return !unprotected_pages[addr / PAGE_SIZE];
 }
+
+// Fine-grained self-modifying code detection (Dynarec.FineSmc)
+// The code of each write protected page is tracked in chunks of 64 bytes. Instead of storing to a locked page
+// and faulting, the dynarec write handlers call bm_WriteLockedRam(), which only discards the blocks overlapping
+// the written bytes and keeps the page protected.
+#define SMC_CHUNK_SIZE (PAGE_SIZE / 64)
+// Non-zero if the page is locked in the main RAM view
+extern u8 locked_pages[RAM_SIZE_MAX/PAGE_SIZE];
+template<typename T>
+void DYNACALL bm_WriteLockedRam(u32 addr, T data);
@@ -17,10 +17,9 @@
 #include "decoder_opcodes.h"
 #include "cfg/option.h"
 
-#define BLOCK_MAX_SH_OPS_SOFT 500
-#define BLOCK_MAX_SH_OPS_HARD 511
-
-static RuntimeBlockInfo* blk;
+// The decoder state is per thread: the cpu thread decodes the baseline blocks while the background compiler
+// decodes the others
+static thread_local RuntimeBlockInfo* blk;
 
 static const char idle_hash[] =
        //BIOS
@@ -61,7 +60,7 @@ static inline shil_param mk_regi(int reg)
 	return mk_reg((Sh4RegType)reg);
 }
 
-static state_t state;
+static thread_local state_t state;
 
 static void Emit(shilop op,shil_param rd=shil_param(),shil_param rs1=shil_param(),shil_param rs2=shil_param(),u32 flags=0,shil_param rs3=shil_param(),shil_param rd2=shil_param())
 {
@@ -564,9 +563,9 @@ static void dec_param(DecParam p,shil_param& r1,shil_param& r2, u32 op)
 #define DIV1_KEY 0x3004
 #define ROTCL_KEY 0x4024
 
-static Sh4RegType div_som_reg1;
-static Sh4RegType div_som_reg2;
-static Sh4RegType div_som_reg3;
+static thread_local Sh4RegType div_som_reg1;
+static thread_local Sh4RegType div_som_reg2;
+static thread_local Sh4RegType div_som_reg3;
 
 static u32 MatchDiv32(u32 pc , Sh4RegType &reg1,Sh4RegType &reg2 , Sh4RegType &reg3)
 {
@@ -997,11 +996,33 @@ void dec_updateBlockCycles(RuntimeBlockInfo *block, u16 op)
 	}
 }
 
-bool dec_DecodeBlock(RuntimeBlockInfo* rbi,u32 max_cycles)
+// Continues decoding at the target of a static branch, for superblocks
+static bool dec_FollowBranch(u32 max_cycles)
+{
+	// The code of the block must stay in a small range to be write protected
+	const u32 MaxSpan = 4096;
+
+	if ((state.BlockType != BET_StaticJump && state.BlockType != BET_StaticCall)
+			// not ended because of its size or an fpscr change
+			|| !state.cpu.is_delayslot
+			|| state.JumpAddr < state.cpu.rpc || state.JumpAddr >= blk->vaddr + MaxSpan
+			|| !IsOnRam(state.JumpAddr) || mmu_enabled()
+			|| blk->oplist.size() >= BLOCK_MAX_SH_OPS_SOFT || blk->guest_cycles >= max_cycles)
+		return false;
+
+	state.cpu.rpc = state.JumpAddr;
+	state.cpu.is_delayslot = false;
+	state.NextOp = NDO_NextOp;
+	return true;
+}
+
+bool dec_DecodeBlock(RuntimeBlockInfo* rbi,u32 max_cycles,DecodeMode mode)
 {
 	blk=rbi;
 	state_Setup(blk->vaddr, blk->fpu_cfg);
 	ngen_GetFeatures(&state.ngen);
+	if (mode == DM_Baseline)
+		state.ngen.InterpreterFallback = true;
 	
 	blk->guest_opcodes=0;
 	// If full MMU, don't allow the block to extend past the end of the current 4K page
@@ -1033,6 +1054,8 @@ bool dec_DecodeBlock(RuntimeBlockInfo* rbi,u32 max_cycles)
 					{
 						if (sr.FD == 1)
 						{
+							if (mode == DM_Background || mode == DM_Superblock)
+								return false;
 							// We need to know FPSCR to compile the block, so let the exception handler run first
 							// as it may change the fp registers
 							Do_Exception(next_pc, 0x800, 0x100);
@@ -1068,6 +1091,8 @@ bool dec_DecodeBlock(RuntimeBlockInfo* rbi,u32 max_cycles)
 			break;
 
 		case NDO_End:
+			if (mode == DM_Superblock && dec_FollowBranch(max_cycles))
+				continue;
 			// Disabled for now since we need to know if the block is read-only,
 			// which isn't determined until after the decoding.
 			// This is a relatively rare optimization anyway
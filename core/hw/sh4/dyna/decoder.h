@@ -2,6 +2,9 @@
 #include "shil.h"
 #include "../sh4_if.h"
 
+#define BLOCK_MAX_SH_OPS_SOFT 500
+#define BLOCK_MAX_SH_OPS_HARD 511
+
 #define mkbet(c,s,v) ((c<<3)|(s<<1)|v)
 #define BET_GET_CLS(x) (x>>3)
 
@@ -43,8 +46,16 @@ struct ngen_features
 	bool InterpreterFallback; //if set all the non-branch opcodes are handled with the ifb opcode
 };
 
+enum DecodeMode
+{
+	DM_Normal,
+	DM_Baseline,	// all the non-branch opcodes are handled with the ifb opcode, see asynccompile.h
+	DM_Background,	// decoding by the background compiler: no exception can be raised
+	DM_Superblock,	// static branches are followed, no exception can be raised
+};
+
 struct RuntimeBlockInfo;
-bool dec_DecodeBlock(RuntimeBlockInfo* rbi,u32 max_cycles);
+bool dec_DecodeBlock(RuntimeBlockInfo* rbi,u32 max_cycles,DecodeMode mode=DM_Normal);
 void dec_updateBlockCycles(RuntimeBlockInfo *block, u16 op);
 
 struct state_t
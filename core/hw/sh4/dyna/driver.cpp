@@ -9,12 +9,18 @@
 #include "hw/sh4/modules/mmu.h"
 #include "cfg/option.h"
 
+#include <chrono>
 #include <ctime>
 #include <cfloat>
+#include <mutex>
 
 #include "blockmanager.h"
+#include "blockcache.h"
+#include "asynccompile.h"
 #include "ngen.h"
 #include "decoder.h"
+#include "emulator.h"
+#include "profiler/profiler.h"
 
 #include <xxhash.h>
 
@@ -37,17 +43,39 @@ uintptr_t cc_rx_offset;
 
 u32 LastAddr;
 u32 LastAddr_min;
+// Segment of the code cache being filled
+static u32 codeSegment;
+// Start of the first block, after the code generated by ngen_ResetBlocks()
+static u32 codeStart = CODE_SIZE;
 u32 TempLastAddr;
 u32* emit_ptr=0;
 u32* emit_ptr_limit;
 
 std::unordered_set<u32> smc_hotspots;
+bool rdv_KeepShil;
+// blocks that couldn't be compiled in the background
+static std::unordered_set<u32> async_failures;
+// The block cache is used by the cpu thread and the background compiler
+static std::mutex blockCacheMutex;
+// blocks ending with a static branch, to be recompiled as superblocks once hot enough
+static std::vector<RuntimeBlockInfoPtr> superblockCandidates;
 
 static sh4_if sh4Interp;
 
 void* emit_GetCCPtr() { return emit_ptr==0?(void*)&CodeCache[LastAddr]:(void*)emit_ptr; }
 void emit_SetBaseAddr() { LastAddr_min = LastAddr; }
 
+static u32 segmentStart(u32 segment)
+{
+	u32 size = (CODE_SIZE - LastAddr_min) / CODE_SEGMENTS & ~15u;
+	return LastAddr_min + segment * size;
+}
+
+static u32 segmentEnd(u32 segment)
+{
+	return segment == CODE_SEGMENTS - 1 ? CODE_SIZE : segmentStart(segment + 1);
+}
+
 void clear_temp_cache(bool full)
 {
 	//printf("recSh4:Temp Code Cache clear at %08X\n", curr_pc);
@@ -59,8 +87,13 @@ static void recSh4_ClearCache()
 {
 	INFO_LOG(DYNAREC, "recSh4:Dynarec Cache clear at %08X free space %d", next_pc, emit_FreeSpace());
 	LastAddr=LastAddr_min;
+	codeSegment = 0;
+	codeStart = CODE_SIZE;
+	ac_Reset();
 	bm_ResetCache();
 	smc_hotspots.clear();
+	async_failures.clear();
+	superblockCandidates.clear();
 	clear_temp_cache(true);
 }
 
@@ -104,12 +137,12 @@ u32 emit_FreeSpace()
 	if (emit_ptr)
 		return (emit_ptr_limit - emit_ptr) * sizeof(u32);
 	else
-		return CODE_SIZE - LastAddr;
+		return segmentEnd(codeSegment) - LastAddr;
 }
 
 void AnalyseBlock(RuntimeBlockInfo* blk);
 
-static char block_hash[1024];
+static thread_local char block_hash[1024];
 
 const char* RuntimeBlockInfo::hash()
 {
@@ -139,7 +172,7 @@ const char* RuntimeBlockInfo::hash()
 	return block_hash;
 }
 
-bool RuntimeBlockInfo::Setup(u32 rpc,fpscr_t rfpu_cfg)
+bool RuntimeBlockInfo::Setup(u32 rpc,fpscr_t rfpu_cfg,DecodeMode mode)
 {
 	staging_runs=addr=lookups=runs=host_code_size=0;
 	guest_cycles=guest_opcodes=host_opcodes=0;
@@ -152,10 +185,16 @@ bool RuntimeBlockInfo::Setup(u32 rpc,fpscr_t rfpu_cfg)
 	BlockType = BET_SCL_Intr;
 	has_fpu_op = false;
 	temp_block = false;
+	linked_pages = 0;
+	baseline = mode == DM_Baseline;
+	superblock = mode == DM_Superblock;
+	cache_hit = false;
 	
 	vaddr = rpc;
 	if (mmu_enabled())
 	{
+		if (mode == DM_Background || mode == DM_Superblock)
+			return false;
 		u32 rv = mmu_instruction_translation(vaddr, addr);
 		if (rv != MMU_ERROR_NONE)
 		{
@@ -169,36 +208,91 @@ bool RuntimeBlockInfo::Setup(u32 rpc,fpscr_t rfpu_cfg)
 	
 	oplist.clear();
 
+	if (mode == DM_Normal || mode == DM_Background)
+	{
+		std::unique_lock<std::mutex> lock(blockCacheMutex);
+		if (bc_Lookup(this, mode == DM_Background))
+		{
+			lock.unlock();
+			cache_hit = true;
+			if (mode == DM_Normal)
+			{
+				SetProtectedFlags();
+				prof.counters.bm.cache_hits++;
+			}
+			return true;
+		}
+	}
 	try {
-		if (!dec_DecodeBlock(this, SH4_TIMESLICE / 2))
+		if (!dec_DecodeBlock(this, SH4_TIMESLICE / 2, mode))
 			return false;
 	}
 	catch (SH4ThrownException& ex) {
-		Do_Exception(rpc, ex.expEvn, ex.callVect);
+		// Only raised on the cpu thread, for the block about to run
+		if (mode == DM_Normal || mode == DM_Baseline)
+			Do_Exception(rpc, ex.expEvn, ex.callVect);
 		return false;
 	}
-	SetProtectedFlags();
+	// In background mode, read_only is set by the caller: the block manager belongs to the cpu thread,
+	// which checks it when the block is installed.
+	if (mode == DM_Superblock)
+		read_only = bm_IsCodeProtectable(addr, sh4_code_size);
+	else if (mode != DM_Background)
+		SetProtectedFlags();
 
 	AnalyseBlock(this);
+	if (mode == DM_Normal)
+	{
+		std::lock_guard<std::mutex> lock(blockCacheMutex);
+		bc_Add(this);
+	}
 
 	return true;
 }
 
-DynarecCodeEntryPtr rdv_CompilePC(u32 blockcheck_failures)
+static u32 elapsedUs(std::chrono::steady_clock::time_point since)
 {
-	u32 pc=next_pc;
-
-	if (emit_FreeSpace()<16*1024 || pc==0x8c0000e0 || pc==0xac010000 || pc==0xac008300)
-		recSh4_ClearCache();
+	return (u32)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - since).count();
+}
 
-	RuntimeBlockInfo* rbi = ngen_AllocateBlock();
+static void addStall(u32 us)
+{
+	u32 i = 0;
+	while (us > 1 && i < 15)
+	{
+		us >>= 1;
+		i++;
+	}
+	prof.counters.bm.stall_us[i]++;
+}
 
-	if (!rbi->Setup(pc,fpscr))
+// Upper bound of the compilation time on the cpu thread of the given fraction of the blocks
+static u32 stallPercentile(float fraction)
+{
+	auto& bm = prof.counters.bm;
+	u32 total = 0;
+	for (u32 count : bm.stall_us)
+		total += count;
+	u32 count = 0;
+	for (int i = 0; i < 16; i++)
 	{
-		delete rbi;
-		return NULL;
+		count += bm.stall_us[i];
+		if (count >= total * fraction)
+			return 2 << i;
 	}
-	rbi->blockcheck_failures = blockcheck_failures;
+	return 2 << 15;
+}
+
+static bool asyncCompile(u32 pc)
+{
+	// Decoded blocks are invalidated by hashing the system RAM they depend on
+	return config::DynarecAsyncCompile && !mmu_enabled() && IsOnRam(pc)
+			&& async_failures.count(pc) == 0 && ac_Pending() < 4096;
+}
+
+static void emitBlock(RuntimeBlockInfo *rbi)
+{
+	u32 pc = rbi->vaddr;
 	if (smc_hotspots.find(rbi->addr) != smc_hotspots.end())
 	{
 		if (TEMP_CODE_SIZE - TempLastAddr < 16 * 1024)
@@ -209,13 +303,25 @@ DynarecCodeEntryPtr rdv_CompilePC(u32 blockcheck_failures)
 		if (rbi->read_only)
 			INFO_LOG(DYNAREC, "WARNING: temp block %x (%x) is protected!", rbi->vaddr, rbi->addr);
 	}
+	else
+		codeStart = std::min(codeStart, LastAddr);
 	bool do_opts = !rbi->temp_block;
 	rbi->staging_runs=do_opts?100:-100;
 	bool block_check = !rbi->read_only;
+	auto start = std::chrono::steady_clock::now();
 	ngen_Compile(rbi, block_check, (pc & 0xFFFFFF) == 0x08300 || (pc & 0xFFFFFF) == 0x10000, false, do_opts);
 	verify(rbi->code!=0);
+	prof.counters.bm.codegen_us += elapsedUs(start);
 
 	bm_AddBlock(rbi);
+#if FEAT_SHREC == DYNAREC_JIT
+	// Only needed to generate the host code
+	if (!rdv_KeepShil)
+		std::vector<shil_opcode>().swap(rbi->oplist);
+#endif
+	if (config::DynarecSuperblocks && !mmu_enabled() && rbi->read_only && !rbi->superblock && !rbi->baseline
+			&& (rbi->BlockType == BET_StaticJump || rbi->BlockType == BET_StaticCall))
+		superblockCandidates.push_back(bm_GetBlock((void *)CC_RW2RX(rbi->code)));
 
 	if (emit_ptr != NULL)
 	{
@@ -223,10 +329,223 @@ DynarecCodeEntryPtr rdv_CompilePC(u32 blockcheck_failures)
 		emit_ptr = NULL;
 		emit_ptr_limit = NULL;
 	}
+}
+
+// Generates the host code of a block again. Its guest code is write protected so it hasn't changed.
+static bool regenerateBlock(const RuntimeBlockInfo& block)
+{
+	RuntimeBlockInfo *rbi = ngen_AllocateBlock();
+	rbi->read_only = true;
+	// No exception can be raised, and the block cache makes decoding cheap
+	if (!rbi->Setup(block.vaddr, block.fpu_cfg, block.superblock ? DM_Superblock : DM_Background)
+			|| !rbi->read_only || rbi->sh4_code_size != block.sh4_code_size
+			|| !bm_IsCodeProtectable(rbi->addr, rbi->sh4_code_size))
+	{
+		// Not accounted for by the block manager
+		rbi->sh4_code_size = 0;
+		delete rbi;
+		return false;
+	}
+	rbi->SetProtectedFlags();
+	rbi->blockcheck_failures = 0;
+	emitBlock(rbi);
+
+	return true;
+}
+
+/*
+	Reuses the next segment of the code cache, which holds the oldest blocks.
+	They are discarded, except the most used ones, whose host code is generated again at the
+	start of the segment.
+*/
+static void reclaimCodeSegment()
+{
+	if (CODE_SEGMENTS == 1)
+	{
+		recSh4_ClearCache();
+		return;
+	}
+	// Blocks run this many times since they were generated are kept
+	const u32 HotBlockRuns = 32;
+
+	codeSegment = (codeSegment + 1) % CODE_SEGMENTS;
+	u32 start = std::max(segmentStart(codeSegment), codeStart);
+	u32 end = segmentEnd(codeSegment);
+	DEBUG_LOG(DYNAREC, "recSh4: reclaiming code segment %d at %08X", codeSegment, next_pc);
+	std::vector<RuntimeBlockInfoPtr> blocks = bm_ReclaimCode(&CodeCache[start], &CodeCache[end]);
+	LastAddr = start;
+
+	// Blocks in writable pages may have been modified since
+	std::vector<RuntimeBlockInfoPtr> hotBlocks;
+	if (!mmu_enabled())
+		for (const auto& block : blocks)
+			if (block->runs >= HotBlockRuns && block->read_only && !block->baseline)
+				hotBlocks.push_back(block);
+	std::sort(hotBlocks.begin(), hotBlocks.end(), [](const RuntimeBlockInfoPtr& a, const RuntimeBlockInfoPtr& b) {
+		return a->runs > b->runs;
+	});
+	// Use at most a quarter of the segment
+	u32 limit = start + (end - start) / 4;
+	u32 kept = 0;
+	for (const auto& block : hotBlocks)
+	{
+		if (LastAddr + block->host_code_size > limit || emit_FreeSpace() < 16 * 1024 + block->host_code_size)
+			break;
+		if (regenerateBlock(*block))
+			kept++;
+	}
+	auto& bm = prof.counters.bm;
+	bm.reclaimed++;
+	bm.evicted += blocks.size() - kept;
+	bm.kept += kept;
+}
+
+DynarecCodeEntryPtr rdv_CompilePC(u32 blockcheck_failures)
+{
+	u32 pc=next_pc;
+
+	if (pc==0x8c0000e0 || pc==0xac010000 || pc==0xac008300)
+		recSh4_ClearCache();
+	else if (emit_FreeSpace()<16*1024)
+		reclaimCodeSegment();
+
+	RuntimeBlockInfo* rbi = ngen_AllocateBlock();
+
+	auto start = std::chrono::steady_clock::now();
+	bool async = blockcheck_failures == 0 && asyncCompile(pc);
+	if (!rbi->Setup(pc, fpscr, async ? DM_Baseline : DM_Normal))
+	{
+		delete rbi;
+		return NULL;
+	}
+	prof.counters.bm.decode_us += elapsedUs(start);
+	if (async)
+		prof.counters.bm.baseline++;
+	else
+		prof.counters.bm.compiled++;
+	rbi->blockcheck_failures = blockcheck_failures;
+	emitBlock(rbi);
+	if (async)
+		ac_Request(pc, rbi->fpu_cfg, rbi->read_only);
+	addStall(elapsedUs(start));
 
 	return rbi->code;
 }
 
+void rdv_InstallCompiledBlocks()
+{
+	auto& bm = prof.counters.bm;
+	AsyncResult result;
+	while (ac_GetResult(result))
+	{
+		auto start = std::chrono::steady_clock::now();
+		RuntimeBlockInfo *rbi = result.block;
+		RuntimeBlockInfoPtr baseline = bm_GetBlock(result.addr);
+		if (!baseline || !baseline->baseline
+				|| (rbi != nullptr && (rbi->fpu_cfg.PR != baseline->fpu_cfg.PR
+						|| rbi->fpu_cfg.SZ != baseline->fpu_cfg.SZ
+						|| rbi->fpu_cfg.RM != baseline->fpu_cfg.RM)))
+		{
+			// The baseline block has been discarded or replaced since the request
+			if (rbi != nullptr)
+				ac_DeleteBlock(rbi);
+			continue;
+		}
+		if (rbi == nullptr
+				|| bm_IsCodeProtectable(rbi->addr, rbi->sh4_code_size) != rbi->read_only
+				|| bc_HashMemory(result.depStart, result.depSize) != result.depHash)
+		{
+			// The code has been modified: compile it on the cpu thread next time
+			if (rbi != nullptr)
+				ac_DeleteBlock(rbi);
+			async_failures.insert(result.addr);
+			bm_DiscardBlock(baseline.get());
+			bm.async_failed++;
+			continue;
+		}
+		if (emit_FreeSpace() < 16 * 1024)
+		{
+			// The code cache will be cleared on the next miss
+			ac_DeleteBlock(rbi);
+			continue;
+		}
+		bm_DiscardBlock(baseline.get());
+		rbi->SetProtectedFlags();
+		if (rbi->cache_hit)
+			bm.cache_hits++;
+		else
+		{
+			std::lock_guard<std::mutex> lock(blockCacheMutex);
+			bc_Add(rbi);
+		}
+		rbi->blockcheck_failures = 0;
+		emitBlock(rbi);
+		bm.async_installed++;
+		addStall(elapsedUs(start));
+	}
+}
+
+// Returns false if the block can't be extended
+static bool compileSuperblock(const RuntimeBlockInfoPtr& block)
+{
+	RuntimeBlockInfo *rbi = ngen_AllocateBlock();
+	auto start = std::chrono::steady_clock::now();
+	if (!rbi->Setup(block->vaddr, block->fpu_cfg, DM_Superblock)
+			|| rbi->guest_opcodes <= block->guest_opcodes || !rbi->read_only)
+	{
+		// Not accounted for by the block manager
+		rbi->sh4_code_size = 0;
+		delete rbi;
+		return false;
+	}
+	prof.counters.bm.decode_us += elapsedUs(start);
+	bm_DiscardBlock(block.get());
+	rbi->SetProtectedFlags();
+	rbi->blockcheck_failures = 0;
+	emitBlock(rbi);
+
+	return true;
+}
+
+void rdv_CompileSuperblocks()
+{
+	// Runs of a block since it was compiled before it is extended
+	const u32 SuperblockRuns = 5000;
+	// Superblocks compiled at most per call
+	const u32 MaxSuperblocks = 64;
+
+	if (!config::DynarecSuperblocks || mmu_enabled())
+	{
+		superblockCandidates.clear();
+		return;
+	}
+	auto& bm = prof.counters.bm;
+	u32 compiled = 0;
+	for (size_t i = 0; i < superblockCandidates.size(); )
+	{
+		const RuntimeBlockInfoPtr& candidate = superblockCandidates[i];
+		// Discarded blocks are dropped
+		bool discarded = bm_GetCodeByVAddr(candidate->vaddr) != (DynarecCodeEntryPtr)CC_RW2RX(candidate->code);
+		if (!discarded && (candidate->runs < SuperblockRuns || compiled >= MaxSuperblocks || emit_FreeSpace() < 16 * 1024))
+		{
+			i++;
+			continue;
+		}
+		RuntimeBlockInfoPtr block = candidate;
+		superblockCandidates[i] = superblockCandidates.back();
+		superblockCandidates.pop_back();
+		if (discarded || bm_GetBlock(block->vaddr) != block)
+			continue;
+		if (compileSuperblock(block))
+		{
+			bm.superblocks++;
+			compiled++;
+		}
+		else
+			bm.superblock_rejects++;
+	}
+}
+
 DynarecCodeEntryPtr DYNACALL rdv_FailedToFindBlock_pc()
 {
 	return rdv_FailedToFindBlock(next_pc);
@@ -236,6 +555,11 @@ DynarecCodeEntryPtr DYNACALL rdv_FailedToFindBlock(u32 pc)
 {
 	//DEBUG_LOG(DYNAREC, "rdv_FailedToFindBlock %08x", pc);
 	next_pc=pc;
+	// Best done here rather than while compiling a block called from another one,
+	// since the code of the latter may be overwritten
+	if (CODE_SEGMENTS > 1 && emit_FreeSpace() < 256 * 1024)
+		reclaimCodeSegment();
+	rdv_InstallCompiledBlocks();
 	DynarecCodeEntryPtr code = rdv_CompilePC(0);
 	if (code == NULL)
 		code = bm_GetCodeByVAddr(next_pc);
@@ -333,6 +657,9 @@ void* DYNACALL rdv_LinkBlock(u8* code,u32 dpc)
 	}
 
 	DynarecCodeEntryPtr rv = rdv_FindOrCompile();  // Returns rx ptr
+	// the block may have been discarded to reclaim its code
+	if (!stale_block && bm_GetBlock(code) != rbi)
+		stale_block = true;
 
 	if (!mmu_enabled() && !stale_block)
 	{
@@ -390,6 +717,54 @@ static void recSh4_Reset(bool hard)
 	recSh4_ClearCache();
 }
 
+static std::string blockCachePath()
+{
+	return get_game_save_prefix() + ".blocks";
+}
+
+static bool blockCacheEnabled()
+{
+	// not when booting the BIOS
+	return config::DynarecBlockCache && settings.imgread.ImagePath[0] != '\0';
+}
+
+static void dynarecEvent(Event event)
+{
+	auto& bm = prof.counters.bm;
+	switch (event)
+	{
+	case Event::Start:
+		bc_Clear();
+		bm.compiled = bm.cache_hits = bm.decode_us = bm.codegen_us = 0;
+		bm.baseline = bm.async_installed = bm.async_failed = 0;
+		bm.reclaimed = bm.evicted = bm.kept = 0;
+		bm.superblocks = bm.superblock_rejects = 0;
+		memset(bm.stall_us, 0, sizeof(bm.stall_us));
+		if (blockCacheEnabled())
+			bc_Load(blockCachePath());
+		break;
+	case Event::Terminate:
+		ac_Term();
+		if (bm.compiled != 0)
+			INFO_LOG(DYNAREC, "%d blocks compiled, %d from the block cache: decoding %d ms, host code %d ms",
+					bm.compiled, bm.cache_hits, bm.decode_us / 1000, bm.codegen_us / 1000);
+		if (bm.baseline != 0)
+			INFO_LOG(DYNAREC, "%d baseline blocks, %d replaced, %d failed", bm.baseline, bm.async_installed, bm.async_failed);
+		if (bm.reclaimed != 0)
+			INFO_LOG(DYNAREC, "%d code segments reclaimed: %d blocks discarded, %d kept", bm.reclaimed, bm.evicted, bm.kept);
+		if (bm.superblocks + bm.superblock_rejects != 0)
+			INFO_LOG(DYNAREC, "%d superblocks compiled, %d blocks not extended", bm.superblocks, bm.superblock_rejects);
+		if (bm.compiled + bm.baseline != 0)
+			INFO_LOG(DYNAREC, "Compilation stalls: 50%% < %d us, 99%% < %d us", stallPercentile(0.5f), stallPercentile(0.99f));
+		if (blockCacheEnabled())
+			bc_Save(blockCachePath());
+		bc_Clear();
+		break;
+	default:
+		break;
+	}
+}
+
 static void recSh4_Init()
 {
 	INFO_LOG(DYNAREC, "recSh4 Init");
@@ -427,11 +802,16 @@ static void recSh4_Init()
 	TempCodeCache = CodeCache + CODE_SIZE;
 	ngen_init();
 	bm_ResetCache();
+	EventManager::listen(Event::Start, dynarecEvent);
+	EventManager::listen(Event::Terminate, dynarecEvent);
 }
 
 static void recSh4_Term()
 {
 	INFO_LOG(DYNAREC, "recSh4 Term");
+	EventManager::unlisten(Event::Start, dynarecEvent);
+	EventManager::unlisten(Event::Terminate, dynarecEvent);
+	ac_Term();
 	bm_Term();
 	sh4Interp.Term();
 }
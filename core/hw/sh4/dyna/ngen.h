@@ -47,6 +47,13 @@
 
 #define CODE_SIZE   (10*1024*1024)
 #define TEMP_CODE_SIZE (1024*1024)
+// The code cache is split into segments reclaimed in turn when it's full
+#if FEAT_SHREC == DYNAREC_CPP
+// the block table of the cpp dynarec can only be reset with the whole cache
+#define CODE_SEGMENTS 1
+#else
+#define CODE_SEGMENTS 8
+#endif
 
 // When NO_RWX is enabled there's two address-spaces, one executable and
 // one writtable. The emitter and most of the code in rec-* will work with
@@ -81,6 +88,12 @@ DynarecCodeEntryPtr DYNACALL rdv_BlockCheckFail(u32 addr);
 DynarecCodeEntryPtr rdv_CompilePC(u32 blockcheck_failures);
 //Finds or compiles code @pc
 DynarecCodeEntryPtr rdv_FindOrCompile();
+//Replaces the baseline blocks with the blocks compiled in the background
+void rdv_InstallCompiledBlocks();
+//Recompiles the most used blocks ending with a static branch together with the following blocks
+void rdv_CompileSuperblocks();
+//Keep the shil code of the blocks once compiled, for debugging
+extern bool rdv_KeepShil;
 
 //code -> pointer to code of block, dpc -> if dynamic block, pc. if cond, 0 for next, 1 for branch
 void* DYNACALL rdv_LinkBlock(u8* code,u32 dpc);
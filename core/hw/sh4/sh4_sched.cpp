@@ -25,6 +25,15 @@ std::vector<sched_list> sch_list;	// using list as external inside a macro confu
 
 int sh4_sched_next_id=-1;
 
+/*
+	Pending events, as a binary min-heap of sch_list ids ordered by deadline.
+	sch_list is the reference state (it is what gets serialized): the heap is
+	rebuilt from it by sh4_sched_ffts().
+*/
+static std::vector<int> sch_heap;
+static std::vector<int> sch_heap_pos;	// index of each id in sch_heap, -1 if not scheduled
+static std::vector<int> sch_due;		// events being dispatched by sh4_sched_tick
+
 u32 sh4_sched_remaining(size_t id, u32 reference)
 {
 	if (sch_list[id].end != -1)
@@ -38,36 +47,110 @@ u32 sh4_sched_remaining(size_t id)
 	return sh4_sched_remaining(id, sh4_sched_now());
 }
 
-void sh4_sched_ffts()
+// Deadlines are at most SH4_MAIN_CLOCK cycles apart so the wrapping difference orders them
+static bool heap_before(int a, int b)
+{
+	int diff = sch_list[a].end - sch_list[b].end;
+	return diff < 0 || (diff == 0 && a < b);
+}
+
+static void heap_set(size_t idx, int id)
 {
-	u32 diff=-1;
-	int slot=-1;
+	sch_heap[idx] = id;
+	sch_heap_pos[id] = idx;
+}
 
-	for (size_t i=0;i<sch_list.size();i++)
+static void heap_up(size_t idx)
+{
+	int id = sch_heap[idx];
+	while (idx > 0)
 	{
-		if (sh4_sched_remaining(i)<diff)
-		{
-			slot=i;
-			diff=sh4_sched_remaining(i);
-		}
+		size_t parent = (idx - 1) / 2;
+		if (!heap_before(id, sch_heap[parent]))
+			break;
+		heap_set(idx, sch_heap[parent]);
+		idx = parent;
+	}
+	heap_set(idx, id);
+}
+
+static void heap_down(size_t idx)
+{
+	int id = sch_heap[idx];
+	for (;;)
+	{
+		size_t child = idx * 2 + 1;
+		if (child >= sch_heap.size())
+			break;
+		if (child + 1 < sch_heap.size() && heap_before(sch_heap[child + 1], sch_heap[child]))
+			child++;
+		if (!heap_before(sch_heap[child], id))
+			break;
+		heap_set(idx, sch_heap[child]);
+		idx = child;
 	}
+	heap_set(idx, id);
+}
 
+static void heap_remove(int id)
+{
+	int idx = sch_heap_pos[id];
+	if (idx == -1)
+		return;
+	sch_heap_pos[id] = -1;
+	int last = sch_heap.back();
+	sch_heap.pop_back();
+	if (last == id)
+		return;
+	heap_set(idx, last);
+	heap_up(idx);
+	heap_down(sch_heap_pos[last]);
+}
+
+static void heap_insert(int id)
+{
+	sch_heap.push_back(id);
+	heap_up(sch_heap.size() - 1);
+}
+
+// Sets the time slice to the earliest deadline
+static void sh4_sched_next_update()
+{
+	u32 now=sh4_sched_now();
 	sh4_sched_ffb-=Sh4cntx.sh4_sched_next;
 
-	sh4_sched_next_id=slot;
-	if (slot!=-1)
-		Sh4cntx.sh4_sched_next=diff;
+	if (!sch_heap.empty())
+	{
+		sh4_sched_next_id=sch_heap[0];
+		int diff=sch_list[sh4_sched_next_id].end-now;
+		Sh4cntx.sh4_sched_next=std::max(0, diff);
+	}
 	else
+	{
+		sh4_sched_next_id=-1;
 		Sh4cntx.sh4_sched_next=SH4_MAIN_CLOCK;
+	}
 
 	sh4_sched_ffb+=Sh4cntx.sh4_sched_next;
 }
 
+void sh4_sched_ffts()
+{
+	sch_heap.clear();
+	sch_heap_pos.assign(sch_list.size(), -1);
+	for (size_t i=0;i<sch_list.size();i++)
+		if (sch_list[i].end!=-1)
+			heap_insert(i);
+
+	sh4_sched_next_update();
+}
+
 int sh4_sched_register(int tag, sh4_sched_callback* ssc)
 {
 	sched_list t={ssc,tag,-1,-1};
 
 	sch_list.push_back(t);
+	sch_heap_pos.push_back(-1);
 
 	return sch_list.size()-1;
 }
@@ -96,15 +179,24 @@ void sh4_sched_request(size_t id, int cycles)
 	if (cycles == -1)
 	{
 		sch_list[id].end = -1;
+		heap_remove(id);
 	}
 	else
 	{
 		sch_list[id].end = sch_list[id].start + cycles;
 		if (sch_list[id].end == -1)
 			sch_list[id].end++;
+		if (sch_heap_pos[id] == -1)
+			heap_insert(id);
+		else
+		{
+			// already scheduled: move it to its new place
+			heap_up(sch_heap_pos[id]);
+			heap_down(sch_heap_pos[id]);
+		}
 	}
 
-	sh4_sched_ffts();
+	sh4_sched_next_update();
 }
 
 /* Returns how much time has passed for this callback */
@@ -142,17 +234,22 @@ void sh4_sched_tick(int cycles)
 
 	if (Sh4cntx.sh4_sched_next<0)
 	{
-		u32 fztime=sh4_sched_now()-cycles;
-		if (sh4_sched_next_id!=-1)
+		// Take all the events that are due, in deadline order, before running any callback.
+		// Callbacks may reschedule or cancel events: those due again are run on the next tick.
+		u32 now=sh4_sched_now();
+		sch_due.clear();
+		while (!sch_heap.empty() && (int)(sch_list[sch_heap[0]].end-now)<=0)
+		{
+			int id=sch_heap[0];
+			sch_due.push_back(id);
+			heap_remove(id);
+		}
+		for (size_t i = 0; i < sch_due.size(); i++)
 		{
-			for (size_t i = 0; i < sch_list.size(); i++)
-			{
-				u32 remaining = sh4_sched_remaining(i, fztime);
-				verify(remaining >= 0 || remaining == -1);
-				if (remaining >= 0 && remaining <= (u32)cycles)
-					handle_cb(i);
-			}
+			int id=sch_due[i];
+			if (sch_heap_pos[id]==-1 && sch_list[id].end!=-1)
+				handle_cb(id);
 		}
-		sh4_sched_ffts();
+		sh4_sched_next_update();
 	}
 }
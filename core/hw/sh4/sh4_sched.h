@@ -42,6 +42,10 @@ void sh4_sched_request(size_t id, int cycles);
 */
 void sh4_sched_tick(int cycles);
 
+/*
+	Rebuild the event queue from sch_list and update the time slice.
+	Must be called after sch_list has been modified directly (savestates)
+*/
 void sh4_sched_ffts();
 
 struct sched_list
@@ -3,6 +3,7 @@
 
 //Get a copy of the operators for structs ... ugly , but works :)
 #include "common.h"
+#include "readahead.h"
 
 void GetSessionInfo(u8* out,u8 ses);
 
@@ -16,11 +17,18 @@ void libGDR_ReadSubChannel(u8 * buff, u32 format, u32 len)
 
 void libGDR_ReadSector(u8 * buff,u32 StartSector,u32 SectorCount,u32 secsz)
 {
-	GetDriveSector(buff,StartSector,SectorCount,secsz);
+	u32 read = ra_Read(buff,StartSector,SectorCount,secsz);
+	if (read < SectorCount)
+		GetDriveSector(buff + read * secsz,StartSector + read,SectorCount - read,secsz);
 	//if (CurrDrive)
 	//	CurrDrive->ReadSector(buff,StartSector,SectorCount,secsz);
 }
 
+void libGDR_ReadAhead(u32 StartSector,u32 secsz)
+{
+	ra_Start(StartSector,secsz);
+}
+
 void libGDR_GetToc(u32* toc,u32 area)
 {
 	GetDriveToc(toc,(DiskArea)area);
@@ -89,4 +97,5 @@ s32 libGDR_Init()
 void libGDR_Term()
 {
 	TermDrive();
+	ra_Term();
 }
@@ -1,4 +1,6 @@
 #include "common.h"
+#include "hunkcache.h"
+#include "cfg/option.h"
 
 #include <libchdr/chd.h>
 
@@ -9,18 +11,25 @@ struct CHDDisc : Disc
 {
 	chd_file *chd = nullptr;
 	FILE *fp = nullptr;
-	u8* hunk_mem = nullptr;
-	u32 old_hunk = 0;
+	// chd files read by the worker threads of the hunk cache
+	std::vector<chd_file *> workerChds;
+	std::vector<FILE *> workerFps;
+	HunkCache *cache = nullptr;
 
 	u32 hunkbytes = 0;
 	u32 sph = 0;
 
 	bool TryOpen(const char* file);
+	void OpenCache(const char* file, u32 hunkCount);
 
 	~CHDDisc() override
 	{
-		delete[] hunk_mem;
+		delete cache;
 
+		for (chd_file *workerChd : workerChds)
+			chd_close(workerChd);
+		for (FILE *workerFp : workerFps)
+			std::fclose(workerFp);
 		if (chd)
 			chd_close(chd);
 		if (fp)
@@ -49,15 +58,9 @@ struct CHDTrack : TrackFile
 	{
 		u32 fad_offs = FAD + Offset;
 		u32 hunk=(fad_offs)/disc->sph;
-		if (disc->old_hunk!=hunk)
-		{
-			chd_read(disc->chd,hunk,disc->hunk_mem); //CHDERR_NONE
-			disc->old_hunk = hunk;
-		}
-
 		u32 hunk_ofs = fad_offs%disc->sph;
 
-		memcpy(dst, disc->hunk_mem + hunk_ofs * (2352+96), fmt);
+		disc->cache->read(hunk, hunk_ofs * (2352+96), dst, fmt);
 
 		if (swap_bytes)
 		{
@@ -97,8 +100,6 @@ bool CHDDisc::TryOpen(const char* file)
 	const chd_header* head = chd_get_header(chd);
 
 	hunkbytes = head->hunkbytes;
-	hunk_mem = new u8[hunkbytes];
-	old_hunk=0xFFFFFFF;
 
 	sph = hunkbytes/(2352+96);
 
@@ -107,6 +108,7 @@ bool CHDDisc::TryOpen(const char* file)
 		INFO_LOG(GDROM, "chd: hunkbytes is invalid, %d\n",hunkbytes);
 		return false;
 	}
+	OpenCache(file, head->totalhunks);
 
 	u32 tag;
 	u8 flags;
@@ -186,6 +188,31 @@ bool CHDDisc::TryOpen(const char* file)
 	return true;
 }
 
+void CHDDisc::OpenCache(const char* file, u32 hunkCount)
+{
+	u32 prefetch = std::max(0, (int)config::CHDPrefetchHunks);
+	u32 workers = std::min(prefetch, std::max(1u, std::min(std::thread::hardware_concurrency() / 2, 4u)));
+	// each worker thread needs its own chd file
+	while (workerChds.size() < workers)
+	{
+		FILE *workerFp = nowide::fopen(file, "rb");
+		if (workerFp == nullptr)
+			break;
+		chd_file *workerChd;
+		if (chd_open_file(workerFp, CHD_OPEN_READ, 0, &workerChd) != CHDERR_NONE)
+		{
+			std::fclose(workerFp);
+			break;
+		}
+		workerFps.push_back(workerFp);
+		workerChds.push_back(workerChd);
+	}
+	DEBUG_LOG(GDROM, "chd: caching %d hunks, %d prefetched by %d threads", (int)config::CHDCacheHunks, prefetch, (int)workerChds.size());
+	cache = new HunkCache(hunkbytes, hunkCount, std::max(1, (int)config::CHDCacheHunks), prefetch, workerChds.size(),
+			[this](u32 reader, u32 hunk, u8 *dst) {
+				return chd_read(reader == 0 ? chd : workerChds[reader - 1], hunk, dst) == CHDERR_NONE;
+			});
+}
 
 Disc* chd_parse(const char* file)
 {
@@ -1,4 +1,7 @@
 #include "common.h"
+#include "readahead.h"
+#include "preload.h"
+#include "cfg/option.h"
 
 Disc* chd_parse(const char* file);
 Disc* gdi_parse(const char* file);
@@ -10,6 +13,7 @@ Disc* ioctl_parse(const char* file);
 
 u32 NullDriveDiscType;
 Disc* disc;
+std::mutex disc_mutex;
 
 Disc*(*drivers[])(const char* path)=
 {
@@ -25,12 +29,12 @@ Disc*(*drivers[])(const char* path)=
 
 u8 q_subchannel[96];
 
-bool ConvertSector(u8* in_buff , u8* out_buff , int from , int to,int sector)
+bool ConvertSector(u8* in_buff , u8* out_buff , int from , int to,int sector, u8* subcode)
 {
 	//get subchannel data, if any
 	if (from == 2448)
 	{
-		memcpy(q_subchannel, in_buff + 2352, 96);
+		memcpy(subcode, in_buff + 2352, 96);
 		from -= 96;
 	}
 	//if no conversion
@@ -77,6 +81,38 @@ bool ConvertSector(u8* in_buff , u8* out_buff , int from , int to,int sector)
 	return true;
 }
 
+bool CopySectors(const u8* in_buff, u32 from, u32 count, u8* out_buff, u32 to)
+{
+	if (from == to && (to == 2352 || to == 2048))
+	{
+		memcpy(out_buff, in_buff, count * to);
+		return true;
+	}
+	u32 offset;
+	if (from == 2352 && to == 2340)
+		offset = 12;
+	else if (from == 2352 && to == 2328)
+		offset = 24;
+	else if (from == 2352 && to == 2336)
+		offset = 0x10;
+	else if (from == 2352 && to == 2048)
+		offset = 0;		// depends on the mode
+	else if (from == 2336 && to == 2048)
+		offset = 8;
+	else
+		return false;
+	for (u32 i = 0; i < count; i++)
+	{
+		if (offset != 0)
+			memcpy(out_buff, in_buff + offset, to);
+		else
+			memcpy(out_buff, in_buff + (in_buff[15] == 1 ? 0x10 : 0x18), to);
+		in_buff += from;
+		out_buff += to;
+	}
+	return true;
+}
+
 Disc* OpenDisc(const char* fn)
 {
 	Disc* rv = NULL;
@@ -106,6 +142,8 @@ bool InitDrive_(char* fn)
 	if (disc != NULL)
 	{
 		INFO_LOG(GDROM, "gdrom: Opened image \"%s\"", fn);
+		if (config::GDRomPreload != 0)
+			PreloadDisc(disc, config::GDRomPreload == 1);
 		NullDriveDiscType = Busy;
 	}
 	else
@@ -164,6 +202,7 @@ bool DiscSwap()
 
 void TermDrive()
 {
+	ra_Stop();
 	delete disc;
 	disc = NULL;
 }
@@ -195,6 +234,7 @@ static u32 CreateTrackInfo_se(u32 ctrl, u32 addr, u32 tracknum)
 
 void GetDriveSector(u8 * buff,u32 StartSector,u32 SectorCount,u32 secsz)
 {
+	std::lock_guard<std::mutex> lock(disc_mutex);
 	if (disc != nullptr)
 		disc->ReadSectors(StartSector, SectorCount, buff, secsz);
 }
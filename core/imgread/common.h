@@ -1,5 +1,6 @@
 #pragma once
 #include "types.h"
+#include <mutex>
 #include <vector>
 
 #include "emulator.h"
@@ -63,7 +64,10 @@ enum DiskArea
 	DoubleDensity
 };
 
-bool ConvertSector(u8* in_buff , u8* out_buff , int from , int to,int sector);
+bool ConvertSector(u8* in_buff , u8* out_buff , int from , int to,int sector, u8* subcode);
+// Converts count sectors like ConvertSector in a single pass, for the conversions not needing the subcode.
+// Returns false if the conversion isn't supported.
+bool CopySectors(const u8* in_buff, u32 from, u32 count, u8* out_buff, u32 to);
 
 bool InitDrive();
 void TermDrive();
@@ -88,6 +92,10 @@ struct Session
 struct TrackFile
 {
 	virtual void Read(u32 FAD,u8* dst,SectorFormat* sector_type,u8* subcode,SubcodeFormat* subcode_type)=0;
+	// Reads count sectors of fmt bytes at once. Returns the number of sectors read, 0 if not supported.
+	virtual u32 ReadSectors(u32 FAD, u32 count, u8* dst, u32 fmt) { return 0; }
+	// Last sector stored in the file, 0 if unknown
+	virtual u32 GetEndFAD() { return 0; }
 	virtual ~TrackFile() = default;;
 };
 
@@ -142,11 +150,29 @@ struct Disc
 		return false;
 	}
 
-	void ReadSectors(u32 FAD,u32 count,u8* dst,u32 fmt)
+	// Reads the sectors of the track containing FAD that can be read at once. Returns the number of sectors read.
+	u32 ReadTrackSectors(u32 FAD,u32 count,u8* dst,u32 fmt)
+	{
+		for (size_t i=tracks.size();i-->0;)
+		{
+			const Track& track = tracks[i];
+			if (FAD>=track.StartFAD && (FAD<=track.EndFAD || track.EndFAD==0) && track.file)
+			{
+				if (track.EndFAD != 0)
+					count = std::min(count, track.EndFAD - FAD + 1);
+				return track.file->ReadSectors(FAD, count, dst, fmt);
+			}
+		}
+		return 0;
+	}
+
+	// Returns true if the subcode was read
+	bool ReadSectors(u32 FAD,u32 count,u8* dst,u32 fmt,u8* subcode = q_subchannel)
 	{
 		u8 temp[2448];
 		SectorFormat secfmt;
 		SubcodeFormat subfmt;
+		bool subcodeRead = false;
 
 		u32 progress = ~0;
 		for (u32 i = 1; i <= count; i++)
@@ -165,12 +191,22 @@ struct Disc
 					gui_display_notification(status_str, 2000);
 				}
 			}
-			if (ReadSector(FAD,temp,&secfmt,q_subchannel,&subfmt))
+			// Up to 256 sectors at once, so that the progress is still reported
+			u32 read = ReadTrackSectors(FAD, std::min(count - i + 1, 256u), dst, fmt);
+			if (read > 0)
+			{
+				i += read - 1;
+				dst += read * fmt;
+				FAD += read;
+				continue;
+			}
+			if (ReadSector(FAD,temp,&secfmt,subcode,&subfmt))
 			{
+				subcodeRead |= subfmt != SUBFMT_NONE;
 				//TODO: Proper sector conversions
 				if (secfmt==SECFMT_2352)
 				{
-					ConvertSector(temp,dst,2352,fmt,FAD);
+					ConvertSector(temp,dst,2352,fmt,FAD,subcode);
 				}
 				else if (fmt == 2048 && secfmt==SECFMT_2336_MODE2)
 					memcpy(dst,temp+8,2048);
@@ -186,7 +222,8 @@ struct Disc
 				else if (fmt==2048 && secfmt==SECFMT_2448_MODE2)
 				{
 					// Pier Solar and the Great Architects
-					ConvertSector(temp, dst, 2448, fmt, FAD);
+					ConvertSector(temp, dst, 2448, fmt, FAD, subcode);
+					subcodeRead = true;
 				}
 				else
 				{
@@ -201,6 +238,7 @@ struct Disc
 			dst+=fmt;
 			FAD++;
 		}
+		return subcodeRead;
 	}
 	virtual ~Disc() 
 	{
@@ -253,6 +291,8 @@ struct Disc
 };
 
 extern Disc* disc;
+// Serializes the disc accesses of the emulation and of the read-ahead thread
+extern std::mutex disc_mutex;
 
 Disc* OpenDisc(const char* fn);
 
@@ -272,25 +312,48 @@ struct RawTrackFile : TrackFile
 		this->cleanup=true;
 	}
 
-	void Read(u32 FAD,u8* dst,SectorFormat* sector_type,u8* subcode,SubcodeFormat* subcode_type) override
+	SectorFormat GetSectorFormat()
 	{
 		//for now hackish
 		if (fmt==2352)
-			*sector_type=SECFMT_2352;
+			return SECFMT_2352;
 		else if (fmt==2048)
-			*sector_type=SECFMT_2048_MODE2_FORM1;
+			return SECFMT_2048_MODE2_FORM1;
 		else if (fmt==2336)
-			*sector_type=SECFMT_2336_MODE2;
+			return SECFMT_2336_MODE2;
 		else if (fmt==2448)
-			*sector_type=SECFMT_2448_MODE2;
+			return SECFMT_2448_MODE2;
 		else
 		{
 			verify(false);
+			return SECFMT_2352;
 		}
+	}
+
+	void Read(u32 FAD,u8* dst,SectorFormat* sector_type,u8* subcode,SubcodeFormat* subcode_type) override
+	{
+		*sector_type = GetSectorFormat();
 
 		std::fseek(file, offset + FAD * fmt, SEEK_SET);
 		std::fread(dst, 1, fmt, file);
 	}
+
+	// Only when the sectors don't need to be converted
+	u32 ReadSectors(u32 FAD, u32 count, u8* dst, u32 fmt) override
+	{
+		if (fmt != this->fmt || (fmt != 2352 && fmt != 2048))
+			return 0;
+		std::fseek(file, offset + FAD * fmt, SEEK_SET);
+		return (u32)std::fread(dst, fmt, count, file);
+	}
+
+	u32 GetEndFAD() override
+	{
+		std::fseek(file, 0, SEEK_END);
+		s64 size = (s64)std::ftell(file) - offset;
+		return size >= fmt ? (u32)(size / fmt) - 1 : 0;
+	}
+
 	~RawTrackFile() override
 	{
 		if (cleanup && file)
@@ -298,6 +361,10 @@ struct RawTrackFile : TrackFile
 	}
 };
 
+// Returns a track file mapped in memory if Dreamcast.GDRomMapFiles is enabled and the file can be mapped,
+// or a RawTrackFile
+TrackFile *NewRawTrackFile(FILE *file, u32 file_offs, u32 first_fad, u32 secfmt);
+
 DiscType GuessDiscType(bool m1, bool m2, bool da);
 void gd_setdisc();
 
@@ -308,6 +375,8 @@ void libGDR_Term();
 
 //IO
 void libGDR_ReadSector(u8 * buff,u32 StartSector,u32 SectorCount,u32 secsz);
+// The sectors starting at StartSector are about to be read sequentially
+void libGDR_ReadAhead(u32 StartSector,u32 secsz);
 void libGDR_ReadSubChannel(u8 * buff, u32 format, u32 len);
 void libGDR_GetToc(u32* toc,u32 area);
 u32 libGDR_GetDiscType();
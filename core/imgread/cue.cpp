@@ -187,7 +187,7 @@ Disc* cue_parse(const char* file)
 				t.EndFAD = current_fad - 1;
 				DEBUG_LOG(GDROM, "file[%zd] \"%s\": session %d type %s FAD:%d -> %d", disc->tracks.size() + 1, track_filename.c_str(), session_number, track_type.c_str(), t.StartFAD, t.EndFAD);
 				
-				t.file = new RawTrackFile(track_file, 0, t.StartFAD, sector_size);
+				t.file = NewRawTrackFile(track_file, 0, t.StartFAD, sector_size);
 				disc->tracks.push_back(t);
 				
 				track_number = -1;
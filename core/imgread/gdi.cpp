@@ -142,7 +142,7 @@ Disc* load_gdi(const char* file)
 		if (SSIZE!=0)
 		{
 			std::string path = basepath + normalize_path_separator(track_filename);
-			t.file = new RawTrackFile(nowide::fopen(path.c_str(), "rb"), OFFSET, t.StartFAD,SSIZE);
+			t.file = NewRawTrackFile(nowide::fopen(path.c_str(), "rb"), OFFSET, t.StartFAD,SSIZE);
 		}
 		if (!disc->tracks.empty())
 			disc->tracks.back().EndFAD = t.StartFAD - 1;
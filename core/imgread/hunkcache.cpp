@@ -0,0 +1,162 @@
+#include "hunkcache.h"
+#include "profiler/profiler.h"
+
+#include <algorithm>
+
+HunkCache::HunkCache(u32 hunkBytes, u32 hunkCount, u32 capacity, u32 prefetch, u32 workers, Reader reader)
+	: hunkBytes(hunkBytes), hunkCount(hunkCount), prefetch(workers > 0 ? prefetch : 0), reader(reader)
+{
+	if (this->prefetch == 0)
+		workers = 0;
+	// the hunks being decompressed can't be replaced
+	capacity = std::max(capacity, this->prefetch + workers + 1);
+	entries.resize(capacity);
+	memory.resize((size_t)capacity * hunkBytes);
+	for (u32 i = 0; i < capacity; i++)
+	{
+		entries[i].state = Empty;
+		entries[i].data = &memory[(size_t)i * hunkBytes];
+	}
+	for (u32 i = 0; i < workers; i++)
+		threads.emplace_back(&HunkCache::run, this, i + 1);
+}
+
+HunkCache::~HunkCache()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		exiting = true;
+		cond.notify_all();
+	}
+	for (std::thread& thread : threads)
+		thread.join();
+}
+
+bool HunkCache::read(u32 hunk, u32 offset, u8 *dst, u32 size)
+{
+	if (hunk >= hunkCount || offset + size > hunkBytes)
+		return false;
+	std::unique_lock<std::mutex> lock(mutex);
+	Entry *entry;
+	for (;;)
+	{
+		auto it = hunks.find(hunk);
+		if (it == hunks.end())
+		{
+			entry = allocate(hunk, false);
+			if (entry != nullptr)
+				break;
+		}
+		else
+		{
+			entry = it->second;
+			entry->lastUse = ++useCount;
+			entry->prefetched = false;
+			if (entry->state == Ready)
+			{
+				memcpy(dst, entry->data + offset, size);
+				prof.counters.gdrom.chd_hits++;
+				prefetchAfter(hunk);
+				return true;
+			}
+			if (entry->state == Queued)
+			{
+				// not started by a worker thread yet
+				queue.erase(std::find(queue.begin(), queue.end(), hunk));
+				entry->state = Decompressing;
+				break;
+			}
+			prof.counters.gdrom.chd_waits++;
+		}
+		cond.wait(lock);
+	}
+	lock.unlock();
+	bool success = reader(0, hunk, entry->data);
+	lock.lock();
+	prof.counters.gdrom.chd_hunks++;
+	if (!success)
+	{
+		release(*entry);
+		return false;
+	}
+	entry->state = Ready;
+	memcpy(dst, entry->data + offset, size);
+	prefetchAfter(hunk);
+	return true;
+}
+
+// Replaces an empty or the least recently used entry. Hunks prefetched but not read yet are only replaced
+// by the hunks read. Returns nullptr if no entry can be replaced.
+HunkCache::Entry *HunkCache::allocate(u32 hunk, bool prefetching)
+{
+	Entry *lru = nullptr;
+	for (Entry& entry : entries)
+	{
+		if (entry.state == Empty)
+		{
+			lru = &entry;
+			break;
+		}
+		if (entry.state == Ready && !(prefetching && entry.prefetched)
+				&& (lru == nullptr || entry.lastUse < lru->lastUse))
+			lru = &entry;
+	}
+	if (lru == nullptr)
+		return nullptr;
+	if (lru->state == Ready)
+		hunks.erase(lru->hunk);
+	lru->hunk = hunk;
+	lru->state = prefetching ? Queued : Decompressing;
+	lru->prefetched = prefetching;
+	lru->lastUse = ++useCount;
+	hunks[hunk] = lru;
+	return lru;
+}
+
+void HunkCache::release(Entry& entry)
+{
+	hunks.erase(entry.hunk);
+	entry.state = Empty;
+	cond.notify_all();
+}
+
+void HunkCache::prefetchAfter(u32 hunk)
+{
+	for (u32 next = hunk + 1; next <= hunk + prefetch && next < hunkCount && queue.size() < prefetch; next++)
+	{
+		if (hunks.count(next) != 0)
+			continue;
+		if (allocate(next, true) == nullptr)
+			break;
+		queue.push_back(next);
+		cond.notify_all();
+	}
+}
+
+void HunkCache::run(u32 index)
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	for (;;)
+	{
+		cond.wait(lock, [this]() { return exiting || !queue.empty(); });
+		if (exiting)
+			break;
+		u32 hunk = queue.front();
+		queue.pop_front();
+		Entry *entry = hunks[hunk];
+		entry->state = Decompressing;
+		lock.unlock();
+		bool success = reader(index, hunk, entry->data);
+		lock.lock();
+		prof.counters.gdrom.chd_hunks++;
+		if (success)
+		{
+			entry->state = Ready;
+			cond.notify_all();
+		}
+		else
+		{
+			release(*entry);
+		}
+	}
+}
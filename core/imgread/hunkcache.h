@@ -0,0 +1,64 @@
+/*
+	Cache of decompressed CHD hunks.
+
+	The least recently used hunk is replaced on a miss, so that interleaved reads (CDDA and data)
+	don't decompress the same hunks again and again.
+	Worker threads decompress the hunks following each hunk read, up to prefetch hunks ahead, and
+	a read of a hunk being decompressed waits for it. Each thread uses its own reader (index 0 for
+	the emulation thread) since a chd file can't be read by several threads.
+*/
+#pragma once
+#include "types.h"
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+class HunkCache
+{
+public:
+	// Decompresses a hunk with the given reader. Returns false on error.
+	using Reader = std::function<bool(u32 reader, u32 hunk, u8 *dst)>;
+
+	HunkCache(u32 hunkBytes, u32 hunkCount, u32 capacity, u32 prefetch, u32 workers, Reader reader);
+	~HunkCache();
+
+	// Copies size bytes at offset in the hunk. Returns false if the hunk can't be read.
+	bool read(u32 hunk, u32 offset, u8 *dst, u32 size);
+
+private:
+	enum State { Empty, Queued, Decompressing, Ready };
+	struct Entry
+	{
+		u32 hunk;
+		State state;
+		bool prefetched;	// not read yet
+		u64 lastUse;
+		u8 *data;
+	};
+
+	Entry *allocate(u32 hunk, bool prefetching);
+	void release(Entry& entry);
+	void prefetchAfter(u32 hunk);
+	void run(u32 index);
+
+	const u32 hunkBytes;
+	const u32 hunkCount;
+	const u32 prefetch;
+	const Reader reader;
+
+	std::vector<Entry> entries;
+	std::vector<u8> memory;
+	std::unordered_map<u32, Entry *> hunks;
+	u64 useCount = 0;
+
+	std::mutex mutex;
+	std::condition_variable cond;	// hunk decompressed, queued or exit
+	std::deque<u32> queue;
+	std::vector<std::thread> threads;
+	bool exiting = false;
+};
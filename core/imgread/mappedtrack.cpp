@@ -0,0 +1,114 @@
+#include "common.h"
+#include "cfg/option.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#include <io.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+// Sectors are copied directly from the file mapped in memory. Used on 64-bit hosts only, since tracks can be
+// as large as 1 GB.
+struct MappedTrackFile : RawTrackFile
+{
+	const u8 *data = nullptr;
+	size_t size = 0;
+#ifdef _WIN32
+	HANDLE mapping = NULL;
+#endif
+
+	MappedTrackFile(FILE *file, u32 file_offs, u32 first_fad, u32 secfmt)
+		: RawTrackFile(file, file_offs, first_fad, secfmt)
+	{
+	}
+
+	bool Map()
+	{
+		size = flycast::fsize(file);
+		if (size == 0)
+			return false;
+#ifdef _WIN32
+		mapping = CreateFileMapping((HANDLE)_get_osfhandle(_fileno(file)), NULL, PAGE_READONLY, 0, 0, NULL);
+		if (mapping == NULL)
+			return false;
+		data = (const u8 *)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+#else
+		void *p = mmap(nullptr, size, PROT_READ, MAP_SHARED, fileno(file), 0);
+		if (p != MAP_FAILED)
+			data = (const u8 *)p;
+#endif
+		return data != nullptr;
+	}
+
+	// Number of sectors in the file from FAD, up to count
+	u32 available(u32 FAD, u32 count)
+	{
+		s64 pos = (s64)offset + (s64)FAD * fmt;
+		if (pos < 0 || (size_t)pos >= size)
+			return 0;
+		return (u32)std::min<size_t>(count, (size - pos) / fmt);
+	}
+
+	void Read(u32 FAD,u8* dst,SectorFormat* sector_type,u8* subcode,SubcodeFormat* subcode_type) override
+	{
+		*sector_type = GetSectorFormat();
+		if (available(FAD, 1) == 1)
+			memcpy(dst, data + offset + (size_t)FAD * fmt, fmt);
+	}
+
+	u32 ReadSectors(u32 FAD, u32 count, u8* dst, u32 fmt) override
+	{
+		count = available(FAD, count);
+		if (count == 0)
+			return 0;
+		const u8 *src = data + offset + (size_t)FAD * this->fmt;
+#ifndef _WIN32
+		// Large transfers, such as when loading a naomi gd-rom game
+		size_t length = (size_t)count * this->fmt;
+		bool sequential = length >= 256 * 1024;
+		uintptr_t pageMask = sysconf(_SC_PAGESIZE) - 1;
+		void *start = (void *)((uintptr_t)src & ~pageMask);
+		length += (uintptr_t)src & pageMask;
+		if (sequential)
+			madvise(start, length, MADV_SEQUENTIAL);
+#endif
+		bool copied = CopySectors(src, this->fmt, count, dst, fmt);
+#ifndef _WIN32
+		if (sequential)
+			madvise(start, length, MADV_NORMAL);
+#endif
+		return copied ? count : 0;
+	}
+
+	~MappedTrackFile() override
+	{
+#ifdef _WIN32
+		if (data != nullptr)
+			UnmapViewOfFile(data);
+		if (mapping != NULL)
+			CloseHandle(mapping);
+#else
+		if (data != nullptr)
+			munmap((void *)data, size);
+#endif
+	}
+};
+
+TrackFile *NewRawTrackFile(FILE *file, u32 file_offs, u32 first_fad, u32 secfmt)
+{
+#if HOST_CPU == CPU_X64 || HOST_CPU == CPU_ARM64
+	if (config::GDRomMapFiles && file != nullptr)
+	{
+		MappedTrackFile *track = new MappedTrackFile(file, file_offs, first_fad, secfmt);
+		if (track->Map())
+			return track;
+		WARN_LOG(GDROM, "Track file can't be mapped in memory");
+		// the file is still used by the RawTrackFile
+		track->cleanup = false;
+		delete track;
+	}
+#endif
+	return new RawTrackFile(file, file_offs, first_fad, secfmt);
+}
@@ -0,0 +1,260 @@
+#include "preload.h"
+#include "common.h"
+
+#include <chrono>
+#include <memory>
+#include <zlib.h>
+
+#ifndef TARGET_NO_OPENMP
+#include <omp.h>
+#endif
+
+namespace
+{
+
+const u32 BlockSize = 64 * 1024;
+// blocks read before being compressed in parallel
+const u32 BatchBlocks = 64;
+
+struct Block
+{
+	std::vector<u8> data;
+	bool compressed;
+};
+
+// The sectors of a track, all of the same format
+struct PreloadedTrackFile : TrackFile
+{
+	u32 StartFAD;
+	u32 sectorCount;
+	SectorFormat sectorType;
+	SubcodeFormat subcodeType;
+	u32 sectorSize;			// data and subcode
+	u32 blockSectors;
+	std::vector<Block> blocks;
+	// last block decompressed
+	u32 cachedBlock = ~0u;
+	std::vector<u8> cache;
+
+	const u8 *getBlock(u32 index)
+	{
+		Block& block = blocks[index];
+		if (!block.compressed)
+			return block.data.data();
+		if (cachedBlock != index)
+		{
+			uLongf size = blockSectors * sectorSize;
+			cache.resize(size);
+			if (uncompress(cache.data(), &size, block.data.data(), block.data.size()) != Z_OK)
+				WARN_LOG(GDROM, "Preloaded block %d can't be decompressed", index);
+			cachedBlock = index;
+		}
+		return cache.data();
+	}
+
+	void Read(u32 FAD, u8* dst, SectorFormat* sector_type, u8* subcode, SubcodeFormat* subcode_type) override
+	{
+		*sector_type = sectorType;
+		u32 sector = FAD - StartFAD;
+		if (sector >= sectorCount)
+			return;
+		const u8 *src = getBlock(sector / blockSectors) + (sector % blockSectors) * sectorSize;
+		if (subcodeType == SUBFMT_96)
+		{
+			memcpy(dst, src, sectorSize - 96);
+			memcpy(subcode, src + sectorSize - 96, 96);
+			*subcode_type = SUBFMT_96;
+		}
+		else
+			memcpy(dst, src, sectorSize);
+	}
+
+	u32 ReadSectors(u32 FAD, u32 count, u8* dst, u32 fmt) override
+	{
+		// the subcode of each sector must be read
+		if (subcodeType != SUBFMT_NONE)
+			return 0;
+		u32 sector = FAD - StartFAD;
+		if (sector >= sectorCount)
+			return 0;
+		count = std::min(count, sectorCount - sector);
+		u32 read = 0;
+		while (read < count)
+		{
+			u32 n = std::min(count - read, blockSectors - sector % blockSectors);
+			const u8 *src = getBlock(sector / blockSectors) + (sector % blockSectors) * sectorSize;
+			if (!CopySectors(src, sectorSize, n, dst, fmt))
+				break;
+			sector += n;
+			read += n;
+			dst += n * fmt;
+		}
+		return read;
+	}
+};
+
+u32 getSectorSize(SectorFormat format)
+{
+	switch (format)
+	{
+	case SECFMT_2352:
+		return 2352;
+	case SECFMT_2048_MODE1:
+	case SECFMT_2048_MODE2_FORM1:
+		return 2048;
+	case SECFMT_2336_MODE2:
+		return 2336;
+	case SECFMT_2448_MODE2:
+		return 2448;
+	default:
+		return 0;
+	}
+}
+
+void compressBlocks(Block *blocks, int count)
+{
+#ifndef TARGET_NO_OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+	for (int i = 0; i < count; i++)
+	{
+		Block& block = blocks[i];
+		uLongf size = compressBound(block.data.size());
+		std::vector<u8> compressed(size);
+		if (compress2(compressed.data(), &size, block.data.data(), block.data.size(), Z_BEST_SPEED) == Z_OK
+				&& size < block.data.size() - block.data.size() / 8)
+		{
+			compressed.resize(size);
+			compressed.shrink_to_fit();
+			block.data.swap(compressed);
+			block.compressed = true;
+		}
+	}
+}
+
+// Last sector of a track, or 0 if unknown.
+// The last track of a gdi has no end, it's given by the lead-out. The sectors past the end of the file aren't kept.
+u32 trackEnd(const Disc *disc, size_t index)
+{
+	const Track& track = disc->tracks[index];
+	u32 end = track.EndFAD;
+	if (end == 0 && index + 1 == disc->tracks.size() && disc->LeadOut.StartFAD > track.StartFAD)
+		end = disc->LeadOut.StartFAD - 1;
+	if (end != 0 && track.file != nullptr)
+	{
+		u32 fileEnd = track.file->GetEndFAD();
+		if (fileEnd != 0)
+			end = std::min(end, fileEnd);
+	}
+	return end;
+}
+
+// Returns nullptr if the track can't be preloaded
+PreloadedTrackFile *preloadTrack(const Track& track, u32 endFad, bool compress, u32& sectorsRead, u32 totalSectors)
+{
+	if (track.file == nullptr || endFad == 0 || endFad < track.StartFAD)
+		return nullptr;
+	std::unique_ptr<PreloadedTrackFile> preloaded(new PreloadedTrackFile());
+	preloaded->StartFAD = track.StartFAD;
+	preloaded->sectorCount = endFad - track.StartFAD + 1;
+
+	u8 sector[2448];
+	u8 subcode[96];
+	SubcodeFormat subcodeType = SUBFMT_NONE;
+	track.file->Read(track.StartFAD, sector, &preloaded->sectorType, subcode, &subcodeType);
+	preloaded->subcodeType = subcodeType;
+	preloaded->sectorSize = getSectorSize(preloaded->sectorType) + (subcodeType == SUBFMT_96 ? 96 : 0);
+	if (preloaded->sectorSize == 0)
+		return nullptr;
+	preloaded->blockSectors = std::max(1u, BlockSize / preloaded->sectorSize);
+	preloaded->blocks.resize((preloaded->sectorCount + preloaded->blockSectors - 1) / preloaded->blockSectors);
+
+	u32 progress = ~0;
+	u32 batchStart = 0;
+	for (u32 b = 0; b < preloaded->blocks.size(); b++)
+	{
+		if (loading_canceled)
+			return nullptr;
+		Block& block = preloaded->blocks[b];
+		u32 first = b * preloaded->blockSectors;
+		u32 count = std::min(preloaded->blockSectors, preloaded->sectorCount - first);
+		block.data.resize(count * preloaded->sectorSize);
+		block.compressed = false;
+		for (u32 i = 0; i < count; i++)
+		{
+			u8 *dst = &block.data[i * preloaded->sectorSize];
+			SectorFormat sectorType;
+			subcodeType = SUBFMT_NONE;
+			memset(sector, 0, sizeof(sector));
+			track.file->Read(track.StartFAD + first + i, sector, &sectorType, subcode, &subcodeType);
+			if (sectorType != preloaded->sectorType || subcodeType != preloaded->subcodeType)
+			{
+				WARN_LOG(GDROM, "Track at FAD %d has sectors of different formats and can't be preloaded", track.StartFAD);
+				return nullptr;
+			}
+			memcpy(dst, sector, getSectorSize(sectorType));
+			if (subcodeType == SUBFMT_96)
+				memcpy(dst + getSectorSize(sectorType), subcode, 96);
+		}
+		sectorsRead += count;
+		const u32 newProgress = (u32)((u64)sectorsRead * 100 / totalSectors);
+		if (progress != newProgress)
+		{
+			progress = newProgress;
+			char status_str[32];
+			sprintf(status_str, "Preloading %d%%", progress);
+			gui_display_notification(status_str, 2000);
+		}
+		if (compress && (b + 1 - batchStart == BatchBlocks || b + 1 == preloaded->blocks.size()))
+		{
+			compressBlocks(&preloaded->blocks[batchStart], b + 1 - batchStart);
+			batchStart = b + 1;
+		}
+	}
+	return preloaded.release();
+}
+
+}
+
+bool PreloadDisc(Disc *disc, bool compress)
+{
+	auto start = std::chrono::steady_clock::now();
+	std::vector<u32> endFads;
+	u32 totalSectors = 0;
+	for (size_t i = 0; i < disc->tracks.size(); i++)
+	{
+		endFads.push_back(trackEnd(disc, i));
+		if (endFads.back() >= disc->tracks[i].StartFAD)
+			totalSectors += endFads.back() - disc->tracks[i].StartFAD + 1;
+	}
+	u32 sectorsRead = 0;
+	u64 fileBytes = 0;
+	u64 residentBytes = 0;
+	std::vector<PreloadedTrackFile *> preloaded;
+	for (size_t i = 0; i < disc->tracks.size(); i++)
+	{
+		PreloadedTrackFile *file = preloadTrack(disc->tracks[i], endFads[i], compress, sectorsRead, std::max(totalSectors, 1u));
+		if (loading_canceled)
+		{
+			delete file;
+			for (PreloadedTrackFile *f : preloaded)
+				delete f;
+			return false;
+		}
+		preloaded.push_back(file);
+	}
+	for (size_t i = 0; i < preloaded.size(); i++)
+	{
+		PreloadedTrackFile *file = preloaded[i];
+		if (file == nullptr)
+			continue;
+		fileBytes += (u64)file->sectorCount * file->sectorSize;
+		for (const Block& block : file->blocks)
+			residentBytes += block.data.size();
+		disc->tracks[i].Destroy();
+		disc->tracks[i].file = file;
+	}
+	u32 ms = (u32)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+	INFO_LOG(GDROM, "Disc preloaded in %d ms: %d MB of sectors, %d MB resident", ms, (int)(fileBytes >> 20), (int)(residentBytes >> 20));
+	return true;
+}
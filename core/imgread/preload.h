@@ -0,0 +1,16 @@
+/*
+	Disc preloading.
+
+	Every track of the disc is read once when the disc is opened, and its sectors are then read from
+	memory, with no more file accesses. Sectors are kept in blocks of 64 KB, compressed with zlib
+	unless uncompressed blocks are requested.
+	Tracks with an unknown size or with sectors of different formats are still read from their file.
+	Enabled by Dreamcast.GDRomPreload.
+*/
+#pragma once
+#include "types.h"
+
+struct Disc;
+
+// Replaces the track files of the disc by their sectors in memory. Returns false if canceled.
+bool PreloadDisc(Disc *disc, bool compress);
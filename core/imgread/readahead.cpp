@@ -0,0 +1,205 @@
+#include "readahead.h"
+#include "common.h"
+#include "cfg/option.h"
+#include "profiler/profiler.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+namespace
+{
+
+const u32 ChunkSectors = 32;
+const u32 ChunkCount = 8;
+const u32 MaxSectorSize = 2352;
+
+struct Chunk
+{
+	u32 fad;
+	u32 count;
+	u32 consumed;		// sectors already copied to the emulation
+	bool ready;
+	u32 subcodeMask;	// sectors with a subcode
+	u8 subcode[ChunkSectors][96];
+	u8 data[ChunkSectors * MaxSectorSize];
+};
+
+std::mutex mutex;
+std::condition_variable cond;	// chunk read or consumed, new request or exit
+Chunk chunks[ChunkCount];
+u32 head;			// next chunk to copy
+u32 filled;			// chunks being read or ready
+u32 nextFad;		// first sector of the next chunk to read
+u32 endFad;			// last sector of the track
+u32 sectorSize;		// 0 when not reading ahead
+u32 generation;		// incremented when the chunks are dropped
+bool busy;
+bool exiting;
+std::thread thread;
+
+void run()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	for (;;)
+	{
+		cond.wait(lock, []() { return exiting || (sectorSize != 0 && nextFad <= endFad && filled < ChunkCount); });
+		if (exiting)
+			break;
+		Chunk& chunk = chunks[(head + filled) % ChunkCount];
+		chunk.fad = nextFad;
+		chunk.count = std::min(ChunkSectors, endFad - nextFad + 1);
+		chunk.consumed = 0;
+		chunk.ready = false;
+		chunk.subcodeMask = 0;
+		u32 fad = chunk.fad;
+		u32 count = chunk.count;
+		u32 secsz = sectorSize;
+		u32 gen = generation;
+		nextFad += chunk.count;
+		filled++;
+		busy = true;
+		lock.unlock();
+
+		// Sector by sector to keep the subcode of each one, and so that the emulation can read the disc in between
+		u32 subcodeMask = 0;
+		for (u32 i = 0; i < count; i++)
+		{
+			std::lock_guard<std::mutex> discLock(disc_mutex);
+			if (disc != nullptr && disc->ReadSectors(fad + i, 1, &chunk.data[i * secsz], secsz, chunk.subcode[i]))
+				subcodeMask |= 1 << i;
+		}
+
+		lock.lock();
+		busy = false;
+		// The chunk is discarded if dropped while being read. Its slot isn't used until the next one is started.
+		if (gen == generation)
+		{
+			chunk.subcodeMask = subcodeMask;
+			chunk.ready = true;
+		}
+		cond.notify_all();
+	}
+}
+
+// Drops the chunks without waiting for the one being read
+void reset()
+{
+	sectorSize = 0;
+	head = 0;
+	filled = 0;
+	generation++;
+}
+
+// First sector expected by the next read
+u32 expectedFad()
+{
+	return filled > 0 ? chunks[head].fad + chunks[head].consumed : nextFad;
+}
+
+// Last sector of the track containing fad, or 0 if unknown
+u32 trackEnd(u32 fad)
+{
+	std::lock_guard<std::mutex> lock(disc_mutex);
+	if (disc == nullptr)
+		return 0;
+	for (size_t i = disc->tracks.size(); i-- > 0;)
+	{
+		const Track& track = disc->tracks[i];
+		if (track.StartFAD > fad)
+			continue;
+		if (track.EndFAD != 0)
+			return fad <= track.EndFAD ? track.EndFAD : 0;
+		return disc->LeadOut.StartFAD > fad ? disc->LeadOut.StartFAD - 1 : 0;
+	}
+	return 0;
+}
+
+}
+
+void ra_Start(u32 fad, u32 secsz)
+{
+	if (!config::GDRomReadAhead || secsz > MaxSectorSize)
+		return;
+	std::unique_lock<std::mutex> lock(mutex);
+	if (sectorSize == secsz && expectedFad() == fad)
+		return;
+	reset();
+	u32 end = trackEnd(fad);
+	if (end == 0)
+		return;
+	if (!thread.joinable())
+	{
+		exiting = false;
+		thread = std::thread(run);
+	}
+	nextFad = fad;
+	endFad = end;
+	sectorSize = secsz;
+	cond.notify_all();
+}
+
+u32 ra_Read(u8 *buff, u32 fad, u32 count, u32 secsz)
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	if (sectorSize == 0 || secsz != sectorSize)
+		return 0;
+	if (expectedFad() != fad)
+	{
+		prof.counters.gdrom.readahead_misses++;
+		return 0;
+	}
+	u32 read = 0;
+	while (read < count && (filled > 0 || nextFad <= endFad))
+	{
+		if (filled == 0 || !chunks[head].ready)
+		{
+			// The emulated transfer is faster than the host I/O
+			prof.counters.gdrom.stalls++;
+			auto start = std::chrono::steady_clock::now();
+			cond.wait(lock, []() { return filled > 0 && chunks[head].ready; });
+			prof.counters.gdrom.stall_us += (u32)std::chrono::duration_cast<std::chrono::microseconds>(
+					std::chrono::steady_clock::now() - start).count();
+		}
+		Chunk& chunk = chunks[head];
+		u32 n = std::min(count - read, chunk.count - chunk.consumed);
+		memcpy(&buff[read * secsz], &chunk.data[chunk.consumed * secsz], n * secsz);
+		// The last subcode read is kept, as when reading the disc directly
+		for (u32 i = chunk.consumed + n; i-- > chunk.consumed;)
+			if (chunk.subcodeMask & (1 << i))
+			{
+				memcpy(q_subchannel, chunk.subcode[i], sizeof(q_subchannel));
+				break;
+			}
+		chunk.consumed += n;
+		read += n;
+		if (chunk.consumed == chunk.count)
+		{
+			head = (head + 1) % ChunkCount;
+			filled--;
+			cond.notify_all();
+		}
+	}
+	prof.counters.gdrom.readahead_sectors += read;
+	return read;
+}
+
+void ra_Stop()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	reset();
+	cond.wait(lock, []() { return !busy; });
+}
+
+void ra_Term()
+{
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		reset();
+		exiting = true;
+		cond.notify_all();
+	}
+	if (thread.joinable())
+		thread.join();
+}
@@ -0,0 +1,21 @@
+/*
+	GD-ROM read-ahead.
+
+	When a read command starts (libGDR_ReadAhead), a worker thread reads the following sectors of the
+	track in chunks of 32 sectors, up to 8 chunks ahead of the emulation. The sequential reads of the
+	emulation (libGDR_ReadSector) are then copied from these chunks. They only wait for the worker
+	thread when the emulated transfer is faster than the host I/O, which is counted as a stall.
+	The emulated timing and the data read are the same as without read-ahead.
+	Enabled by Dreamcast.GDRomReadAhead.
+*/
+#pragma once
+#include "types.h"
+
+// Starts reading ahead from the given sector, unless already doing so
+void ra_Start(u32 fad, u32 secsz);
+// Copies the sectors available from the read-ahead chunks, waiting for them to be read if needed.
+// Returns the number of sectors copied, which is 0 if the sectors aren't the ones expected.
+u32 ra_Read(u8 *buff, u32 fad, u32 count, u32 secsz);
+// Drops the chunks read ahead and waits for the worker thread to be idle
+void ra_Stop();
+void ra_Term();
@@ -14,6 +14,7 @@
 #endif
 #include <unistd.h>
 #include "hw/sh4/dyna/blockmanager.h"
+#include "hw/mem/mem_watch.h"
 
 #include "oslib/host_context.h"
 
@@ -45,6 +46,9 @@ void sigill_handler(int sn, siginfo_t * si, void *segfault_ctx) {
 
 void fault_handler (int sn, siginfo_t * si, void *segfault_ctx)
 {
+	// write tracking for incremental snapshots
+	if (memwatch::writeAccess(si->si_addr))
+		return;
 	// code protection in RAM
 	if (bm_RamWriteAccess(si->si_addr))
 		return;
@@ -21,6 +21,7 @@
 #include "reios/reios.h"
 #include "hw/sh4/sh4_sched.h"
 #include "hw/sh4/sh4_if.h"
+#include "hw/sh4/modules/mmu.h"
 #include "hw/pvr/spg.h"
 #include "hw/aica/aica_if.h"
 #include "hw/aica/dsp.h"
@@ -30,6 +31,7 @@
 #include "input/gamepad_device.h"
 #include "hw/sh4/dyna/blockmanager.h"
 #include "log/LogManager.h"
+#include "profiler/profiler.h"
 #include "cheats.h"
 #include "rend/CustomTexture.h"
 #include "hw/maple/maple_devs.h"
@@ -597,6 +599,7 @@ void* dc_run(void*)
 		Get_Sh4Interpreter(&sh4_cpu);
 		INFO_LOG(DYNAREC, "Using Interpreter");
 	}
+	const bool profiling = config::DynarecProfiler && prof_sampling_start(1000);
 	if (singleStep)
 	{
 		singleStep = false;
@@ -604,10 +607,17 @@ void* dc_run(void*)
 	}
 	else
 	{
+		gdxsv_rollback.Resume();
 		do {
 			reset_requested = false;
 
 			sh4_cpu.Run();
+			// In rollback mode the cpu is stopped at the end of each frame
+			while (gdxsv_rollback.FrameEnded() && !reset_requested)
+			{
+				gdxsv_rollback.NextFrame();
+				sh4_cpu.Run();
+			}
 
 			SaveRomFiles();
 
@@ -615,6 +625,13 @@ void* dc_run(void*)
 				dc_reset(false);
 		} while (reset_requested);
 	}
+	if (profiling)
+	{
+		prof_sampling_stop();
+		std::string path = get_writable_data_path("profile.json");
+		if (prof_write_json(path))
+			INFO_LOG(DYNAREC, "Profile written to %s", path.c_str());
+	}
 
     TermAudio();
 
@@ -656,6 +673,7 @@ void dc_term()
 void dc_stop()
 {
 	bool running = dc_is_running();
+	gdxsv_rollback.Interrupt();
 	sh4_cpu.Stop();
 	rend_cancel_emu_wait();
 	emu_thread.WaitToEnd();
@@ -797,71 +815,25 @@ void dc_savestate(int index)
 {
     gdxsv.RestoreOnlinePatch();
 
-	unsigned int total_size = 0 ;
-	void *data = NULL ;
-
-	if ( ! dc_serialize(&data, &total_size) )
-	{
-		WARN_LOG(SAVESTATE, "Failed to save state - could not initialize total size") ;
-		gui_display_notification("Save state failed", 2000);
-		cleanup_serialize(data) ;
-    	return;
-	}
-
-	data = malloc(total_size) ;
-	if ( data == NULL )
-	{
-		WARN_LOG(SAVESTATE, "Failed to save state - could not malloc %d bytes", total_size) ;
-		gui_display_notification("Save state failed - memory full", 2000);
-		cleanup_serialize(data) ;
-    	return;
-	}
-
-	void *data_ptr = data;
-
-	if ( ! dc_serialize(&data_ptr, &total_size) )
-	{
-		WARN_LOG(SAVESTATE, "Failed to save state - could not serialize data") ;
-		gui_display_notification("Save state failed", 2000);
-		cleanup_serialize(data) ;
-    	return;
-	}
-
 	std::string filename = get_savestate_file_path(index, true);
-#if 0
-	FILE *f = nowide::fopen(filename.c_str(), "wb") ;
-
-	if ( f == NULL )
-	{
-		WARN_LOG(SAVESTATE, "Failed to save state - could not open %s for writing", filename.c_str()) ;
-		gui_display_notification("Cannot open save file", 2000);
-		cleanup_serialize(data) ;
-    	return;
-	}
-
-	std::fwrite(data, 1, total_size, f) ;
-	std::fclose(f);
-#else
 	RZipFile zipFile;
 	if (!zipFile.Open(filename, true))
 	{
 		WARN_LOG(SAVESTATE, "Failed to save state - could not open %s for writing", filename.c_str());
 		gui_display_notification("Cannot open save file", 2000);
-		cleanup_serialize(data);
     	return;
 	}
-	if (zipFile.Write(data, total_size) != total_size)
+	// The state is compressed and written as it is serialized
+	unsigned int total_size = 0;
+	bool serialized = dc_serialize(zipFile, &total_size);
+	if (!zipFile.Close() || !serialized)
 	{
 		WARN_LOG(SAVESTATE, "Failed to save state - error writing %s", filename.c_str());
 		gui_display_notification("Error saving state", 2000);
-		zipFile.Close();
-		cleanup_serialize(data);
+		nowide::remove(filename.c_str());
     	return;
 	}
-	zipFile.Close();
-#endif
 
-	cleanup_serialize(data) ;
 	INFO_LOG(SAVESTATE, "Saved state to %s size %d", filename.c_str(), total_size) ;
 	gui_display_notification("State saved", 1000);
 }
@@ -932,6 +904,10 @@ void dc_loadstate(int index)
 #endif
     mmu_flush_table();
 #if FEAT_SHREC != DYNAREC_NONE
+	// Keep the compiled blocks whose code is unchanged by the loaded state
+	bool keepBlocks = !mmu_enabled();
+	if (keepBlocks)
+		bm_SaveCodePages();
 	bm_Reset();
 #endif
 
@@ -948,7 +924,12 @@ void dc_loadstate(int index)
 
     gdxsv.Reset();
 	mmu_set_state();
-	sh4_cpu.ResetCache();
+#if FEAT_SHREC != DYNAREC_NONE
+	if (keepBlocks && !mmu_enabled())
+		bm_DiscardChangedBlocks();
+	else
+#endif
+		sh4_cpu.ResetCache();
     dsp.dyndirty = true;
     sh4_sched_ffts();
 
@@ -0,0 +1,97 @@
+#include "audiostream.h"
+#include "stdclass.h"
+
+#include <chrono>
+#include <cstdio>
+#include <thread>
+
+// Writes the audio output to a WAV file, at the pace of a real audio device
+using the_clock = std::chrono::steady_clock;
+
+static FILE *wav_file;
+static u32 wav_frames;
+static the_clock::time_point last_time;
+
+static void wav_write_header()
+{
+	u32 data_size = wav_frames * 4;
+	struct {
+		char riff[4] = { 'R', 'I', 'F', 'F' };
+		u32 riff_size;
+		char wave[4] = { 'W', 'A', 'V', 'E' };
+		char fmt[4] = { 'f', 'm', 't', ' ' };
+		u32 fmt_size = 16;
+		u16 format = 1;			// PCM
+		u16 channels = 2;
+		u32 sample_rate = 44100;
+		u32 byte_rate = 44100 * 4;
+		u16 block_align = 4;
+		u16 bits_per_sample = 16;
+		char data[4] = { 'd', 'a', 't', 'a' };
+		u32 data_size;
+	} header;
+	header.riff_size = 36 + data_size;
+	header.data_size = data_size;
+	std::fseek(wav_file, 0, SEEK_SET);
+	std::fwrite(&header, sizeof(header), 1, wav_file);
+}
+
+static void wav_init()
+{
+	std::string path = get_writable_data_path("audio.wav");
+	wav_file = nowide::fopen(path.c_str(), "wb");
+	if (wav_file == nullptr)
+	{
+		WARN_LOG(AUDIO, "Can't create %s", path.c_str());
+		return;
+	}
+	INFO_LOG(AUDIO, "Writing audio to %s", path.c_str());
+	wav_frames = 0;
+	wav_write_header();
+	last_time = the_clock::time_point();
+}
+
+static void wav_term()
+{
+	if (wav_file == nullptr)
+		return;
+	wav_write_header();
+	std::fclose(wav_file);
+	wav_file = nullptr;
+}
+
+static u32 wav_push(const void* frame, u32 samples, bool wait)
+{
+	if (wait)
+	{
+		if (last_time.time_since_epoch() != the_clock::duration::zero())
+		{
+			auto fduration = std::chrono::nanoseconds(1000000000L * samples / 44100);
+			auto duration = fduration - (the_clock::now() - last_time);
+			std::this_thread::sleep_for(duration);
+			last_time += fduration;
+		}
+		else
+			last_time = the_clock::now();
+	}
+	if (wav_file != nullptr)
+	{
+		std::fwrite(frame, 4, samples, wav_file);
+		wav_frames += samples;
+	}
+	return 1;
+}
+
+static audiobackend_t audiobackend_wav = {
+    "wav", // Slug
+    "WAV File", // Name
+    &wav_init,
+    &wav_push,
+    &wav_term,
+	nullptr,
+	nullptr,
+	nullptr,
+	nullptr
+};
+
+static bool wav = RegisterAudioBackend(&audiobackend_wav);
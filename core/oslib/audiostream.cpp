@@ -1,11 +1,18 @@
 #include "audiostream.h"
+#include "profiler/profiler.h"
 #include <memory>
-
-struct SoundFrame { s16 l; s16 r; };
+#include <thread>
 
 static SoundFrame Buffer[SAMPLE_COUNT];
 static u32 writePtr;  // next sample index
 
+// Audio thread (config::AudioThread): the frames written by the emulation are pushed to the backend by
+// a separate thread, so that the emulation never waits for the audio device
+static RingBuffer audioRing;
+static AudioResampler resampler;
+static std::thread audioThread;
+static std::atomic<bool> audioThreadRunning;
+
 static audiobackend_t *audiobackend_current = nullptr;
 static std::unique_ptr<std::vector<audiobackend_t *>> audiobackends;	// Using a pointer to avoid out of order init
 
@@ -47,10 +54,10 @@ audiobackend_t* GetAudioBackend(const std::string& slug)
 	{
 		if (slug == "auto")
 		{
-			// Don't select the null or OpenSL/Oboe drivers
+			// Don't select the null, wav or OpenSL/Oboe drivers
 			audiobackend_t *autoselection = nullptr;
 			for (auto backend : *audiobackends)
-				if (backend->slug != "null" && backend->slug != "OpenSL" && backend->slug != "Oboe")
+				if (backend->slug != "null" && backend->slug != "wav" && backend->slug != "OpenSL" && backend->slug != "Oboe")
 				{
 					autoselection = backend;
 					break;
@@ -84,12 +91,98 @@ void WriteSample(s16 r, s16 l)
 
 	if (++writePtr == SAMPLE_COUNT)
 	{
-		if (audiobackend_current != nullptr)
+		if (audioThreadRunning)
+		{
+			// dropped if the emulation is faster than the audio device
+			if (!audioRing.write((const u8 *)Buffer, sizeof(Buffer)))
+				prof.counters.audio.overruns++;
+		}
+		else if (audiobackend_current != nullptr)
 			audiobackend_current->push(Buffer, SAMPLE_COUNT, config::LimitFPS);
 		writePtr = 0;
 	}
 }
 
+u32 AudioResampler::process(RingBuffer& ring, SoundFrame *out, u32 count)
+{
+	u32 buffered = ring.available() / sizeof(SoundFrame);
+	if (buffering)
+	{
+		if (buffered < target)
+		{
+			memset(out, 0, count * sizeof(SoundFrame));
+			return count;
+		}
+		buffering = false;
+		fill = buffered;
+	}
+	fill += (buffered - fill) / 16.f;
+	float error = std::max(-1.f, std::min(1.f, (fill - target) / target));
+	ratio = 1.f + MaxAdjustment * error;
+
+	for (u32 i = 0; i < count; i++)
+	{
+		while (pos >= 1.f)
+		{
+			SoundFrame frame;
+			if (!ring.read((u8 *)&frame, sizeof(frame)))
+			{
+				// underrun: silence until the buffer is filled again
+				buffering = true;
+				memset(&out[i], 0, (count - i) * sizeof(SoundFrame));
+				return count - i;
+			}
+			prev = next;
+			next = frame;
+			pos -= 1.f;
+		}
+		out[i].l = (s16)(prev.l + (next.l - prev.l) * pos);
+		out[i].r = (s16)(prev.r + (next.r - prev.r) * pos);
+		pos += ratio;
+	}
+	return 0;
+}
+
+void AudioResampler::reset(u32 targetFrames)
+{
+	target = targetFrames;
+	fill = 0.f;
+	ratio = 1.f;
+	pos = 1.f;
+	prev = {};
+	next = {};
+	buffering = true;
+}
+
+static void audioThreadLoop()
+{
+	SoundFrame frames[SAMPLE_COUNT];
+	while (audioThreadRunning)
+	{
+		prof.counters.audio.underruns += resampler.process(audioRing, frames, SAMPLE_COUNT);
+		audiobackend_current->push(frames, SAMPLE_COUNT, true);
+	}
+}
+
+static void startAudioThread()
+{
+	// Enough for the emulation to be ahead or behind by a few blocks
+	u32 frames = std::max<u32>(config::AudioBufferSize, SAMPLE_COUNT * 4);
+	audioRing.setCapacity(frames * sizeof(SoundFrame));
+	resampler.reset(frames / 2);
+	audioThreadRunning = true;
+	audioThread = std::thread(audioThreadLoop);
+}
+
+static void stopAudioThread()
+{
+	if (!audioThread.joinable())
+		return;
+	audioThreadRunning = false;
+	audioThread.join();
+	INFO_LOG(AUDIO, "Audio thread stopped: %d blocks dropped, %d silent frames", prof.counters.audio.overruns, prof.counters.audio.underruns);
+}
+
 void InitAudio()
 {
 	if (cfgLoadInt("audio", "disable", 0)) {
@@ -112,6 +205,8 @@ void InitAudio()
 
 	INFO_LOG(AUDIO, "Initializing audio backend \"%s\" (%s)...", audiobackend_current->slug.c_str(), audiobackend_current->name.c_str());
 	audiobackend_current->init();
+	if (config::AudioThread)
+		startAudioThread();
 	if (audio_recording_started)
 	{
 		// Restart recording
@@ -127,6 +222,7 @@ void TermAudio()
 		bool rec_started = audio_recording_started;
 		StopAudioRecording();
 		audio_recording_started = rec_started;
+		stopAudioThread();
 		audiobackend_current->term();
 		INFO_LOG(AUDIO, "Terminating audio backend \"%s\" (%s)...", audiobackend_current->slug.c_str(), audiobackend_current->name.c_str());
 		audiobackend_current = nullptr;
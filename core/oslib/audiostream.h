@@ -71,6 +71,11 @@ class RingBuffer
 	}
 
 public:
+	// Bytes that can be read
+	u32 available() {
+		return buffer.empty() ? 0 : readSize();
+	}
+
 	bool write(const u8 *data, u32 size)
 	{
 		if (size > writeSize())
@@ -117,3 +122,30 @@ public:
 		writeCursor = 0;
 	}
 };
+
+struct SoundFrame { s16 l; s16 r; };
+
+// Resamples the frames written by the emulation to the rate at which the audio device consumes them.
+// The ratio is adjusted by up to 0.5% to keep the buffered frames around the target, so that small
+// differences between the emulation speed and the device rate don't empty or fill the buffer.
+class AudioResampler
+{
+public:
+	static constexpr float MaxAdjustment = 0.005f;
+
+	void reset(u32 targetFrames);
+	// Outputs count frames resampled from the frames read from the ring buffer.
+	// Returns the number of silent frames output while the buffer is filled up to the target.
+	u32 process(RingBuffer& ring, SoundFrame *out, u32 count);
+	// Input frames consumed per output frame
+	float getRatio() const { return ratio; }
+
+private:
+	float target = 0.f;
+	float fill = 0.f;		// smoothed buffered frames
+	float ratio = 1.f;
+	float pos = 1.f;		// between prev and next
+	SoundFrame prev {};
+	SoundFrame next {};
+	bool buffering = true;
+};
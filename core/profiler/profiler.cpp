@@ -1,13 +1,264 @@
 #include "profiler.h"
+#include "hw/sh4/sh4_if.h"
+#include "hw/sh4/dyna/blockmanager.h"
+#include "hw/sh4/dyna/ngen.h"
+#include "oslib/host_context.h"
+
+#include <algorithm>
+#include <atomic>
+#include <unordered_map>
+#if defined(__linux__)
+#include <csignal>
+#include <ctime>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#endif
 
 profiler_cfg prof;
 
+void context_from_segfault(host_context_t* hctx, void* segfault_ctx);
+
 void prof_init()
 {
 	memset(&prof,0,sizeof(prof));
 	prof.enable=false;
 }
 
+namespace sampling
+{
+
+struct Sample
+{
+	void *hostPc;
+	u32 guestPc;
+	u32 weight;
+};
+
+// Filled by the signal handler, emptied by prof_resolve_samples()
+// A sample stands for weight intervals
+static Sample samples[65536];
+static std::atomic<u32> sampleCount;
+static std::atomic<u32> droppedCount;
+
+struct BlockProfile
+{
+	u64 samples;
+	u32 guestCycles;
+	u32 guestOpcodes;
+	u32 hostCodeSize;
+};
+// by guest address
+static std::unordered_map<u32, BlockProfile> blocks;
+static std::unordered_map<u32, u64> hostSamples;
+static u64 totalSamples;
+static u64 unknownSamples;
+static u32 interval;
+static bool active;
+
+#if defined(__linux__) && HOST_CPU != CPU_GENERIC
+static timer_t timer;
+static struct sigaction oldAction;
+
+static void signalHandler(int sn, siginfo_t *si, void *segfault_ctx)
+{
+	u32 i = sampleCount;
+	if (i == ARRAY_SIZE(samples))
+	{
+		droppedCount++;
+		return;
+	}
+	host_context_t ctx;
+	context_from_segfault(&ctx, segfault_ctx);
+	samples[i].hostPc = (void *)ctx.pc;
+	samples[i].guestPc = Sh4cntx.pc;
+	// cpu clock timers expire on scheduler ticks: the expirations in between are counted as overruns
+	samples[i].weight = 1 + std::max(si->si_overrun, 0);
+	sampleCount = i + 1;
+}
+
+static bool startTimer(u32 interval_us)
+{
+	struct sigaction act;
+	memset(&act, 0, sizeof(act));
+	act.sa_sigaction = signalHandler;
+	sigemptyset(&act.sa_mask);
+	act.sa_flags = SA_SIGINFO | SA_RESTART;
+	if (sigaction(SIGPROF, &act, &oldAction) != 0)
+		return false;
+
+	// Only the cpu time of the calling thread is sampled, and the signal is sent to it
+	clockid_t clock;
+	if (pthread_getcpuclockid(pthread_self(), &clock) != 0)
+		clock = CLOCK_MONOTONIC;
+	sigevent sev;
+	memset(&sev, 0, sizeof(sev));
+	sev.sigev_notify = SIGEV_THREAD_ID;
+	sev.sigev_signo = SIGPROF;
+#ifdef sigev_notify_thread_id
+	sev.sigev_notify_thread_id = (pid_t)syscall(SYS_gettid);
+#else
+	sev._sigev_un._tid = (pid_t)syscall(SYS_gettid);
+#endif
+	if (timer_create(clock, &sev, &timer) != 0)
+	{
+		sigaction(SIGPROF, &oldAction, nullptr);
+		return false;
+	}
+	itimerspec spec;
+	spec.it_interval.tv_sec = interval_us / 1000000;
+	spec.it_interval.tv_nsec = interval_us % 1000000 * 1000;
+	spec.it_value = spec.it_interval;
+	timer_settime(timer, 0, &spec, nullptr);
+
+	return true;
+}
+
+static void stopTimer()
+{
+	timer_delete(timer);
+	sigaction(SIGPROF, &oldAction, nullptr);
+}
+#else
+static bool startTimer(u32 interval_us) {
+	return false;
+}
+static void stopTimer() { }
+#endif
+
+static void resolve(const Sample& sample)
+{
+	totalSamples += sample.weight;
+#if FEAT_SHREC != DYNAREC_NONE
+	u8 *rw = (u8 *)CC_RX2RW(sample.hostPc);
+	if (rw >= CodeCache && rw < CodeCache + CODE_SIZE + TEMP_CODE_SIZE)
+	{
+		RuntimeBlockInfoPtr block = bm_GetBlock(sample.hostPc);
+		if (!block)
+			block = bm_GetStaleBlock(sample.hostPc);
+		if (!block)
+		{
+			// dispatcher, or block being compiled
+			unknownSamples += sample.weight;
+			return;
+		}
+		BlockProfile& profile = blocks[block->vaddr];
+		profile.samples += sample.weight;
+		profile.guestCycles = block->guest_cycles;
+		profile.guestOpcodes = block->guest_opcodes;
+		profile.hostCodeSize = block->host_code_size;
+		return;
+	}
+#endif
+	hostSamples[sample.guestPc] += sample.weight;
+}
+
+}
+
+bool prof_sampling_start(u32 interval_us)
+{
+	using namespace sampling;
+	if (active)
+		return true;
+	if (!startTimer(interval_us))
+	{
+		WARN_LOG(DYNAREC, "Sampling profiler not available");
+		return false;
+	}
+	interval = interval_us;
+	active = true;
+#if FEAT_SHREC != DYNAREC_NONE
+	bm_EnablePerfMap(true);
+#endif
+	INFO_LOG(DYNAREC, "Sampling profiler started: interval %d us", interval_us);
+
+	return true;
+}
+
+void prof_sampling_stop()
+{
+	using namespace sampling;
+	if (!active)
+		return;
+	stopTimer();
+	active = false;
+	prof_resolve_samples();
+#if FEAT_SHREC != DYNAREC_NONE
+	bm_EnablePerfMap(false);
+#endif
+}
+
+bool prof_sampling_active()
+{
+	return sampling::active;
+}
+
+void prof_sampling_reset()
+{
+	using namespace sampling;
+	prof_resolve_samples();
+	blocks.clear();
+	hostSamples.clear();
+	totalSamples = 0;
+	unknownSamples = 0;
+	droppedCount = 0;
+}
+
+void prof_resolve_samples()
+{
+	using namespace sampling;
+	// Samples added by the signal handler while resolving are picked up by the next iteration
+	u32 start = 0;
+	while (true)
+	{
+		u32 count = sampleCount;
+		for (u32 i = start; i < count; i++)
+			resolve(samples[i]);
+		if (sampleCount.compare_exchange_strong(count, 0))
+			break;
+		start = count;
+	}
+}
+
+bool prof_write_json(const std::string& path)
+{
+	using namespace sampling;
+	prof_resolve_samples();
+	FILE *f = nowide::fopen(path.c_str(), "w");
+	if (f == nullptr)
+		return false;
+
+	std::vector<std::pair<u32, BlockProfile>> sortedBlocks(blocks.begin(), blocks.end());
+	std::sort(sortedBlocks.begin(), sortedBlocks.end(), [](const std::pair<u32, BlockProfile>& a, const std::pair<u32, BlockProfile>& b) {
+		return a.second.samples > b.second.samples;
+	});
+	std::vector<std::pair<u32, u64>> sortedHost(hostSamples.begin(), hostSamples.end());
+	std::sort(sortedHost.begin(), sortedHost.end(), [](const std::pair<u32, u64>& a, const std::pair<u32, u64>& b) {
+		return a.second > b.second;
+	});
+
+	fprintf(f, "{\n\t\"interval_us\": %d,\n", interval);
+	fprintf(f, "\t\"samples\": %llu,\n", (unsigned long long)totalSamples);
+	fprintf(f, "\t\"dropped\": %d,\n", (u32)droppedCount);
+	fprintf(f, "\t\"unknown\": %llu,\n", (unsigned long long)unknownSamples);
+	fprintf(f, "\t\"blocks\": [");
+	for (size_t i = 0; i < sortedBlocks.size(); i++)
+	{
+		const BlockProfile& b = sortedBlocks[i].second;
+		fprintf(f, "%s\n\t\t{ \"pc\": \"%08X\", \"samples\": %llu, \"host_us\": %llu, \"guest_cycles\": %d, \"guest_opcodes\": %d, \"host_code_size\": %d }",
+				i == 0 ? "" : ",", sortedBlocks[i].first, (unsigned long long)b.samples, (unsigned long long)b.samples * interval,
+				b.guestCycles, b.guestOpcodes, b.hostCodeSize);
+	}
+	fprintf(f, "\n\t],\n\t\"host\": [");
+	for (size_t i = 0; i < sortedHost.size(); i++)
+		fprintf(f, "%s\n\t\t{ \"pc\": \"%08X\", \"samples\": %llu, \"host_us\": %llu }",
+				i == 0 ? "" : ",", sortedHost[i].first, (unsigned long long)sortedHost[i].second,
+				(unsigned long long)sortedHost[i].second * interval);
+	fprintf(f, "\n\t]\n}\n");
+
+	return std::fclose(f) == 0;
+}
+
 struct regacc
 {
 	Sh4RegType reg;
@@ -5,6 +5,23 @@
 void prof_init();
 void prof_periodical();
 
+/*
+	Sampling profiler of the emulated code.
+	The cpu thread is interrupted every interval (of cpu time) and the host pc is recorded.
+	Samples in the code cache are attributed to the block being executed, the others
+	(interpreter, memory handlers, ...) to the current guest pc.
+	Totals are kept until prof_sampling_reset().
+*/
+// Starts sampling the calling thread, which must be the cpu thread. Linux only.
+bool prof_sampling_start(u32 interval_us);
+void prof_sampling_stop();
+bool prof_sampling_active();
+void prof_sampling_reset();
+// Attributes the pending samples to their block. Must be called on the cpu thread before blocks are freed.
+void prof_resolve_samples();
+// Writes the totals as JSON, hottest blocks first
+bool prof_write_json(const std::string& path);
+
 inline void print_array(const char* name, u32* arr,u32 size)
 {
 	printf("%s = [",name);
@@ -89,6 +106,25 @@ struct profiler_cfg
 			u32 callstack_hit;
 			u32 callstack_miss;
 			u32 slowpath;
+			u32 load_kept;		// blocks kept / discarded when loading a state
+			u32 load_discarded;
+			u32 compiled;		// blocks compiled, and how many of them were found in the block cache
+			u32 cache_hits;
+			u32 decode_us;		// time spent decoding and optimizing / generating host code
+			u32 codegen_us;
+			u32 baseline;		// baseline blocks, and how many were replaced / dropped (see asynccompile.h)
+			u32 async_installed;
+			u32 async_failed;
+			u32 stall_us[16];	// blocks by compilation time on the cpu thread, in [2^i, 2^(i+1)) us
+			u32 reclaimed;		// code cache segments reclaimed, and how many of their blocks were discarded / kept
+			u32 evicted;
+			u32 kept;
+			u32 superblocks;	// superblocks compiled, and blocks that couldn't be extended
+			u32 superblock_rejects;
+			u32 smc_pages;		// code pages unprotected by a write fault
+			u32 smc_data_writes;	// writes to locked pages handled without fault (Dynarec.FineSmc), outside / inside code chunks
+			u32 smc_code_writes;
+			u32 smc_discarded;	// blocks discarded by those code writes
 
 			void print() 
 			{ 
@@ -100,9 +136,64 @@ struct profiler_cfg
 				print_elem("callstack_hit",callstack_hit);
 				print_elem("callstack_miss",callstack_miss);
 				print_elem("slowpath",slowpath);
+				print_elem("load_kept",load_kept);
+				print_elem("load_discarded",load_discarded);
+				print_elem("compiled",compiled);
+				print_elem("cache_hits",cache_hits);
+				print_elem("decode_us",decode_us);
+				print_elem("codegen_us",codegen_us);
+				print_elem("baseline",baseline);
+				print_elem("async_installed",async_installed);
+				print_elem("async_failed",async_failed);
+				print_array("stall_us",stall_us,16);
+				print_elem("reclaimed",reclaimed);
+				print_elem("evicted",evicted);
+				print_elem("kept",kept);
+				print_elem("superblocks",superblocks);
+				print_elem("superblock_rejects",superblock_rejects);
+				print_elem("smc_pages",smc_pages);
+				print_elem("smc_data_writes",smc_data_writes);
+				print_elem("smc_code_writes",smc_code_writes);
+				print_elem("smc_discarded",smc_discarded);
 			}
 		} bm;
 
+		struct
+		{
+			u32 readahead_sectors;	// sectors read ahead (see readahead.h), and reads of other sectors
+			u32 readahead_misses;
+			u32 stalls;				// reads waiting for the read-ahead thread, and the time waited
+			u32 stall_us;
+			u32 chd_hunks;			// CHD hunks decompressed (see hunkcache.h), reads of cached hunks and of hunks being decompressed
+			u32 chd_hits;
+			u32 chd_waits;
+
+			void print()
+			{
+				print_head("gdrom");
+				print_elem("readahead_sectors",readahead_sectors);
+				print_elem("readahead_misses",readahead_misses);
+				print_elem("stalls",stalls);
+				print_elem("stall_us",stall_us);
+				print_elem("chd_hunks",chd_hunks);
+				print_elem("chd_hits",chd_hits);
+				print_elem("chd_waits",chd_waits);
+			}
+		} gdrom;
+
+		struct
+		{
+			u32 overruns;			// blocks dropped and silent frames of the audio thread
+			u32 underruns;
+
+			void print()
+			{
+				print_head("audio");
+				print_elem("overruns",overruns);
+				print_elem("underruns",underruns);
+			}
+		} audio;
+
 		struct
 		{
 			u32 call_direct; u32 call_indirect;
@@ -138,6 +229,8 @@ struct profiler_cfg
 			shil.print();
 			ralloc.print();
 			bm.print();
+			gdrom.print();
+			audio.print();
 			blkrun.print();
 		}
 	} counters;
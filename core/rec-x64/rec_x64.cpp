@@ -17,6 +17,7 @@ using namespace Xbyak::util;
 
 #include "hw/sh4/sh4_core.h"
 #include "hw/sh4/sh4_mem.h"
+#include "cfg/option.h"
 #include "x64_regalloc.h"
 #include "xbyak_base.h"
 
@@ -186,6 +187,13 @@ public:
 #else
 		sub(dword[rip + &cycle_counter], block->guest_cycles);
 #endif
+		// Used to keep the hot blocks when reclaiming the code cache and to pick the superblocks.
+		// Only the blocks of read-only pages are considered so the others don't pay for it.
+		if ((CODE_SEGMENTS > 1 || config::DynarecSuperblocks) && block->read_only && !block->baseline && !mmu_enabled())
+		{
+			mov(rax, (uintptr_t)&block->runs);
+			inc(dword[rax]);
+		}
 		regalloc.DoAlloc(block);
 
 		for (current_opid = 0; current_opid < block->oplist.size(); current_opid++)
@@ -971,6 +979,9 @@ private:
 		bool isram = false;
 		void* ptr = _vmem_write_const(addr, isram, size > 4 ? 4 : size);
 
+		if (isram && config::DynarecFineSmc)
+			// go through the write barrier of the memory handler
+			return false;
 		if (isram)
 		{
 			// Immediate pointer to RAM: super-duper fast access
@@ -1110,6 +1121,8 @@ private:
 					MemHandlers[type][size][op] = getCurr();
 					if (type == MemType::Fast && _nvmem_enabled())
 					{
+						if (op == MemOp::W && config::DynarecFineSmc)
+							genWriteBarrier(size);
 						mov(rax, (uintptr_t)virt_ram_base);
 						if (!_nvmem_4gb_space())
 						{
@@ -1227,6 +1240,43 @@ private:
 		MemHandlerEnd = getCurr();
 	}
 
+	// Writes to a write protected RAM page go to bm_WriteLockedRam() instead of faulting
+	void genWriteBarrier(int size)
+	{
+		Xbyak::Label unlocked;
+		// Area 3 in P0-P3
+		mov(r10d, call_regs[0]);
+		shr(r10d, 26);
+		cmp(r10d, 0x38);
+		jae(unlocked);
+		and_(r10d, 7);
+		cmp(r10d, 3);
+		jne(unlocked);
+
+		mov(r10d, call_regs[0]);
+		mov(rax, (uintptr_t)&RAM_MASK);
+		and_(r10d, dword[rax]);
+		shr(r10d, 12);		// PAGE_SIZE
+		mov(rax, (uintptr_t)locked_pages);
+		cmp(byte[rax + r10], 0);
+		switch (size)
+		{
+		case MemSize::S8:
+			jne((const void *)bm_WriteLockedRam<u8>);	// tail call
+			break;
+		case MemSize::S16:
+			jne((const void *)bm_WriteLockedRam<u16>);
+			break;
+		case MemSize::S32:
+			jne((const void *)bm_WriteLockedRam<u32>);
+			break;
+		case MemSize::S64:
+			jne((const void *)bm_WriteLockedRam<u64>);
+			break;
+		}
+		L(unlocked);
+	}
+
 	void saveXmmRegisters()
 	{
 #ifndef _WIN32
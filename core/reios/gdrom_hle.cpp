@@ -72,6 +72,7 @@ template<bool virtual_addr>
 static void read_sectors_to(u32 addr, u32 sector, u32 count)
 {
 	gd_hle_state.cur_sector = sector + count - 1;
+	libGDR_ReadAhead(sector, 2048);
 	if (virtual_addr)
 		gd_hle_state.xfer_end_time = 0;
 	else if (count > 5)
@@ -379,6 +380,7 @@ static void GD_HLE_Command(u32 cc)
 			gd_hle_state.multi_read_count = num * 2048;
 			gd_hle_state.multi_read_total = gd_hle_state.multi_read_count;
 			gd_hle_state.multi_read_offset = 0;
+			libGDR_ReadAhead(sector, 2048);
 			gd_hle_state.result[2] = 2048;
 			gd_hle_state.result[3] = num > 0 ? 1 : 0;
 		}
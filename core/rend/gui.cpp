@@ -1527,6 +1527,18 @@ static void gui_display_settings()
 		    			"Stretch the screen horizontally");
 		    	OptionArrowButtons("Frame Skipping", config::SkipFrame, 0, 6,
 		    			"Number of frames to skip between two actually rendered frames");
+		    	OptionArrowButtons("Render Queue", config::RenderQueueDepth, 1, 4,
+		    			"Number of frames the emulation can queue while the GPU is busy. More than one may cause graphical glitches");
+		    	ImGui::Text("Render Queue Pacing:");
+		    	ImGui::Columns(2, "queuepacing", false);
+		    	OptionRadioButton("Throughput", config::RenderQueuePacing, 0, "Wait for a free slot when the render queue is full");
+		    	ImGui::NextColumn();
+		    	OptionRadioButton("Latency", config::RenderQueuePacing, 1, "Replace the oldest pending frame when the render queue is full");
+		    	ImGui::Columns(1, nullptr, false);
+#ifndef TARGET_NO_OPENMP
+		    	OptionCheckbox("Parallel Display List Parsing", config::ParallelTaParsing,
+		    			"Decode large display lists on several threads");
+#endif
 		    }
 	    	ImGui::Spacing();
 		    header("Render to Texture");
@@ -1680,6 +1692,18 @@ static void gui_display_settings()
 		    	OptionCheckbox("Safe Mode", config::DynarecSafeMode,
 		    			"Do not optimize integer division. Not recommended");
 		    	OptionCheckbox("Idle Skip", config::DynarecIdleSkip, "Skip wait loops. Recommended");
+		    	OptionCheckbox("Block Cache", config::DynarecBlockCache,
+		    			"Save the decoded blocks of each game to speed up compilation on the next run");
+		    	OptionCheckbox("Background Compilation", config::DynarecAsyncCompile,
+		    			"Optimize new code in a separate thread. Reduces stuttering when loading");
+		    	OptionCheckbox("Superblocks", config::DynarecSuperblocks,
+		    			"Recompile the most used code across unconditional branches");
+		    	OptionCheckbox("Fine-grained SMC Detection", config::DynarecFineSmc,
+		    			"Track self-modifying code by 64-byte chunks so that data written next to code doesn't slow it down");
+#ifdef __linux__
+		    	OptionCheckbox("Profiler", config::DynarecProfiler,
+		    			"Sample the emulated code and write data/profile.json when pausing. JIT symbols go to /tmp/perf-<pid>.map");
+#endif
 		    }
 	    	ImGui::Spacing();
 		    header("Network");
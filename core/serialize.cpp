@@ -184,13 +184,25 @@ extern TLB_Entry ITLB[4];
 extern u32 sq_remap[64];
 static u32 ITLB_LRU_USE[64];
 
+// Main RAM, VRAM and AICA RAM are left out (incremental snapshots)
+static bool skip_guest_ram;
+
+// When set, serialized data is written to this stream instead of *dest
+static SerializeStream *serialize_stream;
+static bool serialize_stream_error;
+
 //./core/imgread/common.o
 extern u32 NullDriveDiscType;
 extern u8 q_subchannel[96];
 
 bool rc_serialize(const void *src, unsigned int src_size, void **dest, unsigned int *total_size)
 {
-	if ( *dest != NULL )
+	if (serialize_stream != nullptr)
+	{
+		if (!serialize_stream_error && !serialize_stream->Write(src, src_size))
+			serialize_stream_error = true;
+	}
+	else if ( *dest != NULL )
 	{
 		memcpy(*dest, src, src_size) ;
 		*dest = ((unsigned char*)*dest) + src_size ;
@@ -271,7 +283,8 @@ bool dc_serialize(void **data, unsigned int *total_size)
 		REICAST_S(timers[i].m_step);
 	}
 
-	REICAST_SA(aica_ram.data,aica_ram.size) ;
+	if (!skip_guest_ram)
+		REICAST_SA(aica_ram.data,aica_ram.size) ;
 	REICAST_S(VREG);
 	REICAST_S(ARMRST);
 	REICAST_S(rtc_EN);
@@ -343,7 +356,8 @@ bool dc_serialize(void **data, unsigned int *total_size)
 
 	SerializeTAContext(data, total_size);
 
-	REICAST_SA(vram.data, vram.size);
+	if (!skip_guest_ram)
+		REICAST_SA(vram.data, vram.size);
 
 	REICAST_SA(OnChipRAM.data(), OnChipRAM_SIZE);
 
@@ -360,7 +374,8 @@ bool dc_serialize(void **data, unsigned int *total_size)
 	icache.Serialize(data, total_size);
 	ocache.Serialize(data, total_size);
 
-	REICAST_SA(mem_b.data, mem_b.size);
+	if (!skip_guest_ram)
+		REICAST_SA(mem_b.data, mem_b.size);
 
 	REICAST_SA(InterruptEnvId,32);
 	REICAST_SA(InterruptBit,32);
@@ -771,7 +786,8 @@ bool dc_unserialize(void **data, unsigned int *total_size)
 		REICAST_US(timers[i].m_step);
 	}
 
-	REICAST_USA(aica_ram.data,aica_ram.size) ;
+	if (!skip_guest_ram)
+		REICAST_USA(aica_ram.data,aica_ram.size) ;
 	REICAST_US(VREG);
 	REICAST_US(ARMRST);
 	REICAST_US(rtc_EN);
@@ -893,7 +909,8 @@ bool dc_unserialize(void **data, unsigned int *total_size)
 	if (version >= V11)
 		UnserializeTAContext(data, total_size, version);
 
-	REICAST_USA(vram.data, vram.size);
+	if (!skip_guest_ram)
+		REICAST_USA(vram.data, vram.size);
 	pal_needs_update = true;
 
 	REICAST_USA(OnChipRAM.data(), OnChipRAM_SIZE);
@@ -917,7 +934,8 @@ bool dc_unserialize(void **data, unsigned int *total_size)
 	else
 		ocache.Reset(true);
 
-	REICAST_USA(mem_b.data, mem_b.size);
+	if (!skip_guest_ram)
+		REICAST_USA(mem_b.data, mem_b.size);
 
 	if (version < V5)
 		REICAST_SKIP(2);
@@ -1083,3 +1101,29 @@ bool dc_unserialize(void **data, unsigned int *total_size)
 
 	return true ;
 }
+
+bool dc_serialize_devices(void **data, unsigned int *total_size)
+{
+	skip_guest_ram = true;
+	bool rc = dc_serialize(data, total_size);
+	skip_guest_ram = false;
+	return rc;
+}
+
+bool dc_serialize(SerializeStream& stream, unsigned int *total_size)
+{
+	serialize_stream = &stream;
+	serialize_stream_error = false;
+	void *data = nullptr;
+	bool rc = dc_serialize(&data, total_size);
+	serialize_stream = nullptr;
+	return rc && !serialize_stream_error;
+}
+
+bool dc_unserialize_devices(void **data, unsigned int *total_size)
+{
+	skip_guest_ram = true;
+	bool rc = dc_unserialize(data, total_size);
+	skip_guest_ram = false;
+	return rc;
+}
@@ -0,0 +1,241 @@
+#include "snapshot.h"
+#include "stdclass.h"
+
+#include <algorithm>
+#include <cstring>
+#include <xxhash.h>
+
+using namespace memwatch;
+
+int SnapshotChain::Find(u32 id) const
+{
+	if (chain.empty() || id < chain.front().id || id > chain.back().id)
+		return -1;
+	// ids are increasing but not necessarily contiguous
+	auto it = std::lower_bound(chain.begin(), chain.end(), id,
+			[](const Snapshot& s, u32 id) { return s.id < id; });
+	if (it == chain.end() || it->id != id)
+		return -1;
+	return (int)(it - chain.begin());
+}
+
+void SnapshotChain::Recycle(Snapshot& snapshot)
+{
+	pool.push_back(std::move(snapshot));
+	Snapshot& s = pool.back();
+	s.devicesSize = 0;
+	for (int r = 0; r < RegionCount; r++)
+	{
+		s.pages[r].clear();
+		s.data[r].clear();
+	}
+}
+
+void SnapshotChain::Reset()
+{
+	memwatch::disable();
+	while (!chain.empty())
+	{
+		Recycle(chain.back());
+		chain.pop_back();
+	}
+	pool.clear();
+}
+
+bool SnapshotChain::SaveDevices(Snapshot& snapshot)
+{
+	unsigned int size = 0;
+	void *data = nullptr;
+	if (!dc_serialize_devices(&data, &size))
+		return false;
+	if (snapshot.devices.size() < size)
+		// Leave some room for variable sized blocks (TA contexts) to avoid reallocating every frame
+		snapshot.devices.resize(size + size / 16);
+	data = snapshot.devices.data();
+	if (!dc_serialize_devices(&data, &size))
+		return false;
+	snapshot.devicesSize = size;
+	return true;
+}
+
+bool SnapshotChain::Take(u32 id)
+{
+	if (!chain.empty() && id <= chain.back().id)
+	{
+		WARN_LOG(SAVESTATE, "Snapshot %d taken after %d", id, chain.back().id);
+		return false;
+	}
+	Snapshot snapshot;
+	if (!pool.empty())
+	{
+		snapshot = std::move(pool.back());
+		pool.pop_back();
+	}
+	snapshot.id = id;
+
+	if (chain.empty() || !memwatch::enabled())
+	{
+		// Full image. Tracking starts before copying so that concurrent writes aren't missed.
+		while (!chain.empty())
+		{
+			Recycle(chain.back());
+			chain.pop_back();
+		}
+		memwatch::enable();
+		for (int r = 0; r < RegionCount; r++)
+		{
+			Region region = (Region)r;
+			snapshot.data[r].resize(regionSize(region));
+			memcpy(snapshot.data[r].data(), regionPtr(region), regionSize(region));
+		}
+	}
+	else
+	{
+		for (int r = 0; r < RegionCount; r++)
+		{
+			Region region = (Region)r;
+			// Pages are protected again by collect(): a write happening during the copy will be in the next snapshot
+			memwatch::collect(region, snapshot.pages[r]);
+			snapshot.data[r].resize(snapshot.pages[r].size() * PAGE_SIZE);
+			u8 *dst = snapshot.data[r].data();
+			const u8 *src = regionPtr(region);
+			for (u32 offset : snapshot.pages[r])
+			{
+				memcpy(dst, src + offset, PAGE_SIZE);
+				dst += PAGE_SIZE;
+			}
+		}
+	}
+	if (!SaveDevices(snapshot))
+	{
+		Recycle(snapshot);
+		return false;
+	}
+	chain.push_back(std::move(snapshot));
+
+	return true;
+}
+
+const u8 *SnapshotChain::PageAt(int index, Region region, u32 offset) const
+{
+	for (; index > 0; index--)
+	{
+		const std::vector<u32>& pages = chain[index].pages[region];
+		auto it = std::lower_bound(pages.begin(), pages.end(), offset);
+		if (it != pages.end() && *it == offset)
+			return &chain[index].data[region][(it - pages.begin()) * PAGE_SIZE];
+	}
+	return &chain.front().data[region][offset];
+}
+
+bool SnapshotChain::Restore(u32 id)
+{
+	int index = Find(id);
+	if (index < 0)
+		return false;
+
+	// Tracking is stopped when the memory mappings are recreated
+	const bool full = !memwatch::enabled();
+	for (int r = 0; r < RegionCount; r++)
+	{
+		Region region = (Region)r;
+		scratch.clear();
+		if (full)
+		{
+			for (u32 offset = 0; offset < regionSize(region); offset += PAGE_SIZE)
+				scratch.push_back(offset);
+		}
+		else
+		{
+			// Pages written since the snapshot: the ones held by newer snapshots and the ones currently dirty
+			memwatch::collect(region, scratch);
+			for (size_t i = index + 1; i < chain.size(); i++)
+				scratch.insert(scratch.end(), chain[i].pages[r].begin(), chain[i].pages[r].end());
+			std::sort(scratch.begin(), scratch.end());
+			scratch.erase(std::unique(scratch.begin(), scratch.end()), scratch.end());
+		}
+
+		// Pages are unprotected first, which also notifies the texture cache
+		u8 *dst = regionPtr(region);
+		for (u32 offset : scratch)
+		{
+			memwatch::touch(region, offset);
+			memcpy(dst + offset, PageAt(index, region, offset), PAGE_SIZE);
+		}
+		if (!full)
+		{
+			// Memory now matches the snapshot: pages aren't dirty anymore
+			scratch.clear();
+			memwatch::collect(region, scratch);
+		}
+	}
+	if (full)
+		memwatch::enable();
+
+	void *data = chain[index].devices.data();
+	unsigned int size = 0;
+	if (!dc_unserialize_devices(&data, &size))
+		return false;
+
+	while ((int)chain.size() > index + 1)
+	{
+		Recycle(chain.back());
+		chain.pop_back();
+	}
+
+	return true;
+}
+
+void SnapshotChain::DropBefore(u32 id)
+{
+	while (chain.size() >= 2 && chain[1].id <= id)
+	{
+		Snapshot& base = chain.front();
+		Snapshot& next = chain[1];
+		for (int r = 0; r < RegionCount; r++)
+		{
+			const u8 *src = next.data[r].data();
+			for (u32 offset : next.pages[r])
+			{
+				memcpy(&base.data[r][offset], src, PAGE_SIZE);
+				src += PAGE_SIZE;
+			}
+		}
+		std::swap(base.devices, next.devices);
+		base.devicesSize = next.devicesSize;
+		base.id = next.id;
+		Recycle(next);
+		chain.erase(chain.begin() + 1);
+	}
+}
+
+size_t SnapshotChain::Size(u32 id) const
+{
+	int index = Find(id);
+	if (index < 0)
+		return 0;
+	size_t size = chain[index].devicesSize;
+	for (int r = 0; r < RegionCount; r++)
+		size += chain[index].data[r].size();
+	return size;
+}
+
+u64 SnapshotChain::Hash(u32 id) const
+{
+	int index = Find(id);
+	if (index < 0)
+		return 0;
+	XXH64_state_t *state = XXH64_createState();
+	XXH64_reset(state, 0);
+	XXH64_update(state, chain[index].devices.data(), chain[index].devicesSize);
+	for (int r = 0; r < RegionCount; r++)
+	{
+		Region region = (Region)r;
+		for (u32 offset = 0; offset < regionSize(region); offset += PAGE_SIZE)
+			XXH64_update(state, PageAt(index, region, offset), PAGE_SIZE);
+	}
+	u64 hash = XXH64_digest(state);
+	XXH64_freeState(state);
+
+	return hash;
+}
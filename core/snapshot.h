@@ -0,0 +1,61 @@
+/*
+	In-memory savestates taken at frame rate (rollback, rewind).
+
+	The oldest snapshot of the chain holds a full copy of main RAM, VRAM and AICA RAM.
+	Each following snapshot only holds the device state and the guest memory pages
+	written since the previous one, as reported by memwatch.
+*/
+#pragma once
+#include "types.h"
+#include "hw/mem/mem_watch.h"
+
+#include <deque>
+#include <vector>
+
+class SnapshotChain
+{
+public:
+	// Drop all snapshots and stop tracking writes
+	void Reset();
+
+	// Snapshot the machine. ids must be increasing. Emulation must be stopped.
+	bool Take(u32 id);
+
+	// Restore the machine to a snapshot. Newer snapshots are dropped.
+	// The caller is responsible for flushing the code caches and mmu state, as dc_loadstate does.
+	bool Restore(u32 id);
+
+	// Merge the snapshots older than id into the full image
+	void DropBefore(u32 id);
+
+	bool Has(u32 id) const { return Find(id) >= 0; }
+
+	// Number of snapshots, the full image included
+	size_t Count() const { return chain.size(); }
+
+	// Bytes held by a snapshot
+	size_t Size(u32 id) const;
+
+	// Hash of the complete state of a snapshot
+	u64 Hash(u32 id) const;
+
+private:
+	struct Snapshot
+	{
+		u32 id = 0;
+		std::vector<u8> devices;
+		u32 devicesSize = 0;
+		// Offsets of the pages held, in increasing order. Unused by the full image.
+		std::vector<u32> pages[memwatch::RegionCount];
+		std::vector<u8> data[memwatch::RegionCount];
+	};
+
+	int Find(u32 id) const;
+	bool SaveDevices(Snapshot& snapshot);
+	const u8 *PageAt(int index, memwatch::Region region, u32 offset) const;
+	void Recycle(Snapshot& snapshot);
+
+	std::deque<Snapshot> chain;
+	std::vector<Snapshot> pool;
+	std::vector<u32> scratch;
+};
@@ -176,6 +176,18 @@ bool rc_serialize(const void *src, unsigned int src_size, void **dest, unsigned
 bool rc_unserialize(void *src, unsigned int src_size, void **dest, unsigned int *total_size);
 bool dc_serialize(void **data, unsigned int *total_size);
 bool dc_unserialize(void **data, unsigned int *total_size);
+// Same as above without main RAM, VRAM and AICA RAM
+bool dc_serialize_devices(void **data, unsigned int *total_size);
+bool dc_unserialize_devices(void **data, unsigned int *total_size);
+
+// Destination of a state serialized without an intermediate buffer
+class SerializeStream
+{
+public:
+	virtual ~SerializeStream() = default;
+	virtual bool Write(const void *data, size_t length) = 0;
+};
+bool dc_serialize(SerializeStream& stream, unsigned int *total_size);
 
 #define REICAST_S(v) rc_serialize(&(v), sizeof(v), data, total_size)
 #define REICAST_US(v) rc_unserialize(&(v), sizeof(v), data, total_size)
@@ -324,6 +336,7 @@ struct settings_t
 	struct
 	{
 		bool NoBatch;
+		bool muteAudio;
 	} aica;
 
 	struct
@@ -338,6 +351,7 @@ struct settings_t
 	} input;
 
 	bool gameStarted;
+	bool disableRenderer;
 };
 
 extern settings_t settings;
@@ -8,6 +8,7 @@
 #include "xinput_gamepad.h"
 #include "win_keyboard.h"
 #include "hw/sh4/dyna/blockmanager.h"
+#include "hw/mem/mem_watch.h"
 #include "log/LogManager.h"
 #include "wsi/context.h"
 #if defined(USE_SDL)
@@ -181,6 +182,9 @@ LONG ExeptionHandler(EXCEPTION_POINTERS *ep)
 
 	//printf("[EXC] During access to : 0x%X\n", address);
 
+	// write tracking for incremental snapshots
+	if (memwatch::writeAccess(address))
+		return EXCEPTION_CONTINUE_EXECUTION;
 	// code protection in RAM
 	if (bm_RamWriteAccess(address))
 		return EXCEPTION_CONTINUE_EXECUTION;
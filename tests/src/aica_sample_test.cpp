@@ -0,0 +1,170 @@
+#include "gtest/gtest.h"
+#include "types.h"
+#include "emulator.h"
+#include "cfg/cfg.h"
+#include "cfg/option.h"
+#include "hw/mem/_vmem.h"
+#include "hw/aica/aica_if.h"
+#include "hw/aica/aica_mem.h"
+#include "hw/aica/sgc_if.h"
+#include "oslib/audiostream.h"
+
+#include <chrono>
+
+static std::vector<u32> captured;
+
+static u32 capturePush(const void *data, u32 frames, bool wait)
+{
+	const u32 *p = (const u32 *)data;
+	captured.insert(captured.end(), p, p + frames);
+	return 1;
+}
+
+static audiobackend_t captureBackend = {
+	"test",
+	"Test capture",
+	[]() {},
+	&capturePush,
+	[]() {},
+	nullptr
+};
+static bool captureRegistered = RegisterAudioBackend(&captureBackend);
+
+// Register write applied before rendering a given batch of 32 samples
+struct RegWrite
+{
+	int batch;
+	u32 addr;
+	u32 value;
+};
+
+#define CHAN(ch, reg) ((ch) * 0x80 + (reg))
+
+/*
+	Four voices: 16-bit PCM looping with a low-pass filter, 8-bit PCM one-shot,
+	ADPCM looping with pitch and amplitude LFOs, ADPCM stream.
+	All of them are sent to the DSP, which copies MIXS 0 to EFREG 0.
+*/
+static const RegWrite trace[] = {
+	// ch 0: PCM16, SA 0x10000, loop 0x100-0x800, filter on
+	{ 0, CHAN(0, 0x04), 0x0000 }, { 0, CHAN(0, 0x00), 0x0201 }, { 0, CHAN(0, 0x08), 0x100 }, { 0, CHAN(0, 0x0C), 0x800 },
+	{ 0, CHAN(0, 0x10), 0x001f }, { 0, CHAN(0, 0x14), 0x0010 }, { 0, CHAN(0, 0x18), 0x0200 }, { 0, CHAN(0, 0x1C), 0x8000 },
+	{ 0, CHAN(0, 0x20), 0x00f0 }, { 0, CHAN(0, 0x24), 0x0f1f }, { 0, CHAN(0, 0x28), 0x0408 },
+	{ 0, CHAN(0, 0x2C), 0x0800 }, { 0, CHAN(0, 0x30), 0x1000 }, { 0, CHAN(0, 0x34), 0x0c00 }, { 0, CHAN(0, 0x38), 0x0a00 },
+	{ 0, CHAN(0, 0x40), 0x1010 }, { 0, CHAN(0, 0x44), 0x0808 },
+	// ch 1: PCM8, SA 0x20000, no loop
+	{ 0, CHAN(1, 0x04), 0x0000 }, { 0, CHAN(1, 0x00), 0x0082 }, { 0, CHAN(1, 0x08), 0 }, { 0, CHAN(1, 0x0C), 0x1800 },
+	{ 0, CHAN(1, 0x10), 0x041f }, { 0, CHAN(1, 0x14), 0x0018 }, { 0, CHAN(1, 0x18), 0x0800 }, { 0, CHAN(1, 0x1C), 0x8000 },
+	{ 0, CHAN(1, 0x20), 0x0080 }, { 0, CHAN(1, 0x24), 0x0d05 }, { 0, CHAN(1, 0x28), 0x1020 },
+	// ch 2: ADPCM, SA 0x30000, loop 0x200-0x1000, LFOs
+	{ 0, CHAN(2, 0x04), 0x0000 }, { 0, CHAN(2, 0x00), 0x0303 }, { 0, CHAN(2, 0x08), 0x200 }, { 0, CHAN(2, 0x0C), 0x1000 },
+	{ 0, CHAN(2, 0x10), 0x001a }, { 0, CHAN(2, 0x14), 0x4014 }, { 0, CHAN(2, 0x18), 0x7900 }, { 0, CHAN(2, 0x1C), 0xb6b5 },
+	{ 0, CHAN(2, 0x20), 0x00c0 }, { 0, CHAN(2, 0x24), 0x0c10 }, { 0, CHAN(2, 0x28), 0x0020 },
+	// ch 3: ADPCM stream, SA 0x40000, DSP send only
+	{ 0, CHAN(3, 0x04), 0x0000 }, { 0, CHAN(3, 0x00), 0x0384 }, { 0, CHAN(3, 0x08), 0x0 }, { 0, CHAN(3, 0x0C), 0x2000 },
+	{ 0, CHAN(3, 0x10), 0x001f }, { 0, CHAN(3, 0x14), 0x0010 }, { 0, CHAN(3, 0x18), 0x0000 }, { 0, CHAN(3, 0x1C), 0x8000 },
+	{ 0, CHAN(3, 0x20), 0x00f0 }, { 0, CHAN(3, 0x24), 0x0000 }, { 0, CHAN(3, 0x28), 0x0020 },
+	// key on
+	{ 0, CHAN(0, 0x00), 0xc201 }, { 0, CHAN(1, 0x00), 0x4082 }, { 0, CHAN(2, 0x00), 0x4303 }, { 0, CHAN(3, 0x00), 0xc384 },
+	// pitch change, pan change, key off
+	{ 10, CHAN(0, 0x18), 0x1100 },
+	{ 16, CHAN(2, 0x24), 0x0f05 },
+	{ 20, CHAN(0, 0x00), 0x0201 }, { 20, CHAN(0, 0x00), 0x8201 },
+	{ 40, CHAN(2, 0x00), 0x0303 }, { 40, CHAN(2, 0x00), 0x8303 },
+};
+
+class AicaSampleTest : public ::testing::Test {
+protected:
+	void SetUp() override {
+		if (!_vmem_reserve())
+			die("_vmem_reserve failed");
+		dc_init();
+		cfgSetAutoSave(false);
+		TermAudio();
+		config::AudioBackend = "test";
+		InitAudio();
+	}
+	void TearDown() override {
+		TermAudio();
+		config::DSPEnabled = false;
+	}
+
+	void reset()
+	{
+		dc_reset(true);
+		for (u32 i = 0; i < 0x10000; i++)
+		{
+			aica_ram[0x10000 + i] = (u8)(i * 7 + (i >> 5));
+			aica_ram[0x20000 + i] = (u8)(i * 13);
+			aica_ram[0x30000 + i] = (u8)(i * 0x9b + (i >> 3));
+			aica_ram[0x40000 + i] = (u8)(i ^ (i >> 4));
+		}
+		// master volume
+		libAICA_WriteReg(0x2800, 0x000f, 2);
+		// EFREG 0 full volume, centered
+		libAICA_WriteReg(0x2000, 0x0f00, 2);
+		// DSP: X=MIXS[0] Y=COEF[0] ZERO, then EFREG[0] = ACC
+		libAICA_WriteReg(0x3000, 0x7ff8, 2);
+		libAICA_WriteReg(0x3400 + 4, 0xa000 | (0x20 << 7), 2);
+		libAICA_WriteReg(0x3400 + 8, 0x0002, 2);
+		libAICA_WriteReg(0x3400 + 0x18, 0x1000, 2);
+		captured.clear();
+	}
+
+	void render(bool batched, int batches)
+	{
+		reset();
+		size_t next = 0;
+		for (int batch = 0; batch < batches; batch++)
+		{
+			for (; next < ARRAY_SIZE(trace) && trace[next].batch == batch; next++)
+				libAICA_WriteReg(trace[next].addr, trace[next].value, 2);
+			if (batched)
+				AICA_Sample32();
+			else
+				for (int i = 0; i < 32; i++)
+					AICA_Sample();
+		}
+	}
+
+	void compare(int batches)
+	{
+		render(false, batches);
+		std::vector<u32> expected = captured;
+		render(true, batches);
+		ASSERT_EQ(batches * 32u, expected.size());
+		ASSERT_EQ(expected.size(), captured.size());
+		bool silent = true;
+		for (size_t i = 0; i < expected.size(); i++)
+		{
+			ASSERT_EQ(expected[i], captured[i]) << "sample " << i;
+			silent = silent && expected[i] == 0;
+		}
+		ASSERT_FALSE(silent);
+	}
+};
+
+TEST_F(AicaSampleTest, BatchedTest)
+{
+	compare(SAMPLE_COUNT / 32 * 4);
+}
+
+TEST_F(AicaSampleTest, BatchedDspTest)
+{
+	config::DSPEnabled = true;
+	compare(SAMPLE_COUNT / 32 * 4);
+}
+
+TEST_F(AicaSampleTest, Benchmark)
+{
+	using Clock = std::chrono::steady_clock;
+	const int kBatches = 44100 / 32 * 10;
+
+	auto start = Clock::now();
+	render(false, kBatches);
+	auto single = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start).count();
+	start = Clock::now();
+	render(true, kBatches);
+	auto batched = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start).count();
+	printf("10 s of audio: AICA_Sample %lld us, AICA_Sample32 %lld us\n", (long long)single, (long long)batched);
+}
@@ -0,0 +1,295 @@
+#include "gtest/gtest.h"
+#include "types.h"
+#include "emulator.h"
+#include "cfg/option.h"
+#include "hw/mem/_vmem.h"
+#include "hw/sh4/sh4_if.h"
+#include "hw/sh4/sh4_core.h"
+#include "hw/sh4/sh4_mem.h"
+#include "hw/sh4/modules/mmu.h"
+#include "hw/sh4/dyna/asynccompile.h"
+#include "hw/sh4/dyna/blockcache.h"
+#include "hw/sh4/dyna/ngen.h"
+#include "profiler/profiler.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <thread>
+#include <atomic>
+
+#if FEAT_SHREC != DYNAREC_NONE
+
+#ifdef __unix__
+// the block table is allocated on demand by the fault handler
+void install_fault_handler();
+#endif
+
+class AsyncCompileTest : public ::testing::Test {
+protected:
+	void SetUp() override {
+#ifdef __unix__
+		install_fault_handler();
+#endif
+		if (!_vmem_reserve())
+			die("_vmem_reserve failed");
+		dc_init();
+		mem_map_default();
+		dc_reset(true);
+		mmu_set_state();
+		Get_Sh4Recompiler(&sh4_cpu);
+		// the shil code of the blocks is compared
+		rdv_KeepShil = true;
+		writeProgram();
+	}
+	void TearDown() override {
+		config::DynarecAsyncCompile = false;
+		config::DynarecBlockCache = false;
+		bc_Clear();
+		rdv_KeepShil = false;
+		ac_Term();
+		clearCode();
+	}
+
+	static const u32 Start = 0x8c010000;
+	static const u32 BlockSize = 64;
+	static const int BlockCount = 2000;
+
+	// Blocks of 28 integer ops followed by a branch to the next block
+	static void writeProgram()
+	{
+		std::mt19937 rng(1);
+		for (int b = 0; b < BlockCount; b++)
+		{
+			u32 start = Start + b * BlockSize;
+			for (u32 i = 0; i < 28; i++)
+			{
+				u32 n = rng() % 8;
+				u32 m = rng() % 8;
+				u16 op;
+				switch (rng() % 4)
+				{
+				case 0: op = 0xE000 | n << 8 | (rng() & 0xff); break;	// mov #imm,rn
+				case 1: op = 0x300C | n << 8 | m << 4; break;			// add rm,rn
+				case 2: op = 0x4000 | n << 8; break;					// shll rn
+				default: op = 0x200A | n << 8 | m << 4; break;			// xor rm,rn
+				}
+				WriteMem16(start + i * 2, op);
+			}
+			WriteMem16(start + 56, 0xA002);		// bra next block
+			WriteMem16(start + 58, 0x0009);		// nop
+		}
+	}
+
+	static void clearCode()
+	{
+		sh4_cpu.ResetCache();
+		bm_Reset();
+	}
+
+	static void resetCounters()
+	{
+		auto& bm = prof.counters.bm;
+		bm.compiled = bm.baseline = bm.async_installed = bm.async_failed = 0;
+		memset(bm.stall_us, 0, sizeof(bm.stall_us));
+	}
+
+	// Compiles all the blocks, installing the blocks compiled in the background on each miss
+	static void compileAll()
+	{
+		for (int b = 0; b < BlockCount; b++)
+			rdv_FailedToFindBlock(Start + b * BlockSize);
+	}
+
+	static void compileMisses()
+	{
+		for (int b = 0; b < BlockCount; b++)
+		{
+			next_pc = Start + b * BlockSize;
+			rdv_CompilePC(0);
+		}
+	}
+
+	static std::string shil(u32 addr)
+	{
+		RuntimeBlockInfoPtr block = bm_GetBlock(addr);
+		std::string s;
+		for (const shil_opcode& op : block->oplist)
+			s += op.dissasm() + "\n";
+		return s;
+	}
+
+	static std::vector<std::string> shilAll()
+	{
+		std::vector<std::string> code;
+		for (int b = 0; b < BlockCount; b++)
+			code.push_back(shil(Start + b * BlockSize));
+		return code;
+	}
+
+	// Decodes a block without adding it to the block manager
+	static std::string decode(u32 addr, DecodeMode mode)
+	{
+		RuntimeBlockInfo *block = ngen_AllocateBlock();
+		block->read_only = true;
+		std::string s;
+		if (block->Setup(addr, fpscr, mode))
+			for (const shil_opcode& op : block->oplist)
+				s += op.dissasm() + "\n";
+		if (mode == DM_Background)
+			ac_DeleteBlock(block);
+		else
+			delete block;
+		return s;
+	}
+
+	static u32 stallTotal()
+	{
+		u32 total = 0;
+		for (u32 count : prof.counters.bm.stall_us)
+			total += count;
+		return total;
+	}
+};
+
+TEST_F(AsyncCompileTest, Install)
+{
+	auto& bm = prof.counters.bm;
+	config::DynarecAsyncCompile = false;
+	clearCode();
+	compileAll();
+	std::vector<std::string> reference = shilAll();
+
+	config::DynarecAsyncCompile = true;
+	clearCode();
+	resetCounters();
+	compileAll();
+	ASSERT_EQ(0u, bm.compiled);
+	ASSERT_EQ((u32)BlockCount, bm.baseline);
+
+	ac_Flush();
+	rdv_InstallCompiledBlocks();
+	ASSERT_EQ((u32)BlockCount, bm.async_installed);
+	ASSERT_EQ(0u, bm.async_failed);
+	ASSERT_EQ((u32)BlockCount * 2, stallTotal());
+	for (int b = 0; b < BlockCount; b++)
+		ASSERT_FALSE(bm_GetBlock(Start + b * BlockSize)->baseline);
+	ASSERT_TRUE(reference == shilAll());
+}
+
+TEST_F(AsyncCompileTest, ModifiedCode)
+{
+	auto& bm = prof.counters.bm;
+	config::DynarecAsyncCompile = true;
+	clearCode();
+	resetCounters();
+	rdv_FailedToFindBlock(Start);
+	ac_Flush();
+	// The block is modified before being installed
+	WriteMem16(Start, 0xE17F);	// mov #127,r1
+	rdv_InstallCompiledBlocks();
+	ASSERT_EQ(0u, bm.async_installed);
+
+	rdv_FailedToFindBlock(Start);
+	ac_Flush();
+	rdv_InstallCompiledBlocks();
+	std::string code = shil(Start);
+
+	config::DynarecAsyncCompile = false;
+	clearCode();
+	rdv_FailedToFindBlock(Start);
+	ASSERT_EQ(code, shil(Start));
+}
+
+TEST_F(AsyncCompileTest, CacheHits)
+{
+	auto& bm = prof.counters.bm;
+	config::DynarecBlockCache = true;
+	bc_Clear();
+	config::DynarecAsyncCompile = false;
+	clearCode();
+	compileAll();
+	std::vector<std::string> reference = shilAll();
+
+	// The worker thread finds the blocks in the cache. They're counted by the cpu thread when installed.
+	config::DynarecAsyncCompile = true;
+	clearCode();
+	resetCounters();
+	bm.cache_hits = 0;
+	compileMisses();
+	ac_Flush();
+	ASSERT_EQ(0u, bm.cache_hits);
+	rdv_InstallCompiledBlocks();
+	ASSERT_EQ((u32)BlockCount, bm.async_installed);
+	ASSERT_EQ((u32)BlockCount, bm.cache_hits);
+	for (int b = 0; b < BlockCount; b++)
+		ASSERT_TRUE(bm_GetBlock(Start + b * BlockSize)->read_only);
+	ASSERT_TRUE(reference == shilAll());
+}
+
+TEST_F(AsyncCompileTest, Benchmark)
+{
+	auto& bm = prof.counters.bm;
+	config::DynarecAsyncCompile = false;
+	clearCode();
+	resetCounters();
+	bm.decode_us = bm.codegen_us = 0;
+	compileMisses();
+	u32 syncUs = bm.decode_us + bm.codegen_us;
+
+	config::DynarecAsyncCompile = true;
+	clearCode();
+	resetCounters();
+	bm.decode_us = bm.codegen_us = 0;
+	compileMisses();
+	u32 asyncUs = bm.decode_us + bm.codegen_us;
+	ac_Flush();
+	rdv_InstallCompiledBlocks();
+	printf("%d blocks: cpu thread %d us -> %d us on misses, %d us with the replacements\n", BlockCount,
+			syncUs, asyncUs, bm.decode_us + bm.codegen_us);
+}
+
+TEST_F(AsyncCompileTest, BaselineWhileDecoding)
+{
+	std::vector<std::string> baseline;
+	std::vector<std::string> background;
+	for (int b = 0; b < BlockCount; b++)
+	{
+		baseline.push_back(decode(Start + b * BlockSize, DM_Baseline));
+		background.push_back(decode(Start + b * BlockSize, DM_Background));
+	}
+	ASSERT_NE(baseline[0], background[0]);
+
+	// The cpu thread decodes baseline blocks while the background compiler is busy decoding the others
+	std::atomic<bool> done(false);
+	std::atomic<u32> workerDecodes(0);
+	bool workerOk = true;
+	std::thread worker([&]() {
+		for (int b = 0; !done; b = (b + 1) % BlockCount)
+		{
+			if (decode(Start + b * BlockSize, DM_Background) != background[b])
+				workerOk = false;
+			workerDecodes++;
+		}
+	});
+	u32 maxUs = 0;
+	u64 totalUs = 0;
+	for (int b = 0; b < BlockCount; b++)
+	{
+		auto start = std::chrono::steady_clock::now();
+		std::string code = decode(Start + b * BlockSize, DM_Baseline);
+		u32 us = (u32)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+		maxUs = std::max(maxUs, us);
+		totalUs += us;
+		ASSERT_EQ(baseline[b], code);
+	}
+	done = true;
+	worker.join();
+	ASSERT_TRUE(workerOk);
+	ASSERT_NE(0u, workerDecodes.load());
+	printf("%d baseline blocks during %d background decodes: %d us avg, %d us max\n", BlockCount,
+			workerDecodes.load(), (int)(totalUs / BlockCount), maxUs);
+}
+
+#endif
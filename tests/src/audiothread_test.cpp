@@ -0,0 +1,188 @@
+#include "gtest/gtest.h"
+#include "types.h"
+#include "cfg/cfg.h"
+#include "cfg/option.h"
+#include "oslib/audiostream.h"
+#include "profiler/profiler.h"
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+using the_clock = std::chrono::steady_clock;
+
+// Counts the blocks pushed by the emulation thread, which initializes the backend, and by the other threads.
+// Consumes the frames at the pace of a real audio device.
+static std::thread::id emuThread;
+static std::atomic<u32> emuPushes;
+static std::atomic<u32> threadPushes;
+static the_clock::time_point captureTime;
+
+static void capture_init()
+{
+	emuThread = std::this_thread::get_id();
+	emuPushes = 0;
+	threadPushes = 0;
+	captureTime = the_clock::time_point();
+}
+
+static u32 capture_push(const void* frame, u32 samples, bool wait)
+{
+	if (std::this_thread::get_id() == emuThread)
+		emuPushes++;
+	else
+		threadPushes++;
+	if (wait)
+	{
+		if (captureTime.time_since_epoch() != the_clock::duration::zero())
+		{
+			auto duration = std::chrono::nanoseconds(1000000000L * samples / 44100);
+			std::this_thread::sleep_for(duration - (the_clock::now() - captureTime));
+			captureTime += duration;
+		}
+		else
+			captureTime = the_clock::now();
+	}
+	return 1;
+}
+
+static void capture_term()
+{
+}
+
+static audiobackend_t audiobackend_capture = {
+	"test-capture",
+	"Test capture",
+	&capture_init,
+	&capture_push,
+	&capture_term,
+	nullptr,
+	nullptr,
+	nullptr,
+	nullptr
+};
+
+static bool capture = RegisterAudioBackend(&audiobackend_capture);
+
+class AudioThreadTest : public ::testing::Test {
+protected:
+	void SetUp() override {
+		memset(&prof.counters.audio, 0, sizeof(prof.counters.audio));
+	}
+	void TearDown() override {
+		config::AudioThread = false;
+		config::AudioBackend.reset();
+	}
+
+	static const u32 Capacity = 4096;
+	float produced = 0.f;
+	u32 inputFrame = 0;
+
+	// Emulation producing speed times as many frames as the device consumes. Returns the output frames.
+	std::vector<SoundFrame> simulate(float speed, u32 blocks, RingBuffer& ring, AudioResampler& resampler,
+			u32& underruns, u32& overruns)
+	{
+		std::vector<SoundFrame> output(blocks * SAMPLE_COUNT);
+		SoundFrame block[SAMPLE_COUNT];
+		for (u32 b = 0; b < blocks; b++)
+		{
+			for (produced += speed * SAMPLE_COUNT; produced >= SAMPLE_COUNT; produced -= SAMPLE_COUNT)
+			{
+				// 441 Hz sine
+				for (SoundFrame& frame : block)
+				{
+					frame.l = frame.r = (s16)(10000 * std::sin(inputFrame * 2 * 3.14159265 / 100));
+					inputFrame++;
+				}
+				if (!ring.write((const u8 *)block, sizeof(block)))
+					overruns++;
+			}
+			underruns += resampler.process(ring, &output[b * SAMPLE_COUNT], SAMPLE_COUNT);
+		}
+		return output;
+	}
+};
+
+TEST_F(AudioThreadTest, RateControl)
+{
+	for (float speed : { 1.f, 1.003f, 0.997f })
+	{
+		produced = 0.f;
+		inputFrame = 0;
+		RingBuffer ring;
+		ring.setCapacity(Capacity * sizeof(SoundFrame));
+		AudioResampler resampler;
+		resampler.reset(Capacity / 2);
+		u32 underruns = 0;
+		u32 overruns = 0;
+		// 30 s
+		simulate(speed, 2600, ring, resampler, underruns, overruns);
+		ASSERT_EQ(0u, overruns) << speed;
+		ASSERT_NEAR(speed, resampler.getRatio(), 0.0005f);
+
+		// 1 min after the rates are matched
+		underruns = 0;
+		std::vector<SoundFrame> output = simulate(speed, 5200, ring, resampler, underruns, overruns);
+		ASSERT_EQ(0u, underruns) << speed;
+		ASSERT_EQ(0u, overruns) << speed;
+		ASSERT_NEAR(speed, resampler.getRatio(), 0.0005f);
+		printf("speed %.3f: ratio %.4f, %d frames buffered\n", speed, resampler.getRatio(), ring.available() / (int)sizeof(SoundFrame));
+	}
+}
+
+TEST_F(AudioThreadTest, Underrun)
+{
+	RingBuffer ring;
+	ring.setCapacity(Capacity * sizeof(SoundFrame));
+	AudioResampler resampler;
+	resampler.reset(Capacity / 2);
+	u32 underruns = 0;
+	u32 overruns = 0;
+	// Silence while the buffer fills up
+	simulate(1.f, 4, ring, resampler, underruns, overruns);
+	ASSERT_EQ(3 * SAMPLE_COUNT, underruns);
+	simulate(1.f, 100, ring, resampler, underruns, overruns);
+	ASSERT_EQ(3 * SAMPLE_COUNT, underruns);
+	// The emulation stops for a while
+	underruns = 0;
+	simulate(0.f, 10, ring, resampler, underruns, overruns);
+	ASSERT_GT(underruns, 0u);
+	underruns = 0;
+	simulate(1.f, 100, ring, resampler, underruns, overruns);
+	ASSERT_EQ(3 * SAMPLE_COUNT, underruns);
+	ASSERT_EQ(0u, overruns);
+}
+
+TEST_F(AudioThreadTest, WriteSample)
+{
+	cfgSetAutoSave(false);
+	config::AudioBackend = "test-capture";
+	const u32 Frames = 22050;
+	for (int threaded = 0; threaded < 2; threaded++)
+	{
+		config::AudioThread = threaded == 1;
+		InitAudio();
+		for (u32 i = 0; i < Frames; i++)
+			WriteSample((s16)i, (s16)i);
+		if (threaded)
+			while (threadPushes == 0)
+				std::this_thread::yield();
+		TermAudio();
+		printf("%s: %d blocks pushed by the emulation, %d by the audio thread\n", threaded ? "audio thread" : "emulation thread",
+				(u32)emuPushes, (u32)threadPushes);
+		if (threaded)
+		{
+			// The emulation never waits for the audio device
+			ASSERT_EQ(0u, emuPushes);
+			ASSERT_GT(threadPushes, 0u);
+		}
+		else
+		{
+			ASSERT_EQ(Frames / SAMPLE_COUNT, emuPushes);
+			ASSERT_EQ(0u, threadPushes);
+		}
+	}
+}
@@ -0,0 +1,176 @@
+#include "gtest/gtest.h"
+#include "types.h"
+#include "emulator.h"
+#include "cfg/option.h"
+#include "hw/mem/_vmem.h"
+#include "hw/sh4/sh4_if.h"
+#include "hw/sh4/sh4_core.h"
+#include "hw/sh4/sh4_mem.h"
+#include "hw/sh4/modules/mmu.h"
+#include "hw/sh4/dyna/blockcache.h"
+#include "hw/sh4/dyna/ngen.h"
+#include "profiler/profiler.h"
+
+#include <cstdio>
+#include <random>
+
+#if FEAT_SHREC != DYNAREC_NONE
+
+#ifdef __unix__
+// the block table is allocated on demand by the fault handler
+void install_fault_handler();
+#endif
+
+class BlockCacheTest : public ::testing::Test {
+protected:
+	void SetUp() override {
+#ifdef __unix__
+		install_fault_handler();
+#endif
+		if (!_vmem_reserve())
+			die("_vmem_reserve failed");
+		dc_init();
+		mem_map_default();
+		dc_reset(true);
+		mmu_set_state();
+		Get_Sh4Recompiler(&sh4_cpu);
+		bc_Clear();
+		// the shil code of the blocks is compared
+		rdv_KeepShil = true;
+		writeProgram();
+	}
+	void TearDown() override {
+		config::DynarecBlockCache = false;
+		rdv_KeepShil = false;
+		bc_Clear();
+		clearCode();
+		std::remove(path.c_str());
+	}
+
+	static const u32 Start = 0x8c010000;
+	static const u32 BlockSize = 64;
+	static const int BlockCount = 2000;
+
+	/*
+		Blocks of 28 integer ops, one of them loading a constant at the end of the block,
+		followed by a branch to the next block.
+	*/
+	static void writeProgram()
+	{
+		std::mt19937 rng(1);
+		for (int b = 0; b < BlockCount; b++)
+		{
+			u32 start = Start + b * BlockSize;
+			int constOp = rng() % 28;
+			for (u32 i = 0; i < 28; i++)
+			{
+				u32 pc = start + i * 2;
+				u32 n = rng() % 8;
+				u32 m = rng() % 8;
+				u16 op;
+				if ((int)i == constOp)
+					// mov.l @(disp,pc),rn
+					op = 0xD000 | n << 8 | (start + 60 - ((pc & ~3) + 4)) / 4;
+				else
+					switch (rng() % 5)
+					{
+					case 0: op = 0xE000 | n << 8 | (rng() & 0xff); break;	// mov #imm,rn
+					case 1: op = 0x300C | n << 8 | m << 4; break;			// add rm,rn
+					case 2: op = 0x4000 | n << 8; break;					// shll rn
+					case 3: op = 0x200A | n << 8 | m << 4; break;			// xor rm,rn
+					default: op = 0x0007 | n << 8 | m << 4; break;			// mul.l rm,rn
+					}
+				WriteMem16(pc, op);
+			}
+			WriteMem16(start + 56, 0xA002);		// bra next block
+			WriteMem16(start + 58, 0x0009);		// nop
+			WriteMem32(start + 60, rng());
+		}
+	}
+
+	static void clearCode()
+	{
+		sh4_cpu.ResetCache();
+		bm_Reset();
+	}
+
+	// Compiles all the blocks and returns their shil code
+	static std::vector<std::string> compileAll()
+	{
+		std::vector<std::string> code;
+		for (int b = 0; b < BlockCount; b++)
+		{
+			next_pc = Start + b * BlockSize;
+			rdv_CompilePC(0);
+			RuntimeBlockInfoPtr block = bm_GetBlock(next_pc);
+			std::string s;
+			for (const shil_opcode& op : block->oplist)
+				s += op.dissasm() + "\n";
+			code.push_back(s);
+		}
+		return code;
+	}
+
+	std::string path = ::testing::TempDir() + "blockcache_test.blocks";
+};
+
+TEST_F(BlockCacheTest, ReuseTest)
+{
+	auto& bm = prof.counters.bm;
+	config::DynarecBlockCache = false;
+	clearCode();
+	std::vector<std::string> reference = compileAll();
+
+	// first run: blocks are added to the cache
+	config::DynarecBlockCache = true;
+	clearCode();
+	bm.cache_hits = 0;
+	std::vector<std::string> code = compileAll();
+	ASSERT_EQ(0u, bm.cache_hits);
+	ASSERT_TRUE(reference == code);
+	ASSERT_TRUE(bc_Save(path));
+
+	// next run
+	bc_Clear();
+	ASSERT_TRUE(bc_Load(path));
+	clearCode();
+	bm.cache_hits = 0;
+	code = compileAll();
+	ASSERT_EQ((u32)BlockCount, bm.cache_hits);
+	ASSERT_TRUE(reference == code);
+
+	// Changing the constant of the first block invalidates the blocks of its page,
+	// since the constant is propagated in protected blocks
+	clearCode();
+	WriteMem32(Start + 60, ReadMem32(Start + 60) ^ 0x12345678);
+	config::DynarecBlockCache = false;
+	reference = compileAll();
+	config::DynarecBlockCache = true;
+	clearCode();
+	bm.cache_hits = 0;
+	code = compileAll();
+	ASSERT_EQ((u32)BlockCount - PAGE_SIZE / BlockSize, bm.cache_hits);
+	ASSERT_TRUE(reference == code);
+}
+
+TEST_F(BlockCacheTest, Benchmark)
+{
+	auto& bm = prof.counters.bm;
+	config::DynarecBlockCache = true;
+	clearCode();
+	bm.decode_us = bm.codegen_us = 0;
+	compileAll();
+	u32 coldDecode = bm.decode_us;
+	u32 coldCodegen = bm.codegen_us;
+	ASSERT_TRUE(bc_Save(path));
+	bc_Clear();
+	ASSERT_TRUE(bc_Load(path));
+
+	clearCode();
+	bm.decode_us = bm.codegen_us = 0;
+	compileAll();
+	printf("%d blocks: decoding %d us -> %d us, host code %d us -> %d us\n", BlockCount,
+			coldDecode, bm.decode_us, coldCodegen, bm.codegen_us);
+}
+
+#endif
@@ -0,0 +1,219 @@
+#include "gtest/gtest.h"
+#include "types.h"
+#include "emulator.h"
+#include "hw/mem/_vmem.h"
+#include "hw/sh4/sh4_if.h"
+#include "hw/sh4/sh4_core.h"
+#include "hw/sh4/sh4_mem.h"
+#include "hw/sh4/modules/mmu.h"
+#include "hw/sh4/dyna/blockmanager.h"
+#include "hw/sh4/dyna/ngen.h"
+#include "profiler/profiler.h"
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#if FEAT_SHREC != DYNAREC_NONE
+
+#ifdef __unix__
+// the block table is allocated on demand by the fault handler
+void install_fault_handler();
+#endif
+
+class BlockManagerTest : public ::testing::Test {
+protected:
+	void SetUp() override {
+#ifdef __unix__
+		install_fault_handler();
+#endif
+		if (!_vmem_reserve())
+			die("_vmem_reserve failed");
+		dc_init();
+		// dc_init() only maps the first reserved memory, which the dynarec must access directly
+		_vmem_init_mappings();
+		mem_map_default();
+		dc_reset(true);
+		mmu_set_state();
+		Get_Sh4Recompiler(&sh4_cpu);
+		writeBlocks();
+	}
+	void TearDown() override {
+		sh4_cpu.ResetCache();
+		bm_Reset();
+	}
+
+	static const u32 Start = 0x8c100000;
+	static const u32 BlockSize = 32;
+	static const int BlockCount = 8192;
+
+	// Blocks of 14 integer ops followed by a branch to the next block, many per page
+	static void writeBlocks()
+	{
+		std::mt19937 rng(1);
+		for (int b = 0; b < BlockCount; b++)
+		{
+			u32 addr = Start + b * BlockSize;
+			for (u32 i = 0; i < 14; i++)
+			{
+				u32 n = rng() % 8;
+				u32 m = rng() % 8;
+				WriteMem16(addr + i * 2, rng() % 2 ? 0xE000 | n << 8 | (rng() & 0xff)	// mov #imm,rn
+						: 0x300C | n << 8 | m << 4);									// add rm,rn
+			}
+			WriteMem16(addr + 28, 0xA002);		// bra next block
+			WriteMem16(addr + 30, 0x0009);		// nop
+		}
+	}
+
+	static void compileAll()
+	{
+		for (int b = 0; b < BlockCount; b++)
+			rdv_FailedToFindBlock(Start + b * BlockSize);
+	}
+
+	static std::vector<u8> saveState()
+	{
+		unsigned int size = 0;
+		void *data = nullptr;
+		dc_serialize(&data, &size);
+		std::vector<u8> state(size);
+		data = state.data();
+		dc_serialize(&data, &size);
+		return state;
+	}
+
+	// As in dc_loadstate()
+	static void loadState(std::vector<u8>& state)
+	{
+		bm_SaveCodePages();
+		bm_Reset();
+		void *data = state.data();
+		unsigned int size = 0;
+		dc_unserialize(&data, &size);
+		bm_DiscardChangedBlocks();
+	}
+
+	static u32 elapsedUs(std::chrono::steady_clock::time_point since)
+	{
+		return (u32)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - since).count();
+	}
+};
+
+TEST_F(BlockManagerTest, Lookup)
+{
+	sh4_cpu.ResetCache();
+	compileAll();
+	std::vector<u8 *> code;
+	for (int b = 0; b < BlockCount; b++)
+	{
+		RuntimeBlockInfoPtr block = bm_GetBlock(Start + b * BlockSize);
+		ASSERT_NE(nullptr, block);
+		ASSERT_TRUE(block->read_only);
+		code.push_back((u8 *)bm_GetCodeByVAddr(Start + b * BlockSize));
+	}
+	std::mt19937 rng(2);
+	const int Lookups = 1000000;
+	auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < Lookups; i++)
+	{
+		int b = rng() % BlockCount;
+		RuntimeBlockInfoPtr block = bm_GetBlock(code[b] + rng() % 16);
+		ASSERT_EQ(Start + b * BlockSize, block->addr);
+	}
+	u32 us = elapsedUs(start);
+	printf("%d host pc lookups in %d us (%.1f ns each)\n", Lookups, us, us * 1000.0 / Lookups);
+}
+
+TEST_F(BlockManagerTest, Allocation)
+{
+	const int Count = 1000000;
+	std::vector<RuntimeBlockInfo *> blocks(64);
+	auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < Count / 64; i++)
+	{
+		for (auto& block : blocks)
+			block = ngen_AllocateBlock();
+		for (auto& block : blocks)
+			delete block;
+	}
+	u32 us = elapsedUs(start);
+	printf("%d blocks allocated and freed in %d us (%.1f ns each)\n", Count, us, us * 1000.0 / Count);
+}
+
+TEST_F(BlockManagerTest, Invalidation)
+{
+	const int Rounds = 5;
+	u32 compileUs = 0;
+	u32 invalidateUs = 0;
+	for (int round = 0; round < Rounds; round++)
+	{
+		sh4_cpu.ResetCache();
+		auto start = std::chrono::steady_clock::now();
+		compileAll();
+		compileUs += elapsedUs(start);
+
+		// Writing to each code page discards all its blocks
+		start = std::chrono::steady_clock::now();
+		for (u32 addr = Start; addr < Start + BlockCount * BlockSize; addr += PAGE_SIZE)
+			bm_RamWriteAccess(addr);
+		invalidateUs += elapsedUs(start);
+		for (int b = 0; b < BlockCount; b++)
+			ASSERT_EQ(nullptr, bm_GetBlock(Start + b * BlockSize));
+		bm_Periodical_1s();
+	}
+	printf("%d blocks: compiled in %d us, invalidated in %d us (%.2f us per block)\n", BlockCount,
+			compileUs / Rounds, invalidateUs / Rounds, (double)invalidateUs / Rounds / BlockCount);
+}
+
+TEST_F(BlockManagerTest, LoadState)
+{
+	// The state to load differs from the current memory in one code page
+	const u32 Changed = Start + 10 * PAGE_SIZE;
+	u16 op = ReadMem16(Changed + 2);
+	WriteMem16(Changed + 2, op ^ 1);
+	std::vector<u8> state = saveState();
+	WriteMem16(Changed + 2, op);
+
+	sh4_cpu.ResetCache();
+	compileAll();
+	std::vector<RuntimeBlockInfo *> blocks;
+	std::vector<void *> code;
+	for (int b = 0; b < BlockCount; b++)
+	{
+		blocks.push_back(bm_GetBlock(Start + b * BlockSize).get());
+		code.push_back((void *)bm_GetCodeByVAddr(Start + b * BlockSize));
+	}
+
+	auto& bm = prof.counters.bm;
+	bm.load_kept = bm.load_discarded = 0;
+	loadState(state);
+	ASSERT_EQ(op ^ 1, ReadMem16(Changed + 2));
+	ASSERT_EQ(PAGE_SIZE / BlockSize, bm.load_discarded);
+	ASSERT_EQ(BlockCount - PAGE_SIZE / BlockSize, bm.load_kept);
+
+	// Only the blocks of the changed page are discarded. The others are still in the lookup table.
+	for (int b = 0; b < BlockCount; b++)
+	{
+		u32 addr = Start + b * BlockSize;
+		if ((addr & ~PAGE_MASK) == Changed)
+		{
+			ASSERT_EQ(nullptr, bm_GetBlock(addr));
+			ASSERT_EQ((void *)ngen_FailedToFindBlock, (void *)bm_GetCodeByVAddr(addr));
+		}
+		else
+		{
+			ASSERT_EQ(blocks[b], bm_GetBlock(addr).get());
+			ASSERT_EQ(code[b], (void *)bm_GetCodeByVAddr(addr));
+			ASSERT_TRUE(blocks[b]->read_only);
+		}
+	}
+
+	// The pages of the kept blocks are write-protected again
+	WriteMem16(Start, ReadMem16(Start));
+	ASSERT_EQ(nullptr, bm_GetBlock(Start));
+	ASSERT_NE(nullptr, bm_GetBlock(Changed + PAGE_SIZE));
+}
+
+#endif
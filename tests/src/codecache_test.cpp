@@ -0,0 +1,123 @@
+#include "gtest/gtest.h"
+#include "types.h"
+#include "emulator.h"
+#include "hw/mem/_vmem.h"
+#include "hw/sh4/sh4_if.h"
+#include "hw/sh4/sh4_core.h"
+#include "hw/sh4/sh4_mem.h"
+#include "hw/sh4/modules/mmu.h"
+#include "hw/sh4/dyna/ngen.h"
+#include "profiler/profiler.h"
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+
+#if FEAT_SHREC != DYNAREC_NONE
+
+#ifdef __unix__
+// the block table is allocated on demand by the fault handler
+void install_fault_handler();
+#endif
+
+class CodeCacheTest : public ::testing::Test {
+protected:
+	void SetUp() override {
+#ifdef __unix__
+		install_fault_handler();
+#endif
+		if (!_vmem_reserve())
+			die("_vmem_reserve failed");
+		dc_init();
+		mem_map_default();
+		dc_reset(true);
+		mmu_set_state();
+		Get_Sh4Recompiler(&sh4_cpu);
+		writeBlocks(HotStart, HotCount);
+		writeBlocks(ColdStart, ColdCount);
+	}
+	void TearDown() override {
+		sh4_cpu.ResetCache();
+		bm_Reset();
+	}
+
+	static const u32 HotStart = 0x8c010000;
+	static const int HotCount = 100;
+	static const u32 ColdStart = 0x8c100000;
+	static const int ColdCount = 40000;
+	static const u32 BlockSize = 256;
+
+	// Blocks of 124 integer ops followed by a branch to the next block
+	static void writeBlocks(u32 start, int count)
+	{
+		std::mt19937 rng(start);
+		for (int b = 0; b < count; b++)
+		{
+			u32 addr = start + b * BlockSize;
+			for (u32 i = 0; i < 124; i++)
+			{
+				u32 n = rng() % 8;
+				u32 m = rng() % 8;
+				u16 op;
+				switch (rng() % 4)
+				{
+				case 0: op = 0xE000 | n << 8 | (rng() & 0xff); break;	// mov #imm,rn
+				case 1: op = 0x300C | n << 8 | m << 4; break;			// add rm,rn
+				case 2: op = 0x4000 | n << 8; break;					// shll rn
+				default: op = 0x200A | n << 8 | m << 4; break;			// xor rm,rn
+				}
+				WriteMem16(addr + i * 2, op);
+			}
+			WriteMem16(addr + 248, 0xA002);		// bra next block
+			WriteMem16(addr + 250, 0x0009);		// nop
+		}
+	}
+
+	// Returns true if the block had to be compiled
+	static bool run(u32 addr, u32 runs)
+	{
+		bool compiled = false;
+		RuntimeBlockInfoPtr block = bm_GetBlock(addr);
+		if (!block)
+		{
+			rdv_FailedToFindBlock(addr);
+			block = bm_GetBlock(addr);
+			compiled = true;
+		}
+		block->runs += runs;
+		return compiled;
+	}
+};
+
+TEST_F(CodeCacheTest, HotBlocksKept)
+{
+	auto& bm = prof.counters.bm;
+	sh4_cpu.ResetCache();
+	bm.compiled = bm.reclaimed = bm.evicted = bm.kept = 0;
+	for (int b = 0; b < HotCount; b++)
+		run(HotStart + b * BlockSize, 0);
+
+	// The hot blocks run between each batch of new blocks, until the whole code cache has been reclaimed
+	u32 hotCompiles = 0;
+	int cold = 0;
+	auto start = std::chrono::steady_clock::now();
+	while (bm.reclaimed <= CODE_SEGMENTS)
+	{
+		for (int i = 0; i < 50; i++, cold++)
+			run(ColdStart + (cold % ColdCount) * BlockSize, 1);
+		for (int b = 0; b < HotCount; b++)
+			hotCompiles += run(HotStart + b * BlockSize, 100);
+	}
+	u32 ms = (u32)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+
+	ASSERT_GT(bm.evicted, 0u);
+#if CODE_SEGMENTS > 1 && (HOST_CPU == CPU_X64)
+	// only this dynarec counts the runs of each block
+	ASSERT_EQ(0u, hotCompiles);
+	ASSERT_GT(bm.kept, 0u);
+#endif
+	printf("%d blocks compiled in %d ms (%.0f/s), %d hot blocks recompiled, %d segments reclaimed: %d blocks discarded, %d kept\n",
+			bm.compiled, ms, bm.compiled * 1000.0 / std::max(ms, 1u), hotCompiles, bm.reclaimed, bm.evicted, bm.kept);
+}
+
+#endif
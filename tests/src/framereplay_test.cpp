@@ -0,0 +1,341 @@
+#include "gtest/gtest.h"
+#include "types.h"
+#include "emulator.h"
+#include "hw/mem/_vmem.h"
+#include "hw/pvr/pvr_mem.h"
+#include "hw/pvr/pvr_regs.h"
+#include "hw/pvr/ta.h"
+#include "hw/pvr/ta_ctx.h"
+#include "hw/pvr/Renderer_if.h"
+#include "hw/sh4/sh4_mem.h"
+#include "oslib/directory.h"
+#include "rend/TexCache.h"
+#include "rend/sorter.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <memory>
+#include <new>
+#include <random>
+#include <string>
+#include <vector>
+
+/*
+	Replays dumped frames (see dump_frame) through the CPU side of the PVR pipeline, with no window or GPU:
+	display list parsing, texture decoding, translucent polygon sorting and the null renderer.
+	Set FRAME_DUMP_DIR to a directory of dumped frames, otherwise a few synthetic frames are used.
+	FRAME_REPLAY_COUNT sets how many times each frame is replayed.
+*/
+
+TA_context* read_frame(const char* file, u8* vram_ref);
+void dump_frame(const char* file, TA_context* ctx, u8* vram, const u8* vram_ref);
+Renderer* rend_norend();
+
+static std::atomic<u64> newCount;
+static std::atomic<u64> newBytes;
+
+// Counts the allocations. The default operator delete frees them.
+void *operator new(size_t size)
+{
+	newCount++;
+	newBytes += size;
+	void *p = malloc(size != 0 ? size : 1);
+	if (p == nullptr)
+		throw std::bad_alloc();
+	return p;
+}
+
+// Texture ids identify the texture parameters. Textures are decoded separately.
+struct ReplayRenderer : Renderer
+{
+	bool Init() override { return true; }
+	void Resize(int w, int h) override {}
+	void Term() override {}
+	bool Process(TA_context* ctx) override { return true; }
+	bool Render() override { return true; }
+	u64 GetTexture(TSP tsp, TCW tcw) override { return (u64)tsp.full << 32 | tcw.full; }
+};
+
+// Decoded textures are dropped
+class ReplayTexture : public BaseTextureCacheData
+{
+public:
+	bool created = false;
+
+	std::string GetId() override { return std::to_string((uintptr_t)this); }
+	void UploadToGPU(int width, int height, u8 *temp_tex_buffer, bool mipmapped, bool mipmapsIncluded = false) override {}
+};
+
+class ReplayTextureCache : public BaseTextureCache<ReplayTexture>
+{
+public:
+	// Returns the number of texels decoded
+	u64 use(TSP tsp, TCW tcw)
+	{
+		ReplayTexture *texture = getTextureCacheData(tsp, tcw);
+		if (!texture->created)
+		{
+			texture->Create();
+			texture->created = true;
+		}
+		if (!texture->NeedsUpdate())
+			return 0;
+		texture->Update();
+		return texture->w * texture->h;
+	}
+};
+
+struct Stage
+{
+	const char *name;
+	const char *unit;
+	u64 cpuUs;
+	u64 wallUs;
+	u64 allocs;
+	u64 allocBytes;
+	u64 items;
+
+	template<typename F>
+	void measure(F f)
+	{
+		u64 count = newCount;
+		u64 bytes = newBytes;
+		std::clock_t cpu = std::clock();
+		auto start = std::chrono::steady_clock::now();
+		items += f();
+		wallUs += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+		cpuUs += (u64)(std::clock() - cpu) * 1000000 / CLOCKS_PER_SEC;
+		allocs += newCount - count;
+		allocBytes += newBytes - bytes;
+	}
+};
+
+class FrameReplayTest : public ::testing::Test {
+protected:
+	void SetUp() override {
+		if (!_vmem_reserve())
+			die("_vmem_reserve failed");
+		dc_init();
+		mem_map_default();
+		dc_reset(true);
+		savedRenderer = renderer;
+		renderer = &ids;
+	}
+	void TearDown() override {
+		textures.Clear();
+		_vmem_unprotect_vram(0, VRAM_SIZE);
+		renderer = savedRenderer;
+		tactx_Term();
+		for (const std::string& file : synthetic)
+			std::remove(file.c_str());
+	}
+
+	ReplayRenderer ids;
+	Renderer *savedRenderer = nullptr;
+	ReplayTextureCache textures;
+	std::vector<std::string> synthetic;
+
+	Stage stages[5] = {
+		{ "load", "frames" },
+		{ "parse", "vertices" },
+		{ "texture", "texels" },
+		{ "sort", "polys" },
+		{ "render", "frames" },
+	};
+
+	// Textured strips in the opaque, punch-through and translucent lists, in 2 render passes
+	void dumpFrames(const std::string& dir, int count)
+	{
+		flycast::mkdir(dir.c_str(), 0755);
+		std::mt19937 rng(42);
+		for (int frame = 0; frame < count; frame++)
+		{
+			for (u32 i = 0; i < VRAM_SIZE; i += 4)
+				*(u32 *)&vram[i] = rng();
+			// A single region
+			REGION_BASE = 0;
+			pvr_write32p<u32>(0, 0x80000000);
+			TCW texturePool[64];
+			for (TCW& tcw : texturePool)
+			{
+				tcw.full = 0;
+				tcw.TexAddr = rng() % 0x80000;
+				tcw.PixelFmt = rng() % 3;
+				tcw.ScanOrder = rng() & 1;
+			}
+
+			TA_context *ctx = tactx_Alloc();
+			// no background texture
+			memset(ctx->rend.global_param_op.head(), 0, sizeof(PolyParam));
+			memset(ctx->rend.verts.head(), 0, sizeof(Vertex) * 4);
+			const u32 lists[] = { ListType_Opaque, ListType_Punch_Through, ListType_Translucent };
+			for (int pass = 0; pass < 2; pass++)
+			{
+				if (pass > 0)
+					ctx->tad.Continue();
+				for (u32 list : lists)
+				{
+					for (int i = 0; i < 300; i++)
+					{
+						// Textured, Gouraud, packed color and 32-bit uv
+						TA_PolyParam0 *pp = (TA_PolyParam0 *)param(ctx, ParamType_Polygon_or_Modifier_Volume, list, 0x0a);
+						pp->isp.DepthMode = 6;
+						pp->tsp.TexU = rng() % 4;
+						pp->tsp.TexV = rng() % 4;
+						if (list == ListType_Translucent)
+						{
+							pp->tsp.SrcInstr = 4;
+							pp->tsp.DstInstr = 5;
+						}
+						pp->tcw = texturePool[rng() % 64];
+						for (int strip = rng() % 3; strip >= 0; strip--)
+						{
+							u32 vertices = rng() % 5 + 4;
+							for (u32 v = 0; v < vertices; v++)
+							{
+								TA_Vertex3 *vtx = (TA_Vertex3 *)param(ctx, ParamType_Vertex_Parameter, list, 0x0a, v == vertices - 1)->data_32;
+								vtx->xyz[0] = (f32)(rng() % 640);
+								vtx->xyz[1] = (f32)(rng() % 480);
+								vtx->xyz[2] = 1.f / (rng() % 1000 + 1);
+								vtx->u = (rng() % 1024) / 1024.f;
+								vtx->v = (rng() % 1024) / 1024.f;
+								vtx->BaseCol = rng() | 0xff000000;
+								vtx->OffsCol = rng();
+							}
+						}
+					}
+					param(ctx, ParamType_End_Of_List, list);
+				}
+			}
+			std::string path = dir + "/dcframe-" + std::to_string(frame);
+			dump_frame(path.c_str(), ctx, &vram[0], nullptr);
+			synthetic.push_back(path);
+			tactx_Recycle(ctx);
+		}
+	}
+
+	static Ta_Dma *param(TA_context *ctx, u32 paraType, u32 listType, u32 objCtrl = 0, bool endOfStrip = false)
+	{
+		Ta_Dma *p = (Ta_Dma *)ctx->tad.thd_data;
+		ctx->tad.thd_data += sizeof(Ta_Dma);
+		memset(p, 0, sizeof(Ta_Dma));
+		p->pcw.ParaType = paraType;
+		p->pcw.ListType = listType;
+		p->pcw.obj_ctrl = objCtrl;
+		p->pcw.EndOfStrip = endOfStrip;
+		return p;
+	}
+
+	u64 decodeTextures(const List<PolyParam>& list)
+	{
+		u64 texels = 0;
+		for (const PolyParam *pp = list.head(); pp != list.LastPtr(0); pp++)
+			if (pp->pcw.Texture)
+				texels += textures.use(pp->tsp, pp->tcw);
+		return texels;
+	}
+
+	u64 sort(TA_context *ctx)
+	{
+		_pvrrc = ctx;
+		u32 polys = 0;
+		RenderPass previous = {};
+		std::vector<SortTrigDrawParam> sortedPolys;
+		std::vector<u32> sortedIndexes;
+		for (const RenderPass *pass = pvrrc.render_passes.head(); pass != pvrrc.render_passes.LastPtr(0); pass++)
+		{
+			if (pass->autosort)
+			{
+				// per triangle and per strip sorting
+				u32 count = pass->tr_count - previous.tr_count;
+				GenSorted(previous.tr_count, count, sortedPolys, sortedIndexes);
+				SortPParams(previous.tr_count, count);
+				polys += count;
+			}
+			previous = *pass;
+		}
+		return polys;
+	}
+
+	bool replay(const std::string& path, int count)
+	{
+		TA_context *ctx = nullptr;
+		stages[0].measure([&]() {
+			ctx = read_frame(path.c_str(), nullptr);
+			return ctx != nullptr;
+		});
+		if (ctx == nullptr)
+			return false;
+		pal_needs_update = true;
+		palette_update();
+		std::unique_ptr<Renderer> norend(rend_norend());
+		for (int i = 0; i < count; i++)
+		{
+			bool parsed = false;
+			stages[1].measure([&]() {
+				parsed = ta_parse_vdrc(ctx);
+				return ctx->rend.verts.used();
+			});
+			EXPECT_TRUE(parsed) << path;
+			stages[2].measure([&]() {
+				textures.Clear();
+				return decodeTextures(ctx->rend.global_param_op)
+						+ decodeTextures(ctx->rend.global_param_pt)
+						+ decodeTextures(ctx->rend.global_param_tr);
+			});
+			stages[3].measure([&]() {
+				return sort(ctx);
+			});
+			stages[4].measure([&]() {
+				_pvrrc = ctx;
+				return norend->Process(ctx) && norend->Render();
+			});
+		}
+		tactx_Recycle(ctx);
+		return true;
+	}
+};
+
+TEST_F(FrameReplayTest, Pipeline)
+{
+	std::string dir;
+	const char *dumps = std::getenv("FRAME_DUMP_DIR");
+	if (dumps != nullptr)
+		dir = dumps;
+	else
+	{
+		dir = ::testing::TempDir() + "frame_replay";
+		dumpFrames(dir, 4);
+	}
+	const char *replays = std::getenv("FRAME_REPLAY_COUNT");
+	int count = replays != nullptr ? std::max(atoi(replays), 1) : 5;
+
+	std::vector<std::string> files;
+	DirectoryTree tree(dir);
+	for (const DirectoryTree::item& item : tree)
+		files.push_back(item.parentPath + "/" + item.name);
+	std::sort(files.begin(), files.end());
+
+	int frames = 0;
+	for (const std::string& file : files)
+		if (replay(file, count))
+			frames++;
+	ASSERT_NE(0, frames) << "No frame dump in " << dir;
+
+	printf("%d frames replayed %d times\n", frames, count);
+	for (const Stage& stage : stages)
+	{
+		// the frames are only loaded once
+		int runs = &stage == &stages[0] ? frames : frames * count;
+		printf("%-8s %8.3f ms cpu %8.3f ms wall %8.1f allocs %8.1f KB per frame, %.3g %s/s\n", stage.name,
+				stage.cpuUs / 1000.0 / runs, stage.wallUs / 1000.0 / runs,
+				(double)stage.allocs / runs, stage.allocBytes / 1024.0 / runs,
+				stage.items * 1e6 / std::max<u64>(stage.wallUs, 1), stage.unit);
+	}
+	if (dumps == nullptr)
+		std::remove(dir.c_str());
+}
@@ -0,0 +1,153 @@
+#include "gtest/gtest.h"
+#include "types.h"
+#include "gdxsv/gdx_ring.h"
+
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+class GdxRingTest : public ::testing::Test {
+};
+
+TEST_F(GdxRingTest, WrapTest)
+{
+	std::unique_ptr<GdxRing<16>> ring(new GdxRing<16>());
+	u8 data[32];
+	for (int i = 0; i < 32; i++)
+		data[i] = (u8)i;
+
+	ASSERT_TRUE(ring->Empty());
+	ASSERT_EQ(16u, ring->Write(data, 32));
+	ASSERT_EQ(0u, ring->Avail());
+	ASSERT_EQ(0u, ring->Write(data, 1));
+
+	u8 out[32];
+	ASSERT_EQ(10u, ring->Read(out, 10));
+	ASSERT_EQ(0, memcmp(data, out, 10));
+	// Wraps around the end of the buffer
+	ASSERT_EQ(10u, ring->Write(data + 16, 10));
+	ASSERT_EQ(16u, ring->Size());
+	ASSERT_EQ(16u, ring->Read(out, 32));
+	ASSERT_EQ(0, memcmp(data + 10, out, 16));
+	ASSERT_TRUE(ring->Empty());
+
+	ring->Write(data, 5);
+	ring->Clear();
+	ASSERT_TRUE(ring->Empty());
+	ASSERT_EQ(16u, ring->Avail());
+}
+
+TEST_F(GdxRingTest, ConcurrentTest)
+{
+	std::unique_ptr<GdxRing<1024>> ring(new GdxRing<1024>());
+	const u32 total = 1024 * 1024;
+
+	std::thread producer([&ring, total]() {
+		u8 buf[333];
+		u32 written = 0;
+		while (written < total)
+		{
+			u32 n = std::min<u32>(sizeof(buf), total - written);
+			for (u32 i = 0; i < n; i++)
+				buf[i] = (u8)(written + i);
+			u32 done = 0;
+			while (done < n)
+			{
+				u32 w = ring->Write(buf + done, n - done);
+				if (w == 0)
+					std::this_thread::yield();
+				done += w;
+			}
+			written += n;
+		}
+	});
+
+	u32 read = 0;
+	bool ok = true;
+	u8 buf[777];
+	while (read < total)
+	{
+		u32 n = ring->Read(buf, sizeof(buf));
+		if (n == 0)
+			std::this_thread::yield();
+		for (u32 i = 0; i < n; i++)
+			ok &= buf[i] == (u8)(read + i);
+		read += n;
+	}
+	producer.join();
+	ASSERT_TRUE(ok);
+	ASSERT_TRUE(ring->Empty());
+}
+
+// Emulation-thread cost of queuing one frame of battle traffic, with the network thread
+// draining concurrently: mutex-guarded std::deque (former implementation) vs GdxRing.
+TEST_F(GdxRingTest, Benchmark)
+{
+	using Clock = std::chrono::steady_clock;
+	const int kFrames = 60 * 60;
+	const u32 kBytesPerFrame = 96;
+	u8 frame[kBytesPerFrame];
+	for (u32 i = 0; i < kBytesPerFrame; i++)
+		frame[i] = (u8)i;
+
+	std::mutex mtx;
+	std::deque<u8> deque;
+	std::atomic<bool> stop{false};
+	std::thread deque_consumer([&]() {
+		u8 buf[1024];
+		while (!stop)
+		{
+			std::lock_guard<std::mutex> lock(mtx);
+			int n = std::min<int>(deque.size(), sizeof(buf));
+			for (int i = 0; i < n; i++)
+			{
+				buf[i] = deque.front();
+				deque.pop_front();
+			}
+		}
+	});
+	Clock::duration deque_total{}, deque_max{};
+	for (int f = 0; f < kFrames; f++)
+	{
+		auto start = Clock::now();
+		{
+			std::lock_guard<std::mutex> lock(mtx);
+			for (u32 i = 0; i < kBytesPerFrame; i++)
+				deque.push_back(frame[i]);
+		}
+		auto d = Clock::now() - start;
+		deque_total += d;
+		deque_max = std::max(deque_max, d);
+	}
+	stop = true;
+	deque_consumer.join();
+
+	std::unique_ptr<GdxRing<64 * 1024>> ring(new GdxRing<64 * 1024>());
+	stop = false;
+	std::thread ring_consumer([&]() {
+		u8 buf[1024];
+		while (!stop)
+			ring->Read(buf, sizeof(buf));
+	});
+	Clock::duration ring_total{}, ring_max{};
+	for (int f = 0; f < kFrames; f++)
+	{
+		auto start = Clock::now();
+		ring->Write(frame, kBytesPerFrame);
+		auto d = Clock::now() - start;
+		ring_total += d;
+		ring_max = std::max(ring_max, d);
+	}
+	stop = true;
+	ring_consumer.join();
+
+	using ns = std::chrono::nanoseconds;
+	printf("deque+mutex: avg %lld ns/frame, max %lld ns\n",
+			(long long)std::chrono::duration_cast<ns>(deque_total).count() / kFrames,
+			(long long)std::chrono::duration_cast<ns>(deque_max).count());
+	printf("GdxRing:     avg %lld ns/frame, max %lld ns\n",
+			(long long)std::chrono::duration_cast<ns>(ring_total).count() / kFrames,
+			(long long)std::chrono::duration_cast<ns>(ring_max).count());
+}
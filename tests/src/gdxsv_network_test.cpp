@@ -0,0 +1,321 @@
+#include "gtest/gtest.h"
+#include "types.h"
+#include "emulator.h"
+#include "hw/mem/_vmem.h"
+#include "hw/sh4/sh4_mem.h"
+#include "gdxsv/gdxsv_network.h"
+#include "gdxsv/gdxsv_backend_udp.h"
+
+#include <map>
+#include <mutex>
+#include <thread>
+
+class GdxsvNetworkTest : public ::testing::Test {
+protected:
+	void SetUp() override {
+#ifdef _WIN32
+		WSADATA wsaData;
+		WSAStartup(MAKEWORD(2, 0), &wsaData);
+#endif
+	}
+};
+
+TEST_F(GdxsvNetworkTest, WakeupTest)
+{
+	UdpClient client;
+	ASSERT_TRUE(client.Bind(0));
+	UdpWakeup wakeup;
+	ASSERT_TRUE(wakeup.Open());
+
+	// Nothing to read: times out
+	ASSERT_FALSE(client.Wait(10, wakeup));
+
+	// A pending notification interrupts the wait right away instead of after a minute
+	wakeup.Notify();
+	ASSERT_FALSE(client.Wait(60000, wakeup));
+
+	std::thread notifier([&wakeup]() {
+		std::this_thread::sleep_for(std::chrono::milliseconds(20));
+		wakeup.Notify();
+	});
+	ASSERT_FALSE(client.Wait(60000, wakeup));
+	notifier.join();
+
+	// Notifications are drained by Wait
+	ASSERT_FALSE(client.Wait(0, wakeup));
+}
+
+// Loopback stand-in for the match server: accepts the session, answers pings and echoes the battle messages back
+class FakeMcs
+{
+public:
+	~FakeMcs() {
+		Stop();
+	}
+
+	bool Start()
+	{
+		if (!server.Bind(0) || !wakeup.Open())
+			return false;
+		thread = std::thread([this]() { Loop(); });
+		return true;
+	}
+
+	void Stop()
+	{
+		stop = true;
+		wakeup.Notify();
+		if (thread.joinable())
+			thread.join();
+	}
+
+	int port() const { return server.bind_port(); }
+
+	std::string Received() {
+		std::lock_guard<std::mutex> lock(mutex);
+		return received;
+	}
+	std::string SessionId() {
+		std::lock_guard<std::mutex> lock(mutex);
+		return session_id;
+	}
+	std::string FinDetail() {
+		std::lock_guard<std::mutex> lock(mutex);
+		return fin_detail;
+	}
+
+private:
+	void Loop()
+	{
+		char buf[16 * 1024];
+		std::string sender;
+		UdpRemote client;
+		proto::Packet pkt;
+		MessageBuffer msg_buf;
+		MessageFilter msg_filter;
+		while (!stop)
+		{
+			if (!server.Wait(100, wakeup))
+				continue;
+			int n = server.RecvFrom(buf, sizeof(buf), sender);
+			if (n <= 0 || !pkt.ParseFromArray(buf, n))
+				continue;
+			if (!client.is_open())
+				client.Open(sender);
+
+			proto::Packet reply;
+			switch (pkt.type())
+			{
+			case proto::MessageType::HelloServer:
+				{
+					std::lock_guard<std::mutex> lock(mutex);
+					session_id = pkt.session_id();
+				}
+				msg_buf.SessionId(pkt.session_id());
+				reply.set_type(proto::MessageType::HelloServer);
+				reply.mutable_hello_server_data()->set_ok(true);
+				reply.mutable_hello_server_data()->set_user_id("user01");
+				break;
+
+			case proto::MessageType::Ping:
+				reply.set_type(proto::MessageType::Pong);
+				reply.mutable_pong_data()->set_user_id(pkt.ping_data().user_id());
+				reply.mutable_pong_data()->set_timestamp(pkt.ping_data().timestamp());
+				break;
+
+			case proto::MessageType::Battle:
+				msg_buf.ApplySeqAck(pkt.seq(), pkt.ack());
+				for (const auto& msg : pkt.battle_data())
+					if (msg_filter.IsNextMessage(msg))
+					{
+						{
+							std::lock_guard<std::mutex> lock(mutex);
+							received += msg.body();
+						}
+						msg_buf.PushBattleMessage("server", (u8 *)msg.body().data(), msg.body().size());
+					}
+				reply = msg_buf.Packet();
+				break;
+
+			case proto::MessageType::Fin:
+				{
+					std::lock_guard<std::mutex> lock(mutex);
+					fin_detail = pkt.fin_data().detail();
+				}
+				continue;
+
+			default:
+				continue;
+			}
+			if (reply.SerializeToArray(buf, sizeof(buf)))
+				server.SendTo(buf, reply.GetCachedSize(), client);
+		}
+	}
+
+	UdpClient server;
+	UdpWakeup wakeup;
+	std::thread thread;
+	std::atomic<bool> stop{false};
+	std::mutex mutex;
+	std::string received;
+	std::string session_id;
+	std::string fin_detail;
+};
+
+class GdxsvBackendUdpTest : public GdxsvNetworkTest {
+protected:
+	void SetUp() override {
+		GdxsvNetworkTest::SetUp();
+		if (!_vmem_reserve())
+			die("_vmem_reserve failed");
+		dc_init();
+		mem_map_default();
+		for (u32 i = 0; i < 4; i++)
+		{
+			WriteMem16_nommu(TxQueue + i, 0);
+			WriteMem16_nommu(RxQueue + i, 0);
+		}
+		symbols["gdx_txq"] = TxQueue;
+		symbols["gdx_rxq"] = RxQueue;
+	}
+
+	static const u32 TxQueue = 0x8c100000;
+	static const u32 RxQueue = 0x8c101000;
+
+	// Game side: appends data to the guest tx queue
+	void GameWrite(GdxsvBackendUdp& backend, const std::string& data)
+	{
+		u16 tail = ReadMem16_nommu(TxQueue + 2);
+		for (char c : data)
+		{
+			WriteMem8_nommu(TxQueue + 4 + tail, (u8)c);
+			tail = (tail + 1) % GDX_QUEUE_SIZE;
+		}
+		WriteMem16_nommu(TxQueue + 2, tail);
+		backend.OnGameWrite();
+		// all sent to the net thread
+		ASSERT_EQ(tail, ReadMem16_nommu(TxQueue));
+	}
+
+	// Game side: consumes the guest rx queue
+	std::string GameRead(GdxsvBackendUdp& backend)
+	{
+		backend.OnGameRead();
+		u16 head = ReadMem16_nommu(RxQueue);
+		u16 tail = ReadMem16_nommu(RxQueue + 2);
+		std::string data;
+		for (; head != tail; head = (head + 1) % GDX_QUEUE_SIZE)
+			data += (char)ReadMem8_nommu(RxQueue + 4 + head);
+		WriteMem16_nommu(RxQueue, head);
+		return data;
+	}
+
+	// Polls until the condition is met. The limit is only there to fail instead of hanging.
+	template<typename F>
+	static bool WaitFor(F condition)
+	{
+		for (int i = 0; i < 30000 && !condition(); i++)
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		return condition();
+	}
+
+	std::map<std::string, u32> symbols;
+};
+
+TEST_F(GdxsvBackendUdpTest, BattleTest)
+{
+	FakeMcs mcs;
+	ASSERT_TRUE(mcs.Start());
+	std::atomic<int> maxlag{0};
+	GdxsvBackendUdp backend(symbols, maxlag);
+	ASSERT_TRUE(backend.Connect("127.0.0.1", mcs.port()));
+
+	// The game gets a reply to its first message, which holds the session id
+	std::string rx;
+	ASSERT_TRUE(WaitFor([&]() { rx += GameRead(backend); return rx.size() >= 14; }));
+	ASSERT_EQ(14u, rx.size());
+	GameWrite(backend, std::string(12, '\0') + "session1");
+	ASSERT_TRUE(WaitFor([&]() { return maxlag != 0; }));
+	ASSERT_EQ("session1", mcs.SessionId());
+	ASSERT_EQ(10u, backend.PingRtt().Count());
+
+	// Battle messages are delivered in order to the server, and the echoed ones to the game
+	std::string sent;
+	rx.clear();
+	for (int i = 0; i < 500; i++)
+	{
+		char msg[32];
+		sprintf(msg, "message %03d;", i);
+		sent += msg;
+		GameWrite(backend, msg);
+		if (i % 10 == 0)
+			rx += GameRead(backend);
+		if (i % 50 == 0)
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	ASSERT_TRUE(WaitFor([&]() { rx += GameRead(backend); return rx.size() >= sent.size(); }));
+	ASSERT_EQ(sent, mcs.Received());
+	ASSERT_EQ(sent, rx);
+	ASSERT_GT(backend.SendLatency().Count(), 0u);
+	ASSERT_GT(backend.RecvLatency().Count(), 0u);
+
+	backend.Reset();
+	ASSERT_TRUE(WaitFor([&]() { return !mcs.FinDetail().empty(); }));
+	ASSERT_EQ("cl_hard_reset", mcs.FinDetail());
+	// Nothing is delivered to the game once the battle is over
+	ASSERT_EQ("", GameRead(backend));
+}
+
+TEST_F(GdxsvBackendUdpTest, ReconnectTest)
+{
+	FakeMcs mcs;
+	ASSERT_TRUE(mcs.Start());
+	FakeMcs mcs2;
+	ASSERT_TRUE(mcs2.Start());
+	std::atomic<int> maxlag{0};
+	GdxsvBackendUdp backend(symbols, maxlag);
+	ASSERT_TRUE(backend.Connect("127.0.0.1", mcs.port()));
+	std::string rx;
+	ASSERT_TRUE(WaitFor([&]() { rx += GameRead(backend); return rx.size() >= 14; }));
+	GameWrite(backend, std::string(12, '\0') + "session1");
+	ASSERT_TRUE(WaitFor([&]() { return maxlag != 0; }));
+	ASSERT_EQ("session1", mcs.SessionId());
+
+	// Connecting again ends the first session and starts over with the other server
+	maxlag = 0;
+	ASSERT_TRUE(backend.Connect("127.0.0.1", mcs2.port()));
+	ASSERT_TRUE(WaitFor([&]() { return !mcs.FinDetail().empty(); }));
+	ASSERT_EQ("connect", mcs.FinDetail());
+	// The previous net thread doesn't close the new remote
+	ASSERT_TRUE(backend.IsConnected());
+
+	rx.clear();
+	ASSERT_TRUE(WaitFor([&]() { rx += GameRead(backend); return rx.size() >= 14; }));
+	ASSERT_EQ(14u, rx.size());
+	GameWrite(backend, std::string(12, '\0') + "session2");
+	ASSERT_TRUE(WaitFor([&]() { return maxlag != 0; }));
+	ASSERT_EQ("session2", mcs2.SessionId());
+
+	GameWrite(backend, "message;");
+	rx.clear();
+	ASSERT_TRUE(WaitFor([&]() { rx += GameRead(backend); return rx.size() >= 8; }));
+	ASSERT_EQ("message;", rx);
+	ASSERT_EQ("message;", mcs2.Received());
+	ASSERT_EQ("", mcs.Received());
+}
+
+TEST_F(GdxsvNetworkTest, HistogramTest)
+{
+	LatencyHistogram h;
+	ASSERT_EQ(0u, h.Percentile(50));
+	for (int i = 0; i < 99; i++)
+		h.Record(3);
+	h.Record(5000);
+	ASSERT_EQ(100u, h.Count());
+	ASSERT_EQ(4u, h.Percentile(50));
+	ASSERT_EQ(4u, h.Percentile(99));
+	ASSERT_EQ(8192u, h.Percentile(100));
+	ASSERT_EQ(5000u, h.Max());
+	h.Clear();
+	ASSERT_EQ(0u, h.Count());
+}
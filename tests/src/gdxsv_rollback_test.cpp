@@ -0,0 +1,249 @@
+#include "gtest/gtest.h"
+#include "types.h"
+#include "emulator.h"
+#include "cfg/cfg.h"
+#include "cfg/option.h"
+#include "hw/holly/sb.h"
+#include "hw/maple/maple_cfg.h"
+#include "hw/maple/maple_devs.h"
+#include "hw/pvr/pvr_regs.h"
+#include "hw/sh4/sh4_if.h"
+#include "hw/sh4/sh4_mem.h"
+#include "input/gamepad_device.h"
+#include "gdxsv/gdxsv_rollback.h"
+// after the protobuf headers: defines r
+#include "hw/sh4/sh4_core.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+
+#ifdef __linux__
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+extern u32 RealTimeClock;
+#ifdef __linux__
+// the block table is allocated on demand by the fault handler
+void install_fault_handler();
+#endif
+
+class GdxsvRollbackTest : public ::testing::Test {
+};
+
+static RollbackInput input(u32 kcode)
+{
+	RollbackInput in;
+	in.kcode = kcode;
+	return in;
+}
+
+TEST_F(GdxsvRollbackTest, PredictionTest)
+{
+	std::unique_ptr<RollbackInputHistory> history(new RollbackInputHistory());
+	history->Clear();
+
+	// Nothing received yet: neutral prediction
+	ASSERT_EQ(RollbackInput(), history->Remote(1));
+
+	// Confirmed inputs are used as is, the last one is repeated for later frames
+	ASSERT_FALSE(history->ConfirmRemote(2, input(2)));
+	ASSERT_EQ(0u, history->LastConfirmedRemote());
+	ASSERT_TRUE(history->ConfirmRemote(1, input(1)));
+	ASSERT_EQ(2u, history->LastConfirmedRemote());
+	ASSERT_EQ(input(1), history->Remote(1));
+	ASSERT_EQ(input(2), history->Remote(2));
+	ASSERT_EQ(input(2), history->Remote(3));
+	ASSERT_EQ(input(2), history->Remote(4));
+
+	// Correct prediction: no rollback needed
+	ASSERT_FALSE(history->ConfirmRemote(3, input(2)));
+	// Misprediction
+	ASSERT_TRUE(history->ConfirmRemote(4, input(4)));
+	// Duplicates are ignored
+	ASSERT_FALSE(history->ConfirmRemote(4, input(5)));
+	ASSERT_EQ(input(4), history->Remote(4));
+
+	// Frames far outside the window are dropped
+	ASSERT_FALSE(history->ConfirmRemote(4 + RollbackInputHistory::kSize, input(6)));
+	ASSERT_EQ(4u, history->LastConfirmedRemote());
+}
+
+TEST_F(GdxsvRollbackTest, LocalTest)
+{
+	std::unique_ptr<RollbackInputHistory> history(new RollbackInputHistory());
+	history->Clear();
+	history->SetLocal(10, input(10));
+	ASSERT_EQ(input(10), history->Local(10));
+	ASSERT_EQ(RollbackInput(), history->Local(11));
+	// Overwritten once the ring wraps
+	history->SetLocal(10 + RollbackInputHistory::kSize, input(11));
+	ASSERT_EQ(RollbackInput(), history->Local(10));
+}
+
+#ifdef __linux__
+// Deterministic replay harness: two emulator processes play a local two-player game against each other
+// over loopback UDP with rollback enabled and no renderer, and compare the hash of the state of each
+// confirmed frame (rollback_check). The peers are this executable run again with GDXSV_ROLLBACK_PEER set.
+class GdxsvRollbackReplayTest : public ::testing::Test {
+protected:
+	static const u32 Frames = 180;
+	static const u32 Start = 0x8c010000;
+	static const u32 MapleCommands = 0x8c00f000;
+	// Condition of the controllers of port A and B
+	static const u32 PortA = 0x8c00f100;
+	static const u32 PortB = 0x8c00f200;
+	static const u32 Result = 0x8c00f300;
+
+	// Buttons of a player, changing every few frames so that predictions are often wrong
+	static u32 buttons(int player, u32 frame)
+	{
+		u32 x = (frame / 3 + 1) * 2654435761u + (player + 1) * 40503u;
+		return ~((x >> 13) & 0x060e);
+	}
+
+	// The game: both controllers are read by maple DMA at each vblank. Their state is accumulated
+	// in r5 by a busy loop, so that the machine state depends on the inputs and on when they changed.
+	static void writeProgram()
+	{
+		WriteMem32(MapleCommands, 1);									// port A, 2 words
+		WriteMem32(MapleCommands + 4, PortA & 0x1fffffff);
+		WriteMem32(MapleCommands + 8, MDCF_GetCondition | (0x20 << 8) | (1 << 24));
+		WriteMem32(MapleCommands + 12, MFID_0_Input);
+		WriteMem32(MapleCommands + 16, 0x80010001);						// last, port B, 2 words
+		WriteMem32(MapleCommands + 20, PortB & 0x1fffffff);
+		WriteMem32(MapleCommands + 24, MDCF_GetCondition | (0x60 << 8) | (0x40 << 16) | (1 << 24));
+		WriteMem32(MapleCommands + 28, MFID_0_Input);
+		// The reset value is past the last line of the frame, and the BIOS isn't run
+		SPG_VBLANK_INT.vblank_out_interrupt_line_number = 0x15;
+		SB_MMSEL = 1;
+		SB_MDSTAR = MapleCommands & 0x1fffffff;
+		SB_MDTSEL = 1;
+		SB_MDEN = 1;
+
+		u32 addr = Start;
+		WriteMem16(addr, 0x5042);			// mov.l @(8,r4),r0
+		WriteMem16(addr += 2, 0x350C);		// add r0,r5
+		WriteMem16(addr += 2, 0x4504);		// rotl r5
+		WriteMem16(addr += 2, 0x5062);		// mov.l @(8,r6),r0
+		WriteMem16(addr += 2, 0x250A);		// xor r0,r5
+		WriteMem16(addr += 2, 0x7101);		// add #1,r1
+		WriteMem16(addr += 2, 0x2752);		// mov.l r5,@r7
+		addr += 2;
+		WriteMem16(addr, 0xA000 | ((Start - addr - 4) / 2 & 0xfff));	// bra Start
+		WriteMem16(addr + 2, 0x0009);		// nop
+		r[4] = PortA;
+		r[6] = PortB;
+		r[7] = Result;
+		Sh4cntx.pc = Start;
+	}
+
+	static void runPeer(int player, int port, int peerPort)
+	{
+		install_fault_handler();
+		if (!_vmem_reserve())
+			die("_vmem_reserve failed");
+		dc_init();
+		mem_map_default();
+		settings.platform.system = DC_PLATFORM_DREAMCAST;
+		for (int bus = 0; bus < 2; bus++)
+		{
+			config::MapleMainDevices[bus] = MDT_SegaController;
+			config::MapleExpansionDevices[bus][0] = MDT_None;
+			config::MapleExpansionDevices[bus][1] = MDT_None;
+		}
+		cfgSetAutoSave(false);
+		dc_reset(true);
+		mcfg_CreateDevices();
+		// Set from the host time by the reset
+		RealTimeClock = 0;
+#if FEAT_SHREC != DYNAREC_NONE
+		Get_Sh4Recompiler(&sh4_cpu);
+#else
+		Get_Sh4Interpreter(&sh4_cpu);
+#endif
+		writeProgram();
+
+		cfgSetVirtual("gdxsv", "rollback", "yes");
+		cfgSetVirtual("gdxsv", "rollback_player", std::to_string(player));
+		cfgSetVirtual("gdxsv", "rollback_port", std::to_string(port));
+		cfgSetVirtual("gdxsv", "rollback_peer", "127.0.0.1:" + std::to_string(peerPort));
+		cfgSetVirtual("gdxsv", "rollback_check", "yes");
+		gdxsv_rollback.Reset();
+		ASSERT_TRUE(gdxsv_rollback.Active());
+
+		// As in dc_run()
+		sh4_cpu.Run();
+		while (gdxsv_rollback.FrameEnded() && gdxsv_rollback.Frame() < Frames)
+		{
+			kcode[0] = buttons(player, gdxsv_rollback.Frame());
+			// The players lag in turn: the other one runs ahead on predicted inputs and rolls back
+			if (gdxsv_rollback.Frame() % 15 == 0 && gdxsv_rollback.Frame() / 15 % 2 == (u32)player)
+				usleep(50000);
+			gdxsv_rollback.NextFrame();
+			if (!gdxsv_rollback.Active())
+				break;
+			sh4_cpu.Run();
+		}
+		u32 frames = gdxsv_rollback.Frame();
+		printf("player %d: %d frames, %d rollbacks, %d frame hashes compared, %d desyncs\n", player + 1, frames,
+				gdxsv_rollback.RollbackCount(), gdxsv_rollback.HashChecks(), gdxsv_rollback.DesyncCount());
+		ASSERT_EQ((u32)Frames, frames);
+		ASSERT_GT(gdxsv_rollback.RollbackCount(), 0u);
+		ASSERT_GT(gdxsv_rollback.HashChecks(), Frames / 2);
+		ASSERT_EQ(0u, gdxsv_rollback.DesyncCount());
+		gdxsv_rollback.Stop();
+	}
+};
+
+TEST_F(GdxsvRollbackReplayTest, Peer)
+{
+	// Only run by TwoPeers
+	const char *peer = getenv("GDXSV_ROLLBACK_PEER");
+	if (peer == nullptr)
+		return;
+	int player, port, peerPort;
+	ASSERT_EQ(3, sscanf(peer, "%d:%d:%d", &player, &port, &peerPort));
+	runPeer(player, port, peerPort);
+}
+
+TEST_F(GdxsvRollbackReplayTest, TwoPeers)
+{
+	if (getenv("GDXSV_ROLLBACK_PEER") != nullptr)
+		return;
+	// Free ports for the peers
+	int ports[2];
+	{
+		UdpClient udp[2];
+		for (int i = 0; i < 2; i++)
+		{
+			ASSERT_TRUE(udp[i].Bind(0));
+			ports[i] = udp[i].bind_port();
+		}
+		udp[0].Close();
+		udp[1].Close();
+	}
+	pid_t pids[2];
+	for (int player = 0; player < 2; player++)
+	{
+		pids[player] = fork();
+		ASSERT_NE(-1, pids[player]);
+		if (pids[player] == 0)
+		{
+			char peer[64];
+			sprintf(peer, "%d:%d:%d", player, ports[player], ports[player ^ 1]);
+			setenv("GDXSV_ROLLBACK_PEER", peer, 1);
+			execl("/proc/self/exe", "rollback_peer", "--gtest_filter=GdxsvRollbackReplayTest.Peer", nullptr);
+			_exit(127);
+		}
+	}
+	for (pid_t pid : pids)
+	{
+		int status;
+		ASSERT_EQ(pid, waitpid(pid, &status, 0));
+		ASSERT_TRUE(WIFEXITED(status));
+		ASSERT_EQ(0, WEXITSTATUS(status));
+	}
+}
+#endif
@@ -0,0 +1,270 @@
+#include "gtest/gtest.h"
+#include "types.h"
+#include "cfg/option.h"
+#include "imgread/common.h"
+#include "imgread/hunkcache.h"
+#include "profiler/profiler.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <random>
+#include <set>
+#include <thread>
+#include <vector>
+#include <zlib.h>
+
+Disc* chd_parse(const char* file);
+
+// Hunks of 8 sectors of 2352 bytes with 96 bytes of subcode, as in CD-ROM CHD files
+const u32 SectorBytes = 2352 + 96;
+const u32 HunkSectors = 8;
+const u32 HunkBytes = SectorBytes * HunkSectors;
+
+struct TraceRead
+{
+	u32 fad;
+	u32 count;
+	u32 secsz;
+};
+
+class HunkCacheTest : public ::testing::Test {
+protected:
+	void SetUp() override {
+		memset(&prof.counters.gdrom, 0, sizeof(prof.counters.gdrom));
+	}
+
+	std::atomic<u32> decompressed { 0 };
+	std::atomic<u32> failing { ~0u };
+	std::atomic<u32> workerReads { 0 };
+	// zlib compressed hunks
+	std::vector<std::vector<u8>> compressed;
+
+	HunkCache::Reader patternReader()
+	{
+		return [this](u32 reader, u32 hunk, u8 *dst) {
+			decompressed++;
+			if (hunk == failing)
+				return false;
+			for (u32 i = 0; i < HunkBytes; i += 4)
+				*(u32 *)&dst[i] = hunk * 0x10001 + i;
+			if (reader != 0)
+				workerReads++;
+			return true;
+		};
+	}
+
+	static void checkPattern(u32 hunk, u32 offset, const u8 *data, u32 size)
+	{
+		for (u32 i = 0; i < size; i += 4)
+			ASSERT_EQ(hunk * 0x10001 + offset + i, *(const u32 *)&data[i]) << "hunk " << hunk << " offset " << offset + i;
+	}
+
+	// Sectors made of a repeated pattern and noise, to be compressed about as much as disc data
+	void compressHunks(u32 count)
+	{
+		std::mt19937 rng(42);
+		std::vector<u8> hunk(HunkBytes);
+		compressed.resize(count);
+		for (u32 h = 0; h < count; h++)
+		{
+			for (u32 i = 0; i < HunkBytes; i++)
+				hunk[i] = (i & 64) != 0 ? (u8)rng() : (u8)(i / 16);
+			uLongf size = compressBound(HunkBytes);
+			compressed[h].resize(size);
+			ASSERT_EQ(Z_OK, compress(compressed[h].data(), &size, hunk.data(), HunkBytes));
+			compressed[h].resize(size);
+		}
+	}
+
+	HunkCache::Reader zlibReader()
+	{
+		return [this](u32 reader, u32 hunk, u8 *dst) {
+			decompressed++;
+			uLongf size = HunkBytes;
+			return uncompress(dst, &size, compressed[hunk].data(), compressed[hunk].size()) == Z_OK;
+		};
+	}
+
+	// CDDA sectors read one at a time, interleaved with data reads, as while a game loads with music
+	static std::vector<TraceRead> syntheticTrace()
+	{
+		std::vector<TraceRead> trace;
+		u32 dataFad = 20000;
+		u32 cddaFad = 150;
+		for (int i = 0; i < 400; i++)
+		{
+			trace.push_back({ dataFad, 16, 2048 });
+			dataFad += 16;
+			for (int j = 0; j < 4; j++)
+				trace.push_back({ cddaFad++, 1, 2352 });
+			// seek to another file
+			if (i % 100 == 99)
+				dataFad += 5000;
+		}
+		return trace;
+	}
+
+	// Lines of "fad count [sector size]"
+	static std::vector<TraceRead> loadTrace(const char *path)
+	{
+		std::vector<TraceRead> trace;
+		std::ifstream file(path);
+		std::string line;
+		while (std::getline(file, line))
+		{
+			TraceRead read { 0, 0, 2352 };
+			if (sscanf(line.c_str(), "%u %u %u", &read.fad, &read.count, &read.secsz) >= 2)
+				trace.push_back(read);
+		}
+		return trace;
+	}
+};
+
+TEST_F(HunkCacheTest, Lru)
+{
+	HunkCache cache(HunkBytes, 100, 4, 0, 0, patternReader());
+	u8 sector[2352];
+	// interleaved reads
+	for (u32 i = 0; i < 16; i++)
+	{
+		u32 hunk = i % 2 == 0 ? 10 : 50;
+		u32 offset = (i / 2) * SectorBytes;
+		ASSERT_TRUE(cache.read(hunk, offset, sector, sizeof(sector)));
+		checkPattern(hunk, offset, sector, sizeof(sector));
+	}
+	ASSERT_EQ(2u, decompressed);
+	ASSERT_EQ(2u, prof.counters.gdrom.chd_hunks);
+	ASSERT_EQ(14u, prof.counters.gdrom.chd_hits);
+
+	// the least recently used hunk is replaced
+	for (u32 hunk = 0; hunk < 3; hunk++)
+		ASSERT_TRUE(cache.read(hunk, 0, sector, sizeof(sector)));
+	ASSERT_EQ(5u, decompressed);
+	ASSERT_TRUE(cache.read(50, 0, sector, sizeof(sector)));
+	ASSERT_EQ(5u, decompressed);
+	ASSERT_TRUE(cache.read(10, 0, sector, sizeof(sector)));
+	ASSERT_EQ(6u, decompressed);
+	checkPattern(10, 0, sector, sizeof(sector));
+
+	ASSERT_FALSE(cache.read(100, 0, sector, sizeof(sector)));
+	ASSERT_FALSE(cache.read(0, HunkBytes - 100, sector, sizeof(sector)));
+}
+
+TEST_F(HunkCacheTest, Errors)
+{
+	HunkCache cache(HunkBytes, 100, 4, 0, 0, patternReader());
+	u8 sector[2352];
+	failing = 20;
+	ASSERT_FALSE(cache.read(20, 0, sector, sizeof(sector)));
+	failing = ~0u;
+	ASSERT_TRUE(cache.read(20, 0, sector, sizeof(sector)));
+	checkPattern(20, 0, sector, sizeof(sector));
+	ASSERT_EQ(2u, decompressed);
+}
+
+TEST_F(HunkCacheTest, Prefetch)
+{
+	const u32 hunks = 200;
+	{
+		HunkCache cache(HunkBytes, hunks, 16, 8, 2, patternReader());
+		u8 sector[2352];
+		ASSERT_TRUE(cache.read(0, 0, sector, sizeof(sector)));
+		// the next 8 hunks are decompressed by the worker threads
+		for (int i = 0; i < 1000 && workerReads < 8; i++)
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		ASSERT_EQ(8u, workerReads);
+		for (u32 hunk = 1; hunk <= 8; hunk++)
+			ASSERT_TRUE(cache.read(hunk, 0, sector, sizeof(sector)));
+		ASSERT_EQ(8u, prof.counters.gdrom.chd_hits);
+
+		for (u32 hunk = 1; hunk < hunks; hunk++)
+			for (u32 s = 0; s < HunkSectors; s++)
+			{
+				ASSERT_TRUE(cache.read(hunk, s * SectorBytes, sector, sizeof(sector)));
+				checkPattern(hunk, s * SectorBytes, sector, sizeof(sector));
+			}
+		// a failing hunk is read again
+		failing = 0;
+		ASSERT_FALSE(cache.read(0, 0, sector, sizeof(sector)));
+		failing = ~0u;
+	}
+	// Each hunk is only decompressed once, by the emulation or a worker thread
+	ASSERT_EQ(hunks + 1, decompressed);
+	ASSERT_EQ(decompressed, prof.counters.gdrom.chd_hunks);
+}
+
+TEST_F(HunkCacheTest, Trace)
+{
+	struct Setting
+	{
+		int cacheHunks;
+		int prefetchHunks;
+	};
+	const Setting settings[] = { { 1, 0 }, { 16, 0 }, { 16, 4 }, { 32, 8 } };
+	const char *tracePath = std::getenv("CHD_TRACE");
+	std::vector<TraceRead> trace = tracePath != nullptr ? loadTrace(tracePath) : syntheticTrace();
+	ASSERT_FALSE(trace.empty()) << tracePath;
+	// Set CHD_IMAGE to replay the trace on a CHD image, otherwise zlib compressed hunks are used
+	const char *image = std::getenv("CHD_IMAGE");
+	u32 maxFad = 0;
+	u32 sectors = 0;
+	std::set<u32> hunks;
+	for (const TraceRead& read : trace)
+	{
+		maxFad = std::max(maxFad, read.fad + read.count);
+		sectors += read.count;
+		for (u32 fad = read.fad; fad < read.fad + read.count; fad++)
+			hunks.insert(fad / HunkSectors);
+	}
+	if (image == nullptr)
+		compressHunks(maxFad / HunkSectors + 1);
+
+	std::vector<u8> buffer;
+	for (const Setting& setting : settings)
+	{
+		memset(&prof.counters.gdrom, 0, sizeof(prof.counters.gdrom));
+		config::CHDCacheHunks = setting.cacheHunks;
+		config::CHDPrefetchHunks = setting.prefetchHunks;
+		std::unique_ptr<Disc> chd;
+		std::unique_ptr<HunkCache> cache;
+		if (image != nullptr)
+		{
+			chd.reset(chd_parse(image));
+			ASSERT_NE(nullptr, chd.get()) << image;
+		}
+		else
+		{
+			cache.reset(new HunkCache(HunkBytes, compressed.size(), setting.cacheHunks, setting.prefetchHunks,
+					setting.prefetchHunks > 0 ? 2 : 0, zlibReader()));
+		}
+		auto start = std::chrono::steady_clock::now();
+		for (const TraceRead& read : trace)
+		{
+			buffer.resize(read.count * read.secsz);
+			if (chd)
+				chd->ReadSectors(read.fad, read.count, buffer.data(), read.secsz);
+			else
+				for (u32 i = 0; i < read.count; i++)
+				{
+					u32 fad = read.fad + i;
+					cache->read(fad / HunkSectors, (fad % HunkSectors) * SectorBytes, &buffer[i * read.secsz], read.secsz);
+				}
+		}
+		double us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+		const auto& gdrom = prof.counters.gdrom;
+		printf("cache %2d prefetch %d: %6d hunks decompressed, %6d hits, %5d waits, %.2f us per sector\n", setting.cacheHunks,
+				setting.prefetchHunks, gdrom.chd_hunks, gdrom.chd_hits, gdrom.chd_waits, us / sectors);
+		if (image == nullptr && setting.cacheHunks > 1 && setting.prefetchHunks == 0)
+		{
+			// the interleaved reads don't decompress the same hunks again
+			ASSERT_EQ(hunks.size(), gdrom.chd_hunks);
+		}
+	}
+	config::CHDCacheHunks.reset();
+	config::CHDPrefetchHunks.reset();
+}
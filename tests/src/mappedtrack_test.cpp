@@ -0,0 +1,129 @@
+#include "gtest/gtest.h"
+#include "types.h"
+#include "cfg/option.h"
+#include "imgread/common.h"
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+class MappedTrackTest : public ::testing::Test {
+protected:
+	void TearDown() override {
+		config::GDRomMapFiles = false;
+		for (const std::string& path : files)
+			std::remove(path.c_str());
+	}
+
+	static const u32 Sectors = 600;
+	static const u32 StartFAD = 45150;
+
+	std::vector<std::string> files;
+	std::vector<u8> image;
+
+	// Random sectors of the given size, in mode 1 and mode 2
+	std::string writeTrack(u32 secsz)
+	{
+		std::mt19937 rng(secsz);
+		image.resize(Sectors * secsz);
+		for (u8& b : image)
+			b = (u8)rng();
+		if (secsz == 2352)
+			for (u32 i = 0; i < Sectors; i++)
+				image[i * secsz + 15] = i % 3 == 0 ? 2 : 1;
+		std::string path = ::testing::TempDir() + "track" + std::to_string(secsz) + ".bin";
+		FILE *f = fopen(path.c_str(), "wb");
+		fwrite(image.data(), 1, image.size(), f);
+		fclose(f);
+		files.push_back(path);
+		return path;
+	}
+
+	static Disc *openDisc(const std::string& path, u32 secsz)
+	{
+		Disc *disc = new Disc();
+		Track track;
+		track.file = NewRawTrackFile(fopen(path.c_str(), "rb"), 0, StartFAD, secsz);
+		track.StartFAD = StartFAD;
+		track.EndFAD = StartFAD + Sectors - 1;
+		disc->tracks.push_back(track);
+		return disc;
+	}
+
+	// Sectors converted one by one
+	std::vector<u8> convert(u32 secsz, u32 fad, u32 count, u32 fmt)
+	{
+		std::vector<u8> sectors(count * fmt);
+		u8 subcode[96];
+		for (u32 i = 0; i < count; i++)
+		{
+			u8 *src = &image[(fad - StartFAD + i) * secsz];
+			if (secsz == 2352)
+				ConvertSector(src, &sectors[i * fmt], 2352, fmt, fad + i, subcode);
+			else if (secsz == 2336)
+				memcpy(&sectors[i * fmt], src + 8, 2048);
+			else
+				memcpy(&sectors[i * fmt], src, 2048);
+		}
+		return sectors;
+	}
+
+	void checkTrack(u32 secsz, const std::vector<u32>& formats)
+	{
+		std::string path = writeTrack(secsz);
+		for (int mapped = 0; mapped < 2; mapped++)
+		{
+			config::GDRomMapFiles = mapped == 1;
+			Disc *disc = openDisc(path, secsz);
+			for (u32 fmt : formats)
+			{
+				const u32 reads[][2] = { { StartFAD, 1 }, { StartFAD + 10, 64 }, { StartFAD, Sectors }, { StartFAD + Sectors - 20, 20 } };
+				for (const auto& read : reads)
+				{
+					std::vector<u8> data(read[1] * fmt);
+					disc->ReadSectors(read[0], read[1], data.data(), fmt);
+					ASSERT_EQ(convert(secsz, read[0], read[1], fmt), data)
+							<< "sector size " << secsz << " format " << fmt << " fad " << read[0] << " mapped " << mapped;
+				}
+			}
+			delete disc;
+		}
+	}
+};
+
+TEST_F(MappedTrackTest, Raw)
+{
+	checkTrack(2352, { 2048, 2328, 2336, 2340, 2352 });
+}
+
+TEST_F(MappedTrackTest, Mode2)
+{
+	checkTrack(2336, { 2048 });
+}
+
+TEST_F(MappedTrackTest, Iso)
+{
+	checkTrack(2048, { 2048 });
+}
+
+TEST_F(MappedTrackTest, Throughput)
+{
+	std::string path = writeTrack(2352);
+	std::vector<u8> data(Sectors * 2048);
+	const int Reads = 200;
+	for (int mapped = 0; mapped < 2; mapped++)
+	{
+		config::GDRomMapFiles = mapped == 1;
+		Disc *disc = openDisc(path, 2352);
+		auto start = std::chrono::steady_clock::now();
+		for (int i = 0; i < Reads; i++)
+			// 32 sectors at a time, as the GD-ROM DMA
+			for (u32 fad = StartFAD; fad < StartFAD + Sectors; fad += 32)
+				disc->ReadSectors(fad, std::min(32u, StartFAD + Sectors - fad), &data[(fad - StartFAD) * 2048], 2048);
+		double us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+		printf("%s: %.3f us per sector\n", mapped ? "mapped" : "file", us / Reads / Sectors);
+		delete disc;
+	}
+}
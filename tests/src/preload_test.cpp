@@ -0,0 +1,225 @@
+#include "gtest/gtest.h"
+#include "types.h"
+#include "emulator.h"
+#include "cfg/option.h"
+#include "imgread/common.h"
+#include "imgread/preload.h"
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+Disc* gdi_parse(const char* file);
+
+// Sectors made from their address, mostly zeros as in the padding of a GD-ROM
+struct PatternTrackFile : TrackFile
+{
+	SectorFormat format;
+	bool subcode;
+	u32 oddFormatFad = 0;
+	u32 *reads;
+	bool *deleted;
+
+	PatternTrackFile(SectorFormat format, bool subcode, u32 *reads, bool *deleted)
+		: format(format), subcode(subcode), reads(reads), deleted(deleted) {}
+
+	void Read(u32 FAD, u8* dst, SectorFormat* sector_type, u8* subcode, SubcodeFormat* subcode_type) override
+	{
+		(*reads)++;
+		*sector_type = FAD == oddFormatFad ? SECFMT_2336_MODE2 : format;
+		u32 size = format == SECFMT_2352 ? 2352 : 2048;
+		memset(dst, 0, size);
+		for (u32 i = 0; i < size; i += 64)
+			dst[i] = (u8)(FAD + i);
+		if (format == SECFMT_2352)
+			dst[15] = FAD % 2 + 1;
+		if (this->subcode)
+		{
+			memset(subcode, (u8)FAD, 96);
+			*subcode_type = SUBFMT_96;
+		}
+	}
+	~PatternTrackFile() override {
+		*deleted = true;
+	}
+};
+
+class PreloadTest : public ::testing::Test {
+protected:
+	void SetUp() override {
+		disc = new Disc();
+		addTrack(150, 4149, SECFMT_2352, false);
+		addTrack(4150, 5149, SECFMT_2048_MODE1, false);
+		addTrack(5150, 5349, SECFMT_2352, true);
+	}
+	void TearDown() override {
+		delete disc;
+		disc = nullptr;
+	}
+
+	Disc *disc = nullptr;
+	u32 reads[4] {};
+	bool deleted[4] {};
+
+	PatternTrackFile *addTrack(u32 startFad, u32 endFad, SectorFormat format, bool subcode)
+	{
+		size_t i = disc->tracks.size();
+		Track track;
+		track.StartFAD = startFad;
+		track.EndFAD = endFad;
+		track.file = new PatternTrackFile(format, subcode, &reads[i], &deleted[i]);
+		disc->tracks.push_back(track);
+		return (PatternTrackFile *)track.file;
+	}
+
+	// Reads the disc before and after preloading it
+	void check(bool compress)
+	{
+		Disc *reference = new Disc();
+		u32 refReads[4] {};
+		bool refDeleted[4] {};
+		for (size_t i = 0; i < disc->tracks.size(); i++)
+		{
+			PatternTrackFile *file = (PatternTrackFile *)disc->tracks[i].file;
+			Track track = disc->tracks[i];
+			track.file = new PatternTrackFile(file->format, file->subcode, &refReads[i], &refDeleted[i]);
+			((PatternTrackFile *)track.file)->oddFormatFad = file->oddFormatFad;
+			reference->tracks.push_back(track);
+		}
+		ASSERT_TRUE(PreloadDisc(disc, compress));
+
+		const u32 reads[][3] = {
+			{ 150, 32, 2048 }, { 1000, 500, 2048 }, { 4140, 20, 2048 }, { 4100, 32, 2352 }, { 200, 10, 2340 },
+			{ 4150, 100, 2048 }, { 5140, 20, 2048 }, { 5150, 30, 2352 }, { 5349, 1, 2048 },
+		};
+		for (const auto& read : reads)
+		{
+			std::vector<u8> refData(read[1] * read[2]);
+			std::vector<u8> data(read[1] * read[2]);
+			u8 refSubcode[96] {};
+			u8 subcode[96] {};
+			reference->ReadSectors(read[0], read[1], refData.data(), read[2], refSubcode);
+			disc->ReadSectors(read[0], read[1], data.data(), read[2], subcode);
+			ASSERT_EQ(refData, data) << "fad " << read[0] << " format " << read[2];
+			ASSERT_EQ(0, memcmp(refSubcode, subcode, sizeof(subcode))) << "fad " << read[0];
+		}
+		delete reference;
+	}
+};
+
+TEST_F(PreloadTest, Compressed)
+{
+	check(true);
+	for (int i = 0; i < 3; i++)
+	{
+		ASSERT_TRUE(deleted[i]);
+		ASSERT_EQ(disc->tracks[i].EndFAD - disc->tracks[i].StartFAD + 2, reads[i]);
+	}
+}
+
+TEST_F(PreloadTest, Uncompressed)
+{
+	check(false);
+	for (int i = 0; i < 3; i++)
+		ASSERT_TRUE(deleted[i]);
+}
+
+TEST_F(PreloadTest, NotPreloaded)
+{
+	// Unknown size and sectors of different formats
+	addTrack(6000, 0, SECFMT_2352, false);
+	((PatternTrackFile *)disc->tracks[1].file)->oddFormatFad = 5000;
+	check(true);
+	ASSERT_TRUE(deleted[0]);
+	ASSERT_FALSE(deleted[1]);
+	ASSERT_TRUE(deleted[2]);
+	ASSERT_FALSE(deleted[3]);
+}
+
+TEST_F(PreloadTest, Gdi)
+{
+	// The end of the last track is only given by the lead-out, and the first track is shorter than its area
+	const u32 TrackSectors[] = { 300, 100, 500 };
+	std::vector<std::string> files;
+	for (int i = 0; i < 3; i++)
+	{
+		files.push_back(::testing::TempDir() + "track0" + std::to_string(i + 1) + ".bin");
+		FILE *f = fopen(files.back().c_str(), "wb");
+		std::vector<u8> sector(2352);
+		for (u32 s = 0; s < TrackSectors[i]; s++)
+		{
+			for (u32 j = 0; j < sector.size(); j++)
+				sector[j] = (u8)(s * 13 + j + i);
+			sector[15] = 1;
+			fwrite(sector.data(), sector.size(), 1, f);
+		}
+		fclose(f);
+	}
+	std::string gdiPath = ::testing::TempDir() + "preload.gdi";
+	FILE *f = fopen(gdiPath.c_str(), "w");
+	fprintf(f, "3\n1 0 4 2352 track01.bin 0\n2 600 0 2352 track02.bin 0\n3 45000 4 2352 track03.bin 0\n");
+	fclose(f);
+	files.push_back(gdiPath);
+
+	config::GDRomMapFiles = false;
+	Disc *reference = gdi_parse(gdiPath.c_str());
+	ASSERT_NE(nullptr, reference);
+	TearDown();
+	disc = gdi_parse(gdiPath.c_str());
+	ASSERT_NE(nullptr, disc);
+	ASSERT_EQ(0u, disc->tracks[2].EndFAD);
+	ASSERT_TRUE(PreloadDisc(disc, true));
+
+	const u32 reads[][2] = { { 150, 300 }, { 750, 100 }, { 45150, 500 } };
+	std::vector<std::vector<u8>> expected;
+	for (const auto& read : reads)
+	{
+		expected.emplace_back(read[1] * 2048);
+		reference->ReadSectors(read[0], read[1], expected.back().data(), 2048);
+	}
+	delete reference;
+	// The preloaded tracks aren't read from their file anymore
+	for (int i = 0; i < 3; i++)
+	{
+		f = fopen(files[i].c_str(), "wb");
+		fclose(f);
+	}
+	for (size_t i = 0; i < expected.size(); i++)
+	{
+		std::vector<u8> data(reads[i][1] * 2048);
+		disc->ReadSectors(reads[i][0], reads[i][1], data.data(), 2048);
+		ASSERT_EQ(expected[i], data) << "fad " << reads[i][0];
+	}
+	for (const std::string& path : files)
+		std::remove(path.c_str());
+}
+
+TEST_F(PreloadTest, Canceled)
+{
+	loading_canceled = true;
+	ASSERT_FALSE(PreloadDisc(disc, true));
+	loading_canceled = false;
+	ASSERT_FALSE(deleted[0]);
+}
+
+TEST_F(PreloadTest, Throughput)
+{
+	for (int compress = 0; compress < 2; compress++)
+	{
+		TearDown();
+		disc = new Disc();
+		// 100 MB
+		addTrack(150, 45000, SECFMT_2352, false);
+		auto start = std::chrono::steady_clock::now();
+		ASSERT_TRUE(PreloadDisc(disc, compress == 1));
+		u32 ms = (u32)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+		std::vector<u8> data(32 * 2048);
+		start = std::chrono::steady_clock::now();
+		for (u32 fad = 150; fad + 32 <= 45000; fad += 32)
+			disc->ReadSectors(fad, 32, data.data(), 2048);
+		u32 us = (u32)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+		printf("%s: preloaded 44851 sectors in %d ms, read in %.3f us per sector\n", compress ? "compressed" : "uncompressed",
+				ms, us / 44851.0);
+	}
+}
@@ -0,0 +1,70 @@
+#include "gtest/gtest.h"
+#include "types.h"
+#include "hw/mem/_vmem.h"
+#include "profiler/profiler.h"
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+#ifdef __linux__
+class ProfilerTest : public ::testing::Test {
+protected:
+	void SetUp() override {
+		// samples record the sh4 pc
+		if (!_vmem_reserve())
+			die("_vmem_reserve failed");
+	}
+	void TearDown() override {
+		prof_sampling_stop();
+		prof_sampling_reset();
+	}
+};
+
+static volatile u32 sink;
+
+static void burnCpu(int ms)
+{
+	auto end = std::chrono::steady_clock::now() + std::chrono::milliseconds(ms);
+	while (std::chrono::steady_clock::now() < end)
+		for (int i = 0; i < 10000; i++)
+			sink = sink * 1664525 + 1013904223;
+}
+
+TEST_F(ProfilerTest, SamplingTest)
+{
+	ASSERT_TRUE(prof_sampling_start(1000));
+	ASSERT_TRUE(prof_sampling_active());
+	burnCpu(200);
+	prof_sampling_stop();
+	ASSERT_FALSE(prof_sampling_active());
+
+	std::string path = ::testing::TempDir() + "profile.json";
+	ASSERT_TRUE(prof_write_json(path));
+	std::ifstream f(path);
+	std::stringstream json;
+	json << f.rdbuf();
+	std::remove(path.c_str());
+	// The sample count depends on the load of the machine
+	int samples = -1;
+	size_t pos = json.str().find("\"samples\": ");
+	ASSERT_NE(std::string::npos, pos);
+	ASSERT_EQ(1, sscanf(json.str().c_str() + pos, "\"samples\": %d", &samples));
+	ASSERT_GT(samples, 0);
+	ASSERT_EQ(0u, json.str().find("{\n\t\"interval_us\": 1000,\n"));
+	for (const char *key : { "\"dropped\": ", "\"unknown\": ", "\"blocks\": [", "\"host\": [" })
+		ASSERT_NE(std::string::npos, json.str().find(key)) << key;
+	ASSERT_LT(json.str().find("\"blocks\": ["), json.str().find("\"host\": ["));
+	ASSERT_EQ(json.str().size() - 5, json.str().rfind("\t]\n}\n"));
+
+	// no sample is taken when stopped
+	burnCpu(50);
+	ASSERT_TRUE(prof_write_json(path));
+	std::ifstream f2(path);
+	std::stringstream json2;
+	json2 << f2.rdbuf();
+	std::remove(path.c_str());
+	ASSERT_NE(std::string::npos, json2.str().find("\"samples\": " + std::to_string(samples) + ","));
+}
+#endif
@@ -0,0 +1,180 @@
+#include "gtest/gtest.h"
+#include "types.h"
+#include "cfg/option.h"
+#include "imgread/common.h"
+#include "imgread/readahead.h"
+#include "profiler/profiler.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+// Raw sectors made from their address, optionally with a subcode and read slowly
+struct TestTrackFile : TrackFile
+{
+	bool subcode = false;
+	u32 readUs = 0;
+
+	void Read(u32 FAD, u8* dst, SectorFormat* sector_type, u8* subcode, SubcodeFormat* subcode_type) override
+	{
+		for (u32 i = 0; i < 2352; i++)
+			dst[i] = (u8)(FAD * 7 + i);
+		// mode 1
+		dst[15] = 1;
+		*sector_type = SECFMT_2352;
+		if (this->subcode)
+		{
+			memset(subcode, (u8)FAD, 96);
+			*subcode_type = SUBFMT_96;
+		}
+		if (readUs != 0)
+			std::this_thread::sleep_for(std::chrono::microseconds(readUs));
+	}
+};
+
+class ReadAheadTest : public ::testing::Test {
+protected:
+	void SetUp() override {
+		file = new TestTrackFile();
+		disc = new Disc();
+		Track track;
+		track.file = file;
+		track.StartFAD = Start;
+		track.EndFAD = End;
+		disc->tracks.push_back(track);
+		disc->LeadOut.StartFAD = End + 1;
+		disc->EndFAD = End;
+		disc->type = CdRom;
+		config::GDRomReadAhead = true;
+		memset(&prof.counters.gdrom, 0, sizeof(prof.counters.gdrom));
+	}
+	void TearDown() override {
+		TermDrive();
+		ra_Term();
+		config::GDRomReadAhead = false;
+	}
+
+	static const u32 Start = 150;
+	static const u32 End = 5149;
+
+	TestTrackFile *file = nullptr;
+
+	// Reads the sectors like the GD-ROM DMA, 32 at a time, and checks them
+	static void readSectors(u32 fad, u32 count, u32 secsz, u32 transferUs = 0)
+	{
+		std::vector<u8> data(32 * secsz);
+		std::vector<u8> direct(32 * secsz);
+		u8 subcode[96];
+		while (count > 0)
+		{
+			u32 n = std::min(count, 32u);
+			libGDR_ReadSector(data.data(), fad, n, secsz);
+			disc->ReadSectors(fad, n, direct.data(), secsz, subcode);
+			ASSERT_EQ(0, memcmp(direct.data(), data.data(), n * secsz)) << "fad " << fad;
+			fad += n;
+			count -= n;
+			if (transferUs != 0)
+				std::this_thread::sleep_for(std::chrono::microseconds(transferUs));
+		}
+	}
+};
+
+TEST_F(ReadAheadTest, Sequential)
+{
+	auto& gdrom = prof.counters.gdrom;
+	libGDR_ReadAhead(200, 2048);
+	readSectors(200, 1000, 2048);
+	ASSERT_EQ(1000u, gdrom.readahead_sectors);
+	ASSERT_EQ(0u, gdrom.readahead_misses);
+
+	// The next read continues where the previous one ended
+	libGDR_ReadAhead(1200, 2048);
+	readSectors(1200, 100, 2048);
+	ASSERT_EQ(1100u, gdrom.readahead_sectors);
+
+	// Up to the end of the track
+	libGDR_ReadAhead(End - 99, 2340);
+	readSectors(End - 99, 100, 2340);
+	ASSERT_EQ(1200u, gdrom.readahead_sectors);
+}
+
+TEST_F(ReadAheadTest, OtherReads)
+{
+	auto& gdrom = prof.counters.gdrom;
+	libGDR_ReadAhead(1000, 2048);
+	readSectors(1000, 64, 2048);
+	// Sectors in another format, such as cdda, and other sectors are read directly
+	readSectors(3000, 10, 2352);
+	readSectors(2000, 10, 2048);
+	ASSERT_EQ(1u, gdrom.readahead_misses);
+	readSectors(1064, 64, 2048);
+	ASSERT_EQ(128u, gdrom.readahead_sectors);
+
+	// A new read command elsewhere
+	libGDR_ReadAhead(4000, 2048);
+	readSectors(4000, 64, 2048);
+	ASSERT_EQ(192u, gdrom.readahead_sectors);
+
+	// No read-ahead outside of the tracks
+	libGDR_ReadAhead(End + 100, 2048);
+	u8 sector[2048];
+	ASSERT_EQ(0u, ra_Read(sector, End + 100, 1, 2048));
+}
+
+TEST_F(ReadAheadTest, Subcode)
+{
+	file->subcode = true;
+	libGDR_ReadAhead(500, 2352);
+	u8 sector[2352];
+	for (u32 fad = 500; fad < 600; fad++)
+	{
+		libGDR_ReadSector(sector, fad, 1, 2352);
+		// the subcode of the last sector read, not of the sectors read ahead
+		ASSERT_EQ((u8)fad, q_subchannel[0]);
+	}
+	ASSERT_EQ(100u, prof.counters.gdrom.readahead_sectors);
+}
+
+TEST_F(ReadAheadTest, Stalls)
+{
+	auto& gdrom = prof.counters.gdrom;
+	// 32 sectors in 8 ms, transferred in 16 ms by the emulation
+	file->readUs = 250;
+	config::GDRomReadAhead = false;
+	auto start = std::chrono::steady_clock::now();
+	readSectors(Start, 640, 2048, 16000);
+	u32 directMs = (u32)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+
+	config::GDRomReadAhead = true;
+	start = std::chrono::steady_clock::now();
+	libGDR_ReadAhead(Start, 2048);
+	readSectors(Start, 640, 2048, 16000);
+	u32 readAheadMs = (u32)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+	// The sectors are checked by readSectors
+	ASSERT_EQ(640u, gdrom.readahead_sectors);
+	ASSERT_EQ(0u, gdrom.readahead_misses);
+	printf("20 reads of 32 sectors: %d ms, %d ms with read-ahead, %d stalls (%d us)\n", directMs, readAheadMs, gdrom.stalls, gdrom.stall_us);
+}
+
+TEST_F(ReadAheadTest, RestartWhileReading)
+{
+	auto& gdrom = prof.counters.gdrom;
+	file->readUs = 500;
+	libGDR_ReadAhead(Start, 2048);
+	// The next chunk is being read
+	readSectors(Start, 32, 2048);
+	// New read commands while it's read are served from the new position, the stale chunk is discarded
+	libGDR_ReadAhead(3000, 2048);
+	libGDR_ReadAhead(2000, 2352);
+	readSectors(2000, 64, 2352);
+	ASSERT_EQ(96u, gdrom.readahead_sectors);
+	ASSERT_EQ(0u, gdrom.readahead_misses);
+
+	libGDR_ReadAhead(4000, 2048);
+	ra_Stop();
+	// Nothing is read ahead after a stop
+	u8 sector[2048];
+	ASSERT_EQ(0u, ra_Read(sector, 4000, 1, 2048));
+}
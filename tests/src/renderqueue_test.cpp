@@ -0,0 +1,88 @@
+#include "gtest/gtest.h"
+#include "types.h"
+#include "cfg/option.h"
+#include "hw/pvr/ta_ctx.h"
+
+class RenderQueueTest : public ::testing::Test {
+protected:
+	void SetUp() override {
+		config::RenderQueueDepth = 3;
+		config::AutoSkipFrame = 2;		// never wait for the renderer
+		rend_GetQueueStats();
+	}
+	void TearDown() override {
+		while (TA_context *ctx = DequeueRender())
+			FinishRender(ctx);
+		config::RenderQueueDepth = 1;
+		config::RenderQueuePacing = 0;
+		config::AutoSkipFrame = 0;
+		tactx_Term();
+	}
+
+	static TA_context *newFrame(bool async = true)
+	{
+		TA_context *ctx = tactx_Alloc();
+		ctx->rend.asyncProcess = async;
+		return ctx;
+	}
+};
+
+TEST_F(RenderQueueTest, Throughput)
+{
+	TA_context *frames[3];
+	for (auto& frame : frames)
+	{
+		frame = newFrame();
+		ASSERT_TRUE(QueueRender(frame));
+	}
+	// The queue is full
+	ASSERT_FALSE(QueueRender(newFrame()));
+
+	// Rendered in order
+	for (auto frame : frames)
+	{
+		ASSERT_TRUE(rend_framePending());
+		ASSERT_EQ(frame, DequeueRender());
+		FinishRender(frame);
+	}
+	ASSERT_FALSE(rend_framePending());
+	ASSERT_EQ(nullptr, DequeueRender());
+
+	RenderQueueStats stats = rend_GetQueueStats();
+	ASSERT_EQ(3u, stats.queued);
+	ASSERT_EQ(0u, stats.dropped);
+	ASSERT_EQ(1u, stats.occupancy[0]);
+	ASSERT_EQ(1u, stats.occupancy[1]);
+	ASSERT_EQ(1u, stats.occupancy[2]);
+}
+
+TEST_F(RenderQueueTest, Latency)
+{
+	config::RenderQueuePacing = 1;
+	TA_context *first = newFrame();
+	TA_context *second = newFrame(false);
+	TA_context *third = newFrame();
+	ASSERT_TRUE(QueueRender(first));
+	ASSERT_TRUE(QueueRender(second));
+	ASSERT_TRUE(QueueRender(third));
+	// The first frame is being rendered
+	ASSERT_EQ(first, DequeueRender());
+
+	// Replaces the third frame since the emulation waits for the second one
+	TA_context *fourth = newFrame(false);
+	ASSERT_TRUE(QueueRender(fourth));
+	// Nothing left to replace
+	TA_context *fifth = newFrame(false);
+	ASSERT_FALSE(QueueRender(fifth));
+
+	FinishRender(first);
+	ASSERT_EQ(second, DequeueRender());
+	FinishRender(second);
+	ASSERT_EQ(fourth, DequeueRender());
+	FinishRender(fourth);
+	ASSERT_FALSE(rend_framePending());
+
+	RenderQueueStats stats = rend_GetQueueStats();
+	ASSERT_EQ(4u, stats.queued);
+	ASSERT_EQ(1u, stats.dropped);
+}
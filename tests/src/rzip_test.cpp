@@ -0,0 +1,200 @@
+#include "gtest/gtest.h"
+#include "types.h"
+#include "archive/rzip.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+
+class RZipTest : public ::testing::Test {
+protected:
+	void TearDown() override {
+		RZipFile::SetThreadCount(0);
+		std::remove(path.c_str());
+	}
+
+	/*
+		Something resembling a savestate: 16 MB of system RAM with code, tables and free space,
+		8 MB of VRAM with textures and frame buffers, 2 MB of sound RAM, then the device states.
+		A real state file can be used instead by setting RZIP_BENCH_STATE to its path.
+	*/
+	static std::vector<u8> makeState()
+	{
+		const char *file = std::getenv("RZIP_BENCH_STATE");
+		if (file != nullptr)
+		{
+			RZipFile zipFile;
+			if (zipFile.Open(file, false))
+			{
+				std::vector<u8> state(zipFile.Size());
+				state.resize(zipFile.Read(state.data(), state.size()));
+				return state;
+			}
+		}
+		std::vector<u8> state(28145503);
+		std::mt19937 rng(42);
+		u8 *p = state.data();
+		// RAM: code made of a small instruction set, data tables, zeros
+		for (u32 i = 0; i < 6 * 1024 * 1024; i += 2, p += 2)
+			*(u16 *)p = 0x6000 | (rng() % 64) << 4 | (rng() & 0xf);
+		for (u32 i = 0; i < 4 * 1024 * 1024; i++)
+			*p++ = (rng() & 3) == 0 ? (u8)rng() : (u8)(i >> 4);
+		p += 6 * 1024 * 1024;
+		// VRAM: gradients with some noise
+		for (u32 i = 0; i < 6 * 1024 * 1024; i++)
+			*p++ = (u8)((i & 0x3ff) / 4 + (i >> 16) + (rng() & 7));
+		p += 2 * 1024 * 1024;
+		// ARAM: samples
+		for (u32 i = 0; i < 1024 * 1024; i++)
+			*p++ = (u8)(128 + 100 * std::sin(i / 20.0) + (rng() & 15));
+		return state;
+	}
+
+	void save(const std::vector<u8>& state, RZipFile::Compression compression)
+	{
+		RZipFile zipFile;
+		ASSERT_TRUE(zipFile.Open(path, true, compression));
+		// odd sized writes, like the serialization of the devices
+		size_t offset = 0;
+		for (size_t l = 1; offset < state.size(); l = l * 3 % 1000003 + 1)
+		{
+			l = std::min(l, state.size() - offset);
+			ASSERT_TRUE(zipFile.Write(&state[offset], l));
+			offset += l;
+		}
+		ASSERT_TRUE(zipFile.Close());
+	}
+
+	std::vector<u8> load()
+	{
+		RZipFile zipFile;
+		if (!zipFile.Open(path, false))
+			return {};
+		std::vector<u8> state(zipFile.Size());
+		state.resize(zipFile.Read(state.data(), state.size()));
+		return state;
+	}
+
+	static size_t fileSize(const std::string& path)
+	{
+		FILE *f = std::fopen(path.c_str(), "rb");
+		if (f == nullptr)
+			return 0;
+		std::fseek(f, 0, SEEK_END);
+		size_t size = std::ftell(f);
+		std::fclose(f);
+		return size;
+	}
+
+	std::string path = ::testing::TempDir() + "rzip_test.state";
+};
+
+TEST_F(RZipTest, RoundTripTest)
+{
+	std::vector<u8> state = makeState();
+	for (int threads : { 1, 3, 0 })
+	{
+		RZipFile::SetThreadCount(threads);
+		for (RZipFile::Compression compression : { RZipFile::Default, RZipFile::Fast })
+		{
+			save(state, compression);
+			ASSERT_TRUE(state == load()) << threads << " threads, compression " << compression;
+		}
+	}
+	// Chunking doesn't depend on the number of threads: files are identical
+	RZipFile::SetThreadCount(1);
+	save(state, RZipFile::Default);
+	std::vector<u8> serial = load();
+	size_t serialSize = fileSize(path);
+	RZipFile::SetThreadCount(0);
+	save(state, RZipFile::Default);
+	ASSERT_EQ(serialSize, fileSize(path));
+
+	// Read by a single thread what was written by several
+	RZipFile::SetThreadCount(1);
+	ASSERT_TRUE(serial == load());
+}
+
+TEST_F(RZipTest, TruncatedTest)
+{
+	std::vector<u8> state = makeState();
+	save(state, RZipFile::Fast);
+	size_t size = fileSize(path);
+	std::vector<u8> file(size);
+	FILE *f = std::fopen(path.c_str(), "rb");
+	ASSERT_EQ(1u, std::fread(file.data(), size, 1, f));
+	std::fclose(f);
+	f = std::fopen(path.c_str(), "wb");
+	std::fwrite(file.data(), size / 2, 1, f);
+	std::fclose(f);
+
+	std::vector<u8> read = load();
+	ASSERT_LT(read.size(), state.size());
+	ASSERT_GT(read.size(), 0u);
+	ASSERT_TRUE(std::equal(read.begin(), read.end(), state.begin()));
+}
+
+TEST_F(RZipTest, InvalidHeaderTest)
+{
+	std::vector<u8> state(3 * 1024 * 1024 + 5);
+	for (size_t i = 0; i < state.size(); i++)
+		state[i] = (u8)(i * 7 / 1000);
+	save(state, RZipFile::Fast);
+	size_t size = fileSize(path);
+	std::vector<u8> file(size);
+	FILE *f = std::fopen(path.c_str(), "rb");
+	ASSERT_EQ(1u, std::fread(file.data(), size, 1, f));
+	std::fclose(f);
+	auto rewrite = [&](const std::vector<u8>& data) {
+		FILE *f = std::fopen(path.c_str(), "wb");
+		std::fwrite(data.data(), data.size(), 1, f);
+		std::fclose(f);
+	};
+
+	// The chunk size follows the 8-byte signature
+	for (u32 chunkSize : { 0u, 1024u * 1024 + 1, 0xffffffffu })
+	{
+		std::vector<u8> bad = file;
+		memcpy(&bad[8], &chunkSize, sizeof(chunkSize));
+		rewrite(bad);
+		RZipFile zipFile;
+		ASSERT_FALSE(zipFile.Open(path, false)) << chunkSize;
+	}
+
+	// A compressed chunk larger than any compress() output: the data before it is still returned
+	std::vector<u8> bad = file;
+	u32 firstChunk;
+	memcpy(&firstChunk, &bad[20], sizeof(firstChunk));
+	u32 huge = 0xfffffff0;
+	memcpy(&bad[24 + firstChunk], &huge, sizeof(huge));
+	rewrite(bad);
+	RZipFile::SetThreadCount(1);
+	std::vector<u8> read = load();
+	ASSERT_EQ(1024u * 1024, read.size());
+	ASSERT_TRUE(std::equal(read.begin(), read.end(), state.begin()));
+}
+
+TEST_F(RZipTest, Benchmark)
+{
+	using Clock = std::chrono::steady_clock;
+	std::vector<u8> state = makeState();
+
+	for (RZipFile::Compression compression : { RZipFile::Default, RZipFile::Fast })
+		for (int threads : { 1, 0 })
+		{
+			RZipFile::SetThreadCount(threads);
+			auto start = Clock::now();
+			save(state, compression);
+			auto saveTime = std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - start).count();
+			start = Clock::now();
+			size_t loaded = load().size();
+			auto loadTime = std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - start).count();
+			ASSERT_EQ(state.size(), loaded);
+			printf("%s compression, %s: save %lld ms, load %lld ms, %zu -> %zu bytes\n",
+					compression == RZipFile::Fast ? "fast" : "default",
+					threads == 1 ? "1 thread" : "all cores",
+					(long long)saveTime, (long long)loadTime, state.size(), fileSize(path));
+		}
+}
@@ -5,6 +5,9 @@
 #include "hw/maple/maple_devs.h"
 #include "emulator.h"
 #include "cfg/option.h"
+#include "archive/rzip.h"
+
+#include <cstdio>
 
 class SerializeTest : public ::testing::Test {
 protected:
@@ -34,5 +37,43 @@ TEST_F(SerializeTest, SizeTest)
 	ASSERT_EQ(28145503u, total_size);
 }
 
+class VectorStream : public SerializeStream
+{
+public:
+	bool Write(const void *data, size_t length) override {
+		buffer.insert(buffer.end(), (const u8 *)data, (const u8 *)data + length);
+		return true;
+	}
+	std::vector<u8> buffer;
+};
+
+TEST_F(SerializeTest, StreamTest)
+{
+	unsigned int total_size = 0;
+	void *data = nullptr;
+	ASSERT_TRUE(dc_serialize(&data, &total_size));
+	std::vector<u8> reference(total_size);
+	data = reference.data();
+	ASSERT_TRUE(dc_serialize(&data, &total_size));
+
+	VectorStream stream;
+	unsigned int stream_size = 0;
+	ASSERT_TRUE(dc_serialize(stream, &stream_size));
+	ASSERT_EQ(total_size, stream_size);
+	ASSERT_TRUE(reference == stream.buffer);
 
+	// Compressed as it is serialized
+	std::string path = ::testing::TempDir() + "serialize_test.state";
+	RZipFile zipFile;
+	ASSERT_TRUE(zipFile.Open(path, true));
+	ASSERT_TRUE(dc_serialize(zipFile, &stream_size));
+	ASSERT_TRUE(zipFile.Close());
 
+	ASSERT_TRUE(zipFile.Open(path, false));
+	ASSERT_EQ(total_size, zipFile.Size());
+	std::vector<u8> read(total_size);
+	ASSERT_EQ(total_size, zipFile.Read(read.data(), read.size()));
+	zipFile.Close();
+	std::remove(path.c_str());
+	ASSERT_TRUE(reference == read);
+}
@@ -0,0 +1,155 @@
+#include "gtest/gtest.h"
+#include "types.h"
+#include "emulator.h"
+#include "hw/mem/_vmem.h"
+#include "hw/sh4/sh4_if.h"
+#include "hw/sh4/sh4_sched.h"
+#include "hw/sh4/sh4_interpreter.h"
+
+#include <chrono>
+
+extern std::vector<sched_list> sch_list;
+
+class Sh4SchedTest : public ::testing::Test {
+protected:
+	void SetUp() override {
+		if (!_vmem_reserve())
+			die("_vmem_reserve failed");
+		dc_init();
+		dc_reset(true);
+		// Only the events registered by the test must fire
+		for (size_t i = 0; i < sch_list.size(); i++)
+			sh4_sched_request(i, -1);
+		fired.clear();
+	}
+
+	// Runs the scheduler for the given number of cycles, as the interpreter does
+	static void run(int cycles)
+	{
+		for (; cycles > 0; cycles -= SH4_TIMESLICE)
+		{
+			Sh4cntx.sh4_sched_next -= SH4_TIMESLICE;
+			sh4_sched_tick(SH4_TIMESLICE);
+		}
+	}
+
+	static int record(int tag, int cycles, int jitter)
+	{
+		fired.push_back({ tag, jitter });
+		return 0;
+	}
+
+	struct Fired
+	{
+		int tag;
+		int jitter;
+	};
+	static std::vector<Fired> fired;
+};
+
+std::vector<Sh4SchedTest::Fired> Sh4SchedTest::fired;
+
+TEST_F(Sh4SchedTest, OrderTest)
+{
+	int a = sh4_sched_register(1, &record);
+	int b = sh4_sched_register(2, &record);
+	int c = sh4_sched_register(3, &record);
+	int d = sh4_sched_register(4, &record);
+
+	sh4_sched_request(a, 10000);
+	sh4_sched_request(b, 5000);
+	sh4_sched_request(c, 10000);
+	sh4_sched_request(d, 2000);
+	// cancel
+	sh4_sched_request(d, -1);
+	// only the last request is in effect
+	sh4_sched_request(b, 20000);
+	ASSERT_EQ(10000, Sh4cntx.sh4_sched_next);
+
+	run(30000);
+	ASSERT_EQ(3u, fired.size());
+	// deadline order, then registration order
+	ASSERT_EQ(1, fired[0].tag);
+	ASSERT_EQ(3, fired[1].tag);
+	ASSERT_EQ(2, fired[2].tag);
+	for (const Fired& f : fired)
+	{
+		ASSERT_GE(f.jitter, 0);
+		ASSERT_LT(f.jitter, SH4_TIMESLICE);
+	}
+	fired.clear();
+	run(SH4_MAIN_CLOCK / 10);
+	ASSERT_TRUE(fired.empty());
+}
+
+TEST_F(Sh4SchedTest, PeriodicTest)
+{
+	int id = sh4_sched_register(0, [](int tag, int cycles, int jitter) {
+		fired.push_back({ tag, jitter });
+		return 1000;
+	});
+	sh4_sched_request(id, 1000);
+	u32 start = sh4_sched_now();
+	run(100000);
+	// jitter is compensated so the period is kept on average
+	ASSERT_EQ((sh4_sched_now() - start) / 1000, fired.size());
+}
+
+/*
+	Events requested during boot, with their usual periods:
+	SPG line, AICA, RTC, TMU0-2, GD-ROM, maple, render end, AICA DMA and modem.
+	Maple, render end and TMU2 are one-shot events requested once per frame by the SPG.
+*/
+namespace sched_bench
+{
+enum { Spg, Aica, Rtc, Tmu0, Tmu1, Tmu2, Gdrom, Maple, RenderEnd, AicaDma, Modem, Count };
+static const int periods[Count] = {
+	6349, 145125, SH4_MAIN_CLOCK, 50000, 0, 0, SH4_MAIN_CLOCK / 50, 0, 0, 0, 0
+};
+static int ids[Count];
+static u64 callCount;
+static int line;
+
+static void request(int event, int cycles)
+{
+	sh4_sched_request(ids[event], cycles);
+}
+
+static int callback(int tag, int cycles, int jitter)
+{
+	callCount++;
+	if (tag == Spg && ++line == 525)
+	{
+		line = 0;
+		request(Maple, 40000);
+		request(RenderEnd, 500000 * 3);
+		request(Tmu2, 100000);
+		request(Gdrom, SH4_MAIN_CLOCK / 50);
+	}
+	else if (tag == Tmu0)
+		// some games reprogram the timer from its interrupt handler
+		request(Tmu1, 3000);
+	return periods[tag];
+}
+}
+
+TEST_F(Sh4SchedTest, Benchmark)
+{
+	using namespace sched_bench;
+	using Clock = std::chrono::steady_clock;
+	const int kSeconds = 20;
+
+	for (int i = 0; i < Count; i++)
+		ids[i] = sh4_sched_register(i, &callback);
+	for (int i = 0; i < Count; i++)
+		if (periods[i] != 0)
+			request(i, periods[i]);
+
+	auto start = Clock::now();
+	for (int i = 0; i < kSeconds; i++)
+		run(SH4_MAIN_CLOCK);
+	auto duration = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start).count();
+	printf("%lld us for %d emulated seconds, %llu events\n", (long long)duration, kSeconds,
+			(unsigned long long)callCount);
+	ASSERT_GT(callCount, (u64)kSeconds * 60 * 525);
+}
@@ -0,0 +1,178 @@
+#include "gtest/gtest.h"
+#include "types.h"
+#include "emulator.h"
+#include "cfg/option.h"
+#include "hw/mem/_vmem.h"
+#include "hw/mem/mem_watch.h"
+#include "hw/sh4/sh4_if.h"
+#include "hw/sh4/sh4_core.h"
+#include "hw/sh4/sh4_mem.h"
+#include "hw/sh4/sh4_sched.h"
+#include "hw/sh4/modules/mmu.h"
+#include "hw/sh4/dyna/blockmanager.h"
+#include "hw/sh4/dyna/ngen.h"
+#include "profiler/profiler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+
+#if FEAT_SHREC != DYNAREC_NONE
+
+#ifdef __unix__
+// the block table is allocated on demand by the fault handler
+void install_fault_handler();
+#endif
+
+class SmcTest : public ::testing::Test {
+protected:
+	void SetUp() override {
+#ifdef __unix__
+		install_fault_handler();
+#endif
+		if (!_vmem_reserve())
+			die("_vmem_reserve failed");
+		dc_init();
+		// dc_init() only maps the first reserved memory, which the dynarec must access directly
+		_vmem_init_mappings();
+		mem_map_default();
+		dc_reset(true);
+		mmu_set_state();
+		Get_Sh4Recompiler(&sh4_cpu);
+		writeProgram();
+	}
+	void TearDown() override {
+		memwatch::disable();
+		config::DynarecFineSmc = false;
+		sh4_cpu.ResetCache();
+		bm_Reset();
+	}
+
+	static const u32 Start = 0x8c010000;
+	// Another block in the same page, and a data word in a different chunk
+	static const u32 Other = Start + 0x400;
+	static const u32 Data = Start + 0x800;
+
+	// A loop incrementing r0 and storing it to @r2
+	static void writeProgram()
+	{
+		u32 addr = Start;
+		WriteMem16(addr, 0x7001);			// add #1,r0
+		addr += 2;
+		WriteMem16(addr, 0x2202);			// mov.l r0,@r2
+		addr += 2;
+		for (int i = 0; i < 10; i++, addr += 2)
+			WriteMem16(addr, 0x7101 + i);	// add #imm,r1
+		WriteMem16(addr, 0xA000 | ((Start - addr - 4) / 2 & 0xfff));	// bra Start
+		WriteMem16(addr + 2, 0x0009);		// nop
+
+		WriteMem16(Other, 0x7301);			// add #1,r3
+		WriteMem16(Other + 2, 0x000B);		// rts
+		WriteMem16(Other + 4, 0x0009);		// nop
+	}
+
+	static int stop(int tag, int cycles, int jitter)
+	{
+		sh4_cpu.Stop();
+		return 0;
+	}
+
+	// Runs the loop for the given number of sh4 cycles with r2 pointing at the given address.
+	// Returns the elapsed time in us
+	static u32 run(u32 cycles, u32 target)
+	{
+		for (int i = 0; i < 8; i++)
+			r[i] = 0;
+		r[2] = target;
+		Sh4cntx.pc = Start;
+		static int id = sh4_sched_register(0, stop);
+		sh4_sched_request(id, cycles);
+		auto start = std::chrono::steady_clock::now();
+		sh4_cpu.Run();
+		u32 us = (u32)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+		EXPECT_EQ(r[0], ReadMem32(target));
+		return std::max(us, 1u);
+	}
+};
+
+TEST_F(SmcTest, DataWrites)
+{
+	auto& bm = prof.counters.bm;
+	const u32 Cycles = SH4_MAIN_CLOCK / 4;
+
+	// The first write unprotects the page. The loop is then recompiled and checks its code on each run.
+	config::DynarecFineSmc = false;
+	sh4_cpu.ResetCache();
+	bm.smc_pages = 0;
+	u32 us = run(Cycles, Data);
+	double mips = (double)r[0] * 14 / us;
+	ASSERT_EQ(1u, bm.smc_pages);
+	ASSERT_FALSE(bm_GetBlock(Start)->read_only);
+
+	config::DynarecFineSmc = true;
+	sh4_cpu.ResetCache();
+	bm.smc_pages = bm.smc_data_writes = bm.smc_code_writes = 0;
+	u32 fineUs = run(Cycles, Data);
+	double fineMips = (double)r[0] * 14 / fineUs;
+#if HOST_CPU == CPU_X64
+	// only this dynarec has a write barrier
+	ASSERT_EQ(0u, bm.smc_pages);
+	ASSERT_EQ(0u, bm.smc_code_writes);
+	ASSERT_EQ(r[0], bm.smc_data_writes);
+	ASSERT_TRUE(bm_GetBlock(Start)->read_only);
+#endif
+	printf("Data written next to code: %.0f guest MIPS -> %.0f with fine-grained SMC detection\n", mips, fineMips);
+}
+
+TEST_F(SmcTest, CodeWrites)
+{
+	auto& bm = prof.counters.bm;
+	config::DynarecFineSmc = true;
+	sh4_cpu.ResetCache();
+	rdv_FailedToFindBlock(Other);
+	ASSERT_TRUE(bm_GetBlock(Other)->read_only);
+	bm.smc_pages = bm.smc_code_writes = bm.smc_discarded = 0;
+
+	run(SH4_MAIN_CLOCK / 100, Other);
+	ASSERT_EQ(nullptr, bm_GetBlock(Other));
+#if HOST_CPU == CPU_X64
+	// Only the overwritten block is discarded
+	ASSERT_EQ(0u, bm.smc_pages);
+	ASSERT_EQ(1u, bm.smc_discarded);
+	ASSERT_TRUE(bm_GetBlock(Start)->read_only);
+#endif
+	ASSERT_NE(nullptr, bm_GetBlock(Start));
+}
+
+TEST_F(SmcTest, MemwatchTracking)
+{
+	auto& bm = prof.counters.bm;
+	config::DynarecFineSmc = true;
+	sh4_cpu.ResetCache();
+	rdv_FailedToFindBlock(Other);
+	// Rollback write tracking protects all the views of the RAM
+	memwatch::enable();
+	std::vector<u32> pages;
+	bm.smc_pages = bm.smc_data_writes = bm.smc_discarded = 0;
+	for (int i = 0; i < 2; i++)
+	{
+		run(SH4_MAIN_CLOCK / 100, Data);
+		pages.clear();
+		memwatch::collect(memwatch::Ram, pages);
+		ASSERT_NE(pages.end(), std::find(pages.begin(), pages.end(), Data & RAM_MASK & ~PAGE_MASK));
+	}
+#if HOST_CPU == CPU_X64
+	ASSERT_EQ(0u, bm.smc_pages);
+	ASSERT_NE(0u, bm.smc_data_writes);
+	ASSERT_TRUE(bm_GetBlock(Start)->read_only);
+	ASSERT_TRUE(bm_GetBlock(Other)->read_only);
+#endif
+
+	// The code is still protected against the writes that don't go through the write barrier
+	run(SH4_MAIN_CLOCK / 100, Data);
+	*(u16 *)&mem_b[Other & RAM_MASK] = 0x7302;	// add #2,r3
+	ASSERT_EQ(nullptr, bm_GetBlock(Other));
+	ASSERT_EQ(1u, bm.smc_pages);
+}
+
+#endif
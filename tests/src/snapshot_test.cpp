@@ -0,0 +1,124 @@
+#include "gtest/gtest.h"
+#include "types.h"
+#include "snapshot.h"
+#include "hw/mem/_vmem.h"
+#include "hw/pvr/pvr_mem.h"
+#include "hw/sh4/sh4_mem.h"
+#include "emulator.h"
+
+#include <chrono>
+
+#ifdef __linux__
+void install_fault_handler();
+#endif
+
+class SnapshotTest : public ::testing::Test {
+protected:
+	void SetUp() override {
+#ifndef __linux__
+		GTEST_SKIP() << "needs the fault handler";
+#else
+		install_fault_handler();
+#endif
+		if (!_vmem_reserve())
+			die("_vmem_reserve failed");
+		dc_init();
+		dc_reset(true);
+	}
+	void TearDown() override {
+		chain.Reset();
+	}
+
+	SnapshotChain chain;
+};
+
+TEST_F(SnapshotTest, RestoreTest)
+{
+	for (u32 i = 0; i < 0x10000; i++)
+		mem_b.data[i] = (u8)i;
+	ASSERT_TRUE(chain.Take(0));
+	u64 hash0 = chain.Hash(0);
+
+	mem_b.data[0x1000] = 0xA1;
+	vram.data[0x2000] = 0xA2;
+	ASSERT_TRUE(chain.Take(1));
+	// Only the written pages and the device state are held
+	ASSERT_LT(chain.Size(1), chain.Size(0) / 4);
+
+	mem_b.data[0x1000] = 0xB1;
+	mem_b.data[0x5000] = 0xB2;
+	ASSERT_TRUE(chain.Take(2));
+	mem_b.data[0x8000] = 0xC1;
+
+	ASSERT_TRUE(chain.Restore(1));
+	ASSERT_EQ(0xA1, mem_b.data[0x1000]);
+	ASSERT_EQ(0xA2, vram.data[0x2000]);
+	ASSERT_EQ((u8)0x5000, mem_b.data[0x5000]);
+	ASSERT_EQ((u8)0x8000, mem_b.data[0x8000]);
+	ASSERT_FALSE(chain.Has(2));
+
+	// Writes after a restore are tracked again
+	mem_b.data[0x9000] = 0xD1;
+	ASSERT_TRUE(chain.Restore(0));
+	ASSERT_EQ((u8)0x1000, mem_b.data[0x1000]);
+	ASSERT_EQ((u8)0x9000, mem_b.data[0x9000]);
+	ASSERT_EQ(0, vram.data[0x2000]);
+
+	ASSERT_TRUE(chain.Take(3));
+	ASSERT_EQ(hash0, chain.Hash(3));
+
+	// Merging into the full image
+	mem_b.data[0x3000] = 0xE1;
+	ASSERT_TRUE(chain.Take(4));
+	chain.DropBefore(4);
+	ASSERT_EQ(1u, chain.Count());
+	mem_b.data[0x3000] = 0;
+	ASSERT_TRUE(chain.Restore(4));
+	ASSERT_EQ(0xE1, mem_b.data[0x3000]);
+}
+
+// Full savestate (as dc_savestate does) vs incremental snapshot of a frame writing a few hundred KB
+TEST_F(SnapshotTest, Benchmark)
+{
+	using Clock = std::chrono::steady_clock;
+	using us = std::chrono::microseconds;
+	const int kFrames = 60;
+	const u32 kRamPages = 64;
+	const u32 kVramPages = 32;
+
+	Clock::duration full_total{};
+	unsigned int full_size = 0;
+	for (int f = 0; f < kFrames; f++)
+	{
+		auto start = Clock::now();
+		full_size = 0;
+		void *data = nullptr;
+		dc_serialize(&data, &full_size);
+		data = malloc(full_size);
+		void *p = data;
+		dc_serialize(&p, &full_size);
+		free(data);
+		full_total += Clock::now() - start;
+	}
+
+	ASSERT_TRUE(chain.Take(0));
+	Clock::duration delta_total{};
+	size_t delta_size = 0;
+	for (int f = 1; f <= kFrames; f++)
+	{
+		for (u32 i = 0; i < kRamPages; i++)
+			mem_b.data[(f * 7 + i * 13) % (RAM_SIZE / PAGE_SIZE) * PAGE_SIZE] = (u8)f;
+		for (u32 i = 0; i < kVramPages; i++)
+			vram.data[(f * 5 + i * 11) % (VRAM_SIZE / PAGE_SIZE) * PAGE_SIZE] = (u8)f;
+		auto start = Clock::now();
+		ASSERT_TRUE(chain.Take(f));
+		chain.DropBefore(f > 8 ? f - 7 : 0);
+		delta_total += Clock::now() - start;
+		delta_size += chain.Size(f);
+	}
+
+	printf("full:  avg %lld us, %u bytes\n",
+			(long long)std::chrono::duration_cast<us>(full_total).count() / kFrames, full_size);
+	printf("delta: avg %lld us, %zu bytes\n",
+			(long long)std::chrono::duration_cast<us>(delta_total).count() / kFrames, delta_size / kFrames);
+}
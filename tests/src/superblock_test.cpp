@@ -0,0 +1,166 @@
+#include "gtest/gtest.h"
+#include "types.h"
+#include "emulator.h"
+#include "cfg/option.h"
+#include "hw/mem/_vmem.h"
+#include "hw/sh4/sh4_if.h"
+#include "hw/sh4/sh4_core.h"
+#include "hw/sh4/sh4_mem.h"
+#include "hw/sh4/sh4_sched.h"
+#include "hw/sh4/modules/mmu.h"
+#include "hw/sh4/dyna/ngen.h"
+#include "profiler/profiler.h"
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+
+#if FEAT_SHREC != DYNAREC_NONE
+
+#ifdef __unix__
+// the block table is allocated on demand by the fault handler
+void install_fault_handler();
+#endif
+
+class SuperblockTest : public ::testing::Test {
+protected:
+	void SetUp() override {
+#ifdef __unix__
+		install_fault_handler();
+#endif
+		if (!_vmem_reserve())
+			die("_vmem_reserve failed");
+		dc_init();
+		mem_map_default();
+		dc_reset(true);
+		mmu_set_state();
+		Get_Sh4Recompiler(&sh4_cpu);
+		writeProgram();
+	}
+	void TearDown() override {
+		config::DynarecSuperblocks = false;
+		sh4_cpu.ResetCache();
+		bm_Reset();
+	}
+
+	static const u32 Start = 0x8c010000;
+	static const int BlockCount = 8;
+	static const int BlockOps = 12;
+	static const u32 BlockSize = (BlockOps + 2) * 2;
+
+	std::vector<u16> program;
+
+	// A loop of blocks of integer ops linked by branches. r0 counts the iterations.
+	void writeProgram()
+	{
+		std::mt19937 rng(1);
+		for (int b = 0; b < BlockCount; b++)
+		{
+			for (int i = 0; i < BlockOps; i++)
+			{
+				u32 n = rng() % 7 + 1;
+				u32 m = rng() % 7 + 1;
+				u16 op;
+				if (b == 0 && i == 0)
+					op = 0x7001;						// add #1,r0
+				else switch (rng() % 4)
+				{
+				case 0: op = 0x7000 | n << 8 | (rng() & 0xff); break;	// add #imm,rn
+				case 1: op = 0x300C | n << 8 | m << 4; break;			// add rm,rn
+				case 2: op = 0x4000 | n << 8; break;					// shll rn
+				default: op = 0x200A | n << 8 | m << 4; break;			// xor rm,rn
+				}
+				program.push_back(op);
+			}
+			if (b == BlockCount - 1)
+				// bra to the first block
+				program.push_back(0xA000 | ((u32)-(int)(BlockCount * BlockSize) / 2 & 0xfff));
+			else
+				program.push_back(0xA000);		// bra next block
+			program.push_back(0x0009);			// nop
+		}
+		for (size_t i = 0; i < program.size(); i++)
+			WriteMem16(Start + i * 2, program[i]);
+	}
+
+	// Computes the registers after the given number of iterations, stopping at the given block
+	void model(u32 iterations, u32 stopPc, u32 regs[8])
+	{
+		for (int i = 0; i < 8; i++)
+			regs[i] = 0;
+		for (int b = 0; ; b = (b + 1) % BlockCount)
+		{
+			if (regs[0] == iterations && Start + b * BlockSize == stopPc)
+				break;
+			for (int i = 0; i < BlockOps; i++)
+			{
+				u16 op = program[b * (BlockOps + 2) + i];
+				u32 n = (op >> 8) & 0xf;
+				u32 m = (op >> 4) & 0xf;
+				switch (op & 0xf00f)
+				{
+				case 0x300C: regs[n] += regs[m]; break;
+				case 0x4000: regs[n] <<= 1; break;
+				case 0x200A: regs[n] ^= regs[m]; break;
+				default: regs[n] += (s8)op; break;
+				}
+			}
+		}
+	}
+
+	static int stop(int tag, int cycles, int jitter)
+	{
+		sh4_cpu.Stop();
+		return 0;
+	}
+
+	// Runs the program for the given number of sh4 cycles, returns the elapsed time in us
+	u32 run(u32 cycles)
+	{
+		sh4_cpu.ResetCache();
+		for (int i = 0; i < 8; i++)
+			r[i] = 0;
+		Sh4cntx.pc = Start;
+		static int id = sh4_sched_register(0, stop);
+		sh4_sched_request(id, cycles);
+		auto start = std::chrono::steady_clock::now();
+		sh4_cpu.Run();
+		u32 us = (u32)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+
+		u32 regs[8];
+		model(r[0], Sh4cntx.pc, regs);
+		for (int i = 0; i < 8; i++)
+			EXPECT_EQ(regs[i], r[i]) << "r" << i;
+
+		return std::max(us, 1u);
+	}
+};
+
+TEST_F(SuperblockTest, Benchmark)
+{
+	auto& bm = prof.counters.bm;
+	const u32 Cycles = SH4_MAIN_CLOCK;
+	const u32 opsPerIteration = BlockCount * (BlockOps + 2);
+
+	config::DynarecSuperblocks = false;
+	u32 us = run(Cycles);
+	double mips = (double)r[0] * opsPerIteration / us;
+
+	config::DynarecSuperblocks = true;
+	bm.superblocks = bm.superblock_rejects = 0;
+	u32 superUs = run(Cycles);
+	double superMips = (double)r[0] * opsPerIteration / superUs;
+
+#if HOST_CPU == CPU_X64
+	// only this dynarec counts the runs of each block
+	ASSERT_GT(bm.superblocks, 0u);
+	// The whole loop fits in a superblock
+	RuntimeBlockInfoPtr block = bm_GetBlock(Start);
+	ASSERT_TRUE(block->superblock);
+	ASSERT_EQ((u32)BlockCount * (BlockOps + 2), block->guest_opcodes);
+#endif
+	printf("%.0f guest MIPS -> %.0f with %d superblocks (%d blocks not extended)\n", mips, superMips,
+			bm.superblocks, bm.superblock_rejects);
+}
+
+#endif
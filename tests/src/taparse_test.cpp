@@ -0,0 +1,297 @@
+#include "gtest/gtest.h"
+#include "types.h"
+#include "emulator.h"
+#include "cfg/option.h"
+#include "hw/mem/_vmem.h"
+#include "hw/pvr/pvr_mem.h"
+#include "hw/pvr/pvr_regs.h"
+#include "hw/pvr/ta.h"
+#include "hw/pvr/ta_ctx.h"
+#include "hw/pvr/Renderer_if.h"
+#include "hw/sh4/sh4_mem.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <sstream>
+#ifndef TARGET_NO_OPENMP
+#include <omp.h>
+#endif
+
+TA_context* read_frame(const char* file, u8* vram_ref);
+
+// Texture ids identify the texture parameters
+struct TextureIdRenderer : Renderer
+{
+	bool Init() override { return true; }
+	void Resize(int w, int h) override {}
+	void Term() override {}
+	bool Process(TA_context* ctx) override { return true; }
+	bool Render() override { return true; }
+	u64 GetTexture(TSP tsp, TCW tcw) override { return (u64)tsp.full << 32 | tcw.full; }
+};
+
+template<typename T>
+static std::vector<T> toVector(const List<T>& list)
+{
+	return std::vector<T>(list.head(), list.LastPtr(0));
+}
+
+struct ParsedFrame
+{
+	bool result;
+	bool overrun;
+	u32 fZ_max;
+	std::vector<Vertex> verts;
+	std::vector<u32> idx;
+	std::vector<PolyParam> polys[3];
+	std::vector<ModifierVolumeParam> modvols[2];
+	std::vector<ModTriangle> modtrig;
+	std::vector<RenderPass> passes;
+
+	ParsedFrame(bool result, const rend_context& rc)
+		: result(result), overrun(rc.Overrun), fZ_max((const u32&)rc.fZ_max),
+		  verts(toVector(rc.verts)), idx(toVector(rc.idx)), modtrig(toVector(rc.modtrig)), passes(toVector(rc.render_passes))
+	{
+		polys[0] = toVector(rc.global_param_op);
+		polys[1] = toVector(rc.global_param_pt);
+		polys[2] = toVector(rc.global_param_tr);
+		modvols[0] = toVector(rc.global_param_mvo);
+		modvols[1] = toVector(rc.global_param_mvo_tr);
+	}
+};
+
+class TaParseTest : public ::testing::Test {
+protected:
+	void SetUp() override {
+		if (!_vmem_reserve())
+			die("_vmem_reserve failed");
+		dc_init();
+		mem_map_default();
+		dc_reset(true);
+		// A single region
+		REGION_BASE = 0;
+		pvr_write32p<u32>(0, 0x80000000);
+		savedRenderer = renderer;
+		renderer = &textureIds;
+#ifndef TARGET_NO_OPENMP
+		// even on a single core
+		omp_set_num_threads(4);
+#endif
+	}
+	void TearDown() override {
+		config::ParallelTaParsing = false;
+		renderer = savedRenderer;
+		tactx_Term();
+	}
+
+	TextureIdRenderer textureIds;
+	Renderer *savedRenderer = nullptr;
+	TA_context *ctx = nullptr;
+	std::mt19937 rng;
+
+	Ta_Dma *param(u32 paraType, u32 listType, u32 objCtrl = 0, bool endOfStrip = false)
+	{
+		Ta_Dma *p = (Ta_Dma *)ctx->tad.thd_data;
+		ctx->tad.thd_data += sizeof(Ta_Dma);
+		for (u32& w : p->data_32)
+			w = rng();
+		p->pcw.full = 0;
+		p->pcw.ParaType = paraType;
+		p->pcw.ListType = listType;
+		p->pcw.obj_ctrl = objCtrl;
+		p->pcw.User_Clip = rng() % 4;
+		p->pcw.EndOfStrip = endOfStrip;
+		return p;
+	}
+
+	void object(u32 list)
+	{
+		if (rng() % 8 == 0)
+			param(ParamType_User_Tile_Clip, list);
+		if (list == ListType_Opaque_Modifier_Volume || list == ListType_Translucent_Modifier_Volume)
+		{
+			param(ParamType_Polygon_or_Modifier_Volume, list, rng() & 0x40);
+			for (u32 i = rng() % 4 + 1; i > 0; i--)
+			{
+				param(ParamType_Vertex_Parameter, list);
+				param(ParamType_Vertex_Parameter, list);
+			}
+		}
+		else if (rng() % 5 == 0)
+		{
+			param(ParamType_Sprite, list, rng() & 8);
+			for (u32 i = rng() % 3 + 1; i > 0; i--)
+			{
+				param(ParamType_Vertex_Parameter, list);
+				param(ParamType_Vertex_Parameter, list);
+			}
+		}
+		else
+		{
+			u32 objCtrl, uid;
+			do {
+				objCtrl = rng() & 0xff;
+				uid = TaTypeLut::instance().table[objCtrl];
+			} while ((u8)uid > 14 || (u8)(uid >> 8) > 4);
+			for (u32 i = uid >> 30; i > 0; i--)
+				param(ParamType_Polygon_or_Modifier_Volume, list, objCtrl);
+			u32 pdid = (u8)uid;
+			u32 vertexSize = pdid == 5 || pdid == 6 || pdid >= 11 ? 2 : 1;
+			for (int strip = rng() % 3; strip >= 0; strip--)
+			{
+				u32 count = rng() % 6 + 3;
+				for (u32 i = 0; i < count; i++)
+				{
+					param(ParamType_Vertex_Parameter, list, objCtrl, i == count - 1);
+					if (vertexSize == 2)
+						param(ParamType_Vertex_Parameter, list);
+				}
+			}
+		}
+	}
+
+	// All kinds of parameters in all lists, in several render passes
+	TA_context *makeFrame(u32 seed)
+	{
+		rng.seed(seed);
+		ctx = tactx_Alloc();
+		// no background texture
+		memset(ctx->rend.global_param_op.head(), 0, sizeof(PolyParam));
+		memset(ctx->rend.verts.head(), 0, sizeof(Vertex) * 4);
+		const u32 lists[] = { ListType_Opaque, ListType_Opaque_Modifier_Volume, ListType_Punch_Through,
+				ListType_Translucent, ListType_Translucent_Modifier_Volume };
+		for (int pass = 0; pass < 3; pass++)
+		{
+			if (pass > 0)
+				ctx->tad.Continue();
+			for (u32 list : lists)
+			{
+				for (int i = 0; i < 60; i++)
+					object(list);
+				param(ParamType_End_Of_List, list);
+			}
+		}
+		return ctx;
+	}
+
+	static u32 parse(TA_context *ctx, bool parallel, bool& result)
+	{
+		config::ParallelTaParsing = parallel;
+		auto start = std::chrono::steady_clock::now();
+		result = ta_parse_vdrc(ctx);
+		return (u32)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	// The parallel decoding must give the same result as the serial one
+	static void check(TA_context *ctx)
+	{
+		bool result;
+		// the tile clipping state carries over from the previous frame
+		parse(ctx, false, result);
+		u32 serialUs = parse(ctx, false, result);
+		ParsedFrame serial(result, ctx->rend);
+		u32 parallelUs = parse(ctx, true, result);
+		ParsedFrame parallel(result, ctx->rend);
+
+		ASSERT_EQ(serial.result, parallel.result);
+		ASSERT_EQ(serial.overrun, parallel.overrun);
+		ASSERT_EQ(serial.fZ_max, parallel.fZ_max);
+		ASSERT_EQ(serial.idx, parallel.idx);
+
+		// Only the position and color are set for all vertices
+		ASSERT_EQ(serial.verts.size(), parallel.verts.size());
+		for (size_t i = 0; i < serial.verts.size(); i++)
+		{
+			ASSERT_EQ(0, memcmp(&serial.verts[i].x, &parallel.verts[i].x, 3 * sizeof(float))) << "vertex " << i;
+			ASSERT_EQ(0, memcmp(serial.verts[i].col, parallel.verts[i].col, sizeof(Vertex::col))) << "vertex " << i;
+		}
+		// The texture coordinates are only set for textured polygons. Strips can be linked to the vertices of other polygons.
+		enum { NonTextured, Textured, Unused };
+		std::vector<u8> textured(serial.verts.size(), Unused);
+		for (int l = 0; l < 3; l++)
+		{
+			ASSERT_EQ(serial.polys[l].size(), parallel.polys[l].size());
+			for (size_t i = 0; i < serial.polys[l].size(); i++)
+			{
+				const PolyParam& s = serial.polys[l][i];
+				const PolyParam& p = parallel.polys[l][i];
+				ASSERT_EQ(s.first, p.first) << "list " << l << " poly " << i;
+				ASSERT_EQ(s.count, p.count) << "list " << l << " poly " << i;
+				ASSERT_EQ(s.texid, p.texid) << "list " << l << " poly " << i;
+				ASSERT_EQ(s.tsp.full, p.tsp.full);
+				ASSERT_EQ(s.tcw.full, p.tcw.full);
+				ASSERT_EQ(s.pcw.full, p.pcw.full);
+				ASSERT_EQ(s.isp.full, p.isp.full);
+				ASSERT_EQ(s.tileclip, p.tileclip) << "list " << l << " poly " << i;
+				ASSERT_EQ(s.tsp1.full, p.tsp1.full);
+				ASSERT_EQ(s.tcw1.full, p.tcw1.full);
+				ASSERT_EQ(s.texid1, p.texid1) << "list " << l << " poly " << i;
+				for (u32 j = s.first; j < s.first + s.count; j++)
+				{
+					u8& t = textured[serial.idx[j]];
+					t = t == Unused ? s.pcw.Texture : t & s.pcw.Texture;
+				}
+			}
+		}
+		for (size_t i = 0; i < serial.verts.size(); i++)
+		{
+			if (textured[i] == Textured)
+			{
+				ASSERT_EQ(0, memcmp(&serial.verts[i].u, &parallel.verts[i].u, 2 * sizeof(float))) << "vertex " << i;
+			}
+		}
+		for (int l = 0; l < 2; l++)
+		{
+			ASSERT_EQ(serial.modvols[l].size(), parallel.modvols[l].size());
+			for (size_t i = 0; i < serial.modvols[l].size(); i++)
+			{
+				ASSERT_EQ(serial.modvols[l][i].first, parallel.modvols[l][i].first);
+				ASSERT_EQ(serial.modvols[l][i].count, parallel.modvols[l][i].count);
+				ASSERT_EQ(serial.modvols[l][i].isp.full, parallel.modvols[l][i].isp.full);
+			}
+		}
+		ASSERT_EQ(serial.modtrig.size(), parallel.modtrig.size());
+		ASSERT_EQ(0, memcmp(serial.modtrig.data(), parallel.modtrig.data(), serial.modtrig.size() * sizeof(ModTriangle)));
+		ASSERT_EQ(serial.passes.size(), parallel.passes.size());
+		for (size_t i = 0; i < serial.passes.size(); i++)
+		{
+			ASSERT_EQ(serial.passes[i].op_count, parallel.passes[i].op_count);
+			ASSERT_EQ(serial.passes[i].mvo_count, parallel.passes[i].mvo_count);
+			ASSERT_EQ(serial.passes[i].pt_count, parallel.passes[i].pt_count);
+			ASSERT_EQ(serial.passes[i].tr_count, parallel.passes[i].tr_count);
+			ASSERT_EQ(serial.passes[i].mvo_tr_count, parallel.passes[i].mvo_tr_count);
+		}
+		printf("%d KB of TA data, %zd vertices: %d us serial, %d us parallel\n",
+				(int)(ctx->tad.End() - ctx->tad.thd_root) / 1024, serial.verts.size(), serialUs, parallelUs);
+	}
+};
+
+TEST_F(TaParseTest, Deterministic)
+{
+	for (u32 seed = 1; seed <= 5; seed++)
+	{
+		check(makeFrame(seed));
+		if (HasFatalFailure())
+			return;
+		tactx_Recycle(ctx);
+	}
+	// Frames dumped by the emulator can be checked too
+	const char *dumps = std::getenv("TA_FRAME_DUMPS");
+	if (dumps != nullptr)
+	{
+		std::istringstream paths(dumps);
+		std::string path;
+		while (std::getline(paths, path, ':'))
+		{
+			ctx = read_frame(path.c_str(), nullptr);
+			ASSERT_NE(nullptr, ctx) << path;
+			check(ctx);
+			if (HasFatalFailure())
+				return;
+			tactx_Recycle(ctx);
+		}
+	}
+}
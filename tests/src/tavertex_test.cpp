@@ -0,0 +1,131 @@
+#include "gtest/gtest.h"
+#include "types.h"
+#include "hw/pvr/ta_vtx_simd.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+class TaVertexTest : public ::testing::Test {
+protected:
+	void SetUp() override {
+		// Same as f32_su8_tbl in ta_vtx.cpp
+		for (u32 i = 0; i < 65536; i++)
+		{
+			u32 bits = i << 16;
+			f32 f;
+			memcpy(&f, &bits, sizeof(f));
+			satu8[i] = (s32)bits < 0 ? 0 : bits > 0x3f800000 ? 255 : u8(f * 255);
+		}
+	}
+
+	static f32 asFloat(u32 bits)
+	{
+		f32 f;
+		memcpy(&f, &bits, sizeof(f));
+		return f;
+	}
+
+	u8 satu8[65536];
+	std::mt19937 rng;
+};
+
+#ifdef TA_VTX_SIMD
+TEST_F(TaVertexTest, FloatColor)
+{
+	// Every upper half in every component, with random lower bits
+	for (u32 i = 0; i < 65536; i++)
+	{
+		u32 bits[4];
+		for (u32& b : bits)
+			b = (rng() & 0xffff0000) | (rng() & 0xffff);
+		bits[rng() % 4] = i << 16 | (rng() & 0xffff);
+		f32 argb[4];
+		for (int j = 0; j < 4; j++)
+			argb[j] = asFloat(bits[j]);
+		alignas(4) u8 rgba[4];
+		ta_float_color(rgba, argb);
+		ASSERT_EQ(satu8[bits[1] >> 16], rgba[0]) << std::hex << bits[1];
+		ASSERT_EQ(satu8[bits[2] >> 16], rgba[1]) << std::hex << bits[2];
+		ASSERT_EQ(satu8[bits[3] >> 16], rgba[2]) << std::hex << bits[3];
+		ASSERT_EQ(satu8[bits[0] >> 16], rgba[3]) << std::hex << bits[0];
+	}
+}
+
+TEST_F(TaVertexTest, IntensityColor)
+{
+	for (u32 intensity = 0; intensity < 256; intensity++)
+	{
+		for (u32 c = 0; c < 256; c++)
+		{
+			alignas(4) u8 face[4] = { (u8)c, (u8)(255 - c), (u8)(c ^ 0x5a), (u8)(c + intensity) };
+			alignas(4) u8 color[4];
+			ta_intensity_color(color, face, intensity);
+			for (int j = 0; j < 3; j++)
+				ASSERT_EQ(face[j] * intensity / 256, color[j]) << "face " << c << " intensity " << intensity;
+			ASSERT_EQ(face[3], color[3]);
+		}
+	}
+}
+
+TEST_F(TaVertexTest, Throughput)
+{
+	const size_t Count = 1 << 20;
+	std::vector<f32> colors(Count * 4);
+	for (f32& f : colors)
+		f = (f32)((int)(rng() % 1400) - 200) / 1000.f;
+	std::vector<u32> out(Count);
+
+	auto start = std::chrono::steady_clock::now();
+	for (size_t i = 0; i < Count; i++)
+	{
+		const u32 *bits = (const u32 *)&colors[i * 4];
+		u8 *to = (u8 *)&out[i];
+		to[0] = satu8[bits[1] >> 16];
+		to[1] = satu8[bits[2] >> 16];
+		to[2] = satu8[bits[3] >> 16];
+		to[3] = satu8[bits[0] >> 16];
+	}
+	u32 tableUs = (u32)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+	std::vector<u32> table = out;
+
+	start = std::chrono::steady_clock::now();
+	for (size_t i = 0; i < Count; i++)
+		ta_float_color((u8 *)&out[i], &colors[i * 4]);
+	u32 simdUs = (u32)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+
+	ASSERT_EQ(table, out);
+	printf("%zd floating point colors: %d us with the lookup table, %d us vectorized\n", Count, tableUs, simdUs);
+}
+#endif
+
+TEST_F(TaVertexTest, PackedColor)
+{
+	for (int i = 0; i < 10000; i++)
+	{
+		u32 argb = rng();
+		alignas(4) u8 rgba[4];
+		ta_packed_color(rgba, argb);
+		ASSERT_EQ((u8)(argb >> 16), rgba[0]);
+		ASSERT_EQ((u8)(argb >> 8), rgba[1]);
+		ASSERT_EQ((u8)argb, rgba[2]);
+		ASSERT_EQ((u8)(argb >> 24), rgba[3]);
+	}
+}
+
+TEST_F(TaVertexTest, Uv16)
+{
+	for (int i = 0; i < 10000; i++)
+	{
+		alignas(4) u16 vu[2] = { (u16)rng(), (u16)rng() };
+		f32 uv[2];
+		ta_uv16(uv, vu);
+		u32 u, v;
+		memcpy(&u, &uv[0], sizeof(u));
+		memcpy(&v, &uv[1], sizeof(v));
+		ASSERT_EQ((u32)vu[1] << 16, u);
+		ASSERT_EQ((u32)vu[0] << 16, v);
+	}
+}